@@ -1,26 +1,26 @@
+#include "../../include/HamonCpuTopology.hpp"
 #include "../../include/HamonCube.hpp"
+#include "../../include/HamonJobs.hpp"
+#include "../../include/HamonMap.hpp"
 #include "../../include/HamonNode.hpp"
+#include "../../include/HamonPlacement.hpp"
 #include "../../include/Hamon.hpp"
 #include "../../include/Make.hpp"
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <thread>
-#include <cmath>
+#include <chrono>
 #include <fstream>
 #include <filesystem>
+#include <optional>
 #include <clocale>
 #include <libintl.h>
 
 using namespace dualys;
 
-int largest_power_of_two(const unsigned int n) {
-    if (n == 0)
-        return 0;
-    return static_cast<int>(pow(2, floor(log2(n))));
-}
-
 std::vector<NodeConfig> generate_configs(const int node_count) {
     std::vector<NodeConfig> configs;
     configs.reserve(static_cast<std::size_t>(node_count));
@@ -35,10 +35,200 @@ std::vector<NodeConfig> generate_configs(const int node_count) {
     return configs;
 }
 
-void run_node_process(const int node_id, const int node_count, const std::vector<NodeConfig> &configs) {
-    const HamonCube cube(node_count);
-    HamonNode node(cube.getNode(static_cast<std::size_t>(node_id)), cube, configs);
-    node.run();
+// Word-count cluster described by a .hc file: endpoints, roles, @threads and @cpu of every node.
+static bool configs_from_hc(const std::string &hc_path, int &node_count, TopologySpec &topology,
+                            std::vector<NodeConfig> &configs) {
+    HamonParser parser;
+    try {
+        parser.parse_file(hc_path);
+        parser.finalize();
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return false;
+    }
+    node_count = parser.use_nodes();
+    topology = parser.get_topology_spec();
+    configs = parser.node_configs();
+    return true;
+}
+
+// Gives nodes without an explicit thread count one map thread per CPU they are pinned to. Unpinned
+// nodes (--no-pin) would each see every CPU as their own: they get an even share of the orchestrator's CPUs.
+static void share_hardware_threads(std::vector<NodeConfig> &configs, const std::vector<NodePlacement> &placements,
+                                   const unsigned hardware_threads) {
+    const std::size_t n = configs.size();
+    if (n == 0) return;
+    for (std::size_t i = 0; i < n; ++i) {
+        if (configs[i].map_threads > 0) continue;
+        if (i < placements.size() && !placements[i].cpus.empty()) {
+            configs[i].map_threads = static_cast<int>(placements[i].cpus.size());
+            continue;
+        }
+        const std::size_t share = hardware_threads / n + (i < hardware_threads % n ? 1 : 0);
+        configs[i].map_threads = static_cast<int>(std::max<std::size_t>(1, share));
+    }
+}
+
+void run_node_process(const int node_id, const HamonCube &cube, const std::vector<NodeConfig> &configs,
+                      const NodeOptions &options, const int server_fd, const bool daemon, const int job_fd) {
+    HamonNode node(cube.getNode(static_cast<std::size_t>(node_id)), cube, configs, options);
+    node.adopt_server_socket(server_fd);
+    if (daemon) node.serve(job_fd);
+    else node.run();
+}
+
+// Parse word-count options: --nodes N, --config FILE.hc, --topology NAME, --threads K, --in-process,
+// --socket PATH (daemon), --input PATH, --shared-input, --dynamic, --speculate, --checksums, --text-wire,
+// --shuffle, --gather, --allreduce, --ring-allreduce, --broadcast, --output DIR,
+// --memory-budget BYTES, --spill-dir DIR, --socket-buffer BYTES, --shm-ring BYTES, --phase-timeout MS,
+// --io auto|epoll|uring, --no-pin. Returns false on bad usage.
+static bool parse_run_options(const int argc, char **argv, int &node_count, std::string &config_path,
+                              std::string &topology, int &map_threads, bool &in_process, bool &pin,
+                              std::string &socket_path, NodeOptions &options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--nodes" && has_value) {
+            try { node_count = std::stoi(argv[++i]); } catch (...) {
+                std::cerr << "--nodes expects an integer" << std::endl;
+                return false;
+            }
+        } else if (arg == "--config" && has_value) {
+            config_path = argv[++i];
+        } else if (arg == "--topology" && has_value) {
+            topology = argv[++i];
+            if (TopologySpec spec; !TopologySpec::parse(topology, spec)) {
+                std::cerr << "--topology expects hypercube, ring, torus or torus:RxC" << std::endl;
+                return false;
+            }
+        } else if (arg == "--threads" && has_value) {
+            try { map_threads = std::stoi(argv[++i]); } catch (...) {
+                map_threads = 0;
+            }
+            if (map_threads <= 0) {
+                std::cerr << "--threads expects a positive integer" << std::endl;
+                return false;
+            }
+        } else if (arg == "--in-process") {
+            in_process = true;
+        } else if (arg == "--no-pin") {
+            pin = false;
+        } else if (arg == "--socket" && has_value) {
+            socket_path = argv[++i];
+        } else if (arg == "--input" && has_value) {
+            options.input_file = argv[++i];
+        } else if (arg == "--shared-input") {
+            options.input_mode = InputMode::Shared;
+        } else if (arg == "--dynamic") {
+            options.dynamic_chunks = true;
+        } else if (arg == "--speculate") {
+            options.dynamic_chunks = true;
+            options.speculative = true;
+        } else if (arg == "--checksums") {
+            options.frame_checksums = true;
+        } else if (arg == "--text-wire") {
+            options.wire_format = WireFormat::Text;
+        } else if (arg == "--shuffle") {
+            options.reduce_mode = ReduceMode::Shuffle;
+        } else if (arg == "--socket-buffer" && has_value) {
+            try { options.socket_buffer_bytes = std::stoi(argv[++i]); } catch (...) {
+                options.socket_buffer_bytes = -1;
+            }
+            if (options.socket_buffer_bytes < 0) {
+                std::cerr << "--socket-buffer expects a size in bytes" << std::endl;
+                return false;
+            }
+        } else if (arg == "--shm-ring" && has_value) {
+            long long bytes = -1;
+            try { bytes = std::stoll(argv[++i]); } catch (...) {
+            }
+            if (bytes < 0) {
+                std::cerr << "--shm-ring expects a size in bytes (0 = TCP only)" << std::endl;
+                return false;
+            }
+            options.shm_ring_bytes = static_cast<std::size_t>(bytes);
+        } else if (arg == "--phase-timeout" && has_value) {
+            try { options.phase_timeout_ms = std::stoi(argv[++i]); } catch (...) {
+                options.phase_timeout_ms = -1;
+            }
+            if (options.phase_timeout_ms < 0) {
+                std::cerr << "--phase-timeout expects milliseconds (0 = wait forever)" << std::endl;
+                return false;
+            }
+        } else if (arg == "--io" && has_value) {
+            const std::string backend = argv[++i];
+            if (backend == "auto") options.io_backend = IoBackend::Auto;
+            else if (backend == "epoll") options.io_backend = IoBackend::Epoll;
+            else if (backend == "uring") options.io_backend = IoBackend::Uring;
+            else {
+                std::cerr << "--io expects auto, epoll or uring" << std::endl;
+                return false;
+            }
+        } else if (arg == "--allreduce") {
+            options.reduce_mode = ReduceMode::AllReduce;
+        } else if (arg == "--ring-allreduce") {
+            options.reduce_mode = ReduceMode::RingAllReduce;
+        } else if (arg == "--broadcast") {
+            options.broadcast = true;
+        } else if (arg == "--gather") {
+            options.gather = true;
+        } else if (arg == "--output" && has_value) {
+            options.output_dir = argv[++i];
+        } else if (arg == "--memory-budget" && has_value) {
+            long long bytes = 0;
+            try { bytes = std::stoll(argv[++i]); } catch (...) {
+            }
+            if (bytes <= 0) {
+                std::cerr << "--memory-budget expects a size in bytes" << std::endl;
+                return false;
+            }
+            options.memory_budget = static_cast<std::size_t>(bytes);
+        } else if (arg == "--spill-dir" && has_value) {
+            options.spill_dir = argv[++i];
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            std::cerr << "Usage: hamon [--nodes N | --config FILE.hc] [--topology hypercube|ring|torus[:RxC]] [--threads K] [--in-process] [--input PATH] [--shared-input] [--dynamic] [--speculate] [--checksums] [--text-wire] [--shuffle [--gather] | --allreduce | --ring-allreduce | --broadcast] [--output DIR] [--memory-budget BYTES [--spill-dir DIR]] [--socket-buffer BYTES] [--shm-ring BYTES] [--phase-timeout MS] [--io auto|epoll|uring] [--no-pin] | hamon daemon [run options] [--socket PATH] | hamon submit [--socket PATH] (--input PATH [--operator wordcount] | --shutdown) | hamon init | hamon FILE.hc" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// `hamon submit`: send one request to a daemon and print its output.
+static int submit_command(const int argc, char **argv) {
+    std::string socket_path = HamonJobs::default_socket_path();
+    JobRequest request;
+    for (int i = 2; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--socket" && has_value) {
+            socket_path = argv[++i];
+        } else if (arg == "--input" && has_value) {
+            request.input = argv[++i];
+        } else if (arg == "--operator" && has_value) {
+            request.op = argv[++i];
+        } else if (arg == "--shutdown") {
+            request.shutdown = true;
+        } else {
+            std::cerr << "Usage: hamon submit [--socket PATH] (--input PATH [--operator wordcount] | --shutdown)"
+                    << std::endl;
+            return 1;
+        }
+    }
+    if (!request.shutdown) {
+        if (request.input.empty() || request.op != HamonJobs::word_count) {
+            std::cerr << "hamon submit needs --input PATH; the only operator is " << HamonJobs::word_count << std::endl;
+            return 1;
+        }
+        // The daemon does not share our working directory.
+        request.input = std::filesystem::absolute(request.input).string();
+    }
+    std::string error;
+    if (!HamonJobs::submit(socket_path, request, std::cout, error)) {
+        std::cerr << "hamon submit: " << error << std::endl;
+        return 1;
+    }
+    return 0;
 }
 
 static std::string prompt(const std::string &q, const std::string &def = {}) {
@@ -63,9 +253,50 @@ static bool write_text_file(const std::filesystem::path &p, const std::string &c
 }
 
 int main(const int argc, char **argv) {
+    int node_count = 0;
+    std::string config_path;
+    std::string topology_name;
+    TopologySpec topology_spec;
+    int map_threads = 0;
+    bool in_process = false;
+    bool pin = true;
+    std::string socket_path;
+    NodeOptions options;
+    // `hamon daemon` takes the same options as a run, and keeps the cluster up for jobs.
+    const bool daemon = argc > 1 && std::string(argv[1]) == "daemon";
+    const int first = daemon ? 1 : 0;
     // If an .hc file path is provided as the first argument, run its @phase tasks and exit.
-    if (argc > 1) {
+    if (daemon || (argc > 1 && std::string(argv[1]).rfind("--", 0) == 0)) {
+        if (!parse_run_options(argc - first, argv + first, node_count, config_path, topology_name, map_threads,
+                               in_process, pin, socket_path, options)) {
+            return 1;
+        }
+        if (!daemon && !socket_path.empty()) {
+            std::cerr << "--socket only applies to hamon daemon" << std::endl;
+            return 1;
+        }
+        if (options.gather && options.reduce_mode != ReduceMode::Shuffle) {
+            std::cerr << "--gather only applies to --shuffle" << std::endl;
+            return 1;
+        }
+        if (options.broadcast && options.reduce_mode != ReduceMode::Tree) {
+            std::cerr << "--broadcast only applies to the default tree reduce" << std::endl;
+            return 1;
+        }
+        if (options.memory_budget > 0 && (options.reduce_mode != ReduceMode::Tree || options.broadcast ||
+                                          options.speculative || options.wire_format == WireFormat::Text)) {
+            // Those keep whole tables in memory or per range: a budget could not hold.
+            std::cerr << "--memory-budget only applies to the default tree reduce, without --broadcast, "
+                    "--speculate or --text-wire" << std::endl;
+            return 1;
+        }
+        if (!options.spill_dir.empty() && options.memory_budget == 0) {
+            std::cerr << "--spill-dir only applies to --memory-budget" << std::endl;
+            return 1;
+        }
+    } else if (argc > 1) {
         const std::string arg1 = argv[1];
+        if (arg1 == "submit") return submit_command(argc, argv);
         if (arg1 == "init") {
             // Initialize i18n for the init flow
             setlocale(LC_ALL, "");
@@ -73,14 +304,14 @@ int main(const int argc, char **argv) {
             textdomain("hamon");
 
             const unsigned hw = std::thread::hardware_concurrency();
-            const int def_nodes = largest_power_of_two(hw > 0 ? hw : 1);
+            const int def_nodes = static_cast<int>(hw > 0 ? hw : 1);
             std::string def_name = "make.hc";
             std::string fname = prompt(_("Name of the .hc file to create"), def_name);
             if (fname.empty()) fname = def_name;
             if (fname.rfind(".hc") == std::string::npos) fname += ".hc";
 
             std::string nodes_s = prompt(
-                _("Number of nodes (@use), power of 2"), std::to_string(def_nodes > 0 ? def_nodes : 1));
+                _("Number of nodes (@use)"), std::to_string(def_nodes > 0 ? def_nodes : 1));
             int nodes = 0;
             try { nodes = std::stoi(nodes_s); } catch (...) {
             }
@@ -148,28 +379,123 @@ int main(const int argc, char **argv) {
 
     std::cout << "[hamon] Orchestrator starting" << std::endl;
 
-    int node_count = 0;
     std::vector<NodeConfig> configs;
 
     // 1. Detect hardware and generate default config
     const unsigned int hardware_cores = std::thread::hardware_concurrency();
-    node_count = largest_power_of_two(hardware_cores > 0 ? hardware_cores : 1);
-
+    if (!config_path.empty()) {
+        if (node_count != 0) {
+            std::cerr << "--nodes and --config are exclusive; the node count comes from @use." << std::endl;
+            return 1;
+        }
+        if (!topology_name.empty()) {
+            std::cerr << "--topology and --config are exclusive; the topology comes from @topology." << std::endl;
+            return 1;
+        }
+        if (!configs_from_hc(config_path, node_count, topology_spec, configs)) return 1;
+    } else if (!topology_name.empty()) {
+        (void) TopologySpec::parse(topology_name, topology_spec); // checked with the options
+    }
     if (node_count == 0) {
+        // One node per hardware thread: a hypercube folds the nodes past a power of two onto it.
+        node_count = static_cast<int>(hardware_cores > 0 ? hardware_cores : 1);
+    }
+
+    if (node_count <= 0) {
         std::cerr << "Not enough hardware cores detected to run." << std::endl;
         return 1;
     }
-    std::cout << "[hamon] Detected " << hardware_cores << " cores; using " << node_count << " nodes" << std::endl;
-    configs = generate_configs(node_count);
+    std::optional<HamonCube> built;
+    try {
+        built.emplace(node_count, topology_spec);
+    } catch (const std::invalid_argument &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    const HamonCube &cube = *built;
+    std::cout << "[hamon] Detected " << hardware_cores << " cores; using " << node_count << " nodes on a "
+            << HamonCube::kindName(cube.getKind());
+    if (cube.getKind() == TopologyKind::Torus) std::cout << " " << cube.getRows() << "x" << cube.getColumns();
+    std::cout << std::endl;
+    if (configs.empty()) configs = generate_configs(node_count);
+    if (map_threads > 0) {
+        for (NodeConfig &cfg: configs) if (cfg.map_threads == 0) cfg.map_threads = map_threads;
+    }
+    // Compact per socket, physical cores before SMT siblings: neighbors in the low dimensions share a NUMA node.
+    std::vector<NodePlacement> placements(configs.size());
+    if (pin) {
+        const HamonCpuTopology cpus = HamonCpuTopology::discover();
+        std::cout << "[hamon] CPUs: " << cpus.summary() << std::endl;
+        placements = HamonPlacement::plan(configs, cpus.numa_domains());
+        for (std::size_t i = 0; i < configs.size(); ++i) {
+            std::cout << "[hamon] Node " << configs[i].id << ": " << HamonPlacement::describe(placements[i])
+                    << std::endl;
+        }
+    }
+    share_hardware_threads(configs, placements, HamonMap::pinned_cpu_count());
+
+    int job_fd = -1;
+    if (daemon) {
+        if (socket_path.empty()) socket_path = HamonJobs::default_socket_path();
+        job_fd = HamonJobs::listen(socket_path);
+        if (job_fd < 0) return 1;
+        std::cout << "[hamon] Daemon accepting jobs on " << socket_path << std::endl;
+    }
+    // Removes the job socket once the nodes are gone.
+    const auto close_jobs = [&] {
+        if (job_fd < 0) return;
+        close(job_fd);
+        unlink(socket_path.c_str());
+    };
 
-    // 2. Launch child processes
+    options.launch_time = std::chrono::steady_clock::now();
+    if (in_process) {
+        // 2. Run every node as a thread of this process, linked by in-process channels
+        LocalMesh mesh;
+        std::vector<std::jthread> threads;
+        threads.reserve(static_cast<std::size_t>(node_count));
+        for (std::size_t i = 0; i < static_cast<std::size_t>(node_count); ++i) {
+            threads.emplace_back([&, i] {
+                // Before the node allocates anything: its tables are first touched on its NUMA node.
+                (void) HamonPlacement::apply(placements[i], static_cast<int>(i));
+                HamonNode node(cube.getNode(i), cube, configs, options, &mesh);
+                if (daemon) node.serve(i == 0 ? job_fd : -1);
+                else node.run();
+            });
+        }
+        std::cout << "[hamon] Started " << threads.size() << " nodes as threads; waiting for completion" << std::endl;
+        threads.clear(); // joins them
+        close_jobs();
+        std::cout << "All nodes have finished. Orchestrator shutting down." << std::endl;
+        return 0;
+    }
+
+    // 2. Bind every node's server, so each one is listening before any node connects
+    std::vector<int> servers;
+    for (const NodeConfig &cfg: configs) {
+        const int fd = HamonNode::listen_on(cfg.port, options.socket_buffer_bytes);
+        if (fd < 0) {
+            std::cerr << "Cannot listen on port " << cfg.port << " for Node " << cfg.id << std::endl;
+            for (const int server: servers) close(server);
+            close_jobs();
+            return 1;
+        }
+        servers.push_back(fd);
+    }
+
+    // 3. Launch child processes; each inherits its listening socket
     std::vector<pid_t> childPids;
     childPids.reserve(static_cast<std::size_t>(node_count));
     for (std::size_t i = 0; i < static_cast<std::size_t>(node_count); ++i) {
         const pid_t pid = fork();
         if (pid == 0) {
             // Child process
-            run_node_process(static_cast<int>(i), node_count, configs);
+            for (std::size_t j = 0; j < servers.size(); ++j) {
+                if (j != i) close(servers[j]);
+            }
+            if (i != 0 && job_fd >= 0) close(job_fd);
+            (void) HamonPlacement::apply(placements[i], static_cast<int>(i));
+            run_node_process(static_cast<int>(i), cube, configs, options, servers[i], daemon, job_fd);
             _exit(0);
         }
         if (pid > 0) {
@@ -179,11 +505,14 @@ int main(const int argc, char **argv) {
         }
     }
 
-    // 3. Wait for all processes to finish
+    for (const int server: servers) close(server);
+
+    // 4. Wait for all processes to finish
     std::cout << "[hamon] Launched " << childPids.size() << " nodes; waiting for completion" << std::endl;
     for (const pid_t pid: childPids) {
         waitpid(pid, nullptr, 0);
     }
+    close_jobs();
     std::cout << "All nodes have finished. Orchestrator shutting down." << std::endl;
     return 0;
 }
@@ -0,0 +1,109 @@
+// Completion time of the reduce phase when every node needs the result:
+// tree reduce followed by a broadcast, against the recursive-doubling and the ring allreduce.
+// Usage: hamon_bench_allreduce [nodes] [distinct_words]
+#include "../include/HamonCube.hpp"
+#include "../include/HamonNode.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace dualys;
+
+namespace {
+    struct Variant {
+        const char *name;
+        ReduceMode mode;
+        bool broadcast;
+    };
+
+    // Runs one cluster as child processes and returns the slowest node's reduce time.
+    double run_cluster(const int nodes, const int base_port, const NodeOptions &options) {
+        std::vector<NodeConfig> configs;
+        for (int i = 0; i < nodes; ++i) {
+            NodeConfig cfg;
+            cfg.id = i;
+            cfg.role = i == 0 ? "coordinator" : "worker";
+            cfg.ip_address = "127.0.0.1";
+            cfg.port = base_port + i;
+            cfg.map_threads = 1;
+            configs.push_back(cfg);
+        }
+        int fds[2];
+        if (pipe(fds) != 0) return -1;
+        std::vector<pid_t> children;
+        for (int i = 0; i < nodes; ++i) {
+            if (const pid_t pid = fork(); pid == 0) {
+                close(fds[0]);
+                if (const int null_fd = open("/dev/null", O_WRONLY); null_fd >= 0) dup2(null_fd, STDOUT_FILENO);
+                const HamonCube cube(nodes);
+                HamonNode node(cube.getNode(static_cast<std::size_t>(i)), cube, configs, options);
+                const double seconds = node.run() ? node.timings().reduce_seconds : -1;
+                if (write(fds[1], &seconds, sizeof(seconds)) != sizeof(seconds)) _exit(1);
+                _exit(0);
+            } else if (pid > 0) {
+                children.push_back(pid);
+            }
+        }
+        close(fds[1]);
+        double slowest = 0;
+        double seconds = 0;
+        std::size_t reported = 0;
+        while (read(fds[0], &seconds, sizeof(seconds)) == sizeof(seconds)) {
+            if (seconds < 0) slowest = -1;
+            else if (slowest >= 0) slowest = std::max(slowest, seconds);
+            ++reported;
+        }
+        close(fds[0]);
+        for (const pid_t pid: children) waitpid(pid, nullptr, 0);
+        return reported == static_cast<std::size_t>(nodes) ? slowest : -1;
+    }
+}
+
+int main(const int argc, char **argv) {
+    const int nodes = argc > 1 ? std::stoi(argv[1]) : 8;
+    const int distinct = argc > 2 ? std::stoi(argv[2]) : 200000;
+    if (nodes <= 0) {
+        std::cerr << "nodes must be positive" << std::endl;
+        return 1;
+    }
+
+    // Every word twice, so each node sees about distinct / nodes keys and the vocabulary grows while merging.
+    const std::string input = "/tmp/hamon_bench_allreduce_" + std::to_string(getpid()) + ".txt";
+    {
+        std::ofstream out(input);
+        for (int round = 0; round < 2; ++round) {
+            for (int i = 0; i < distinct; ++i) out << "word" << i << (i % 16 == 15 ? '\n' : ' ');
+        }
+    }
+    std::cout << "[bench] " << nodes << " nodes, " << distinct << " distinct words; slowest node, best of 3" << std::endl;
+
+    const Variant variants[] = {
+        {"tree reduce (node 0 only)", ReduceMode::Tree, false},
+        {"tree reduce + broadcast", ReduceMode::Tree, true},
+        {"allreduce (recursive doubling)", ReduceMode::AllReduce, false},
+        {"allreduce (ring, Gray-code order)", ReduceMode::RingAllReduce, false},
+    };
+    int base_port = 21000;
+    for (const auto &[name, mode, broadcast]: variants) {
+        NodeOptions options;
+        options.input_file = input;
+        options.reduce_mode = mode;
+        options.broadcast = broadcast;
+        double best = -1;
+        for (int round = 0; round < 3; ++round, base_port += nodes) {
+            if (const double seconds = run_cluster(nodes, base_port, options); seconds >= 0) {
+                best = best < 0 ? seconds : std::min(best, seconds);
+            }
+        }
+        if (best < 0) std::cout << "  " << name << ": failed" << std::endl;
+        else std::cout << "  " << name << ": " << best * 1000.0 << " ms" << std::endl;
+    }
+    std::remove(input.c_str());
+    return 0;
+}
@@ -0,0 +1,174 @@
+// Completion time of each collective (slowest node) on nodes running as threads of one process:
+// the binomial tree, pipelined or not, against node 0 sending to every node itself.
+// Usage: hamon_bench_collectives [nodes] [MiB per payload] [segment KiB]   (default: 8 16 256)
+#include "../include/HamonCollectives.hpp"
+#include "../include/HamonQueue.hpp"
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace dualys;
+
+namespace {
+    using Body = std::function<Task<bool>(HamonCollectives &, CollectiveLinks &, int)>;
+
+    struct Variant {
+        const char *name;
+        std::size_t segment_bytes; // 0: one segment per payload
+        Body body;
+    };
+
+    Task<bool> receive_local(EventLoop &loop, LocalChannel &channel, std::string &out) {
+        while (true) {
+            switch (channel.poll_receive(out)) {
+                case ReceiveStatus::Complete:
+                    co_return true;
+                case ReceiveStatus::Failed:
+                    co_return false;
+                case ReceiveStatus::Pending:
+                    break;
+            }
+            const bool readable = co_await loop.readable(channel.doorbell_fd(), EventLoop::deadline_in(30000));
+            if (!readable) co_return false;
+        }
+    }
+
+    // Runs body once on every node, started together; returns the slowest node's time, or -1.
+    double run_nodes(const int nodes, const std::size_t segment_bytes, const Body &body) {
+        LocalMesh mesh;
+        std::barrier start(nodes);
+        std::vector<double> seconds(static_cast<std::size_t>(nodes), -1);
+        {
+            std::vector<std::jthread> threads;
+            for (int id = 0; id < nodes; ++id) {
+                threads.emplace_back([&, id] {
+                    std::map<int, std::unique_ptr<LocalChannel> > channels;
+                    for (int peer = 0; peer < nodes; ++peer) {
+                        if (peer != id) channels[peer] = mesh.take(id, peer);
+                    }
+                    EventLoop loop;
+                    CollectiveLinks links{
+                        [&](const int peer, std::string payload) { channels.at(peer)->send(std::move(payload)); },
+                        [&](const int peer, const int file_fd, const ShardRange &range) {
+                            channels.at(peer)->send_file_range(file_fd, range);
+                        },
+                        [&](const int peer, std::string &out) { return receive_local(loop, *channels.at(peer), out); }
+                    };
+                    HamonCollectives collectives(links, id, nodes, segment_bytes);
+                    start.arrive_and_wait();
+                    const auto begin = std::chrono::steady_clock::now();
+                    if (loop.run(body(collectives, links, id))) {
+                        seconds[static_cast<std::size_t>(id)] =
+                                std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+                    }
+                });
+            }
+        }
+        if (std::ranges::any_of(seconds, [](const double s) { return s < 0; })) return -1;
+        return std::ranges::max(seconds);
+    }
+
+    Task<bool> tree_broadcast(HamonCollectives &collectives, const int id, const std::size_t bytes) {
+        std::string payload = id == 0 ? std::string(bytes, 'x') : std::string();
+        const bool received = co_await collectives.broadcast(payload);
+        co_return received && payload.size() == bytes;
+    }
+
+    Task<bool> flat_broadcast(CollectiveLinks &links, const int id, const int nodes, const std::size_t bytes) {
+        if (id == 0) {
+            const std::string payload(bytes, 'x');
+            for (int peer = 1; peer < nodes; ++peer) links.send(peer, payload);
+            co_return true;
+        }
+        std::string payload;
+        const bool received = co_await links.receive(0, payload);
+        co_return received && payload.size() == bytes;
+    }
+
+    Task<bool> tree_scatter(HamonCollectives &collectives, const int id, const int nodes, const std::size_t bytes) {
+        std::vector<std::string> pieces;
+        if (id == 0) pieces.assign(static_cast<std::size_t>(nodes), std::string(bytes, 'x'));
+        std::string mine;
+        const bool received = co_await collectives.scatter(std::move(pieces), mine);
+        co_return received && mine.size() == bytes;
+    }
+
+    Task<bool> flat_scatter(CollectiveLinks &links, const int id, const int nodes, const std::size_t bytes) {
+        if (id == 0) {
+            for (int peer = 1; peer < nodes; ++peer) links.send(peer, std::string(bytes, 'x'));
+            co_return true;
+        }
+        std::string mine;
+        const bool received = co_await links.receive(0, mine);
+        co_return received && mine.size() == bytes;
+    }
+
+    Task<bool> tree_gather(HamonCollectives &collectives, const int id, const std::size_t bytes) {
+        std::vector<std::string> all;
+        const bool gathered = co_await collectives.gather(std::string(bytes, static_cast<char>('a' + id % 26)), all);
+        co_return gathered;
+    }
+
+    Task<bool> allgather(HamonCollectives &collectives, const int id, const std::size_t bytes) {
+        std::vector<std::string> all;
+        const bool gathered = co_await collectives.allgather(std::string(bytes, static_cast<char>('a' + id % 26)), all);
+        co_return gathered;
+    }
+}
+
+int main(const int argc, char **argv) {
+    const int nodes = argc > 1 ? std::stoi(argv[1]) : 8;
+    const std::size_t payload = (argc > 2 ? std::stoul(argv[2]) : 16) << 20;
+    const std::size_t segment = (argc > 3 ? std::stoul(argv[3]) : 256) << 10;
+    if (nodes <= 1) {
+        std::cerr << "nodes must be above 1" << std::endl;
+        return 1;
+    }
+    // Scatter, gather and allgather move one piece per node; their total matches the broadcast's payload.
+    const std::size_t piece = payload / static_cast<std::size_t>(nodes);
+    std::cout << "[bench] " << nodes << " nodes in process, " << (payload >> 20) << " MiB, segments of "
+            << (segment >> 10) << " KiB; slowest node, best of 3" << std::endl;
+
+    const Variant variants[] = {
+        {"broadcast, flat from node 0", 0, [&](HamonCollectives &, CollectiveLinks &links, const int id) {
+            return flat_broadcast(links, id, nodes, payload);
+        }},
+        {"broadcast, tree, whole payload", payload, [&](HamonCollectives &collectives, CollectiveLinks &, const int id) {
+            return tree_broadcast(collectives, id, payload);
+        }},
+        {"broadcast, tree, pipelined", segment, [&](HamonCollectives &collectives, CollectiveLinks &, const int id) {
+            return tree_broadcast(collectives, id, payload);
+        }},
+        {"scatter, flat from node 0", 0, [&](HamonCollectives &, CollectiveLinks &links, const int id) {
+            return flat_scatter(links, id, nodes, piece);
+        }},
+        {"scatter, tree, pipelined", segment, [&](HamonCollectives &collectives, CollectiveLinks &, const int id) {
+            return tree_scatter(collectives, id, nodes, piece);
+        }},
+        {"gather, tree, pipelined", segment, [&](HamonCollectives &collectives, CollectiveLinks &, const int id) {
+            return tree_gather(collectives, id, piece);
+        }},
+        {"allgather, recursive doubling", segment, [&](HamonCollectives &collectives, CollectiveLinks &, const int id) {
+            return allgather(collectives, id, piece);
+        }},
+    };
+    for (const auto &[name, segment_bytes, body]: variants) {
+        double best = -1;
+        for (int round = 0; round < 3; ++round) {
+            if (const double seconds = run_nodes(nodes, segment_bytes == 0 ? payload : segment_bytes, body); seconds >= 0) {
+                best = best < 0 ? seconds : std::min(best, seconds);
+            }
+        }
+        if (best < 0) std::cout << "  " << name << ": failed" << std::endl;
+        else std::cout << "  " << name << ": " << best * 1000.0 << " ms" << std::endl;
+    }
+    return 0;
+}
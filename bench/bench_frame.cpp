@@ -0,0 +1,100 @@
+// Throughput of the framing layer against the previous send_string/receive_string path.
+// Usage: hamon_bench_frame [total_MiB]
+#include "../include/HamonFrame.hpp"
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace dualys;
+
+namespace {
+    // The path replaced by HamonFrame: u32 length, one send() and one read(), 64 KiB cap.
+    void legacy_send_string(const int sock, const std::string &str) {
+        const uint32_t net_len = htonl(static_cast<uint32_t>(str.size()));
+        send(sock, &net_len, sizeof(net_len), 0);
+        send(sock, str.c_str(), str.size(), 0);
+    }
+
+    std::string legacy_receive_string(const int client_socket) {
+        uint32_t len = 0;
+        if (read(client_socket, &len, sizeof(len)) != sizeof(len)) return "";
+        len = ntohl(len);
+        if (len > 0 && len < 65536) {
+            std::vector<char> buffer(len);
+            if (read(client_socket, buffer.data(), len) == static_cast<ssize_t>(len)) {
+                return {buffer.begin(), buffer.end()};
+            }
+        }
+        return "";
+    }
+
+    // Runs send_one `count` times on one end of a socketpair while recv_one drains the other end.
+    double measure(const std::size_t count, const std::size_t bytes_each,
+                   const std::function<void(int)> &send_one, const std::function<bool(int)> &recv_one) {
+        int fds[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        const auto start = std::chrono::steady_clock::now();
+        std::thread sender([&] { for (std::size_t i = 0; i < count; ++i) send_one(fds[0]); });
+        std::size_t ok = 0;
+        for (std::size_t i = 0; i < count; ++i) if (recv_one(fds[1])) ++ok;
+        sender.join();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        close(fds[0]);
+        close(fds[1]);
+        if (ok != count) std::cout << "  (" << count - ok << " payloads lost)" << std::endl;
+        return static_cast<double>(count * bytes_each) / (1024.0 * 1024.0) / elapsed.count();
+    }
+
+    void report(const std::string &name, const double mib_per_s) {
+        std::cout << "  " << name << ": " << static_cast<long>(mib_per_s) << " MiB/s" << std::endl;
+    }
+}
+
+int main(const int argc, char **argv) {
+    const std::size_t total_mib = argc > 1 ? std::stoul(argv[1]) : 512;
+    const std::size_t total = total_mib << 20;
+
+    // Small payloads: the only size the legacy path can carry (< 64 KiB).
+    const std::string small(32 * 1024, 'x');
+    const std::size_t small_count = total / small.size();
+    std::cout << "[bench] " << small_count << " x 32 KiB payloads" << std::endl;
+    report("legacy u32 + send/read", measure(small_count, small.size(),
+                                             [&](const int fd) { legacy_send_string(fd, small); },
+                                             [&](const int fd) { return legacy_receive_string(fd).size() == small.size(); }));
+    for (const bool checksums: {false, true}) {
+        report(checksums ? "frames + crc32" : "frames", measure(small_count, small.size(), [&](const int fd) {
+            FrameWriter writer(fd, checksums);
+            writer.write(small);
+            writer.finish();
+        }, [&](const int fd) {
+            std::string out;
+            FrameReader reader(fd);
+            return reader.read_payload(out) && out.size() == small.size();
+        }));
+    }
+
+    // One large payload, streamed frame by frame; the legacy path cannot send it at all.
+    const std::string large(total, 'y');
+    std::cout << "[bench] 1 x " << total_mib << " MiB payload (legacy: unsupported)" << std::endl;
+    for (const bool checksums: {false, true}) {
+        report(checksums ? "frames + crc32" : "frames", measure(1, large.size(), [&](const int fd) {
+            FrameWriter writer(fd, checksums);
+            writer.write(large);
+            writer.finish();
+        }, [&](const int fd) {
+            std::string frame;
+            std::size_t got = 0;
+            FrameReader reader(fd);
+            while (reader.next(frame)) got += frame.size();
+            return !reader.failed() && got == large.size();
+        }));
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+// Map-phase tokenization throughput: the previous stream loop against every tokenizer kernel.
+// Usage: hamon_bench_tokenizer [total_MiB]
+#include "../include/HamonTokenizer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <spanstream>
+#include <string>
+#include <vector>
+
+using namespace dualys;
+
+namespace {
+    // Words of 1 to 12 letters drawn from a 10,000-word vocabulary, separated by mixed whitespace.
+    std::string make_text(const std::size_t bytes) {
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<int> len(1, 12);
+        std::uniform_int_distribution<int> letter('a', 'z');
+        std::vector<std::string> vocabulary(10000);
+        for (std::string &word: vocabulary) {
+            for (int i = len(rng); i > 0; --i) word += static_cast<char>(letter(rng));
+        }
+        std::uniform_int_distribution<std::size_t> pick(0, vocabulary.size() - 1);
+        std::uniform_int_distribution<int> gap(0, 15);
+        std::string text;
+        text.reserve(bytes + 16);
+        while (text.size() < bytes) {
+            text += vocabulary[pick(rng)];
+            const int g = gap(rng);
+            text += g == 0 ? '\n' : g == 1 ? '\t' : ' ';
+        }
+        return text;
+    }
+
+    // Best of three runs, so page faults of the first pass do not count.
+    // run returns a result count, printed so the work cannot be optimized away.
+    double measure(const std::string &text, const std::function<std::uint64_t()> &run) {
+        double best = 0;
+        std::uint64_t results = 0;
+        for (int round = 0; round < 3; ++round) {
+            const auto start = std::chrono::steady_clock::now();
+            results = run();
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::max(best, static_cast<double>(text.size()) / (1024.0 * 1024.0) / elapsed.count());
+        }
+        std::cout << "  [" << results << "]";
+        return best;
+    }
+
+    void report(const std::string &name, const double mib_per_s) {
+        std::cout << " " << name << ": " << static_cast<long>(mib_per_s) << " MiB/s" << std::endl;
+    }
+}
+
+int main(const int argc, char **argv) {
+    const std::size_t total_mib = argc > 1 ? std::stoul(argv[1]) : 256;
+    const std::string text = make_text(total_mib << 20);
+    std::cout << "[bench] tokenizing " << total_mib << " MiB, best kernel: "
+            << HamonTokenizer::kernel_name(HamonTokenizer::best_kernel()) << std::endl;
+
+    report("istream >> string", measure(text, [&] {
+        WordCountTable counts;
+        std::ispanstream ss(std::span(text.data(), text.size()));
+        std::string word;
+        while (ss >> word) counts.add(word);
+        return static_cast<std::uint64_t>(counts.size());
+    }));
+    for (const TokenizerKernel kernel: {TokenizerKernel::Scalar, TokenizerKernel::Sse2, TokenizerKernel::Avx2}) {
+        if (!HamonTokenizer::is_supported(kernel)) {
+            std::cout << "  " << HamonTokenizer::kernel_name(kernel) << ": unsupported on this CPU" << std::endl;
+            continue;
+        }
+        report(HamonTokenizer::kernel_name(kernel), measure(text, [&] {
+            WordCountTable counts;
+            HamonTokenizer::count(text, counts, kernel);
+            return static_cast<std::uint64_t>(counts.size());
+        }));
+    }
+
+    // Tokenization alone, without the table, to isolate the scanner.
+    for (const TokenizerKernel kernel: {TokenizerKernel::Scalar, TokenizerKernel::Sse2, TokenizerKernel::Avx2}) {
+        if (!HamonTokenizer::is_supported(kernel)) continue;
+        report(std::string(HamonTokenizer::kernel_name(kernel)) + " split only", measure(text, [&] {
+            return static_cast<std::uint64_t>(HamonTokenizer::split(text, kernel).size());
+        }));
+    }
+    return 0;
+}
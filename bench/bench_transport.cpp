@@ -0,0 +1,180 @@
+// Loopback TCP against the shared-memory rings used between nodes on the same host:
+// round-trip time of one link between two processes, then the reduce latency of whole clusters.
+// Usage: hamon_bench_transport [distinct_words] [nodes...]   (default: 50000 16 64)
+#include "../include/HamonCube.hpp"
+#include "../include/HamonNode.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace dualys;
+
+namespace {
+    struct Variant {
+        const char *name;
+        std::size_t ring_bytes;
+    };
+
+    // Median round trip of a payload echoed by a child process over one link.
+    double round_trip(const int port, const std::size_t ring_bytes, const std::size_t payload_bytes, const int rounds) {
+        const int server = socket(AF_INET, SOCK_STREAM, 0);
+        constexpr int one = 1;
+        setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<std::uint16_t>(port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(server, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(server, 1) != 0) {
+            close(server);
+            return -1;
+        }
+        const pid_t child = fork();
+        if (child == 0) {
+            const int sock = accept(server, nullptr, nullptr);
+            PeerLink::tune_socket(sock, 0);
+            PeerLink link(sock, 0, false);
+            if (!link.negotiate_transport(false, ring_bytes)) _exit(1);
+            std::string message;
+            for (int i = 0; i < rounds && link.receive(message); ++i) link.send(std::move(message));
+            link.flush();
+            _exit(0);
+        }
+        close(server);
+        const int sock = socket(AF_INET, SOCK_STREAM, 0);
+        PeerLink::tune_socket(sock, 0);
+        if (connect(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+            close(sock);
+            waitpid(child, nullptr, 0);
+            return -1;
+        }
+        std::vector<double> samples;
+        {
+            PeerLink link(sock, 1, false);
+            if (link.negotiate_transport(true, ring_bytes)) {
+                const std::string payload(payload_bytes, 'x');
+                std::string echo;
+                for (int i = 0; i < rounds; ++i) {
+                    const auto start = std::chrono::steady_clock::now();
+                    link.send(payload);
+                    if (!link.receive(echo)) break;
+                    samples.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+                }
+            }
+        }
+        waitpid(child, nullptr, 0);
+        if (samples.size() != static_cast<std::size_t>(rounds)) return -1;
+        std::ranges::nth_element(samples, samples.begin() + rounds / 2);
+        return samples[static_cast<std::size_t>(rounds / 2)];
+    }
+
+    // Runs one cluster as child processes and returns the slowest node's reduce time.
+    double run_cluster(const int nodes, const int base_port, const NodeOptions &options) {
+        std::vector<NodeConfig> configs;
+        for (int i = 0; i < nodes; ++i) {
+            NodeConfig cfg;
+            cfg.id = i;
+            cfg.role = i == 0 ? "coordinator" : "worker";
+            cfg.ip_address = "127.0.0.1";
+            cfg.port = base_port + i;
+            cfg.map_threads = 1;
+            configs.push_back(cfg);
+        }
+        int fds[2];
+        if (pipe(fds) != 0) return -1;
+        std::vector<pid_t> children;
+        for (int i = 0; i < nodes; ++i) {
+            if (const pid_t pid = fork(); pid == 0) {
+                close(fds[0]);
+                if (const int null_fd = open("/dev/null", O_WRONLY); null_fd >= 0) dup2(null_fd, STDOUT_FILENO);
+                const HamonCube cube(nodes);
+                HamonNode node(cube.getNode(static_cast<std::size_t>(i)), cube, configs, options);
+                const double seconds = node.run() ? node.timings().reduce_seconds : -1;
+                if (write(fds[1], &seconds, sizeof(seconds)) != sizeof(seconds)) _exit(1);
+                _exit(0);
+            } else if (pid > 0) {
+                children.push_back(pid);
+            }
+        }
+        close(fds[1]);
+        double slowest = 0;
+        double seconds = 0;
+        std::size_t reported = 0;
+        while (read(fds[0], &seconds, sizeof(seconds)) == sizeof(seconds)) {
+            if (seconds < 0) slowest = -1;
+            else if (slowest >= 0) slowest = std::max(slowest, seconds);
+            ++reported;
+        }
+        close(fds[0]);
+        for (const pid_t pid: children) waitpid(pid, nullptr, 0);
+        return reported == static_cast<std::size_t>(nodes) ? slowest : -1;
+    }
+}
+
+int main(const int argc, char **argv) {
+    const int distinct = argc > 1 ? std::stoi(argv[1]) : 50000;
+    std::vector<int> sizes;
+    for (int i = 2; i < argc; ++i) sizes.push_back(std::stoi(argv[i]));
+    if (sizes.empty()) sizes = {16, 64};
+    for (const int nodes: sizes) {
+        if (nodes <= 0 || (nodes & (nodes - 1)) != 0) {
+            std::cerr << "nodes must be powers of 2" << std::endl;
+            return 1;
+        }
+    }
+
+    const std::string input = "/tmp/hamon_bench_transport_" + std::to_string(getpid()) + ".txt";
+    {
+        std::ofstream out(input);
+        for (int round = 0; round < 2; ++round) {
+            for (int i = 0; i < distinct; ++i) out << "word" << i << (i % 16 == 15 ? '\n' : ' ');
+        }
+    }
+    const Variant variants[] = {
+        {"loopback TCP", 0},
+        {"shared-memory rings", ShmChannel::default_ring_bytes},
+    };
+    int base_port = 23000;
+
+    std::cout << "[bench] one link, payload echoed by another process; median round trip" << std::endl;
+    for (const std::size_t payload: {std::size_t{64}, std::size_t{64} << 10, std::size_t{1} << 20}) {
+        std::cout << "  " << payload << " bytes:" << std::endl;
+        for (const auto &[name, ring_bytes]: variants) {
+            const int rounds = payload > (std::size_t{64} << 10) ? 200 : 2000;
+            if (const double seconds = round_trip(base_port++, ring_bytes, payload, rounds); seconds < 0) {
+                std::cout << "    " << name << ": failed" << std::endl;
+            } else {
+                std::cout << "    " << name << ": " << seconds * 1e6 << " us" << std::endl;
+            }
+        }
+    }
+
+    std::cout << "[bench] " << distinct << " distinct words; tree reduce, slowest node, best of 5" << std::endl;
+    for (const int nodes: sizes) {
+        std::cout << "  " << nodes << " nodes:" << std::endl;
+        for (const auto &[name, ring_bytes]: variants) {
+            NodeOptions options;
+            options.input_file = input;
+            options.shm_ring_bytes = ring_bytes;
+            double best = -1;
+            for (int round = 0; round < 5; ++round, base_port += nodes) {
+                if (const double seconds = run_cluster(nodes, base_port, options); seconds >= 0) {
+                    best = best < 0 ? seconds : std::min(best, seconds);
+                }
+            }
+            if (best < 0) std::cout << "    " << name << ": failed" << std::endl;
+            else std::cout << "    " << name << ": " << best * 1000.0 << " ms" << std::endl;
+        }
+    }
+    std::remove(input.c_str());
+    return 0;
+}
@@ -0,0 +1,110 @@
+// epoll against io_uring for the node's two bulk I/O paths: a framed payload sent by a
+// link's sender thread and received on the event loop, then a shared-input range read.
+// Usage: hamon_bench_uring [payload_mib] [rounds]   (default: 64 5)
+#include "../include/HamonFrame.hpp"
+#include "../include/HamonLoop.hpp"
+#include "../include/HamonShard.hpp"
+#include "../include/HamonUring.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace dualys;
+
+namespace {
+    // Same receive path as HamonNode::receive_from() on a TCP link.
+    Task<bool> receive_payload(EventLoop &loop, const int fd, FrameAssembler &assembler, std::string &out) {
+        const Deadline deadline = EventLoop::deadline_in(60000);
+        while (true) {
+            const std::span<char> buffer = assembler.next_buffer();
+            const std::size_t got = co_await loop.receive(fd, buffer, deadline);
+            const ReceiveStatus status = assembler.advance(got, out);
+            if (status == ReceiveStatus::Complete) co_return true;
+            if (status == ReceiveStatus::Failed || got < buffer.size()) co_return false;
+        }
+    }
+
+    // Median seconds to move the payload through a socketpair; enters counts the sender's io_uring_enter calls.
+    double transfer(const IoBackend backend, const std::string &payload, const int rounds, std::size_t &enters) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) return -1;
+        EventLoop loop(backend);
+        IoUring ring(64);
+        IoUring *sender_ring = backend == IoBackend::Uring && ring.is_open() ? &ring : nullptr;
+        FrameAssembler assembler;
+        std::vector<double> samples;
+        for (int i = 0; i < rounds; ++i) {
+            std::string received;
+            const auto start = std::chrono::steady_clock::now();
+            std::thread sender([&] {
+                FrameWriter writer(fds[0], false, HamonFrame::default_frame_size, sender_ring);
+                if (!writer.write(payload) || !writer.finish()) std::cerr << "send failed" << std::endl;
+            });
+            const bool ok = loop.run(receive_payload(loop, fds[1], assembler, received));
+            sender.join();
+            if (!ok || received.size() != payload.size()) break;
+            samples.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        enters = ring.enter_calls();
+        close(fds[0]);
+        close(fds[1]);
+        if (samples.size() != static_cast<std::size_t>(rounds)) return -1;
+        std::ranges::nth_element(samples, samples.begin() + rounds / 2);
+        return samples[static_cast<std::size_t>(rounds / 2)];
+    }
+
+    // Median seconds to read the whole file as one shared-input range.
+    double range_read(const IoBackend backend, const std::string &path, const std::size_t size, const int rounds) {
+        std::vector<double> samples;
+        for (int i = 0; i < rounds; ++i) {
+            std::string out;
+            const auto start = std::chrono::steady_clock::now();
+            if (!HamonShard::read_range(path, {0, size}, out, backend) || out.size() != size) return -1;
+            samples.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::ranges::nth_element(samples, samples.begin() + rounds / 2);
+        return samples[static_cast<std::size_t>(rounds / 2)];
+    }
+}
+
+int main(const int argc, char **argv) {
+    const std::size_t mib = argc > 1 ? std::stoul(argv[1]) : 64;
+    const int rounds = argc > 2 ? std::stoi(argv[2]) : 5;
+    if (!IoUring::available()) {
+        std::cerr << "io_uring is not available on this kernel" << std::endl;
+        return 1;
+    }
+    std::string payload;
+    payload.reserve(mib << 20);
+    for (std::size_t i = 0; payload.size() < (mib << 20); ++i) payload += "mot" + std::to_string(i % 4099) + ' ';
+    const double bytes = static_cast<double>(payload.size());
+
+    std::cout << "Framed transfer of " << mib << " MiB over a socketpair (median of " << rounds << ")" << std::endl;
+    for (const IoBackend backend: {IoBackend::Epoll, IoBackend::Uring}) {
+        std::size_t enters = 0;
+        const double seconds = transfer(backend, payload, rounds, enters);
+        std::printf("  %-6s %9.2f ms  %8.1f MiB/s  sender enters %zu\n", backend == IoBackend::Uring ? "uring" : "epoll",
+                    seconds * 1000.0, bytes / (1 << 20) / seconds, enters);
+    }
+
+    const std::string path = "bench_uring_input.txt";
+    {
+        std::ofstream o(path, std::ios::binary);
+        o << payload;
+    }
+    std::cout << "Shared-input range read of " << mib << " MiB (page cache, median of " << rounds << ")" << std::endl;
+    for (const IoBackend backend: {IoBackend::Epoll, IoBackend::Uring}) {
+        const double seconds = range_read(backend, path, payload.size(), rounds);
+        std::printf("  %-6s %9.2f ms  %8.1f MiB/s\n", backend == IoBackend::Uring ? "uring" : "epoll",
+                    seconds * 1000.0, bytes / (1 << 20) / seconds);
+    }
+    std::remove(path.c_str());
+    return 0;
+}
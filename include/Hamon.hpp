@@ -1,5 +1,7 @@
 #pragma once
 #include <libintl.h>
+#include "HamonCpuTopology.hpp"
+#include "HamonCube.hpp"
 #include <filesystem>
 #include <iostream>
 #include <optional>
@@ -20,6 +22,7 @@ namespace dualys {
         std::string role; // "worker" | "coordinator" | "custom:..."
         int numa = -1; // -1 = auto
         int core = -1; // -1 = auto
+        int threads = -1; // map threads (@threads), -1 = auto
         std::string host; // e.g., 127.0.0.1
         int port = -1; // e.g., 8000
         std::vector<int> neighbors; // logical neighbors (ids)
@@ -57,12 +60,21 @@ namespace dualys {
 
         [[nodiscard]] const std::string &get_topology() const;
 
+        // Topologie pour HamonCube (après finalize): hypercube, ring ou torus et ses lignes
+        [[nodiscard]] TopologySpec get_topology_spec() const;
+
         // Récupérer une vue aplatie des NodeCfg (après finalize)
         [[nodiscard]] std::vector<NodeCfg> materialize_nodes() const;
 
-        // Affichage « dry-run »
+        // Vue NodeConfig des nœuds (après finalize): endpoints, rôles, @threads et @cpu
+        [[nodiscard]] std::vector<NodeConfig> node_configs() const;
+
+        // Affichage « dry-run », avec le placement résolu sur les CPU de cette machine
         void print_plan(std::ostream &os = std::cout) const;
 
+        // Idem sur une topologie donnée
+        void print_plan(std::ostream &os, const HamonCpuTopology &cpus) const;
+
         std::string expand_vars(const std::string &in) const; // remplace ${VAR}
         bool eval_require_expr(const std::string &raw) const; // évalue @require
 
@@ -81,8 +93,6 @@ namespace dualys {
 
         static void parse_host_port(const std::string &s, std::string &host, int &port);
 
-        static bool is_power_of_two(unsigned x);
-
         static int log2i(unsigned x);
 
         // Gestion des nœuds
@@ -102,6 +112,8 @@ namespace dualys {
         int nodes = -1; // @use
         int dimensions = -1; // @dim (auto si @use est puissance de 2)
         std::string topology = "hypercube"; // @topology
+        int topologyRows = -1; // @topology torus rows=R
+        int topologyCols = -1; // @topology torus cols=C
         std::string hostname; // @autoprefix host:port OU @auto host:port
         int autoPortBase = -1; // idem
         std::vector<std::optional<NodeCfg> > config;
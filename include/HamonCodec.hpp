@@ -0,0 +1,171 @@
+#pragma once
+#include <libintl.h>
+#include "HamonCount.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#ifndef I18N_GETTEXT_DEFINED
+#define _(String) gettext(String)
+#define I18N_GETTEXT_DEFINED
+#endif
+
+namespace dualys {
+    /**
+     * @brief Encoding of word-count payloads exchanged during the reduce.
+     */
+    enum class WireFormat {
+        /// Compact binary codec (HamonCodec): prefix-compressed keys, varint counts.
+        Binary,
+        /// Human-readable `word:count,` text (HamonNode::serialize_map), kept for debugging.
+        Text
+    };
+
+    /**
+     * @brief Binary codec for WordCountMap payloads.
+     *
+     * Layout: magic byte, varint entry count, then for every entry in key order:
+     * varint shared-prefix length with the previous key, varint suffix length,
+     * suffix bytes, varint count. Keys are arbitrary bytes, so words containing
+     * `:` or `,` survive the round trip. The exact size is computed first so the
+     * payload is encoded once, straight into its final buffer.
+     */
+    class HamonCodec {
+    public:
+        /// First byte of every binary payload.
+        static constexpr unsigned char magic = 0xB1;
+
+        /**
+         * @brief Exact number of bytes encode_into() will write.
+         * @param counts The map to encode.
+         * @return The encoded size in bytes.
+         */
+        [[nodiscard]] static std::size_t encoded_size(const WordCountMap &counts);
+
+        /**
+         * @brief Exact number of bytes encode_into() will write.
+         * @param entries Entries sorted by key (see WordCountTable::sorted()).
+         * @return The encoded size in bytes.
+         */
+        [[nodiscard]] static std::size_t encoded_size(const WordCountEntries &entries);
+
+        /**
+         * @brief Encode a map into a caller-provided buffer.
+         * @param counts The map to encode.
+         * @param out Destination of at least encoded_size(counts) bytes.
+         * @return Number of bytes written.
+         */
+        static std::size_t encode_into(const WordCountMap &counts, char *out);
+
+        /**
+         * @brief Encode sorted entries into a caller-provided buffer.
+         * @param entries Entries sorted by key.
+         * @param out Destination of at least encoded_size(entries) bytes.
+         * @return Number of bytes written.
+         */
+        static std::size_t encode_into(const WordCountEntries &entries, char *out);
+
+        /**
+         * @brief Encode a map into a buffer sized once with encoded_size().
+         * @param counts The map to encode.
+         * @return The encoded payload.
+         */
+        [[nodiscard]] static std::string encode(const WordCountMap &counts);
+
+        /**
+         * @brief Encode a counting table; its entries are sorted once, here.
+         * @param counts The table to encode.
+         * @return The encoded payload.
+         */
+        [[nodiscard]] static std::string encode(const WordCountTable &counts);
+
+        /**
+         * @brief Decode a binary payload and add its counts to an existing map.
+         * @param payload The bytes produced by encode()/encode_into().
+         * @param counts The map to merge into.
+         * @return false if the payload is truncated or malformed (entries decoded so far are kept).
+         */
+        static bool decode_and_merge(std::string_view payload, WordCountMap &counts);
+
+        /**
+         * @brief Decode a binary payload and add its counts to a counting table.
+         * @param payload The bytes produced by encode()/encode_into().
+         * @param counts The table to merge into.
+         * @return false if the payload is truncated or malformed (entries decoded so far are kept).
+         */
+        static bool decode_and_merge(std::string_view payload, WordCountTable &counts);
+
+        /**
+         * @brief Number of bytes of the LEB128 varint encoding of a value.
+         * @param value The value.
+         * @return 1 to 10.
+         */
+        [[nodiscard]] static std::size_t varint_size(std::uint64_t value);
+
+        /**
+         * @brief Write a LEB128 varint.
+         * @param value The value.
+         * @param out Destination of at least varint_size(value) bytes.
+         * @return Pointer past the last written byte.
+         */
+        static char *put_varint(std::uint64_t value, char *out);
+
+        /**
+         * @brief Read a LEB128 varint.
+         * @param in Cursor into the payload, advanced past the varint.
+         * @param end End of the payload.
+         * @param value Receives the value.
+         * @return false if the varint is truncated or longer than 64 bits.
+         */
+        static bool get_varint(const char *&in, const char *end, std::uint64_t &value);
+    };
+
+    /**
+     * @brief Reads the entries of one binary payload one at a time, in key order.
+     *
+     * For consumers that stream entries (a k-way merge) instead of merging a whole
+     * payload into a map or table.
+     */
+    class CodecCursor {
+    public:
+        /**
+         * @brief Start reading a payload.
+         * @param p_payload The bytes produced by HamonCodec::encode()/encode_into(); must
+         *        outlive the cursor.
+         */
+        explicit CodecCursor(std::string_view p_payload);
+
+        /**
+         * @brief Move to the next entry.
+         * @return false at the end of the payload, or if it is malformed (see failed()).
+         */
+        bool next();
+
+        /**
+         * @brief The current entry's key.
+         * @return A view valid until the next call to next().
+         */
+        [[nodiscard]] std::string_view word() const;
+
+        /**
+         * @brief The current entry's count.
+         * @return The count.
+         */
+        [[nodiscard]] std::uint64_t count() const;
+
+        /**
+         * @brief Whether reading stopped on a truncated or malformed payload.
+         * @return true on error.
+         */
+        [[nodiscard]] bool failed() const;
+
+    private:
+        const char *at;
+        const char *end;
+        std::uint64_t left;
+        std::string current;
+        std::uint64_t current_count;
+        bool broken;
+    };
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include <libintl.h>
+#include "HamonLoop.hpp"
+#include "HamonShard.hpp"
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifndef I18N_GETTEXT_DEFINED
+#define _(String) gettext(String)
+#define I18N_GETTEXT_DEFINED
+#endif
+
+namespace dualys {
+    /**
+     * @brief How a node's collectives reach its peers.
+     *
+     * Sends only queue the payload (each link has its own sender), so a node can forward
+     * one segment while it receives the next.
+     */
+    struct CollectiveLinks {
+        /// Queue a payload for a peer.
+        std::function<void(int peer, std::string payload)> send;
+        /// Queue a byte range of a file for a peer, sent without copying where the link allows.
+        std::function<void(int peer, int file_fd, const ShardRange &range)> send_file_range;
+        /// Receive the next payload from a peer; false on failure or at the phase deadline.
+        std::function<Task<bool>(int peer, std::string &out)> receive;
+    };
+
+    /**
+     * @brief Collective operations over the binomial tree of the hypercube, rooted at node 0.
+     *
+     * A node's parent is its ID with the lowest set bit cleared; its children are its ID
+     * with one more bit set below that one (every bit for node 0), so each tree edge is a
+     * hypercube edge. The subtree of a child across bit d holds the 2^d IDs that follow
+     * it. The tree works for any node count: IDs past the count are left out.
+     *
+     * Payloads travel in segments of at most segment_bytes, and a node forwards each
+     * segment as soon as it arrives. A payload of S bytes thus reaches the deepest node
+     * in about (log2 N + S / segment_bytes) segment times instead of log2 N full copies.
+     * On the wire, every piece of a scatter, gather or allgather is a header
+     * "<node> <length>" followed by its segments, and a stream of pieces ends with an
+     * empty payload.
+     *
+     * Every member must be called by all the nodes of the cluster, in the same order.
+     */
+    class HamonCollectives {
+    public:
+        /// Segment size when none is given.
+        static constexpr std::size_t default_segment_bytes = std::size_t{1} << 20;
+
+        /// Receives the segments of a node's own piece, in order; it may take the string's content.
+        using SegmentSink = std::function<void(std::string &segment)>;
+
+        /**
+         * @brief Collectives of one node.
+         * @param p_links Transport to the node's tree neighbors.
+         * @param p_self The node's ID.
+         * @param p_node_count Nodes in the cluster.
+         * @param p_segment_bytes Largest payload sent at once (at least 1).
+         */
+        HamonCollectives(CollectiveLinks p_links, int p_self, int p_node_count,
+                         std::size_t p_segment_bytes = default_segment_bytes);
+
+        /**
+         * @brief Parent of a node in the tree.
+         * @param node The node's ID.
+         * @return The parent's ID; -1 for node 0.
+         */
+        [[nodiscard]] static int parent_of(int node);
+
+        /**
+         * @brief Children of a node in the tree, largest subtree first.
+         * @param node The node's ID.
+         * @param node_count Nodes in the cluster.
+         * @return The children's IDs.
+         */
+        [[nodiscard]] static std::vector<int> children_of(int node, int node_count);
+
+        /**
+         * @brief End of a node's subtree: the subtree is [node, subtree_end(node)).
+         * @param node The node's ID.
+         * @param node_count Nodes in the cluster.
+         * @return One past the last ID in the subtree.
+         */
+        [[nodiscard]] static int subtree_end(int node, int node_count);
+
+        /**
+         * @brief Pipelined broadcast from node 0.
+         * @param payload Node 0's payload; on the other nodes, receives it.
+         * @return false if a link failed or a message was malformed.
+         */
+        Task<bool> broadcast(std::string &payload);
+
+        /**
+         * @brief Scatter from node 0: node i receives pieces[i].
+         * @param pieces On node 0, one piece per node; ignored elsewhere.
+         * @param mine Receives this node's piece.
+         * @return false if a link failed or a message was malformed.
+         */
+        Task<bool> scatter(std::vector<std::string> pieces, std::string &mine);
+
+        /**
+         * @brief Node 0's side of a scatter of file ranges: queue every other node's range
+         *        down the tree, farthest nodes first.
+         * @param file_fd The file; it must stay open until the links are flushed.
+         * @param ranges One range per node; node 0's own range is not sent.
+         */
+        void scatter_file(int file_fd, const std::vector<ShardRange> &ranges) const;
+
+        /**
+         * @brief A worker's side of a scatter: forward the pieces of its subtree and hand its
+         *        own piece to a sink, segment by segment, as they arrive.
+         * @param own Receives the segments of this node's piece.
+         * @return false if a link failed or a message was malformed.
+         */
+        Task<bool> receive_scatter(const SegmentSink &own);
+
+        /**
+         * @brief Gather to node 0: node 0 receives every node's piece.
+         * @param mine This node's piece.
+         * @param all On node 0, receives the pieces indexed by node; left untouched elsewhere.
+         * @return false if a link failed or a message was malformed.
+         * @note Each node forwards its children's streams one after the other, segment by
+         *       segment, smallest subtree first.
+         */
+        Task<bool> gather(std::string mine, std::vector<std::string> &all);
+
+        /**
+         * @brief Allgather by recursive doubling: in round d, each node swaps everything it
+         *        holds with its partner across bit d, and every node ends with every piece.
+         * @param mine This node's piece.
+         * @param all Receives the pieces indexed by node.
+         * @return false if a link failed or a message was malformed.
+         * @note The exchanges pair the nodes of the largest power of two up to the node count;
+         *       each node past it sends its piece to its partner in that cube first (node
+         *       core + i to node i) and receives every piece from it last.
+         */
+        Task<bool> allgather(std::string mine, std::vector<std::string> &all);
+
+    private:
+        void send_piece(int peer, int node, std::string_view piece) const;
+
+        Task<bool> receive_header(int peer, std::string &message, int &node, std::size_t &length) const;
+
+        Task<bool> receive_pieces(int peer, int first, int last, int relay, std::vector<std::string> &all,
+                                  int modulus) const;
+
+        bool fail(const char *what, int peer) const;
+
+        CollectiveLinks links;
+        int self;
+        int node_count;
+        std::size_t segment_bytes;
+    };
+}
@@ -0,0 +1,261 @@
+#pragma once
+#include <libintl.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifndef I18N_GETTEXT_DEFINED
+#define _(String) gettext(String)
+#define I18N_GETTEXT_DEFINED
+#endif
+
+namespace dualys {
+    /**
+     * @brief Sorted word counts, used where an ordered, owning container is convenient
+     *        (tests, the text wire format).
+     */
+    using WordCountMap = std::map<std::string, std::uint64_t>;
+
+    /**
+     * @brief Word counts in key order, viewing the keys of a WordCountTable.
+     */
+    using WordCountEntries = std::vector<std::pair<std::string_view, std::uint64_t> >;
+
+    /**
+     * @brief Bump allocator for key bytes, released in one shot.
+     *
+     * Memory is carved from large blocks; individual allocations are never freed.
+     * Blocks never move, so pointers stay valid until release() or destruction.
+     */
+    class Arena {
+    public:
+        /**
+         * @brief Create an empty arena.
+         * @param p_block_size Size of the blocks requested from the system.
+         */
+        explicit Arena(std::size_t p_block_size = 64 * 1024);
+
+        /**
+         * @brief Allocate bytes (no alignment guarantee; meant for character data).
+         * @param size Number of bytes.
+         * @return Pointer to size writable bytes.
+         */
+        char *allocate(std::size_t size);
+
+        /**
+         * @brief Free every block at once; all previously returned pointers become invalid.
+         */
+        void release();
+
+        /**
+         * @brief Take over every block of another arena, keeping its pointers valid.
+         * @param other The arena to empty; new allocations still come from this arena's current block.
+         */
+        void absorb(Arena &&other);
+
+        /**
+         * @brief Total bytes requested from the system.
+         * @return The sum of all block sizes.
+         */
+        [[nodiscard]] std::size_t reserved() const;
+
+    private:
+        std::vector<std::unique_ptr<char[]> > blocks;
+        std::size_t block_size;
+        std::size_t reserved_bytes;
+        char *cursor;
+        std::size_t left;
+    };
+
+    /**
+     * @brief Open-addressing hash table counting words for the map phase.
+     *
+     * Design notes:
+     * - Linear probing over a power-of-two array of slots, grown at 70% load.
+     * - Every slot stores the full 64-bit hash, so probes compare the hash before
+     *   touching key bytes and growing never rehashes a key.
+     * - Keys of up to inline_capacity bytes live inside the slot; longer keys are
+     *   copied once into an Arena and released together with the table.
+     * - Counters are 64-bit.
+     * - Iteration order is unspecified; sorted() orders entries only when results
+     *   are printed or serialized.
+     */
+    class WordCountTable {
+    public:
+        /// Longest key stored inline in a slot.
+        static constexpr std::size_t inline_capacity = 20;
+
+        /**
+         * @brief Create an empty table.
+         * @param expected_words Number of distinct words to size the table for.
+         */
+        explicit WordCountTable(std::size_t expected_words = 0);
+
+        WordCountTable(WordCountTable &&) noexcept = default;
+
+        WordCountTable &operator=(WordCountTable &&) noexcept = default;
+
+        WordCountTable(const WordCountTable &) = delete;
+
+        WordCountTable &operator=(const WordCountTable &) = delete;
+
+        /**
+         * @brief Add to the count of a word, inserting it if needed.
+         * @param word The word; its bytes are copied when it is inserted.
+         * @param count Amount to add.
+         */
+        void add(std::string_view word, std::uint64_t count = 1);
+
+        /**
+         * @brief Add every count of another table.
+         * @param other The table to merge in.
+         */
+        void merge(const WordCountTable &other);
+
+        /**
+         * @brief Merge thread-local tables into one, with one thread per table.
+         * @param parts The tables to merge; consumed (their key arenas move to the result).
+         * @return A table holding the sum of all parts.
+         * @note The result is sized up front for the sum of the parts, and each thread inserts
+         *       only the entries whose home slot falls in its own range of the result, so
+         *       threads never write the same slot. Entries whose probe would leave their
+         *       thread's range are inserted afterwards, sequentially. Keys are not copied.
+         */
+        [[nodiscard]] static WordCountTable merge_parallel(std::vector<WordCountTable> parts);
+
+        /**
+         * @brief Count of a word.
+         * @param word The word to look up.
+         * @return Its count, 0 if absent.
+         */
+        [[nodiscard]] std::uint64_t find(std::string_view word) const;
+
+        /**
+         * @brief Number of distinct words.
+         * @return The number of occupied slots.
+         */
+        [[nodiscard]] std::size_t size() const;
+
+        /**
+         * @brief Whether the table holds no word.
+         * @return true if size() == 0.
+         */
+        [[nodiscard]] bool empty() const;
+
+        /**
+         * @brief Visit every (word, count) pair in unspecified order.
+         * @param visit Callable taking (std::string_view, std::uint64_t).
+         */
+        template<class Visitor>
+        void for_each(Visitor &&visit) const {
+            for (const Slot &slot: slots) {
+                if (slot.count != 0) visit(key_of(slot), slot.count);
+            }
+        }
+
+        /**
+         * @brief Move every entry selected by a predicate into a new table.
+         * @param moves Callable taking the entry's hash (see hash()) and returning true to move it.
+         * @return The moved entries; this table keeps the others.
+         * @note Kept entries are re-placed in a fresh slot array of the same capacity;
+         *       their keys stay where they are.
+         */
+        template<class Predicate>
+        [[nodiscard]] WordCountTable extract_if(Predicate &&moves) {
+            WordCountTable out;
+            std::vector<Slot> kept(slots.size(), Slot{});
+            std::size_t kept_count = 0;
+            for (const Slot &slot: slots) {
+                if (slot.count == 0) continue;
+                if (moves(slot.hash)) {
+                    out.add_hashed(key_of(slot), slot.hash, slot.count);
+                } else {
+                    place(kept, mask, slot);
+                    ++kept_count;
+                }
+            }
+            slots.swap(kept);
+            used = kept_count;
+            return out;
+        }
+
+        /**
+         * @brief Entries sorted by key, viewing the table's keys.
+         * @return The sorted entries; valid until the table is modified.
+         */
+        [[nodiscard]] WordCountEntries sorted() const;
+
+        /**
+         * @brief Copy the counts into an ordered map.
+         * @return A WordCountMap with the same content.
+         */
+        [[nodiscard]] WordCountMap to_map() const;
+
+        /**
+         * @brief Remove every word and release the key arena.
+         */
+        void clear();
+
+        /**
+         * @brief Approximate memory held by the table (slots plus arena blocks).
+         * @return Bytes.
+         */
+        [[nodiscard]] std::size_t memory_usage() const;
+
+        /**
+         * @brief Hash function used by the table.
+         * @param word The bytes to hash.
+         * @return A 64-bit hash.
+         */
+        [[nodiscard]] static std::uint64_t hash(std::string_view word);
+
+        /**
+         * @brief Node owning a key in a hash-partitioned (shuffle) reduce.
+         * @param word_hash The key's hash().
+         * @param nodes Number of nodes.
+         * @return A node ID in [0, nodes).
+         * @note Uses the high half of the hash: slot indices use the low bits, and a
+         *       partition whose low bits were all equal would crowd a few home slots.
+         */
+        [[nodiscard]] static std::size_t owner_of(std::uint64_t word_hash, std::size_t nodes) {
+            return static_cast<std::size_t>((word_hash >> 32) % nodes);
+        }
+
+    private:
+        struct Slot {
+            std::uint64_t hash;
+            std::uint64_t count; // 0 marks an empty slot
+            std::uint32_t length;
+            char key[inline_capacity]; // the key bytes, or a pointer into the arena
+        };
+
+        [[nodiscard]] static std::string_view key_of(const Slot &slot) {
+            if (slot.length <= inline_capacity) return {slot.key, slot.length};
+            const char *ptr = nullptr;
+            std::memcpy(&ptr, slot.key, sizeof(ptr));
+            return {ptr, slot.length};
+        }
+
+        void add_hashed(std::string_view word, std::uint64_t word_hash, std::uint64_t count);
+
+        // Puts a slot known to be absent into its probe position.
+        static void place(std::vector<Slot> &target, const std::size_t target_mask, const Slot &slot) {
+            std::size_t i = slot.hash & target_mask;
+            while (target[i].count != 0) i = (i + 1) & target_mask;
+            target[i] = slot;
+        }
+
+        void grow();
+
+        std::vector<Slot> slots;
+        std::size_t mask;
+        std::size_t used;
+        Arena arena;
+    };
+}
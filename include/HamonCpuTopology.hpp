@@ -0,0 +1,110 @@
+#pragma once
+#include <libintl.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#ifndef I18N_GETTEXT_DEFINED
+#define _(String) gettext(String)
+#define I18N_GETTEXT_DEFINED
+#endif
+
+namespace dualys {
+    /**
+     * @brief One logical CPU, as the kernel describes it under /sys/devices/system/cpu/cpu<id>.
+     */
+    struct CpuInfo {
+        /// Logical CPU number.
+        int id = 0;
+        /// Socket (topology/physical_package_id).
+        int package = 0;
+        /// NUMA node holding it; 0 without NUMA information.
+        int numa = 0;
+        /// Physical core within its package (topology/core_id).
+        int core = 0;
+        /// Usable SMT siblings sharing its physical core, itself included, ascending.
+        std::vector<int> siblings;
+        /// Its position among the siblings: 0 for the first thread of the core.
+        int thread = 0;
+    };
+
+    /**
+     * @brief One cache instance (cpu<id>/cache/index<k>), listed once for all the CPUs sharing it.
+     */
+    struct CpuCache {
+        int level = 0;
+        /// "Data", "Instruction" or "Unified".
+        std::string type;
+        std::size_t size_bytes = 0;
+        /// Usable CPUs sharing it, ascending.
+        std::vector<int> cpus;
+    };
+
+    /**
+     * @brief The CPUs of one NUMA node that this process may run on.
+     */
+    struct NumaDomain {
+        /// NUMA node number, as in /sys/devices/system/node/node<id>.
+        int id = 0;
+        /// Logical CPUs, physical cores first: the first thread of every core, then the second ones...
+        std::vector<int> cpus;
+        /// The same CPUs grouped by physical core (SMT siblings together), cores by lowest CPU.
+        /// Empty when unknown: every CPU is then its own core.
+        std::vector<std::vector<int> > cores;
+    };
+
+    /**
+     * @brief Packages, NUMA nodes, physical cores, SMT siblings and caches of the machine.
+     *
+     * Read from sysfs instead of being inferred from the CPU count: Linux usually numbers
+     * CPUs round robin across sockets and enumerates the SMT siblings after every first
+     * thread, so CPU numbers say nothing of where a CPU sits. Only online CPUs in the
+     * process's affinity mask are kept.
+     */
+    class HamonCpuTopology {
+    public:
+        /**
+         * @brief Read the topology of the machine.
+         * @param root Directory holding cpu/ and node/ (normally /sys/devices/system).
+         * @param allowed CPUs the process may use; empty = its affinity mask.
+         * @return The topology. Missing files fall back to one package and one NUMA node,
+         *         with each CPU its own core.
+         */
+        [[nodiscard]] static HamonCpuTopology discover(const std::string &root = "/sys/devices/system",
+                                                       std::vector<int> allowed = {});
+
+        /**
+         * @brief Parse a kernel CPU list such as "0-3,8,10-11".
+         * @param text The list.
+         * @param cpus Receives the CPU numbers, ascending.
+         * @return false if the list is malformed.
+         */
+        static bool parse_cpu_list(const std::string &text, std::vector<int> &cpus);
+
+        /// Usable CPUs, ascending.
+        [[nodiscard]] const std::vector<CpuInfo> &cpus() const { return cpu_list; }
+
+        /// Caches of the usable CPUs.
+        [[nodiscard]] const std::vector<CpuCache> &caches() const { return cache_list; }
+
+        [[nodiscard]] int package_count() const;
+
+        /// Physical cores with at least one usable CPU.
+        [[nodiscard]] int core_count() const;
+
+        /**
+         * @brief The usable CPUs of each NUMA node, for HamonPlacement::plan().
+         * @return One domain per NUMA node with usable CPUs, by NUMA node number.
+         */
+        [[nodiscard]] std::vector<NumaDomain> numa_domains() const;
+
+        /**
+         * @brief One-line description, e.g. "2 packages, 2 NUMA nodes, 12 cores, 24 CPUs; L3 12 MiB x2".
+         */
+        [[nodiscard]] std::string summary() const;
+
+    private:
+        std::vector<CpuInfo> cpu_list;
+        std::vector<CpuCache> cache_list;
+    };
+}
@@ -29,6 +29,41 @@ namespace dualys {
         std::string role;
         std::string ip_address;
         int port;
+        /// Threads running this node's map phase; 0 = one per CPU the node is pinned to.
+        int map_threads = 0;
+        /// NUMA node to run on (@cpu numa=I); -1 = placed automatically.
+        int numa = -1;
+        /// CPU to pin to (@cpu core=J), counted within the NUMA node if one is given; -1 = automatic.
+        int core = -1;
+    };
+
+    /// Shape of the graph linking the nodes.
+    enum class TopologyKind {
+        /// Neighbors differ by one bit of their IDs; IDs past the node count are left out.
+        Hypercube,
+        /// Node i is linked to i - 1 and i + 1, modulo the node count.
+        Ring,
+        /// rows x columns grid with wrap-around; node r * columns + c sits at (r, c).
+        Torus
+    };
+
+    /**
+     * @brief Topology requested on the command line (--topology) or by @topology.
+     */
+    struct TopologySpec {
+        TopologyKind kind = TopologyKind::Hypercube;
+        /// Torus only: rows of the grid (columns = nodes / rows); 0 picks the squarest grid.
+        int rows = 0;
+        /// Torus only: columns of the grid, checked against the node count; 0 if not given.
+        int columns = 0;
+
+        /**
+         * @brief Parse "hypercube", "ring", "torus" or "torus:RxC".
+         * @param text The value.
+         * @param spec Receives the topology.
+         * @return false if the value is not one of those.
+         */
+        static bool parse(const std::string &text, TopologySpec &spec);
     };
 
     /**
@@ -41,6 +76,14 @@ namespace dualys {
      * - The graph is initialized in the constructor and is immutable afterward.
      * - Nodes are stored in a contiguous container and addressed by their ID.
      * - The expected ID domain is [0, 7] for the 3D hypercube.
+     * - A ring or a torus (TopologySpec) replaces the hypercube neighbors with its own
+     *   and accepts any node count; the binomial tree over the ID bits still organises
+     *   the reduce and the collectives, so getDimension() is the bit width of the IDs.
+     * - A hypercube of N nodes, N not a power of two, is the cube of the largest power of
+     *   two P below N (the core) plus N - P extra nodes. Extra node P + i is folded onto
+     *   core node i, its neighbor across the top dimension: pairwise algorithms run on the
+     *   core, with one step before to take in the extra nodes' data and one after to hand
+     *   them their result.
      */
     class HamonCube {
     public:
@@ -52,6 +95,14 @@ namespace dualys {
          */
         explicit HamonCube(int num_nodes);
 
+        /**
+         * @brief Build a cluster graph of the given shape.
+         * @param num_nodes Number of nodes.
+         * @param spec Topology and, for a torus, its rows.
+         * @throws std::invalid_argument If the node count does not fit the topology.
+         */
+        HamonCube(int num_nodes, TopologySpec spec);
+
         /**
          * @brief Get the total number of nodes in the 3D hypercube.
          *
@@ -97,6 +148,56 @@ namespace dualys {
          *   Callers should validate the ID before calling this function.
          */
         [[nodiscard]] const Node &getNode(size_t id) const;
+
+        /**
+         * @brief Shape of the graph.
+         * @return Hypercube, Ring or Torus.
+         */
+        [[nodiscard]] TopologyKind getKind() const;
+
+        /**
+         * @brief Grid of a torus.
+         * @return Its rows; 1 for the other topologies.
+         */
+        [[nodiscard]] int getRows() const;
+
+        /**
+         * @brief Grid of a torus.
+         * @return Its columns; the node count for the other topologies.
+         */
+        [[nodiscard]] int getColumns() const;
+
+        /**
+         * @brief A cycle through every node, for ring algorithms.
+         *
+         * The Gray code i ^ (i >> 1) on a hypercube (skipping codes past the node count),
+         * the IDs in order on a ring, and a row by row snake on a torus (with an odd row
+         * count, the snake skips column 0 and returns along it). Consecutive nodes, the
+         * last and the first included, are neighbors, except on a hypercube whose node
+         * count is not a power of two, where a few pairs are not.
+         *
+         * @return Node IDs in ring order.
+         */
+        [[nodiscard]] const std::vector<int> &getRingOrder() const;
+
+        /**
+         * @brief Nodes of the hypercube's core: the largest power of two up to the node count.
+         * @return The core size; the node count itself when it is a power of two.
+         */
+        [[nodiscard]] int getCoreCount() const;
+
+        /**
+         * @brief The node an extra node is folded onto, or the extra node folded onto a core node.
+         * @param id A node ID.
+         * @return id - core for an extra node, id + core for a core node that has one, else -1.
+         */
+        [[nodiscard]] int getFoldPartner(int id) const;
+
+        /**
+         * @brief Name of a topology, as accepted by TopologySpec::parse.
+         * @return "hypercube", "ring" or "torus".
+         */
+        [[nodiscard]] static const char *kindName(TopologyKind kind);
     private:
         /**
          * @brief Build the hypercube adjacency (neighbors for each node).
@@ -105,8 +206,15 @@ namespace dualys {
          * each pair of connected nodes differs by exactly one bit in their ID.
          */
         void initializeTopology();
+
+        void initializeRing();
+
         int node_count;
         int dimension;
+        TopologyKind kind = TopologyKind::Hypercube;
+        int rows = 1;
+        int columns = 1;
+        std::vector<int> ring_order;
         /**
          * @brief Container holding all nodes of the 3D hypercube.
          *
@@ -0,0 +1,304 @@
+#pragma once
+#include <libintl.h>
+#include "HamonShard.hpp"
+#include "HamonUring.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+
+#ifndef I18N_GETTEXT_DEFINED
+#define _(String) gettext(String)
+#define I18N_GETTEXT_DEFINED
+#endif
+
+namespace dualys {
+    /**
+     * @brief Kind of a frame on the wire.
+     */
+    enum class FrameType : std::uint8_t {
+        /// First frame of every connection: carries the supported protocol versions and the node ID.
+        Hello = 1,
+        /// A piece of a payload.
+        Data = 2,
+        /// Terminates a payload (zero length).
+        End = 3
+    };
+
+    /**
+     * @brief Decoded form of the fixed-size frame header.
+     *
+     * Wire layout (16 bytes, big-endian): type(1) flags(1) reserved(2) checksum(4) length(8).
+     */
+    struct FrameHeader {
+        FrameType type;
+        std::uint8_t flags;
+        std::uint32_t checksum;
+        std::uint64_t length;
+    };
+
+    /**
+     * @brief Length-prefixed framing used by every node-to-node message.
+     *
+     * A payload is sent as any number of Data frames followed by one End frame, so
+     * neither side has to hold a whole payload in memory and there is no size limit
+     * beyond the 64-bit length of a single frame. All reads and writes loop over
+     * partial results. Frames may carry a CRC-32 of their body.
+     */
+    class HamonFrame {
+    public:
+        /// Highest protocol version spoken by this build.
+        static constexpr std::uint16_t protocol_version = 1;
+        /// Lowest protocol version this build still accepts.
+        static constexpr std::uint16_t min_protocol_version = 1;
+        /// Size of an encoded FrameHeader.
+        static constexpr std::size_t header_size = 16;
+        /// Default body size of the Data frames produced by FrameWriter.
+        static constexpr std::size_t default_frame_size = std::size_t{1} << 20;
+        /// Largest Data frame a FrameReader accepts (protects against corrupt headers).
+        static constexpr std::uint64_t max_frame_size = std::uint64_t{64} << 20;
+        /// Flag bit: the checksum field holds the CRC-32 of the frame body.
+        static constexpr std::uint8_t flag_checksum = 0x01;
+
+        /**
+         * @brief Write a buffer completely, retrying on partial writes and EINTR.
+         * @param fd The socket to write to.
+         * @param data The bytes to write.
+         * @param size Number of bytes.
+         * @return true if every byte was written.
+         */
+        static bool write_all(int fd, const void *data, std::size_t size);
+
+        /**
+         * @brief Write a scatter list completely with sendmsg(), retrying on partial writes.
+         * @param fd The socket to write to.
+         * @param iov The buffers to write; modified in place as data goes out.
+         * @param count Number of entries in iov.
+         * @return true if every byte was written.
+         */
+        static bool writev_all(int fd, iovec *iov, std::size_t count);
+
+        /**
+         * @brief Read exactly size bytes, retrying on short reads and EINTR.
+         * @param fd The socket to read from.
+         * @param data Destination buffer.
+         * @param size Number of bytes to read.
+         * @return true if all bytes were read, false on error or end of stream.
+         */
+        static bool read_all(int fd, void *data, std::size_t size);
+
+        /**
+         * @brief CRC-32 (IEEE 802.3 polynomial) of a buffer.
+         * @param data The bytes to checksum.
+         * @param size Number of bytes.
+         * @param crc Running value, to checksum a buffer in several pieces.
+         * @return The updated checksum.
+         */
+        [[nodiscard]] static std::uint32_t crc32(const void *data, std::size_t size, std::uint32_t crc = 0);
+
+        /**
+         * @brief Encode a header into its 16-byte wire form.
+         * @param header The header to encode.
+         * @param out Destination of header_size bytes.
+         */
+        static void encode_header(const FrameHeader &header, unsigned char *out);
+
+        /**
+         * @brief Decode a header from its 16-byte wire form.
+         * @param in Source of header_size bytes.
+         * @return The decoded header.
+         */
+        [[nodiscard]] static FrameHeader decode_header(const unsigned char *in);
+
+        /**
+         * @brief Exchange Hello frames and agree on a protocol version.
+         * @param fd A freshly connected or accepted socket.
+         * @param self_id ID of the local node, announced to the peer.
+         * @param peer_id Receives the ID announced by the peer.
+         * @param version Receives the negotiated version (highest one both sides speak).
+         * @return false if the peer is not speaking the protocol or no common version exists.
+         * @note Both sides write before reading, so it does not matter who connected.
+         */
+        static bool handshake(int fd, int self_id, int &peer_id, std::uint16_t &version);
+
+        /**
+         * @brief First half of handshake(): announce our versions and ID.
+         * @param fd A freshly connected or accepted socket.
+         * @param self_id ID of the local node.
+         * @return true if the Hello frame was written.
+         */
+        static bool send_hello(int fd, int self_id);
+
+        /**
+         * @brief Second half of handshake(): read the peer's Hello and agree on a version.
+         * @param fd The socket, after send_hello().
+         * @param peer_id Receives the ID announced by the peer.
+         * @param version Receives the negotiated version.
+         * @return false if the peer is not speaking the protocol or no common version exists.
+         * @note Event-driven callers wait for the socket to become readable first.
+         */
+        static bool receive_hello(int fd, int &peer_id, std::uint16_t &version);
+    };
+
+    /**
+     * @brief Progress of a non-blocking receive.
+     */
+    enum class ReceiveStatus {
+        /// A whole payload was received.
+        Complete,
+        /// More bytes are needed; wait until the socket is readable and poll again.
+        Pending,
+        /// The stream broke (I/O error, hang-up, bad frame, checksum mismatch).
+        Failed
+    };
+
+    /**
+     * @brief Sends one payload as a stream of Data frames terminated by an End frame.
+     */
+    class FrameWriter {
+    public:
+        /**
+         * @brief Create a writer on a connected socket.
+         * @param p_fd The socket to write to.
+         * @param p_checksums Whether to attach a CRC-32 to every Data frame.
+         * @param p_max_frame Largest body of a single Data frame.
+         * @param p_ring When set, frames are queued and sent in batches of linked sendmsg
+         *        operations on this ring (one io_uring_enter per batch) instead of one
+         *        sendmsg each. The ring must belong to the calling thread.
+         */
+        explicit FrameWriter(int p_fd, bool p_checksums = false,
+                             std::size_t p_max_frame = HamonFrame::default_frame_size, IoUring *p_ring = nullptr);
+
+        /**
+         * @brief Append bytes to the payload.
+         * @param data The bytes; split into frames of at most max_frame bytes.
+         * @return true on success.
+         */
+        bool write(std::string_view data);
+
+        /**
+         * @brief Append a byte range of a file to the payload.
+         * @param file_fd The file to read from.
+         * @param range The byte range to send.
+         * @return true on success.
+         * @note Uses sendfile() for the bodies; with checksums enabled the bytes
+         *       have to be read to be checksummed, so pread() + write is used instead.
+         */
+        bool write_file(int file_fd, const ShardRange &range);
+
+        /**
+         * @brief Terminate the payload with an End frame.
+         * @return true on success.
+         */
+        bool finish();
+
+        /// Frames queued on the ring before a batch is submitted.
+        static constexpr std::size_t batch_frames = 32;
+
+    private:
+        // A frame waiting for its batch; the body is not copied and must outlive it.
+        struct Queued {
+            std::array<unsigned char, HamonFrame::header_size> head;
+            std::array<iovec, 2> iov;
+            msghdr message;
+        };
+
+        bool write_frame(FrameType type, std::string_view body);
+
+        bool send_batch();
+
+        int fd;
+        bool checksums;
+        std::size_t max_frame;
+        IoUring *ring;
+        std::deque<Queued> queued;
+    };
+
+    /**
+     * @brief Receives one payload frame by frame.
+     */
+    class FrameReader {
+    public:
+        /**
+         * @brief Create a reader on a connected socket.
+         * @param p_fd The socket to read from.
+         */
+        explicit FrameReader(int p_fd);
+
+        /**
+         * @brief Read the next Data frame.
+         * @param frame Receives the body of the frame (previous content is replaced).
+         * @return true if a frame was read, false at the End frame or on error (see failed()).
+         */
+        bool next(std::string &frame);
+
+        /**
+         * @brief Read every remaining frame and append their bodies.
+         * @param out Receives the payload bytes.
+         * @return true if the payload was read up to its End frame.
+         */
+        bool read_payload(std::string &out);
+
+        /**
+         * @brief Whether the stream ended abnormally (I/O error, bad frame, checksum mismatch).
+         * @return true on failure.
+         */
+        [[nodiscard]] bool failed() const;
+
+    private:
+        bool next_into(std::string &out, std::size_t at);
+
+        int fd;
+        bool ended;
+        bool error;
+    };
+
+    /**
+     * @brief Receives payloads from a socket without blocking, as bytes arrive.
+     *
+     * The counterpart of FrameReader for event loops: poll() reads whatever the socket
+     * holds (recv with MSG_DONTWAIT) and keeps partial headers and bodies between calls.
+     * Callers with their own reads (io_uring) fill next_buffer() and call advance().
+     * Payloads are decoded back to back on the same stream; a socket must not be read
+     * by a FrameReader while an assembler is in the middle of a payload.
+     */
+    class FrameAssembler {
+    public:
+        /**
+         * @brief Read the bytes available on the socket.
+         * @param fd The socket.
+         * @param out Receives the payload once it is Complete (previous content is replaced).
+         * @return Complete, Pending (socket drained, payload unfinished) or Failed.
+         */
+        ReceiveStatus poll(int fd, std::string &out);
+
+        /**
+         * @brief Where the next bytes of the stream go, for callers that read the socket themselves.
+         * @return The rest of the current frame header or body; never empty.
+         */
+        std::span<char> next_buffer();
+
+        /**
+         * @brief Account for bytes written into next_buffer().
+         * @param n Number of bytes written (at most the buffer's size).
+         * @param out Receives the payload once it is Complete (previous content is replaced).
+         * @return Complete, Pending (call next_buffer() again) or Failed.
+         */
+        ReceiveStatus advance(std::size_t n, std::string &out);
+
+    private:
+        bool finish_body();
+
+        std::array<unsigned char, HamonFrame::header_size> head{};
+        std::size_t head_got = 0;
+        FrameHeader header{};
+        bool in_body = false;
+        std::size_t body_start = 0;
+        std::size_t body_got = 0;
+        std::string payload;
+    };
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <libintl.h>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#ifndef I18N_GETTEXT_DEFINED
+#define _(String) gettext(String)
+#define I18N_GETTEXT_DEFINED
+#endif
+
+namespace dualys {
+    /**
+     * @brief One request to a daemon: a job, or the order to stop.
+     */
+    struct JobRequest {
+        /// What to compute; "wordcount" is the only operator so far.
+        std::string op = "wordcount";
+        /// Absolute path of the job's input, as seen by the daemon.
+        std::string input;
+        /// Stop the daemon instead of running a job.
+        bool shutdown = false;
+    };
+
+    /**
+     * @brief Local submission of jobs to a warm cluster (`hamon daemon` / `hamon submit`).
+     *
+     * Node 0 of a daemon accepts clients on a Unix stream socket. A client writes one
+     * request line, "<operator> <input path>" or "shutdown"; the daemon answers with a
+     * status line, "ok" or "error <reason>", followed by the job's output, and closes
+     * the connection.
+     */
+    class HamonJobs {
+    public:
+        /// Operators a daemon can run.
+        static constexpr std::string_view word_count = "wordcount";
+
+        /// Longest a daemon waits for a connected client's request, in milliseconds.
+        static constexpr int request_timeout_ms = 5000;
+
+        /**
+         * @brief Default path of the job socket: `$XDG_RUNTIME_DIR/hamon.sock`, or
+         *        `/tmp/hamon-<uid>.sock` without a runtime directory.
+         * @return The path.
+         */
+        [[nodiscard]] static std::string default_socket_path();
+
+        /**
+         * @brief Create the listening job socket, readable and writable by its owner only.
+         * @param path Where to bind it. A stale socket left by a dead daemon is replaced.
+         * @return The blocking, close-on-exec socket, or -1 on error (including a daemon
+         *         still answering on that path).
+         */
+        [[nodiscard]] static int listen(const std::string &path);
+
+        /**
+         * @brief Format a request line.
+         * @param request The request.
+         * @return The line, newline included.
+         */
+        [[nodiscard]] static std::string encode(const JobRequest &request);
+
+        /**
+         * @brief Parse a request line.
+         * @param line The line, without its newline.
+         * @param request Receives the request.
+         * @return false if the line is neither "shutdown" nor a known operator followed by a path.
+         */
+        static bool decode(std::string_view line, JobRequest &request);
+
+        /**
+         * @brief Read a client's request (daemon side).
+         * @param client The accepted connection.
+         * @param request Receives the request.
+         * @return false if no valid line arrived within request_timeout_ms.
+         */
+        static bool read_request(int client, JobRequest &request);
+
+        /**
+         * @brief Answer a client (daemon side).
+         * @param client The accepted connection.
+         * @param ok Whether the request succeeded.
+         * @param body The job's output, or the reason of the error.
+         * @return false if the client went away.
+         */
+        static bool reply(int client, bool ok, std::string_view body);
+
+        /**
+         * @brief Submit a request and copy the daemon's answer (client side).
+         * @param path The daemon's job socket.
+         * @param request The request.
+         * @param out Receives the job's output.
+         * @param error Receives the reason when the request fails.
+         * @return true if the daemon answered "ok".
+         */
+        static bool submit(const std::string &path, const JobRequest &request, std::ostream &out, std::string &error);
+    };
+}
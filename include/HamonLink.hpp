@@ -0,0 +1,202 @@
+#pragma once
+#include <libintl.h>
+#include "HamonFrame.hpp"
+#include "HamonQueue.hpp"
+#include "HamonRing.hpp"
+#include "HamonShard.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+
+#ifndef I18N_GETTEXT_DEFINED
+#define _(String) gettext(String)
+#define I18N_GETTEXT_DEFINED
+#endif
+
+namespace dualys {
+    /**
+     * @brief Long-lived connection to one peer, reused by every phase of every job.
+     *
+     * Design notes:
+     * - The socket is opened and handshaken once, when the node sets up its mesh.
+     * - Sends are queued and written by the link's own sender thread, so a node can
+     *   send to several peers at once and receive while its own payload is still
+     *   going out. Each direction is a FIFO stream of framed payloads: both ends
+     *   follow the same phase order, so payloads never need to be tagged.
+     * - Receives are synchronous, on the caller's thread.
+     * - Between two processes on the same host, negotiate_transport() can move the
+     *   payloads onto a pair of shared-memory rings (ShmChannel); the socket then only
+     *   serves to detect a peer that went away.
+     * - Between two nodes running as threads of one process, the link has no socket:
+     *   payloads are moved through a LocalChannel and sends need no sender thread.
+     */
+    class PeerLink {
+    public:
+        /**
+         * @brief Take ownership of a connected, handshaken socket.
+         * @param p_fd The socket.
+         * @param p_peer_id ID of the node at the other end.
+         * @param p_checksums Whether to attach a CRC-32 to every frame sent (TCP only:
+         *        shared-memory payloads never cross a wire).
+         * @param p_backend IoBackend::Uring gives the sender thread its own io_uring, on
+         *        which the frames of a payload go out as one batch of linked sends.
+         */
+        PeerLink(int p_fd, int p_peer_id, bool p_checksums, IoBackend p_backend = IoBackend::Epoll);
+
+        /**
+         * @brief Link to a node running as a thread of the same process.
+         * @param p_local This node's end of the channel (see LocalMesh).
+         * @param p_peer_id ID of the node at the other end.
+         */
+        PeerLink(std::unique_ptr<LocalChannel> p_local, int p_peer_id);
+
+        /**
+         * @brief Send everything still queued, then close the socket.
+         */
+        ~PeerLink();
+
+        PeerLink(const PeerLink &) = delete;
+
+        PeerLink &operator=(const PeerLink &) = delete;
+
+        /**
+         * @brief Agree with the peer on how payloads travel, before the first send.
+         * @param initiator true on the side that connected; it offers a shared-memory segment.
+         * @param ring_bytes Size of each ring direction; 0 keeps the link on TCP.
+         * @return false if the socket failed during the negotiation.
+         * @note Both ends must call this at the same point. Shared memory is only offered
+         *       when ShmChannel::same_host() holds and the segment can be allocated; in
+         *       every other case the link stays on TCP.
+         */
+        bool negotiate_transport(bool initiator, std::size_t ring_bytes);
+
+        /**
+         * @brief Whether payloads go through shared memory rather than the socket.
+         * @return true after a successful shared-memory negotiation.
+         */
+        [[nodiscard]] bool uses_shared_memory() const;
+
+        /**
+         * @brief Whether the peer runs in this process (payloads move through a LocalChannel).
+         * @return true for links built from a LocalChannel.
+         */
+        [[nodiscard]] bool in_process() const;
+
+        /**
+         * @brief Queue a payload; it is framed and written by the sender thread.
+         * @param payload The bytes to send.
+         */
+        void send(std::string payload);
+
+        /**
+         * @brief Queue a byte range of a file, sent with sendfile().
+         * @param file_fd The file; must stay open until flush() returns.
+         * @param range The range to send.
+         */
+        void send_file_range(int file_fd, const ShardRange &range);
+
+        /**
+         * @brief Receive the next payload from the peer.
+         * @param out Receives the payload.
+         * @return true if a whole payload arrived and all its checksums matched.
+         */
+        bool receive(std::string &out);
+
+        /**
+         * @brief Receive without blocking, for the node's event loop.
+         * @param out Receives the payload once it is Complete (previous content is replaced).
+         * @return Complete, Pending (wait until socket_fd() is readable and poll again) or Failed.
+         * @note Must not be mixed with receive() in the middle of a payload.
+         */
+        ReceiveStatus poll_receive(std::string &out);
+
+        /**
+         * @brief Where the next incoming TCP bytes go, for callers that read socket_fd() themselves.
+         * @return The rest of the current frame header or body (see FrameAssembler::next_buffer()).
+         * @note Not for shared-memory or in-process links: use poll_receive().
+         */
+        std::span<char> receive_buffer();
+
+        /**
+         * @brief Account for bytes read into receive_buffer().
+         * @param n Number of bytes read.
+         * @param out Receives the payload once it is Complete.
+         * @return Complete, Pending (read into receive_buffer() again) or Failed.
+         */
+        ReceiveStatus received(std::size_t n, std::string &out);
+
+        /**
+         * @brief Wait until every queued payload has been written to the socket.
+         * @return false if a send failed since the link was opened.
+         */
+        bool flush();
+
+        /**
+         * @brief Like flush(), but give up at a deadline.
+         * @param deadline When to give up.
+         * @return false if a send failed or the queue was not drained in time.
+         */
+        bool flush_until(std::chrono::steady_clock::time_point deadline);
+
+        /**
+         * @brief Shut the socket down: pending and future sends fail at once, and the peer
+         *        sees a hang-up instead of waiting for data that will never come.
+         */
+        void abort();
+
+        /**
+         * @brief The socket, for readiness notifications (shared-memory links ring it too).
+         * @return The file descriptor; for in-process links, the channel's doorbell.
+         */
+        [[nodiscard]] int socket_fd() const;
+
+        /**
+         * @brief ID of the node at the other end.
+         * @return The peer ID.
+         */
+        [[nodiscard]] int peer() const;
+
+        /**
+         * @brief Set the options every mesh socket uses.
+         * @param fd The socket.
+         * @param buffer_bytes SO_SNDBUF/SO_RCVBUF size; 0 keeps the kernel's autotuning.
+         * @note TCP_NODELAY is always set: payloads are written as whole frames, so
+         *       Nagle's algorithm would only delay the last segment of each one.
+         *       Fixed buffer sizes are capped by net.core.wmem_max/rmem_max and disable
+         *       autotuning; they must be set before connect()/listen() to affect the
+         *       window scale.
+         */
+        static void tune_socket(int fd, int buffer_bytes);
+
+    private:
+        struct Outgoing {
+            std::string payload;
+            int file_fd = -1;
+            ShardRange range{};
+        };
+
+        void enqueue(Outgoing item);
+
+        void sender_loop(const std::stop_token &stop);
+
+        int fd;
+        int peer_id;
+        bool checksums;
+        std::unique_ptr<ShmChannel> channel;
+        std::unique_ptr<LocalChannel> local;
+        std::unique_ptr<IoUring> ring;
+        FrameAssembler assembler;
+        std::mutex mutex;
+        std::condition_variable_any queue_changed;
+        std::deque<Outgoing> queue;
+        bool sending;
+        bool failed;
+        std::jthread sender;
+    };
+}
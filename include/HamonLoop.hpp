@@ -0,0 +1,271 @@
+#pragma once
+#include <libintl.h>
+#include "HamonUring.hpp"
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <list>
+#include <map>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+#ifndef I18N_GETTEXT_DEFINED
+#define _(String) gettext(String)
+#define I18N_GETTEXT_DEFINED
+#endif
+
+namespace dualys {
+    /// Point in time after which a wait gives up.
+    using Deadline = std::chrono::steady_clock::time_point;
+
+    /**
+     * @brief Lazily started coroutine producing a T; awaiting it runs it to completion.
+     *
+     * The awaiting coroutine is resumed directly when the task finishes (symmetric
+     * transfer), so chains of tasks do not grow the stack. Tasks are single-threaded:
+     * they are resumed by the EventLoop that runs them.
+     *
+     * @note GCC 12 miscompiles co_await inside an if condition (the awaiter or its
+     *       temporaries are not kept in the frame): bind the result to a local first.
+     */
+    template<class T>
+    class Task {
+    public:
+        struct promise_type {
+            T value{};
+            std::coroutine_handle<> continuation;
+
+            Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            auto final_suspend() noexcept {
+                struct ResumeContinuation {
+                    bool await_ready() noexcept { return false; }
+
+                    std::coroutine_handle<> await_suspend(const std::coroutine_handle<promise_type> self) noexcept {
+                        const std::coroutine_handle<> next = self.promise().continuation;
+                        return next ? next : std::noop_coroutine();
+                    }
+
+                    void await_resume() noexcept {
+                    }
+                };
+                return ResumeContinuation{};
+            }
+
+            void return_value(T v) { value = std::move(v); }
+
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+
+        Task(Task &&other) noexcept : handle(std::exchange(other.handle, {})) {
+        }
+
+        Task &operator=(Task &&) = delete;
+
+        ~Task() {
+            if (handle) handle.destroy();
+        }
+
+        bool await_ready() const noexcept { return false; }
+
+        std::coroutine_handle<> await_suspend(const std::coroutine_handle<> awaiting) noexcept {
+            handle.promise().continuation = awaiting;
+            return handle;
+        }
+
+        T await_resume() { return std::move(handle.promise().value); }
+
+    private:
+        friend class EventLoop;
+
+        explicit Task(const std::coroutine_handle<promise_type> h) : handle(h) {
+        }
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    /**
+     * @brief Single-threaded reactor that drives Task coroutines.
+     *
+     * Coroutines suspend on a file descriptor (readable / writable) or on a timer, each
+     * wait with a deadline; the loop sleeps in epoll_wait until one of them is due and
+     * resumes it. Nothing blocks the loop except the coroutines' own work, so one node
+     * can wait on several peers at once.
+     *
+     * With IoBackend::Uring the loop sleeps in io_uring_enter instead: waits become
+     * poll operations, and receive() / accept() hand the transfer itself to the kernel,
+     * so a coroutine is resumed with its bytes (or connection) already there. All the
+     * operations queued while coroutines run go out in the loop's next system call.
+     */
+    class EventLoop {
+    public:
+        /**
+         * @brief One suspended coroutine, owned by the awaiter in its frame.
+         */
+        struct Waiter {
+            std::coroutine_handle<> handle;
+            int fd = -1;
+            bool ready = false;
+            bool timed = false;
+            /// An io_uring operation for this waiter has not completed yet.
+            bool in_kernel = false;
+            /// Result of that operation (bytes, poll mask, descriptor; -errno on failure).
+            int result = 0;
+            std::multimap<Deadline, Waiter *>::iterator timer;
+        };
+
+        /**
+         * @brief Awaitable returned by readable(), writable() and sleep_until().
+         */
+        class Wait {
+        public:
+            Wait(EventLoop &p_loop, int p_fd, std::uint32_t p_events, Deadline p_deadline);
+
+            bool await_ready() const noexcept { return false; }
+
+            bool await_suspend(std::coroutine_handle<> handle);
+
+            /// true if the descriptor became ready, false if the deadline passed first.
+            bool await_resume() const noexcept { return waiter.ready; }
+
+        private:
+            EventLoop &loop;
+            std::uint32_t events;
+            Deadline deadline;
+            Waiter waiter;
+        };
+
+        /**
+         * @brief Create a loop.
+         * @param p_backend Epoll, or Uring / Auto to use io_uring when the kernel supports it.
+         */
+        explicit EventLoop(IoBackend p_backend = IoBackend::Epoll);
+
+        ~EventLoop();
+
+        EventLoop(const EventLoop &) = delete;
+
+        EventLoop &operator=(const EventLoop &) = delete;
+
+        /**
+         * @brief Run a task and every coroutine it waits on until it finishes.
+         * @param task The root task.
+         * @return The task's result; false if the loop itself failed.
+         */
+        bool run(Task<bool> task);
+
+        /**
+         * @brief Wait until a descriptor can be read (or was hung up).
+         * @param fd The descriptor.
+         * @param deadline When to give up.
+         * @return An awaitable yielding false on timeout.
+         */
+        [[nodiscard]] Wait readable(int fd, Deadline deadline);
+
+        /**
+         * @brief Wait until a descriptor can be written (or a connect() finished).
+         * @param fd The descriptor.
+         * @param deadline When to give up.
+         * @return An awaitable yielding false on timeout.
+         */
+        [[nodiscard]] Wait writable(int fd, Deadline deadline);
+
+        /**
+         * @brief Suspend until a point in time.
+         * @param deadline When to resume.
+         * @return An awaitable.
+         */
+        [[nodiscard]] Wait sleep_until(Deadline deadline);
+
+        /**
+         * @brief Receive until a buffer is full.
+         * @param fd A connected socket.
+         * @param buffer Destination.
+         * @param deadline When to give up.
+         * @return Number of bytes received; less than the buffer's size on end of stream,
+         *         error or timeout.
+         */
+        Task<std::size_t> receive(int fd, std::span<char> buffer, Deadline deadline);
+
+        /**
+         * @brief Accept one connection.
+         * @param fd A listening socket (non-blocking for the epoll backend).
+         * @param deadline When to give up.
+         * @return The new socket (close-on-exec), or -errno (-ETIMEDOUT at the deadline).
+         * @note With io_uring a multishot accept stays armed between calls, until
+         *       stop_accepting().
+         */
+        Task<int> accept(int fd, Deadline deadline);
+
+        /**
+         * @brief Stop accepting on a socket: cancel pending accepts and close connections
+         *        accepted but not yet returned by accept().
+         * @param fd The listening socket.
+         * @note Call it before closing the socket, and not while an accept() on it is suspended.
+         */
+        void stop_accepting(int fd);
+
+        /**
+         * @brief Backend in use, once Auto was resolved.
+         * @return Epoll or Uring.
+         */
+        [[nodiscard]] IoBackend backend() const;
+
+        /**
+         * @brief Run several tasks concurrently.
+         * @param tasks The tasks; all of them run to completion, even after one fails.
+         * @return true if every task returned true.
+         */
+        static Task<bool> all(std::vector<Task<bool> > tasks);
+
+        /**
+         * @brief Deadline a number of milliseconds from now.
+         * @param milliseconds The delay; 0 or less means no deadline.
+         * @return The deadline.
+         */
+        [[nodiscard]] static Deadline deadline_in(int milliseconds);
+
+    private:
+        class Operation;
+
+        class AcceptWait;
+
+        // A listening socket with a multishot accept in the ring.
+        struct Listener {
+            int fd = -1;
+            bool multishot = true;
+            bool armed = false;
+            bool stopped = false;
+            int error = 0;
+            std::deque<int> ready;
+            Waiter *waiting = nullptr;
+        };
+
+        void track(Waiter &waiter, Deadline deadline);
+
+        void complete(Waiter &waiter, bool ready);
+
+        void expire(Waiter &waiter);
+
+        void dispatch(std::uint64_t user_data, std::int32_t result, std::uint32_t flags);
+
+        void accepted(Listener &listener, std::int32_t result, std::uint32_t flags);
+
+        Listener &listener_for(int fd);
+
+        bool poll_events(int timeout_ms);
+
+        std::unique_ptr<IoUring> ring;
+        std::list<Listener> listeners;
+        int epoll_fd;
+        std::multimap<Deadline, Waiter *> timers;
+        std::size_t suspended;
+    };
+}
@@ -0,0 +1,223 @@
+#pragma once
+#include <libintl.h>
+#include "HamonCount.hpp"
+#include "HamonSpill.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifndef I18N_GETTEXT_DEFINED
+#define _(String) gettext(String)
+#define I18N_GETTEXT_DEFINED
+#endif
+
+namespace dualys {
+    /**
+     * @brief Fixed set of threads that count the pieces of one chunk in turn.
+     *
+     * Started once and reused for every piece (HamonMap::count_into), instead of
+     * starting and joining a thread per table for each piece. The calling thread is
+     * the first worker.
+     */
+    class MapWorkers {
+    public:
+        /**
+         * @brief Start the helper threads.
+         * @param p_threads Workers, the caller included: p_threads - 1 threads are started.
+         */
+        explicit MapWorkers(unsigned p_threads);
+
+        ~MapWorkers();
+
+        MapWorkers(const MapWorkers &) = delete;
+
+        MapWorkers &operator=(const MapWorkers &) = delete;
+
+        /// Workers, the caller included.
+        [[nodiscard]] std::size_t size() const { return helpers.size() + 1; }
+
+        /**
+         * @brief Run job(0) ... job(k - 1) at the same time, job(0) on the calling thread.
+         * @param k Jobs; only the first size() run.
+         * @param p_job The job; called with the worker's index.
+         * @note Returns once every job has returned.
+         */
+        void run(std::size_t k, const std::function<void(std::size_t)> &p_job);
+
+    private:
+        void helper_loop(std::size_t index);
+
+        std::vector<std::thread> helpers;
+        const std::function<void(std::size_t)> *job;
+        std::size_t width;
+        std::size_t running;
+        std::uint64_t round;
+        bool stopping;
+        std::mutex mutex;
+        std::condition_variable changed;
+    };
+
+    /**
+     * @brief Multithreaded map phase of one node.
+     *
+     * The chunk is cut into word-aligned sub-chunks (HamonShard::split). Each thread
+     * owns a contiguous run of them and counts into its own WordCountTable; a thread
+     * that runs out of work steals sub-chunks from the other threads' runs. The
+     * thread-local tables are then combined with WordCountTable::merge_parallel, so
+     * the node enters the reduce with a single table.
+     */
+    class HamonMap {
+    public:
+        /// Smallest sub-chunk worth handing to a thread.
+        static constexpr std::size_t min_subchunk = 256 * 1024;
+
+        /// Sub-chunks per thread, so that stealing can even out slow threads.
+        static constexpr std::size_t subchunks_per_thread = 8;
+
+        /**
+         * @brief Number of CPUs this process may run on (its sched_getaffinity mask).
+         * @return At least 1.
+         */
+        [[nodiscard]] static unsigned pinned_cpu_count();
+
+        /**
+         * @brief Thread count to use for a node's map.
+         * @param configured The configured count (NodeConfig::map_threads); <= 0 means auto.
+         * @return configured if > 0, pinned_cpu_count() otherwise.
+         */
+        [[nodiscard]] static unsigned resolve_threads(int configured);
+
+        /**
+         * @brief Count the words of a chunk on several threads.
+         * @param text The chunk.
+         * @param threads Number of threads; 1 counts on the calling thread.
+         * @return The merged word counts.
+         * @note Chunks too small to give every thread a min_subchunk use fewer threads.
+         */
+        [[nodiscard]] static WordCountTable count(std::string_view text, unsigned threads);
+
+        /**
+         * @brief Count a chunk within a memory budget.
+         * @param text The chunk.
+         * @param threads Number of threads.
+         * @param spills Where the tables are spilled (RunStore::spill_if_over) when they grow
+         *        past the budget; checked after every StreamingCount::piece_bytes of text.
+         * @param budget Memory budget of the tables in bytes.
+         * @return The counts not spilled yet; the whole result is these plus the runs.
+         */
+        [[nodiscard]] static WordCountTable count(std::string_view text, unsigned threads, RunStore &spills,
+                                                  std::size_t budget);
+
+        /**
+         * @brief Count the words of a chunk into existing per-thread tables.
+         * @param text The chunk; must end on a word boundary.
+         * @param tables One table per thread (at least one); thread t adds to tables[t].
+         * @param workers If set, the threads to count on (at most workers->size() of them);
+         *        otherwise a thread is started per table for this call.
+         * @note Same splitting and stealing as count(), without the final merge, so that
+         *       successive pieces of one chunk accumulate in the same tables.
+         */
+        static void count_into(std::string_view text, std::vector<WordCountTable> &tables,
+                               MapWorkers *workers = nullptr);
+
+        /**
+         * @brief Combine per-thread tables into one.
+         * @param tables The tables; empty ones (threads that got no work) are skipped.
+         * @return Their sum (WordCountTable::merge_parallel when more than one holds words).
+         */
+        [[nodiscard]] static WordCountTable combine(std::vector<WordCountTable> tables);
+
+        /**
+         * @brief Combine any number of tables on at most a given number of threads.
+         * @param tables The tables, e.g. one per range kept under speculation.
+         * @param threads The node's map threads.
+         * @return Their sum.
+         * @note Surplus tables are first folded into `threads` groups, one thread per group, so the
+         *       parallel merge neither starts a thread per table nor presizes for the sum of them all.
+         */
+        [[nodiscard]] static WordCountTable combine(std::vector<WordCountTable> tables, unsigned threads);
+    };
+
+    /**
+     * @brief Map phase fed piece by piece while the chunk is still arriving.
+     *
+     * feed() hands a piece to a counting thread and returns at once, so the caller can
+     * receive the next piece while this one is counted (double buffering: the caller gets
+     * back the buffer of the previous piece to receive into). Pieces may cut words
+     * anywhere: the bytes after a piece's last delimiter are carried over and counted
+     * with the start of the next piece.
+     */
+    class StreamingCount {
+    public:
+        /// Size of the pieces a coordinator sends a streamed chunk in (a few frames each).
+        static constexpr std::size_t piece_bytes = std::size_t{4} << 20;
+
+        /**
+         * @brief Start the counting thread and its MapWorkers.
+         * @param p_threads Threads counting each piece (HamonMap::count_into).
+         * @param p_spills If set, the tables are spilled there after any piece that takes
+         *        them past the budget (RunStore::spill_if_over); finish() and cut() then
+         *        only return what was not spilled.
+         * @param p_budget Memory budget of the tables in bytes, with p_spills.
+         */
+        explicit StreamingCount(unsigned p_threads, RunStore *p_spills = nullptr, std::size_t p_budget = 0);
+
+        ~StreamingCount();
+
+        StreamingCount(const StreamingCount &) = delete;
+
+        StreamingCount &operator=(const StreamingCount &) = delete;
+
+        /**
+         * @brief Queue the next piece of the chunk.
+         * @param piece The piece; swapped with an already counted buffer (cleared), which the
+         *        caller can reuse for the following piece.
+         * @note Waits only while the previous piece is still being counted.
+         */
+        void feed(std::string &piece);
+
+        /**
+         * @brief Count what is left and return the counts of the whole chunk.
+         * @return The merged counts; the object must not be fed afterwards.
+         */
+        [[nodiscard]] WordCountTable finish();
+
+        /**
+         * @brief Close the current chunk and start a new one on the same thread.
+         * @return The merged counts of everything fed since the previous cut (or the start).
+         * @note Waits for the last piece to be counted; a word is never joined across a cut.
+         */
+        [[nodiscard]] WordCountTable cut();
+
+        /**
+         * @brief Counting speed measured so far.
+         * @return Bytes counted per second of counting; 0 before the first piece is done.
+         */
+        [[nodiscard]] double throughput() const;
+
+    private:
+        void count_piece(std::string_view text);
+
+        void counter_loop();
+
+        std::vector<WordCountTable> tables;
+        RunStore *spills;
+        std::size_t budget;
+        std::string carry;
+        std::string pending;
+        bool has_pending;
+        bool stopping;
+        std::size_t bytes_counted;
+        double seconds_counting;
+        mutable std::mutex mutex;
+        std::condition_variable changed;
+        MapWorkers workers;
+        std::thread counter;
+    };
+}
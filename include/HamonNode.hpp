@@ -1,15 +1,119 @@
 #pragma once
 #include <libintl.h>
+#include "HamonCodec.hpp"
+#include "HamonCollectives.hpp"
 #include "HamonCube.hpp"
+#include "HamonFrame.hpp"
+#include "HamonJobs.hpp"
+#include "HamonLink.hpp"
+#include "HamonLoop.hpp"
+#include "HamonQueue.hpp"
+#include "HamonShard.hpp"
+#include "HamonSpill.hpp"
+#include <chrono>
 #include <map>
+#include <memory>
+#include <ostream>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 #ifndef I18N_GETTEXT_DEFINED
 #define _(String) gettext(String)
 #define I18N_GETTEXT_DEFINED
 #endif
 namespace dualys {
-    using WordCountMap = std::map<std::string, int>;
+    /**
+     * @brief How workers obtain their input chunk.
+     */
+    enum class InputMode {
+        /// The coordinator streams each chunk to its worker over TCP (sendfile).
+        Stream,
+        /// All nodes see the input file; the coordinator only sends (path, offset, length)
+        /// descriptors and each worker reads and aligns its own range.
+        Shared
+    };
+
+    /**
+     * @brief How the per-node counts are combined after the map.
+     */
+    enum class ReduceMode {
+        /// Pairwise merges along the hypercube dimensions onto node 0, which ends with every key.
+        Tree,
+        /// Reduce-scatter: every key is routed to node WordCountTable::owner_of(hash, N), so
+        /// each node ends with a disjoint, fully reduced partition.
+        Shuffle,
+        /// Recursive doubling: partners swap their whole tables in every dimension, so all N
+        /// nodes hold the full result after log2(N) steps. Ring and torus clusters, which
+        /// lack those links, run RingAllReduce instead.
+        AllReduce,
+        /// Ring reduce-scatter then ring allgather: 2(N - 1) steps, each moving about 1/N of
+        /// the table per link, so a link's traffic stays flat as N grows (large tables).
+        RingAllReduce
+    };
+
+    /**
+     * @brief Runtime options shared by every node of a word-count run.
+     * @note The orchestrator fills this from the command line and hands the same
+     *       copy to every node, so all nodes agree on the settings.
+     */
+    struct NodeOptions {
+        /// Path of the input corpus, read by the coordinator.
+        std::string input_file = "input.txt";
+        /// How workers obtain their chunk of the input.
+        InputMode input_mode = InputMode::Stream;
+        /// Workers pull small ranges from node 0 as they finish, sized to their measured
+        /// throughput (ChunkDispenser), instead of receiving one weighted share each.
+        bool dynamic_chunks = false;
+        /// With dynamic_chunks: once the input is handed out, give idle nodes duplicates of
+        /// ranges that fall well behind the median throughput, and keep the first result.
+        bool speculative = false;
+        /// Attach a CRC-32 to every frame sent between nodes.
+        bool frame_checksums = false;
+        /// Encoding of the word-count maps exchanged during the reduce.
+        WireFormat wire_format = WireFormat::Binary;
+        /// How the per-node counts are combined.
+        ReduceMode reduce_mode = ReduceMode::Tree;
+        /// Shuffle mode only: also merge the partitions onto node 0 afterwards (tree reduce).
+        bool gather = false;
+        /// Tree mode only: broadcast node 0's result back to every node after the reduce.
+        bool broadcast = false;
+        /// SO_SNDBUF/SO_RCVBUF of the mesh sockets; 0 keeps the kernel's autotuning.
+        int socket_buffer_bytes = 0;
+        /// Size of each direction of the shared-memory rings used between nodes on the same
+        /// host; 0 keeps every link on TCP. Frame checksums only apply to TCP links.
+        std::size_t shm_ring_bytes = ShmChannel::default_ring_bytes;
+        /// Longest a phase (mesh setup, map, reduce, final flush) may wait on its peers, in
+        /// milliseconds; 0 waits forever. A node that misses it fails and hangs up its links.
+        int phase_timeout_ms = 120000;
+        /// How the node's event loop, link senders and shared-input reads do their I/O;
+        /// Auto picks io_uring when the kernel supports it.
+        IoBackend io_backend = IoBackend::Auto;
+        /// If set, every node holding results writes them to `<output_dir>/part-<id>.txt`.
+        std::string output_dir;
+        /// Memory budget of each node's counts in bytes; 0 = unbounded. Past half of it the
+        /// counting tables are spilled as sorted runs (RunStore), merged during the reduce.
+        std::size_t memory_budget = 0;
+        /// Directory of the spilled runs; empty for the system's temporary directory.
+        std::string spill_dir;
+        /// When the orchestrator launched the nodes, for the startup time; left at the epoch,
+        /// each node measures from the start of its own run().
+        std::chrono::steady_clock::time_point launch_time{};
+    };
+
+    /**
+     * @brief Wall-clock duration of the phases of one node's run.
+     */
+    struct PhaseTimings {
+        /// From the launch (NodeOptions::launch_time) until every node is linked and past
+        /// the startup barrier, i.e. until the map can start.
+        double startup_seconds = 0;
+        /// Input distribution and local counting.
+        double map_seconds = 0;
+        /// From the end of the map until this node holds its final counts (reduce, shuffle,
+        /// allreduce, plus the broadcast or gather when requested).
+        double reduce_seconds = 0;
+    };
 
     class HamonNode {
     public:
@@ -25,14 +129,25 @@ namespace dualys {
          * @param p_topology_node The Node instance representing this node's topology.
          * @param p_cube The HamonCube instance representing the overall hypercube structure.
          * @param p_configs A vector of NodeConfig instances containing configuration details for all nodes
+         * @param p_options Runtime options of the run (input path, ...).
+         * @param p_mesh For nodes running as threads of one process: the channels linking
+         *        them, used instead of a server socket and TCP connections; it must outlive
+         *        the node. nullptr for a node in its own process.
          */
-        HamonNode(Node p_topology_node, HamonCube p_cube, const std::vector<NodeConfig> &p_configs);
+        HamonNode(Node p_topology_node, HamonCube p_cube, const std::vector<NodeConfig> &p_configs,
+                  NodeOptions p_options = {}, LocalMesh *p_mesh = nullptr);
 
         /**
          * @brief Print the final word count results to the console.
          */
         void print_final_results() const;
 
+        /**
+         * @brief Print the final word count results (node 0 only).
+         * @param out Where to print them: the console, or a job's reply in daemon mode.
+         */
+        void print_final_results(std::ostream &out) const;
+
         /**
          * @brief Close the server socket.
          * @return true if the socket was closed successfully, false otherwise.
@@ -40,12 +155,41 @@ namespace dualys {
         [[nodiscard]] bool close_server_socket() const;
 
         /**
-         * @brief Send a string over a socket.
+         * @brief Send a string over a socket as one framed payload.
          * @param sock The socket file descriptor to send the string through.
          * @param str The string to send.
-         * @note This function handles sending the length of the string first, followed by the string data itself.
+         * @param checksums Whether to attach a CRC-32 to every frame.
+         * @return true if the whole payload was sent, false otherwise.
+         * @note The payload is split into Data frames with 64-bit lengths and terminated by an End frame (see FrameWriter).
+         */
+        static bool send_string(int sock, std::string_view str, bool checksums = false);
+
+        /**
+         * @brief Send a byte range of a file over a socket without copying it through user space.
+         * @param sock The socket file descriptor to send through.
+         * @param file_fd The file descriptor to read from.
+         * @param range The byte range of the file to send.
+         * @param checksums Whether to attach a CRC-32 to every frame.
+         * @return true if the whole range was sent, false otherwise.
+         * @note Uses the same framing as send_string, with sendfile() for the frame bodies.
+         */
+        static bool send_file_range(int sock, int file_fd, const ShardRange &range, bool checksums = false);
+
+        /**
+         * @brief Create a TCP socket listening on a port of every interface.
+         * @param port The port.
+         * @param buffer_bytes SO_SNDBUF/SO_RCVBUF inherited by accepted sockets (see PeerLink::tune_socket).
+         * @return The non-blocking, close-on-exec socket, or -1 on error.
+         * @note The orchestrator calls this for every node before forking, so a node's server
+         *       is listening before any peer tries to connect to it.
          */
-        static void send_string(int sock, const std::string &str);
+        [[nodiscard]] static int listen_on(int port, int buffer_bytes);
+
+        /**
+         * @brief Use an already listening socket as the node's server (see listen_on()).
+         * @param fd The socket; the node closes it at the end of run().
+         */
+        void adopt_server_socket(int fd);
 
         /**
          * @brief Run the node's main operations: setup server, distribute tasks, perform map and reduce.
@@ -53,6 +197,25 @@ namespace dualys {
          */
         bool run();
 
+        /**
+         * @brief Daemon mode: link the cluster once, then run one job after another until a
+         *        shutdown request.
+         * @param job_fd Node 0: the listening job socket (HamonJobs::listen()); clients are served
+         *        one at a time, each job's output goes back to its client. Ignored by workers,
+         *        which take their jobs from node 0.
+         * @return true after a shutdown request; false if a job or a link failed (the links are
+         *         out of step then, so the whole cluster stops).
+         * @note Between jobs the nodes keep their links, event loop and threads' settings, so a
+         *       job costs its map and reduce only.
+         */
+        bool serve(int job_fd);
+
+        /**
+         * @brief Phase durations of the last run().
+         * @return The timings; zero before run() completes.
+         */
+        [[nodiscard]] const PhaseTimings &timings() const;
+
         /**
          * @brief Serialize a WordCountMap to a string.
          * @param target_map The WordCountMap to serialize.
@@ -69,14 +232,32 @@ namespace dualys {
          */
         static void deserialize_and_merge_map(const std::string &x, WordCountMap &map);
 
+        /**
+         * @brief Encode word counts for the wire in the configured format.
+         * @param counts The table to encode; entries are sorted here, not before.
+         * @param format Binary (HamonCodec) or Text (serialize_map).
+         * @return The payload.
+         */
+        static std::string encode_map(const WordCountTable &counts, WireFormat format);
+
+        /**
+         * @brief Decode a payload produced by encode_map and merge it into a table.
+         * @param payload The received payload.
+         * @param counts The table to merge into.
+         * @param format The format the payload was encoded with.
+         * @return false if the payload is malformed.
+         */
+        static bool decode_and_merge_map(const std::string &payload, WordCountTable &counts, WireFormat format);
+
     private:
         /**
          * @brief Perform the word count task on a given text chunk.
-         * @param text_chunk The chunk of text to process.
-         * @return A WordCountMap containing the word counts from the text chunk.
-         * @note This function splits the text chunk into words based on whitespace and counts occurrences of each word.
+         * @param text_chunk The chunk of text to process (a view into a mapping or a received buffer).
+         * @return A WordCountTable containing the word counts from the text chunk.
+         * @note This function splits the text chunk into words based on whitespace and counts occurrences of each word,
+         *       on the node's map_threads threads (see HamonMap).
          */
-        [[nodiscard]] WordCountMap perform_word_count_task(const std::string &text_chunk) const;
+        [[nodiscard]] WordCountTable perform_word_count_task(std::string_view text_chunk) const;
 
         /**
          * @brief Set up the server socket for incoming connections.
@@ -86,28 +267,368 @@ namespace dualys {
          */
         bool setup_server();
 
+        /**
+         * @brief Start a non-blocking TCP connection to another node of the cluster.
+         * @param id The ID of the node to connect to.
+         * @return The connecting socket (wait for it to become writable), -2 if the peer
+         *         refused at once (not listening yet), or -1 on error.
+         */
+        [[nodiscard]] int start_connect(size_t id) const;
+
+        /**
+         * @brief Exchange Hello frames on a new socket, waiting for the peer's on the event loop.
+         * @param sock The connected or accepted socket.
+         * @return The ID announced by the peer, or -1 if the handshake failed or timed out.
+         */
+        Task<int> greet(int sock);
+
+        /**
+         * @brief Relative input share of every node, used to split the input.
+         * @return One weight per node: its configured map_threads, or 1 when it is automatic
+         *         (the coordinator cannot see the other nodes' affinity masks).
+         */
+        [[nodiscard]] std::vector<size_t> shard_weights() const;
+
         /**
          * @brief Distribute text chunks to neighbor nodes and perform the map operation.
          * @return true if the distribution and mapping were successful, false otherwise.
          * @note This function sends text chunks to neighbor nodes, receives their word count results,
          *       and combines them with the local word count results.
          */
-        bool distribute_and_map();
+        Task<bool> distribute_and_map();
+
+        /**
+         * @brief Worker side of a streamed map: count the chunk piece by piece as it comes down
+         *        the scatter tree (HamonCollectives::receive_scatter).
+         * @return true once the scatter stream ended and everything was counted.
+         * @note Each piece is counted on a StreamingCount thread while the event loop receives
+         *       the next one and forwards the pieces of the node's subtree, so network time
+         *       overlaps with the count.
+         */
+        Task<bool> receive_and_count();
 
         /**
-         * @brief Receive a string from a socket.
+         * @brief Coordinator side of a pull-scheduled map (NodeOptions::dynamic_chunks).
+         * @return true once every worker was told the input is exhausted and node 0 counted
+         *         the ranges it took for itself.
+         * @note Node 0 counts on its own threads, pulling from the same ChunkTracker, while
+         *       its event loop answers the workers' requests.
+         */
+        Task<bool> dispense_chunks();
+
+        /**
+         * @brief Answer one worker's range requests until it is done: told twice that the
+         *        input is exhausted (once per request it keeps in flight) or, with
+         *        speculation, until it reports the end and gets its list of kept ranges.
+         * @param worker The worker's ID.
+         * @param tracker The shared ranges.
+         * @param input The mapped input in stream mode (ranges are sent with sendfile), or
+         *        nullptr in shared mode (ranges are sent as descriptors).
+         * @param path Path of the input, for descriptors.
+         * @return false if the link failed or the worker went quiet until the deadline.
+         * @note With speculation, a request that finds the input handed out but not counted
+         *       waits, checking for stragglers every straggler_poll_ms. The "X <id>" notices for
+         *       ranges the worker lost (ChunkTracker::take_abandoned) are sent from here too, so
+         *       nothing but the loop writes to the worker and a notice never splits a reply.
+         */
+        Task<bool> serve_chunks(int worker, ChunkTracker &tracker, const MappedFile *input, const std::string &path);
+
+        /**
+         * @brief Worker side of a pull-scheduled map: request ranges from node 0 and count them.
+         * @return true once node 0 reported the input exhausted and everything was counted.
+         * @note Two requests stay in flight, so the next range travels while the current one
+         *       is counted; each request carries the worker's counting throughput. With
+         *       speculation each range is counted apart (StreamingCount::cut()) and kept only
+         *       if node 0 lists it at the end; a range another node completed first is
+         *       abandoned between two pieces.
+         */
+        Task<bool> pull_and_count();
+
+        /// Range requests a worker keeps in flight in a pull-scheduled map.
+        static constexpr int pull_depth = 2;
+
+        /// Blocks a node with a memory budget queues to its parent before waiting for the link.
+        static constexpr int spill_flush_blocks = 8;
+
+        /// How often node 0 looks for stragglers while requests wait, in milliseconds.
+        static constexpr int straggler_poll_ms = 5;
+
+        /**
+         * @brief Receive a framed payload from a socket.
          * @param client_socket The socket file descriptor to receive the string from.
-         * @return The received string.
+         * @param out Receives the payload.
+         * @return true if the payload was received up to its End frame and all checksums matched.
+         */
+        static bool receive_string(int client_socket, std::string &out);
+
+        /**
+         * @brief Accept the connections of the mesh neighbors with higher IDs.
+         * @param expected The IDs to wait for.
+         * @return true once all of them are linked; false on error or at the phase deadline.
+         * @note Connections that fail the handshake, or come from other nodes, are closed.
+         */
+        Task<bool> accept_peers(std::vector<int> expected);
+
+        /**
+         * @brief Connect to a mesh neighbor with a lower ID, retrying while its server may not
+         *        be listening yet (backing off from 1 ms to 50 ms, up to the phase deadline).
+         * @param peer The ID of the node to connect to.
+         * @return true once the link is up.
+         */
+        Task<bool> connect_peer(int peer);
+
+        /**
+         * @brief Wrap a handshaken socket into a PeerLink and agree on its transport.
+         * @param peer The ID of the peer.
+         * @param sock The socket; owned by the link afterwards.
+         * @param initiator Whether this node opened the connection.
+         * @return false if the transport negotiation failed.
+         */
+        bool add_link(int peer, int sock, bool initiator);
+
+        /**
+         * @brief Open the node's long-lived links: its neighbors in the topology, along its
+         *        binomial tree and its ring order, and the coordinator (node 0 links to every worker).
+         * @return true if every link was connected and handshaken.
+         * @note Lower IDs are connected to and higher ones accepted, concurrently on the event
+         *       loop; connections always point downwards, so setup cannot deadlock.
+         */
+        Task<bool> connect_mesh();
+
+        /**
+         * @brief Wait until every node of the cluster has linked its mesh.
+         * @return false if a partner failed or stayed silent until the phase deadline.
+         * @note Butterfly form of the dissemination barrier: in round d, each node signals its
+         *       partner across dimension d and waits for the partner's signal. Partners are
+         *       hypercube neighbors, so the barrier reuses the mesh links, and after log2(N)
+         *       rounds every node has transitively heard from all the others. Extra nodes of a
+         *       hypercube (HamonCube::getFoldPartner) signal their core node before its rounds
+         *       and hear back after them. Ring and torus clusters gather an empty piece up the
+         *       binomial tree and broadcast the release.
+         */
+        Task<bool> barrier();
+
+        /**
+         * @brief Report a peer that did not signal the startup barrier.
+         * @param peer The silent peer.
+         * @return false, for the barrier to return.
+         */
+        bool barrier_failed(int peer) const;
+
+        /**
+         * @brief The link to a peer opened by connect_mesh().
+         * @param peer_id The peer; must be a mesh neighbor.
+         * @return The link.
+         */
+        [[nodiscard]] PeerLink &link_to(int peer_id) const;
+
+        /**
+         * @brief Wait until every queued send has been written, up to the phase deadline.
+         * @return false if a send to any peer failed or timed out.
+         */
+        [[nodiscard]] bool flush_links() const;
+
+        /**
+         * @brief Wait until node 0 has sent every chunk read from the mapped input.
+         * @return false if a chunk could not be sent to a worker.
+         * @note A failed link is shut down and drained, so no sender still reads the mapping
+         *       when this returns.
+         */
+        [[nodiscard]] bool finish_chunk_sends();
+
+        /**
+         * @brief Receive the next payload from a mesh neighbor without blocking the event loop.
+         * @param peer_id The neighbor.
+         * @param out Receives the payload.
+         * @return false if the link failed or nothing arrived before the phase deadline.
+         */
+        Task<bool> receive_from(int peer_id, std::string &out);
+
+        /**
+         * @brief Receive a word-count payload from a neighbor and merge it into local_counts.
+         * @param peer_id The neighbor.
+         * @param what Name of the calling phase, for error messages.
+         * @return false if nothing valid arrived.
+         */
+        Task<bool> receive_and_merge(int peer_id, const char *what);
+
+        /**
+         * @brief Swap one payload with a partner over its link, both directions at once.
+         * @param partner_id The partner node.
+         * @param outgoing The payload to send.
+         * @param incoming Receives the partner's payload.
+         * @return true if the partner's payload was received.
+         * @note The link's sender thread writes while the event loop receives, so two large
+         *       payloads cannot deadlock on full socket buffers.
+         */
+        Task<bool> exchange(int partner_id, std::string outgoing, std::string &incoming);
+
+        /**
+         * @brief Reduce-scatter the local counts by key owner (ReduceMode::Shuffle).
+         * @return true if every exchange succeeded.
+         * @note In dimension d, a node sends its partner the keys whose owner differs from
+         *       its own ID in bit d and merges what it receives; after log2(N) exchanges it
+         *       holds exactly the keys it owns, fully reduced. Past a power of two, extra
+         *       nodes hand their counts to their core node first, keys are routed to the core
+         *       node an owner is folded onto, and each core node sends its extra node's keys
+         *       back at the end.
+         */
+        Task<bool> shuffle();
+
+        /**
+         * @brief The nodes before and after this one in the topology's ring order.
+         * @return {predecessor, successor}; both are this node when it is alone.
          */
-        static std::string receive_string(int client_socket);
+        [[nodiscard]] std::pair<int, int> ring_neighbors() const;
+
+        /**
+         * @brief Reduce-scatter around the ring (ReduceMode::Shuffle on a ring or torus, first
+         *        half of ReduceMode::RingAllReduce).
+         * @return true if every step succeeded.
+         * @note In step s, the node at ring position p sends its successor the keys owned by
+         *       position p - s - 1, which already hold what its predecessor sent in step s - 1.
+         *       After N - 1 steps it holds the keys it owns, fully reduced, as with shuffle().
+         */
+        Task<bool> ring_reduce_scatter();
+
+        /**
+         * @brief Allreduce as ring_reduce_scatter() then a ring allgather (ReduceMode::RingAllReduce).
+         * @return true if every step succeeded.
+         * @note Each encoded partition is forwarded N - 1 times as received and decoded once per node.
+         */
+        Task<bool> ring_allreduce();
+
+        /**
+         * @brief Allreduce the local counts by recursive doubling (ReduceMode::AllReduce).
+         * @return true if every exchange succeeded.
+         * @note In dimension d, partners id and id ^ (1 << d) swap their whole tables over one
+         *       connection (see exchange) and both merge, so every node ends with the global counts.
+         *       Extra nodes past a power of two fold onto the core as in shuffle().
+         */
+        Task<bool> allreduce();
+
+        /**
+         * @brief Send node 0's result to every node along a binomial tree (NodeOptions::broadcast).
+         * @return true if this node sent and received everything it had to.
+         * @note A pipelined HamonCollectives::broadcast of the encoded table: each node forwards
+         *       the segments it receives, without re-encoding, and decodes the whole once.
+         */
+        Task<bool> broadcast();
+
+        /**
+         * @brief Collect the shuffled partitions on node 0 (ReduceMode::Shuffle with NodeOptions::gather).
+         * @return true if node 0 received and decoded every partition.
+         * @note The encoded partitions travel up the binomial tree as they are
+         *       (HamonCollectives::gather); intermediate nodes do not decode or merge them.
+         */
+        Task<bool> gather_partitions();
+
+        /**
+         * @brief This node's collectives over its mesh links, with the phase deadline.
+         * @param segment_bytes Segment size of the payloads it sends.
+         * @return The collectives.
+         */
+        [[nodiscard]] HamonCollectives collectives(std::size_t segment_bytes = HamonCollectives::default_segment_bytes);
+
+        /**
+         * @brief Write the local counts to `<output_dir>/part-<id>.txt`, one "word\tcount" line per key.
+         * @return true on success.
+         */
+        [[nodiscard]] bool write_partition() const;
 
         /**
          * @brief Perform the reduce operation by aggregating word counts from neighbor nodes.
          * @return true if the reduction was successful, false otherwise.
-         * @note This function sends the local word count results to neighbor nodes,
-         *       receives their aggregated results, and combines them with the local results.
+         * @note A node receives the tables of all its children at once and merges them as they
+         *       arrive, then sends the result to its parent; node 0 ends with every key.
+         */
+        Task<bool> reduce();
+
+        /**
+         * @brief Tree reduce of a node with a memory budget (NodeOptions::memory_budget).
+         * @return true once the merged counts went to the parent, or node 0 holds them all.
+         * @note Each child streams its merged runs as RunStore blocks, closed by an empty
+         *       payload, and they are appended to a new run as they arrive. The node then
+         *       streams the k-way merge of its runs and its table to its parent, flushing
+         *       the link every few blocks so the send queue stays small.
+         */
+        Task<bool> reduce_spilled();
+
+        /**
+         * @brief Receive a child's block stream into a new run (reduce_spilled()).
+         * @param peer_id The child.
+         * @return false if a block did not arrive before the deadline or could not be stored.
+         */
+        Task<bool> receive_run(int peer_id);
+
+        /**
+         * @brief Call a function on every final (word, count), in key order.
+         * @param emit Receives each word once; returning false stops.
+         * @return false if emit stopped or the spilled runs could not be read.
+         * @note Merges the spilled runs with local_counts when the node has a memory budget.
+         */
+        bool for_each_result(const RunStore::EntrySink &emit) const;
+
+        /**
+         * @brief Every phase of a job, in order, as one coroutine; links the cluster first
+         *        if it is not linked yet.
+         * @return true if all phases succeeded.
+         */
+        Task<bool> run_phases();
+
+        /**
+         * @brief Connect the mesh and pass the startup barrier.
+         * @return true once every node is linked.
+         */
+        Task<bool> link_cluster();
+
+        /**
+         * @brief Run one job's phases, then report: summary line, output files, and node 0's
+         *        results.
+         * @param results Where node 0 prints the final counts.
+         * @return false if a phase failed or the final sends did not complete.
+         */
+        bool run_job(std::ostream &results);
+
+        /**
+         * @brief Reset the per-job state before a daemon job.
+         * @param input The job's input path.
+         */
+        void start_job(std::string input);
+
+        /**
+         * @brief Node 0 in daemon mode: accept clients on the job socket, announce each job to
+         *        the workers ("J <input>", or "Q" to stop) and run it.
+         * @param job_fd The listening job socket.
+         * @return true after a shutdown request.
+         * @note Requests whose input cannot be read are refused without disturbing the cluster.
+         */
+        bool dispatch_jobs(int job_fd);
+
+        /**
+         * @brief Worker in daemon mode: run each job node 0 announces, until told to stop.
+         * @return true after node 0's "Q".
+         */
+        bool follow_jobs();
+
+        /**
+         * @brief Wait, without deadline, for node 0's next announcement.
+         * @param job Receives it.
+         * @return false if the link to node 0 failed.
+         */
+        Task<bool> next_job(std::string &job);
+
+        /**
+         * @brief Start a phase: name it for messages and set its deadline.
+         * @param name The phase name.
          */
-        [[nodiscard]] bool reduce();
+        void begin_phase(const char *name);
+
+        /**
+         * @brief Abort every link and close the server after a failed phase.
+         * @return false, for `return fail_run();`.
+         */
+        bool fail_run();
 
         /**
          * @brief Read the entire content of a file into a string.
@@ -151,13 +672,20 @@ namespace dualys {
          *     Worker nodes perform the assigned tasks and report results back to the master.
          */
         bool is_master;
-        std::string input_file;
+        /**
+         * @brief Runtime options of the run (input path, ...).
+         */
+        NodeOptions options;
         /**
          * @brief The local word count results for this node.
          * @note This map stores the word counts computed by this node during the map phase.
          *      It is used in the reduce phase to aggregate results from neighbor nodes.
          */
-        WordCountMap local_counts;
+        WordCountTable local_counts;
+        /**
+         * @brief Counts spilled out of local_counts, with a memory budget.
+         */
+        std::unique_ptr<RunStore> spills;
         /**
          * @brief The final aggregated word count results after the reduce phase.
          * @note This map stores the combined word counts from this node and its neighbors.
@@ -165,5 +693,33 @@ namespace dualys {
          * @warning This map is only valid after the reduce phase has completed.
          */
         std::vector<NodeConfig> all_configs;
+        /**
+         * @brief Reactor on which the phases run.
+         */
+        EventLoop loop;
+        /**
+         * @brief Name of the current phase, for timeout messages.
+         */
+        std::string phase_name;
+        /**
+         * @brief When the current phase gives up waiting on its peers.
+         */
+        Deadline phase_deadline;
+        /**
+         * @brief Phase durations measured by run().
+         */
+        PhaseTimings phase_timings;
+        /**
+         * @brief In-process channels to the other nodes, or nullptr to link over sockets.
+         */
+        LocalMesh *local_mesh;
+        /**
+         * @brief Whether the mesh is linked and the startup barrier passed.
+         */
+        bool mesh_ready = false;
+        /**
+         * @brief Long-lived connections to the mesh neighbors, keyed by peer ID.
+         */
+        std::map<int, std::unique_ptr<PeerLink> > links;
     };
 }
@@ -0,0 +1,70 @@
+#pragma once
+#include <libintl.h>
+#include "HamonCpuTopology.hpp"
+#include "HamonCube.hpp"
+#include <string>
+#include <vector>
+
+#ifndef I18N_GETTEXT_DEFINED
+#define _(String) gettext(String)
+#define I18N_GETTEXT_DEFINED
+#endif
+
+namespace dualys {
+    /**
+     * @brief Where one cluster node runs.
+     */
+    struct NodePlacement {
+        /// NUMA node its memory is allocated on; -1 leaves the memory policy alone.
+        int numa = -1;
+        /// CPUs it is pinned to; empty leaves it unpinned.
+        std::vector<int> cpus;
+    };
+
+    /**
+     * @brief Pinning of the word-count nodes to CPUs and of their memory to the local NUMA node.
+     *
+     * The default placement packs the nodes compactly per socket: N nodes are split
+     * evenly across the NUMA nodes, in ID order, and each node gets a contiguous share
+     * of its NUMA node's physical cores, with their SMT siblings. Nodes with close IDs,
+     * which are neighbors across the low hypercube dimensions and share binomial
+     * subtrees, thus stay on one socket; only the top dimensions cross sockets. With
+     * more nodes than cores, each node gets one CPU and SMT siblings are only used once
+     * every core has a node. A node configured with `@cpu numa= core=` keeps its own CPU.
+     */
+    class HamonPlacement {
+    public:
+        /**
+         * @brief Place every node of a cluster.
+         * @param configs The nodes; NodeConfig::numa and NodeConfig::core override the default.
+         * @param domains The machine's NUMA domains (HamonCpuTopology::numa_domains()).
+         * @return One placement per node. The NUMA node is only set on machines with more
+         *         than one, where binding the memory matters.
+         * @note With more nodes than CPUs, nodes share CPUs round robin. core=J is the J-th
+         *       CPU of NUMA node numa=I, physical cores first (or logical CPU J without numa),
+         *       or logical CPU J when J is past its CPU count; numa=I alone pins the node to
+         *       all of that NUMA node's CPUs.
+         */
+        [[nodiscard]] static std::vector<NodePlacement> plan(const std::vector<NodeConfig> &configs,
+                                                             const std::vector<NumaDomain> &domains);
+
+        /**
+         * @brief Pin the calling thread (and the threads it starts later) to a placement.
+         * @param placement Its CPUs and NUMA node.
+         * @param node_id The node, for error messages.
+         * @return false if the affinity or the memory policy could not be set; the node
+         *         still runs, unpinned.
+         * @note The memory policy is MPOL_PREFERRED on the node's NUMA node: pages the node
+         *       touches first (its tables, link buffers and map threads' tables) are allocated
+         *       locally, and spill to the other nodes instead of failing when it is full.
+         */
+        static bool apply(const NodePlacement &placement, int node_id);
+
+        /**
+         * @brief Short description of a placement, e.g. "cpus 0-3, numa 0".
+         * @param placement The placement.
+         * @return The description; "unpinned" for an empty placement.
+         */
+        [[nodiscard]] static std::string describe(const NodePlacement &placement);
+    };
+}
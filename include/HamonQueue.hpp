@@ -0,0 +1,170 @@
+#pragma once
+#include <libintl.h>
+#include "HamonFrame.hpp"
+#include "HamonShard.hpp"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#ifndef I18N_GETTEXT_DEFINED
+#define _(String) gettext(String)
+#define I18N_GETTEXT_DEFINED
+#endif
+
+namespace dualys {
+    /**
+     * @brief Unbounded lock-free multi-producer/single-consumer queue (Vyukov's).
+     *
+     * push() is one atomic exchange plus a store, from any thread; try_pop() is only
+     * called by the consumer. Items are moved in and out, never copied. A push that has
+     * swapped the head but not yet linked its node is invisible to try_pop() for that
+     * instant, so producers signal the consumer after push() returns, not before.
+     */
+    template<class T>
+    class MpscQueue {
+    public:
+        MpscQueue() : head(new Node), tail(head.load()) {
+        }
+
+        ~MpscQueue() {
+            while (tail != nullptr) delete std::exchange(tail, tail->next.load());
+        }
+
+        MpscQueue(const MpscQueue &) = delete;
+
+        MpscQueue &operator=(const MpscQueue &) = delete;
+
+        /**
+         * @brief Append an item.
+         * @param value The item, moved into the queue.
+         */
+        void push(T value) {
+            Node *node = new Node;
+            node->value = std::move(value);
+            Node *previous = head.exchange(node, std::memory_order_acq_rel);
+            previous->next.store(node, std::memory_order_release);
+        }
+
+        /**
+         * @brief Take the oldest item, without waiting.
+         * @param out Receives the item.
+         * @return false if the queue is empty (consumer thread only).
+         */
+        bool try_pop(T &out) {
+            Node *next = tail->next.load(std::memory_order_acquire);
+            if (next == nullptr) return false;
+            out = std::move(next->value);
+            delete std::exchange(tail, next); // the popped node becomes the new stub
+            return true;
+        }
+
+    private:
+        struct Node {
+            std::atomic<Node *> next{nullptr};
+            T value{};
+        };
+
+        std::atomic<Node *> head;
+        Node *tail;
+    };
+
+    struct LocalPipe;
+
+    /**
+     * @brief One end of a link between two nodes running as threads of the same process.
+     *
+     * Each direction is an MpscQueue of payloads: a send moves the string into the
+     * peer's queue, with no framing and no copy. The reader sleeps on an eventfd
+     * (doorbell_fd()), which the writer only signals after the reader announced it was
+     * about to wait, so a busy stream costs no system call. Closing an end (or
+     * destroying it) lets the peer drain what was sent, then fails its receives.
+     */
+    class LocalChannel {
+    public:
+        /**
+         * @brief Create the two connected ends of a channel.
+         * @return The ends; nullptr in both if no eventfd could be created.
+         */
+        [[nodiscard]] static std::pair<std::unique_ptr<LocalChannel>, std::unique_ptr<LocalChannel> > pair();
+
+        ~LocalChannel();
+
+        LocalChannel(const LocalChannel &) = delete;
+
+        LocalChannel &operator=(const LocalChannel &) = delete;
+
+        /**
+         * @brief Hand a payload to the peer.
+         * @param payload The bytes, moved.
+         * @return false if this end or the peer's was closed.
+         */
+        bool send(std::string payload);
+
+        /**
+         * @brief Read a byte range of a file and hand it to the peer as one payload.
+         * @param file_fd The file.
+         * @param range The range to send.
+         * @return false on a read error or if an end was closed.
+         */
+        bool send_file_range(int file_fd, const ShardRange &range);
+
+        /**
+         * @brief Receive the next payload, waiting for it.
+         * @param out Receives the payload.
+         * @return false if the peer closed its end and everything it sent was received.
+         */
+        bool receive(std::string &out);
+
+        /**
+         * @brief Receive without blocking, for event loops.
+         * @param out Receives the payload once it is Complete.
+         * @return Complete, Pending (wait until doorbell_fd() is readable) or Failed.
+         * @note Pending arms the doorbell, so the peer's next send makes the descriptor readable.
+         */
+        ReceiveStatus poll_receive(std::string &out);
+
+        /**
+         * @brief Descriptor that becomes readable when a payload arrives after poll_receive()
+         *        returned Pending, or when the peer closes.
+         * @return The eventfd.
+         */
+        [[nodiscard]] int doorbell_fd() const;
+
+        /**
+         * @brief Stop sending and receiving: the peer sees the end of the stream once it
+         *        drained the payloads already sent, and its sends to this end fail.
+         */
+        void close();
+
+    private:
+        LocalChannel(std::shared_ptr<LocalPipe> p_outbound, std::shared_ptr<LocalPipe> p_inbound);
+
+        std::shared_ptr<LocalPipe> outbound;
+        std::shared_ptr<LocalPipe> inbound;
+    };
+
+    /**
+     * @brief The links of a cluster whose nodes run as threads of one process.
+     *
+     * A channel is created for a pair of nodes when the first of them asks for its
+     * end; the other end waits here until its node asks for it. Thread-safe.
+     */
+    class LocalMesh {
+    public:
+        /**
+         * @brief Take a node's end of its link to a peer.
+         * @param self The node asking.
+         * @param peer The node at the other end.
+         * @return The end, or nullptr if it was already taken or no channel could be created.
+         */
+        [[nodiscard]] std::unique_ptr<LocalChannel> take(int self, int peer);
+
+    private:
+        std::mutex mutex;
+        std::map<std::pair<int, int>, std::unique_ptr<LocalChannel> > waiting;
+        std::map<std::pair<int, int>, bool> taken;
+    };
+}
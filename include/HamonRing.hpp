@@ -0,0 +1,226 @@
+#pragma once
+#include <libintl.h>
+#include "HamonFrame.hpp"
+#include "HamonShard.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+
+#ifndef I18N_GETTEXT_DEFINED
+#define _(String) gettext(String)
+#define I18N_GETTEXT_DEFINED
+#endif
+
+namespace dualys {
+    /**
+     * @brief Shared state of one ring direction, stored at the start of the segment.
+     *
+     * Positions are running byte counts (never wrapped); the ring index is the position
+     * modulo the capacity. The two sequence words are futexes: the writer bumps data_seq
+     * after publishing bytes, the reader bumps space_seq after releasing them, and each
+     * side only issues FUTEX_WAKE when the other one announced that it is sleeping.
+     * A reader driven by an event loop announces a doorbell instead (reader_sleeping ==
+     * ShmRing::doorbell_sleeper): the writer then sends one byte on the TCP socket, which
+     * the loop can wait on with epoll.
+     */
+    struct RingControl {
+        alignas(64) std::atomic<std::uint64_t> head;
+        alignas(64) std::atomic<std::uint64_t> tail;
+        alignas(64) std::atomic<std::uint32_t> data_seq;
+        std::atomic<std::uint32_t> reader_sleeping;
+        alignas(64) std::atomic<std::uint32_t> space_seq;
+        std::atomic<std::uint32_t> writer_sleeping;
+    };
+
+    /**
+     * @brief Single-producer/single-consumer byte ring in memory shared by two processes.
+     *
+     * Bytes are copied straight into the peer's address space, with no syscall unless
+     * one side has to sleep. Waits are bounded: while the ring is empty (or full) the
+     * waiting side checks every few milliseconds that the peer's socket is still open,
+     * so a crashed peer fails the transfer instead of hanging it.
+     */
+    class ShmRing {
+    public:
+        /**
+         * @brief View a ring laid out in a shared mapping.
+         * @param p_control The ring's control block.
+         * @param p_data The ring's buffer.
+         * @param p_capacity Size of the buffer; a power of two.
+         * @param p_liveness_fd Socket connected to the peer, polled for hang-ups while waiting.
+         */
+        ShmRing(RingControl *p_control, char *p_data, std::size_t p_capacity, int p_liveness_fd);
+
+        /**
+         * @brief Copy bytes into the ring, waiting for space as needed.
+         * @param data The bytes.
+         * @param size Number of bytes.
+         * @return false if the peer went away first.
+         */
+        bool write(const void *data, std::size_t size);
+
+        /**
+         * @brief Read a byte range of a file directly into the ring.
+         * @param file_fd The file.
+         * @param range The range to copy.
+         * @return false on a read error or if the peer went away.
+         */
+        bool write_file(int file_fd, const ShardRange &range);
+
+        /**
+         * @brief Copy bytes out of the ring, waiting for them as needed.
+         * @param data Destination buffer.
+         * @param size Number of bytes.
+         * @return false if the peer went away before sending them.
+         */
+        bool read(void *data, std::size_t size);
+
+        /**
+         * @brief Copy out whatever is available, without waiting.
+         * @param data Destination buffer.
+         * @param size Largest number of bytes to copy.
+         * @return Number of bytes copied.
+         */
+        std::size_t try_read(void *data, std::size_t size);
+
+        /**
+         * @brief Ask the writer to ring the socket when it next publishes bytes.
+         * @return true if bytes arrived meanwhile (read them instead of waiting).
+         */
+        bool arm_doorbell();
+
+        /// reader_sleeping value of a reader blocked in FUTEX_WAIT.
+        static constexpr std::uint32_t futex_sleeper = 1;
+        /// reader_sleeping value of a reader waiting for a doorbell byte on the socket.
+        static constexpr std::uint32_t doorbell_sleeper = 2;
+
+    private:
+        std::span<char> reserve();
+
+        void commit(std::size_t n);
+
+        std::span<const char> peek();
+
+        void consume(std::size_t n);
+
+        bool wait(std::atomic<std::uint32_t> &seq, std::atomic<std::uint32_t> &sleeping, bool for_data);
+
+        [[nodiscard]] bool peer_alive() const;
+
+        RingControl *control;
+        char *data;
+        std::size_t capacity;
+        int liveness_fd;
+        bool broken;
+    };
+
+    /**
+     * @brief A shared-memory segment holding one ring per direction between two nodes.
+     *
+     * The node that opened the TCP connection creates the segment under a unique
+     * POSIX shm name and sends the name over the socket; the peer opens it, and the
+     * creator unlinks the name once the peer has mapped it, so nothing is left in
+     * /dev/shm even if a node dies later. The segment is fully allocated up front:
+     * a tmpfs that fills up makes create() fail (and the link falls back to TCP)
+     * instead of raising SIGBUS on a later write.
+     *
+     * A payload is sent as its 64-bit length followed by its bytes.
+     */
+    class ShmChannel {
+    public:
+        /// Default size of each ring direction.
+        static constexpr std::size_t default_ring_bytes = std::size_t{256} << 10;
+
+        /**
+         * @brief Create and map a new segment.
+         * @param ring_bytes Size of each ring direction, rounded up to a power of two.
+         * @param socket_fd The TCP socket to the peer, used to detect hang-ups.
+         * @return The channel, or nullptr if shared memory is unavailable.
+         */
+        [[nodiscard]] static std::unique_ptr<ShmChannel> create(std::size_t ring_bytes, int socket_fd);
+
+        /**
+         * @brief Map a segment created by the peer.
+         * @param name The name sent by the creator.
+         * @param socket_fd The TCP socket to the peer, used to detect hang-ups.
+         * @return The channel, or nullptr if the segment cannot be mapped.
+         */
+        [[nodiscard]] static std::unique_ptr<ShmChannel> open(const std::string &name, int socket_fd);
+
+        /**
+         * @brief Whether a connected socket leads to a process on this host.
+         * @param socket_fd The socket.
+         * @return true for Unix sockets, loopback peers and peers using one of our own addresses.
+         */
+        [[nodiscard]] static bool same_host(int socket_fd);
+
+        ~ShmChannel();
+
+        ShmChannel(const ShmChannel &) = delete;
+
+        ShmChannel &operator=(const ShmChannel &) = delete;
+
+        /**
+         * @brief Name of the segment, to send to the peer.
+         * @return The shm name (empty once unlinked).
+         */
+        [[nodiscard]] const std::string &name() const;
+
+        /**
+         * @brief Remove the segment's name; existing mappings stay valid.
+         */
+        void unlink();
+
+        /**
+         * @brief Send one payload.
+         * @param payload The bytes.
+         * @return false if the peer went away.
+         */
+        bool send(std::string_view payload);
+
+        /**
+         * @brief Send a byte range of a file as one payload.
+         * @param file_fd The file.
+         * @param range The range to send.
+         * @return false on a read error or if the peer went away.
+         */
+        bool send_file_range(int file_fd, const ShardRange &range);
+
+        /**
+         * @brief Receive the next payload.
+         * @param out Receives the payload (previous content is replaced).
+         * @return false if the peer went away first.
+         */
+        bool receive(std::string &out);
+
+        /**
+         * @brief Receive without blocking, for event loops.
+         * @param out Receives the payload once it is Complete.
+         * @return Complete, Pending (wait for the socket to become readable) or Failed.
+         * @note Pending arms the doorbell, so the writer's next bytes make the socket readable.
+         *       Must not be mixed with receive() in the middle of a payload.
+         */
+        ReceiveStatus poll_receive(std::string &out);
+
+    private:
+        bool drain_doorbell() const;
+
+        ShmChannel(void *p_base, std::size_t p_mapped, std::size_t ring_bytes, bool creator, int socket_fd,
+                   std::string p_name);
+
+        void *base;
+        std::size_t mapped;
+        std::string segment_name;
+        ShmRing outbound;
+        ShmRing inbound;
+        int socket;
+        std::uint64_t incoming_length;
+        std::size_t length_got;
+        std::size_t body_got;
+        std::string incoming;
+    };
+}
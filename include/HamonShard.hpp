@@ -0,0 +1,353 @@
+#pragma once
+#include <libintl.h>
+#include "HamonUring.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifndef I18N_GETTEXT_DEFINED
+#define _(String) gettext(String)
+#define I18N_GETTEXT_DEFINED
+#endif
+
+namespace dualys {
+    /**
+     * @brief A contiguous byte range [offset, offset + length) of the input file.
+     */
+    struct ShardRange {
+        /// Byte offset of the first byte of the range.
+        std::size_t offset;
+        /// Number of bytes in the range.
+        std::size_t length;
+    };
+
+    /**
+     * @brief Read-only memory mapping of an input file.
+     *
+     * The coordinator maps the input instead of copying it into a std::string, so
+     * chunks can be handed out as string_views (local map) or as file ranges
+     * (sendfile to workers) without ever duplicating the corpus in memory.
+     */
+    class MappedFile {
+    public:
+        /**
+         * @brief Open and map a file read-only.
+         * @param path Path of the file to map.
+         * @note Check is_open() afterwards; failures are reported on stderr.
+         */
+        explicit MappedFile(const std::string &path);
+
+        ~MappedFile();
+
+        MappedFile(const MappedFile &) = delete;
+
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        /**
+         * @brief Whether the file was opened and mapped successfully.
+         * @return true if view() and fd() are usable.
+         */
+        [[nodiscard]] bool is_open() const;
+
+        /**
+         * @brief The whole mapped file.
+         * @return A view over the mapping (empty for an empty file).
+         */
+        [[nodiscard]] std::string_view view() const;
+
+        /**
+         * @brief A view over one range of the mapping.
+         * @param range The range to view; must lie inside the file.
+         * @return A view over the requested bytes.
+         */
+        [[nodiscard]] std::string_view slice(const ShardRange &range) const;
+
+        /**
+         * @brief The underlying file descriptor, suitable for sendfile().
+         * @return The descriptor, or -1 if the file is not open.
+         */
+        [[nodiscard]] int fd() const;
+
+        /**
+         * @brief Size of the mapped file in bytes.
+         * @return The file size.
+         */
+        [[nodiscard]] std::size_t size() const;
+
+    private:
+        int file_fd;
+        void *data;
+        std::size_t length;
+    };
+
+    /**
+     * @brief Word-boundary-aware splitting of the input into per-node ranges.
+     *
+     * Split points are moved forward to the next delimiter so that no word is cut
+     * in half. The result only depends on the data and the number of parts, so
+     * every run produces the same chunks, and the word counts do not depend on N.
+     */
+    class HamonShard {
+    public:
+        /**
+         * @brief Whether a byte separates words.
+         * @param c The byte to test.
+         * @return true for the bytes `operator>>` skips in the "C" locale.
+         */
+        [[nodiscard]] static bool is_delimiter(char c);
+
+        /**
+         * @brief Move a split point forward to the next word boundary.
+         * @param data The whole input.
+         * @param pos The nominal split point.
+         * @return The first position >= pos that is a delimiter or the end of data.
+         *         Position 0 is always a boundary.
+         */
+        [[nodiscard]] static std::size_t align_to_boundary(std::string_view data, std::size_t pos);
+
+        /**
+         * @brief Align both ends of a nominal range, as split() aligns its split points.
+         * @param data The whole input.
+         * @param nominal The nominal range.
+         * @return The aligned range; empty if a long word covers the whole nominal range.
+         */
+        [[nodiscard]] static ShardRange align_range(std::string_view data, const ShardRange &nominal);
+
+        /**
+         * @brief Split data into parts whose boundaries never cut a word.
+         * @param data The whole input.
+         * @param parts Number of ranges to produce (must be > 0).
+         * @return Exactly `parts` contiguous ranges covering data; some may be empty.
+         */
+        [[nodiscard]] static std::vector<ShardRange> split(std::string_view data, std::size_t parts);
+
+        /**
+         * @brief Split data into ranges proportional to weights, never cutting a word.
+         * @param data The whole input.
+         * @param weights Relative share of each range (e.g. map threads of each node); all > 0.
+         * @return One contiguous range per weight, covering data; some may be empty.
+         */
+        [[nodiscard]] static std::vector<ShardRange> split(std::string_view data,
+                                                           const std::vector<std::size_t> &weights);
+
+        /**
+         * @brief Nominal (unaligned) ranges of a file, computed from its size only.
+         * @param file_size Size of the input in bytes.
+         * @param parts Number of ranges to produce (must be > 0).
+         * @return `parts` ranges split at `i * file_size / parts`; the last one ends at file_size.
+         * @note Aligning each nominal boundary with align_to_boundary yields exactly the
+         *       ranges of split(), which lets every worker fix up its own range.
+         */
+        [[nodiscard]] static std::vector<ShardRange> nominal_split(std::size_t file_size, std::size_t parts);
+
+        /**
+         * @brief Nominal (unaligned) ranges proportional to weights.
+         * @param file_size Size of the input in bytes.
+         * @param weights Relative share of each range; all > 0.
+         * @return One range per weight; aligning its boundaries yields split(data, weights).
+         */
+        [[nodiscard]] static std::vector<ShardRange> nominal_split(std::size_t file_size,
+                                                                   const std::vector<std::size_t> &weights);
+
+        /**
+         * @brief Read a nominal range from shared storage, fixing up both boundaries locally.
+         * @param path Path of the input, visible to the reading node.
+         * @param nominal The nominal range assigned by the coordinator.
+         * @param out Receives the bytes of the word-aligned range.
+         * @param backend IoBackend::Uring reads the range as 1 MiB reads kept in flight
+         *        together on an io_uring, submitted and reaped a batch per system call.
+         * @return true on success, false if the file cannot be read.
+         * @note Uses pread() with posix_fadvise() readahead; only the bytes of the aligned
+         *       range plus the tail of one word past each boundary are read.
+         */
+        static bool read_range(const std::string &path, const ShardRange &nominal, std::string &out,
+                               IoBackend backend = IoBackend::Epoll);
+
+        /**
+         * @brief Encode a (path, offset, length) descriptor for a worker.
+         * @param path Path of the input.
+         * @param range The nominal range of the worker.
+         * @return The descriptor as a short string message.
+         */
+        [[nodiscard]] static std::string encode_descriptor(const std::string &path, const ShardRange &range);
+
+        /**
+         * @brief Decode a descriptor produced by encode_descriptor.
+         * @param message The received message.
+         * @param path Receives the input path.
+         * @param range Receives the nominal range.
+         * @return true if the message is a well-formed descriptor.
+         */
+        static bool decode_descriptor(const std::string &message, std::string &path, ShardRange &range);
+    };
+
+    /**
+     * @brief Hands out the input as a queue of small ranges, to nodes that ask for more
+     *        when they are done (pull scheduling).
+     *
+     * Ranges are nominal and contiguous, in file order; each taker aligns them like
+     * nominal_split() ranges, so the aligned ranges still tile the input. A range is
+     * sized for about target_seconds of work at the throughput the taker reports, but
+     * never more than a share of what is left (guided self-scheduling), so the last
+     * ranges shrink and no node is left counting a big range at the end.
+     * Thread-safe.
+     */
+    class ChunkDispenser {
+    public:
+        /// Work a range should take at the taker's reported throughput.
+        static constexpr double target_seconds = 0.05;
+
+        /**
+         * @brief Queue a whole input.
+         * @param p_total Size of the input in bytes.
+         * @param p_takers Number of nodes pulling ranges.
+         * @param p_min_chunk Smallest range handed out (except the last one).
+         * @param p_max_chunk Largest range handed out.
+         */
+        ChunkDispenser(std::size_t p_total, std::size_t p_takers, std::size_t p_min_chunk = std::size_t{1} << 20,
+                       std::size_t p_max_chunk = std::size_t{64} << 20);
+
+        /**
+         * @brief Take the next range.
+         * @param bytes_per_second The taker's measured throughput; 0 before its first range.
+         * @return The nominal range, or nothing once the input is exhausted.
+         */
+        std::optional<ShardRange> next(double bytes_per_second);
+
+        /**
+         * @brief Bytes not handed out yet.
+         * @return The count.
+         */
+        [[nodiscard]] std::size_t remaining() const;
+
+    private:
+        mutable std::mutex mutex;
+        std::size_t total;
+        std::size_t takers;
+        std::size_t min_chunk;
+        std::size_t max_chunk;
+        std::size_t position;
+    };
+
+    /**
+     * @brief Who holds each range of a ChunkDispenser, and who finished it first.
+     *
+     * Ranges get consecutive ids as they are handed out. With speculation on, a taker
+     * that finds the input exhausted is handed a duplicate of a straggling range instead:
+     * one still open after slack times the time it should take at the takers' median
+     * throughput. The first holder to complete a range keeps its counts; the others drop
+     * theirs, so each byte is counted once whichever copy wins.
+     * Thread-safe.
+     */
+    class ChunkTracker {
+    public:
+        /// How far behind the median throughput a range must fall before it is duplicated.
+        static constexpr double default_slack = 3.0;
+
+        /**
+         * @brief A range handed to a taker.
+         */
+        struct Assignment {
+            /// Id of the range, for complete().
+            std::uint64_t id;
+            /// The nominal range (to align like any ChunkDispenser range).
+            ShardRange range;
+            /// Whether another taker already holds it.
+            bool duplicate;
+        };
+
+        /**
+         * @brief Track the ranges of a new dispenser.
+         * @param p_total Size of the input in bytes.
+         * @param p_takers Number of nodes pulling ranges; takers are numbered from 0.
+         * @param p_slack Straggler threshold (see default_slack); 0 disables speculation.
+         * @param p_min_chunk Smallest range handed out (see ChunkDispenser).
+         * @param p_max_chunk Largest range handed out.
+         */
+        ChunkTracker(std::size_t p_total, std::size_t p_takers, double p_slack,
+                     std::size_t p_min_chunk = std::size_t{1} << 20, std::size_t p_max_chunk = std::size_t{64} << 20);
+
+        /**
+         * @brief Take a fresh range, or a duplicate of a straggler once the input is exhausted.
+         * @param taker The taker.
+         * @param bytes_per_second Its measured throughput; 0 before its first range.
+         * @param now The current time.
+         * @return The range, or nothing: check finished() to tell "wait and ask again" from "done".
+         */
+        std::optional<Assignment> next(int taker, double bytes_per_second, std::chrono::steady_clock::time_point now);
+
+        /**
+         * @brief Record that a taker counted a range.
+         * @param id The range.
+         * @param taker The taker.
+         * @return true if it is the first to complete it, i.e. its counts are the ones to keep.
+         */
+        bool complete(std::uint64_t id, int taker);
+
+        /**
+         * @brief Whether some holder already completed a range.
+         * @param id The range.
+         * @return true if the other holders can abandon it.
+         */
+        [[nodiscard]] bool completed(std::uint64_t id) const;
+
+        /**
+         * @brief The holders of a range other than one taker.
+         * @param id The range.
+         * @param taker The taker to leave out.
+         * @return Their ids, to tell them to abandon the range.
+         */
+        [[nodiscard]] std::vector<int> other_holders(std::uint64_t id, int taker) const;
+
+        /**
+         * @brief Ranges a taker holds that another holder completed first, since the last call.
+         * @param taker The taker.
+         * @return Their ids, once each, to tell the taker to abandon them.
+         * @note Filled by complete(), from whichever thread wins: the caller sends the
+         *       notices from the thread that owns the taker's link.
+         */
+        [[nodiscard]] std::vector<std::uint64_t> take_abandoned(int taker);
+
+        /**
+         * @brief Whether the whole input is counted.
+         * @return true once every range was handed out and (with speculation) completed.
+         */
+        [[nodiscard]] bool finished() const;
+
+        /**
+         * @brief The ranges whose counts a taker keeps.
+         * @param taker The taker.
+         * @return Ids of the ranges it completed first, in increasing order.
+         */
+        [[nodiscard]] std::vector<std::uint64_t> won_by(int taker) const;
+
+        /**
+         * @brief Number of ranges handed out twice.
+         * @return The count.
+         */
+        [[nodiscard]] std::size_t duplicates() const;
+
+    private:
+        struct Entry {
+            ShardRange range;
+            std::vector<int> holders;
+            std::chrono::steady_clock::time_point issued;
+            int winner;
+        };
+
+        mutable std::mutex mutex;
+        ChunkDispenser dispenser;
+        double slack;
+        std::vector<double> rates;
+        std::vector<Entry> entries;
+        /// Per taker: ranges it lost, not reported by take_abandoned() yet.
+        std::vector<std::vector<std::uint64_t> > abandoned;
+        std::size_t open;
+        std::size_t duplicated;
+    };
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include <libintl.h>
+#include "HamonCount.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifndef I18N_GETTEXT_DEFINED
+#define _(String) gettext(String)
+#define I18N_GETTEXT_DEFINED
+#endif
+
+namespace dualys {
+    /**
+     * @brief Sorted runs of word counts spilled to disk, for vocabularies larger than memory.
+     *
+     * A run is a sequence of blocks, each a HamonCodec payload of at most block_entries
+     * entries preceded by its varint length; keys increase across the whole run. Runs
+     * live in temporary files that are unlinked from the start, so they disappear with
+     * the store (or the process). merge() streams a k-way merge of every run and of an
+     * in-memory table while holding one block per run. Nodes exchange the same blocks,
+     * so a run received from a peer is appended block by block without being decoded.
+     * Thread-safe.
+     */
+    class RunStore {
+    public:
+        /// Entries per block: a few hundred KiB for ordinary words.
+        static constexpr std::size_t block_entries = 16384;
+
+        /// Receives merged entries in key order; returning false stops the merge.
+        using EntrySink = std::function<bool(std::string_view word, std::uint64_t count)>;
+        /// Receives merged entries encoded as blocks; returning false stops the merge.
+        using BlockSink = std::function<bool(std::string block)>;
+
+        /**
+         * @brief Create an empty store.
+         * @param p_directory Where run files go; empty for the system's temporary directory.
+         */
+        explicit RunStore(std::string p_directory = {});
+
+        ~RunStore();
+
+        RunStore(const RunStore &) = delete;
+
+        RunStore &operator=(const RunStore &) = delete;
+
+        /**
+         * @brief Write a table out as one sorted run.
+         * @param table The table (left untouched).
+         * @return false on an I/O error.
+         */
+        bool spill(const WordCountTable &table);
+
+        /**
+         * @brief Spill counting tables once they get too big, and start them over.
+         * @param tables Per-thread tables; each non-empty one becomes a run and is replaced
+         *        by a fresh table.
+         * @param budget Memory budget in bytes. The tables are spilled once together they
+         *        use more than half of it: sorting them for the run takes about as much again.
+         * @return false on an I/O error.
+         */
+        bool spill_if_over(std::vector<WordCountTable> &tables, std::size_t budget);
+
+        /**
+         * @brief Start an empty run, to be filled with append_block().
+         * @return Its index, or -1 if no file could be created.
+         */
+        int begin_run();
+
+        /**
+         * @brief Append an encoded block to a run started with begin_run().
+         * @param run The run's index.
+         * @param block A HamonCodec payload whose keys all follow the run's previous keys.
+         * @return false on an I/O error.
+         */
+        bool append_block(int run, std::string_view block);
+
+        /**
+         * @brief Merge every run with a table, combining equal keys.
+         * @param rest Counts still in memory.
+         * @param sink Receives each word once, in key order.
+         * @return false on an I/O error, a corrupt run, or if the sink stopped the merge.
+         */
+        bool merge(const WordCountTable &rest, const EntrySink &sink) const;
+
+        /**
+         * @brief Like merge(), but hand the result over as blocks of block_entries entries.
+         * @param rest Counts still in memory.
+         * @param sink Receives each block, in key order.
+         * @return false on an I/O error, a corrupt run, or if the sink stopped the merge.
+         */
+        bool merge_blocks(const WordCountTable &rest, const BlockSink &sink) const;
+
+        /**
+         * @brief Number of runs.
+         * @return The count.
+         */
+        [[nodiscard]] std::size_t run_count() const;
+
+        /**
+         * @brief Bytes written to runs.
+         * @return The total size of the run files.
+         */
+        [[nodiscard]] std::uint64_t bytes() const;
+
+        /**
+         * @brief Whether every spill and append so far succeeded.
+         * @return false once an I/O error happened (spills from other threads check this).
+         */
+        [[nodiscard]] bool ok() const;
+
+        /**
+         * @brief Drop every run.
+         */
+        void clear();
+
+    private:
+        struct Run {
+            int fd;
+            std::uint64_t size;
+        };
+
+        int create_file() const;
+
+        bool write_block(Run &run, std::string_view block);
+
+        std::string directory;
+        mutable std::mutex mutex;
+        std::vector<Run> runs;
+        bool failed;
+    };
+}
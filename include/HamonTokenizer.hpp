@@ -0,0 +1,81 @@
+#pragma once
+#include <libintl.h>
+#include "HamonCount.hpp"
+#include <string_view>
+#include <vector>
+
+#ifndef I18N_GETTEXT_DEFINED
+#define _(String) gettext(String)
+#define I18N_GETTEXT_DEFINED
+#endif
+
+namespace dualys {
+    /**
+     * @brief Implementation used to find whitespace in a chunk.
+     */
+    enum class TokenizerKernel {
+        /// Portable byte-by-byte classification.
+        Scalar,
+        /// 16 bytes per compare (x86 SSE2).
+        Sse2,
+        /// 32 bytes per compare (x86 AVX2).
+        Avx2
+    };
+
+    /**
+     * @brief Whitespace tokenizer for the map phase.
+     *
+     * Tokens are the maximal runs of bytes that are not whitespace in the "C"
+     * locale (space, \\t, \\n, \\v, \\f, \\r), which is exactly what
+     * `std::istream >> std::string` produces. Each 64-byte block is classified
+     * into a whitespace bitmask (with SIMD compares when available); token
+     * boundaries are then found with bit scans, and tokens are handed out as
+     * string_views into the chunk, without copying or allocating.
+     */
+    class HamonTokenizer {
+    public:
+        /**
+         * @brief The fastest kernel supported by this CPU (checked once with CPUID).
+         * @return Avx2, Sse2 or Scalar.
+         */
+        [[nodiscard]] static TokenizerKernel best_kernel();
+
+        /**
+         * @brief Whether a kernel can run on this CPU.
+         * @param kernel The kernel to check.
+         * @return true if the kernel was compiled in and the CPU supports its instructions.
+         */
+        [[nodiscard]] static bool is_supported(TokenizerKernel kernel);
+
+        /**
+         * @brief Human-readable kernel name, for logs and benchmarks.
+         * @param kernel The kernel.
+         * @return "scalar", "sse2" or "avx2".
+         */
+        [[nodiscard]] static const char *kernel_name(TokenizerKernel kernel);
+
+        /**
+         * @brief Count every token of a chunk into a table, using best_kernel().
+         * @param text The chunk.
+         * @param counts The table to add the tokens to.
+         */
+        static void count(std::string_view text, WordCountTable &counts);
+
+        /**
+         * @brief Count every token of a chunk into a table with a given kernel.
+         * @param text The chunk.
+         * @param counts The table to add the tokens to.
+         * @param kernel The kernel to use; must be supported.
+         */
+        static void count(std::string_view text, WordCountTable &counts, TokenizerKernel kernel);
+
+        /**
+         * @brief Split a chunk into its tokens.
+         * @param text The chunk.
+         * @param kernel The kernel to use; must be supported.
+         * @return Views into text, in order.
+         */
+        [[nodiscard]] static std::vector<std::string_view> split(std::string_view text,
+                                                                 TokenizerKernel kernel = best_kernel());
+    };
+}
@@ -0,0 +1,175 @@
+#pragma once
+#include <libintl.h>
+#include <linux/io_uring.h>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <sys/socket.h>
+
+#ifndef I18N_GETTEXT_DEFINED
+#define _(String) gettext(String)
+#define I18N_GETTEXT_DEFINED
+#endif
+
+namespace dualys {
+    /**
+     * @brief How a node performs its socket and file I/O.
+     */
+    enum class IoBackend {
+        /// io_uring when the kernel supports it, epoll otherwise.
+        Auto,
+        /// Readiness through epoll, then one recv/writev/pread per transfer.
+        Epoll,
+        /// Batched operations submitted through an io_uring.
+        Uring
+    };
+
+    /**
+     * @brief Minimal io_uring: a submission and a completion ring shared with the kernel.
+     *
+     * Operations are queued with the prep_*() functions and handed to the kernel by
+     * enter(), which can also wait for completions in the same system call; a batch
+     * of operations therefore costs one syscall instead of one each. The ring talks to
+     * the kernel directly (io_uring_setup/io_uring_enter), so it needs no library.
+     * A ring is not thread-safe: each thread that submits uses its own.
+     */
+    class IoUring {
+    public:
+        /**
+         * @brief Set up a ring.
+         * @param entries Size of the submission queue (rounded up to a power of two by the kernel).
+         * @note Check is_open(): setup fails on kernels without io_uring or where it is disabled.
+         */
+        explicit IoUring(unsigned entries);
+
+        ~IoUring();
+
+        IoUring(const IoUring &) = delete;
+
+        IoUring &operator=(const IoUring &) = delete;
+
+        /**
+         * @brief Whether io_uring can be used for the node's I/O on this kernel.
+         * @return true if a ring can be set up and supports every operation used here.
+         * @note Probed once per process.
+         */
+        [[nodiscard]] static bool available();
+
+        /**
+         * @brief Resolve IoBackend::Auto.
+         * @param requested The requested backend.
+         * @return Uring if it was requested (or Auto) and is available, Epoll otherwise.
+         */
+        [[nodiscard]] static IoBackend resolve(IoBackend requested);
+
+        /**
+         * @brief Whether the ring was set up.
+         * @return true if operations can be submitted.
+         */
+        [[nodiscard]] bool is_open() const;
+
+        /**
+         * @brief Wait for one readiness event on a descriptor (IORING_OP_POLL_ADD).
+         * @param fd The descriptor.
+         * @param events poll() event mask (POLLIN, POLLOUT, POLLRDHUP; same values as epoll's).
+         * @param user_data Returned with the completion.
+         * @return false if the full submission queue could not be flushed.
+         */
+        bool prep_poll(int fd, std::uint32_t events, std::uint64_t user_data);
+
+        /**
+         * @brief Receive from a socket.
+         * @param fd The socket.
+         * @param buffer Destination.
+         * @param flags recv() flags; MSG_WAITALL completes only once the buffer is full.
+         * @param user_data Returned with the completion.
+         * @return false if the full submission queue could not be flushed.
+         */
+        bool prep_recv(int fd, std::span<char> buffer, int flags, std::uint64_t user_data);
+
+        /**
+         * @brief Send a message on a socket.
+         * @param fd The socket.
+         * @param message The message; must stay valid until the operation completes.
+         * @param flags sendmsg() flags.
+         * @param user_data Returned with the completion.
+         * @param link Whether the next queued operation only starts once this one succeeded.
+         * @return false if the full submission queue could not be flushed.
+         */
+        bool prep_sendmsg(int fd, const msghdr *message, int flags, std::uint64_t user_data, bool link);
+
+        /**
+         * @brief Accept connections on a listening socket.
+         * @param fd The listening socket.
+         * @param flags accept4() flags for the new sockets.
+         * @param multishot Keep accepting (one completion per connection) until cancelled.
+         * @param user_data Returned with every completion.
+         * @return false if the full submission queue could not be flushed.
+         */
+        bool prep_accept(int fd, int flags, bool multishot, std::uint64_t user_data);
+
+        /**
+         * @brief Read from a file at an offset.
+         * @param fd The file.
+         * @param buffer Destination.
+         * @param offset File offset.
+         * @param user_data Returned with the completion.
+         * @return false if the full submission queue could not be flushed.
+         */
+        bool prep_read(int fd, std::span<char> buffer, std::uint64_t offset, std::uint64_t user_data);
+
+        /**
+         * @brief Cancel the queued or running operations submitted with a given user_data.
+         * @param target The user_data of the operations to cancel.
+         * @return false if the full submission queue could not be flushed.
+         * @note The cancellation itself completes with user_data 0.
+         */
+        bool prep_cancel(std::uint64_t target);
+
+        /**
+         * @brief Submit the queued operations and wait for completions.
+         * @param wait_for Number of completions to wait for (0 = just submit).
+         * @param timeout_ms Longest wait in milliseconds; -1 waits without limit.
+         * @return false on an error other than a timeout or an interruption.
+         */
+        bool enter(unsigned wait_for = 0, int timeout_ms = -1);
+
+        /**
+         * @brief Pop the next completion.
+         * @param user_data The completed operation's user_data.
+         * @param result Its result (bytes, descriptor or mask; -errno on failure).
+         * @param flags Completion flags (IORING_CQE_F_MORE: a multishot operation stays armed).
+         * @return false if no completion is waiting.
+         */
+        bool next_completion(std::uint64_t &user_data, std::int32_t &result, std::uint32_t &flags);
+
+        /**
+         * @brief Number of io_uring_enter calls made so far.
+         * @return The count.
+         */
+        [[nodiscard]] std::size_t enter_calls() const;
+
+    private:
+        io_uring_sqe *next_sqe();
+
+        int ring_fd;
+        void *sq_map;
+        std::size_t sq_map_size;
+        void *cq_map;
+        std::size_t cq_map_size;
+        io_uring_sqe *sqes;
+        std::size_t sqes_size;
+        unsigned *sq_head;
+        unsigned *sq_tail;
+        unsigned sq_mask;
+        unsigned sq_entries;
+        unsigned *sq_array;
+        unsigned *cq_head;
+        unsigned *cq_tail;
+        unsigned cq_mask;
+        io_uring_cqe *cqes;
+        unsigned queued_tail;
+        unsigned submitted_tail;
+        std::size_t enters;
+    };
+}
@@ -1,4 +1,5 @@
 #include "../include/Hamon.hpp"
+#include "../include/HamonPlacement.hpp"
 #include <iostream>
 #include <vector>
 #include <algorithm>
@@ -7,6 +8,7 @@
 #include <sstream>
 #include <stdexcept>
 #include <filesystem>
+#include <optional>
 
 using namespace dualys;
 namespace fs = std::filesystem;
@@ -101,10 +103,6 @@ void HamonParser::parse_host_port(const std::string &s, std::string &host, int &
     }
 }
 
-bool HamonParser::is_power_of_two(const unsigned x) {
-    return x && !(x & (x - 1));
-}
-
 int HamonParser::log2i(unsigned x) {
     int r = 0;
     while (x >>= 1) ++r;
@@ -393,7 +391,30 @@ void HamonParser::parse_line(const std::string &line) {
     if (starts_with(s, "@topology")) {
         const auto rest = trim(s.substr(std::string("@topology").size()));
         if (rest.empty()) bad("@topology expects a value (e.g., hypercube)");
-        topology = trim(rest);
+        const auto toks = split_ws(rest);
+        topology = toks[0];
+        topologyRows = topologyCols = -1;
+        bool wrap = topology == "torus";
+        for (size_t i = 1; i < toks.size(); ++i) {
+            const auto eq = toks[i].find('=');
+            if (eq == std::string::npos) bad("@topology parameters are key=value: " + toks[i]);
+            const std::string key = toks[i].substr(0, eq);
+            const std::string value = toks[i].substr(eq + 1);
+            long long v = 0;
+            if (key == "wrap") {
+                wrap = is_truthy(value);
+            } else if ((key == "rows" || key == "cols") && str_to_int(value, v) && v > 0) {
+                (key == "rows" ? topologyRows : topologyCols) = static_cast<int>(v);
+            } else {
+                bad("Invalid @topology parameter: " + toks[i]);
+            }
+        }
+        // A mesh that wraps around is a torus; open grids and full graphs are not run.
+        if (topology == "mesh" && wrap) topology = "torus";
+        if (topology != "hypercube" && topology != "ring" && topology != "torus") {
+            bad("Unsupported @topology " + rest + " (use hypercube, ring, or torus / mesh wrap=true)");
+        }
+        if (topology != "torus" && (topologyRows > 0 || topologyCols > 0)) bad("rows/cols only apply to a torus");
         return;
     }
     if (starts_with(s, "@autoprefix") || starts_with(s, "@auto")) {
@@ -469,6 +490,17 @@ void HamonParser::parse_line(const std::string &line) {
         return;
     }
 
+    if (starts_with(s, "@threads")) {
+        if (currentNodeId < 0) bad("@threads used outside of @node");
+        const auto toks = split_ws(s);
+        if (toks.size() != 2) bad("@threads expects 1 integer");
+        int threads = -1;
+        try { threads = std::stoi(toks[1]); } catch (...) { bad("@threads expects integer"); }
+        if (threads <= 0) bad("@threads must be > 0");
+        ensure_node(currentNodeId).threads = threads;
+        return;
+    }
+
     if (starts_with(s, "@ip")) {
         if (currentNodeId < 0) bad("@ip used outside of @node");
         const auto rest = trim(s.substr(std::string("@ip").size()));
@@ -510,17 +542,23 @@ void HamonParser::finalize() {
     }
 
     // 3) Calculer la dimension si hypercube et non fourni
+    if (topology != "hypercube" && dimensions > 0) bad("@dim only applies to a hypercube");
+    if (topology == "torus") {
+        // La grille: rows x cols == @use; un côté manquant se déduit de l'autre
+        if (topologyRows < 0 && topologyCols > 0) topologyRows = nodes / topologyCols;
+        const int cols = topologyCols > 0 ? topologyCols : (topologyRows > 0 ? nodes / topologyRows : 1);
+        if (topologyRows == 0 || (topologyRows > 0 && topologyRows * cols != nodes)) {
+            bad("@topology torus: rows x cols must equal @use");
+        }
+    }
     if (topology == "hypercube") {
+        // Le plus petit cube qui contient les ids 0..N-1; hors puissance de deux, les nœuds
+        // en trop sont repliés sur le cube inférieur (voir HamonCube)
+        const int fit = nodes > 1 ? log2i(static_cast<unsigned>(nodes - 1)) + 1 : 0;
         if (dimensions < 0) {
-            if (!is_power_of_two(static_cast<unsigned>(nodes))) {
-                bad("@use must be a power of two or provide @dim explicitly for hypercube");
-            }
-            dimensions = log2i(static_cast<unsigned>(nodes));
-        } else {
-            // cohérence 2^dim == nodes
-            if (const int expect = 1 << dimensions; expect != nodes) {
-                bad("@dim inconsistent with @use for hypercube");
-            }
+            dimensions = fit;
+        } else if (dimensions != fit) {
+            bad("@dim inconsistent with @use for hypercube (2^(dim-1) < @use <= 2^dim)");
         }
     }
 
@@ -541,6 +579,20 @@ void HamonParser::finalize() {
         }
     }
 
+    // 5) Voisins par défaut (ring / torus: le graphe de HamonCube)
+    if (topology != "hypercube") {
+        std::optional<HamonCube> graph;
+        try {
+            graph.emplace(nodes, get_topology_spec());
+        } catch (const std::invalid_argument &e) {
+            bad(std::string("@topology ") + topology + ": " + e.what());
+        }
+        if (topology == "torus") topologyRows = graph->getRows();
+        for (int id = 0; id < nodes; ++id) {
+            auto &n = *config[static_cast<std::size_t>(id)];
+            if (n.neighbors.empty()) n.neighbors = graph->getNode(static_cast<std::size_t>(id)).neighbors;
+        }
+    }
     // 5) Voisins par défaut (hypercube)
     if (topology == "hypercube") {
         for (int id = 0; id < nodes; ++id) {
@@ -575,6 +627,17 @@ const std::string &HamonParser::get_topology() const {
     return topology;
 }
 
+TopologySpec HamonParser::get_topology_spec() const {
+    TopologySpec spec;
+    if (topology == "ring") spec.kind = TopologyKind::Ring;
+    if (topology == "torus") {
+        spec.kind = TopologyKind::Torus;
+        spec.rows = std::max(topologyRows, 0);
+        spec.columns = std::max(topologyCols, 0);
+    }
+    return spec;
+}
+
 std::vector<NodeCfg> HamonParser::materialize_nodes() const {
     std::vector<NodeCfg> out;
     out.reserve(config.size());
@@ -582,17 +645,44 @@ std::vector<NodeCfg> HamonParser::materialize_nodes() const {
     return out;
 }
 
+std::vector<NodeConfig> HamonParser::node_configs() const {
+    std::vector<NodeConfig> out;
+    for (const NodeCfg &n: materialize_nodes()) {
+        NodeConfig cfg;
+        cfg.id = n.id;
+        cfg.role = n.role;
+        cfg.ip_address = n.host;
+        cfg.port = n.port;
+        cfg.map_threads = n.threads > 0 ? n.threads : 0;
+        cfg.numa = n.numa;
+        cfg.core = n.core;
+        out.push_back(cfg);
+    }
+    return out;
+}
+
 void HamonParser::print_plan(std::ostream &os) const {
+    print_plan(os, HamonCpuTopology::discover());
+}
+
+void HamonParser::print_plan(std::ostream &os, const HamonCpuTopology &cpus) const {
     os << "[hamon] Cluster: " << nodes << " nodes; topology=" << topology;
     if (topology == "hypercube") os << "; dim=" << dimensions;
+    if (topology == "torus") os << "; grid=" << topologyRows << "x" << nodes / std::max(topologyRows, 1);
+    os << "\n[hamon] CPUs: " << cpus.summary();
+    // Placement of the nodes in ID order, as the orchestrator and the Make runner resolve it.
+    const std::vector<NodePlacement> placements = HamonPlacement::plan(node_configs(), cpus.numa_domains());
+    std::size_t next = 0;
     os << "\n[hamon] Nodes:\n";
     for (const auto &opt: config)
         if (opt.has_value()) {
-            const auto &[id, role, numa, core, host, port, neighbors] = *opt;
+            const auto &[id, role, numa, core, threads, host, port, neighbors] = *opt;
             os << "  • Node " << id
                     << " | role=" << (role.empty() ? "<unset>" : role)
-                    << " | core=" << core
-                    << " | numa=" << numa
+                    << " | core=" << (core >= 0 ? std::to_string(core) : std::string("auto"))
+                    << " | numa=" << (numa >= 0 ? std::to_string(numa) : std::string("auto"))
+                    << " | placement=" << HamonPlacement::describe(placements[next++])
+                    << " | threads=" << (threads > 0 ? std::to_string(threads) : std::string("auto"))
                     << " | endpoint=" << host << ":" << port
                     << " | neighbors=[";
             for (size_t i = 0; i < neighbors.size(); ++i) {
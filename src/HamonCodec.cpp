@@ -0,0 +1,186 @@
+#include "../include/HamonCodec.hpp"
+#include <algorithm>
+#include <iterator>
+
+using namespace dualys;
+
+static std::size_t shared_prefix(const std::string_view a, const std::string_view b) {
+    const std::size_t n = std::min(a.size(), b.size());
+    std::size_t i = 0;
+    while (i < n && a[i] == b[i]) ++i;
+    return i;
+}
+
+std::size_t HamonCodec::varint_size(std::uint64_t value) {
+    std::size_t n = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++n;
+    }
+    return n;
+}
+
+char *HamonCodec::put_varint(std::uint64_t value, char *out) {
+    while (value >= 0x80) {
+        *out++ = static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    *out++ = static_cast<char>(value);
+    return out;
+}
+
+bool HamonCodec::get_varint(const char *&in, const char *end, std::uint64_t &value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64 && in < end; shift += 7) {
+        const auto byte = static_cast<unsigned char>(*in++);
+        value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+template<class Entries>
+static std::size_t encoded_size_of(const Entries &entries) {
+    std::size_t size = 1 + HamonCodec::varint_size(std::size(entries));
+    std::string_view previous;
+    for (const auto &[word, count]: entries) {
+        const std::size_t shared = shared_prefix(previous, word);
+        const std::size_t suffix = word.size() - shared;
+        size += HamonCodec::varint_size(shared) + HamonCodec::varint_size(suffix) + suffix +
+                HamonCodec::varint_size(count);
+        previous = word;
+    }
+    return size;
+}
+
+template<class Entries>
+static std::size_t encode_entries(const Entries &entries, char *out) {
+    char *p = out;
+    *p++ = static_cast<char>(HamonCodec::magic);
+    p = HamonCodec::put_varint(std::size(entries), p);
+    std::string_view previous;
+    for (const auto &[word, count]: entries) {
+        const std::size_t shared = shared_prefix(previous, word);
+        const std::size_t suffix = word.size() - shared;
+        p = HamonCodec::put_varint(shared, p);
+        p = HamonCodec::put_varint(suffix, p);
+        p = std::copy_n(word.data() + shared, suffix, p);
+        p = HamonCodec::put_varint(count, p);
+        previous = word;
+    }
+    return static_cast<std::size_t>(p - out);
+}
+
+// Calls merge(word, count) for every entry of the payload.
+template<class Merge>
+static bool decode_entries(const std::string_view payload, Merge &&merge) {
+    const char *p = payload.data();
+    const char *end = p + payload.size();
+    if (p == end || static_cast<unsigned char>(*p++) != HamonCodec::magic) return false;
+    std::uint64_t entries = 0;
+    if (!HamonCodec::get_varint(p, end, entries)) return false;
+    std::string word;
+    for (std::uint64_t i = 0; i < entries; ++i) {
+        std::uint64_t shared = 0;
+        std::uint64_t suffix = 0;
+        std::uint64_t count = 0;
+        if (!HamonCodec::get_varint(p, end, shared) || !HamonCodec::get_varint(p, end, suffix)) return false;
+        if (shared > word.size() || suffix > static_cast<std::uint64_t>(end - p)) return false;
+        word.resize(static_cast<std::size_t>(shared));
+        word.append(p, static_cast<std::size_t>(suffix));
+        p += suffix;
+        if (!HamonCodec::get_varint(p, end, count)) return false;
+        merge(word, count);
+    }
+    return p == end;
+}
+
+std::size_t HamonCodec::encoded_size(const WordCountMap &counts) {
+    return encoded_size_of(counts);
+}
+
+std::size_t HamonCodec::encoded_size(const WordCountEntries &entries) {
+    return encoded_size_of(entries);
+}
+
+std::size_t HamonCodec::encode_into(const WordCountMap &counts, char *out) {
+    return encode_entries(counts, out);
+}
+
+std::size_t HamonCodec::encode_into(const WordCountEntries &entries, char *out) {
+    return encode_entries(entries, out);
+}
+
+std::string HamonCodec::encode(const WordCountMap &counts) {
+    std::string out(encoded_size(counts), '\0');
+    encode_into(counts, out.data());
+    return out;
+}
+
+std::string HamonCodec::encode(const WordCountTable &counts) {
+    const WordCountEntries entries = counts.sorted();
+    std::string out(encoded_size(entries), '\0');
+    encode_into(entries, out.data());
+    return out;
+}
+
+bool HamonCodec::decode_and_merge(const std::string_view payload, WordCountMap &counts) {
+    // Keys arrive sorted: the insertion point is right after the previous one.
+    auto hint = counts.begin();
+    return decode_entries(payload, [&](const std::string &word, const std::uint64_t count) {
+        const auto it = counts.try_emplace(hint, word, 0);
+        it->second += count;
+        hint = std::next(it);
+    });
+}
+
+bool HamonCodec::decode_and_merge(const std::string_view payload, WordCountTable &counts) {
+    return decode_entries(payload, [&](const std::string &word, const std::uint64_t count) {
+        counts.add(word, count);
+    });
+}
+
+CodecCursor::CodecCursor(const std::string_view p_payload)
+    : at(p_payload.data()), end(p_payload.data() + p_payload.size()), left(0), current_count(0), broken(false) {
+    if (at == end || static_cast<unsigned char>(*at++) != HamonCodec::magic || !HamonCodec::get_varint(at, end, left)) {
+        broken = true;
+        left = 0;
+    }
+}
+
+bool CodecCursor::next() {
+    if (left == 0) {
+        if (!broken && at != end) broken = true; // trailing bytes
+        return false;
+    }
+    std::uint64_t shared = 0;
+    std::uint64_t suffix = 0;
+    if (!HamonCodec::get_varint(at, end, shared) || !HamonCodec::get_varint(at, end, suffix) ||
+        shared > current.size() || suffix > static_cast<std::uint64_t>(end - at)) {
+        broken = true;
+        left = 0;
+        return false;
+    }
+    current.resize(static_cast<std::size_t>(shared));
+    current.append(at, static_cast<std::size_t>(suffix));
+    at += suffix;
+    if (!HamonCodec::get_varint(at, end, current_count)) {
+        broken = true;
+        left = 0;
+        return false;
+    }
+    --left;
+    return true;
+}
+
+std::string_view CodecCursor::word() const {
+    return current;
+}
+
+std::uint64_t CodecCursor::count() const {
+    return current_count;
+}
+
+bool CodecCursor::failed() const {
+    return broken;
+}
@@ -0,0 +1,248 @@
+#include "../include/HamonCollectives.hpp"
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <iostream>
+
+using namespace dualys;
+
+namespace {
+    std::string header_of(const int node, const std::size_t length) {
+        return std::to_string(node) + ' ' + std::to_string(length);
+    }
+
+    bool parse_header(const std::string_view message, int &node, std::size_t &length) {
+        const char *end = message.data() + message.size();
+        const auto [after_node, node_error] = std::from_chars(message.data(), end, node);
+        if (node_error != std::errc{} || after_node == end || *after_node != ' ') return false;
+        const auto [after_length, length_error] = std::from_chars(after_node + 1, end, length);
+        return length_error == std::errc{} && after_length == end;
+    }
+}
+
+HamonCollectives::HamonCollectives(CollectiveLinks p_links, const int p_self, const int p_node_count,
+                                   const std::size_t p_segment_bytes)
+    : links(std::move(p_links))
+      , self(p_self)
+      , node_count(p_node_count)
+      , segment_bytes(std::max<std::size_t>(p_segment_bytes, 1)) {
+}
+
+int HamonCollectives::parent_of(const int node) {
+    return node == 0 ? -1 : node & (node - 1);
+}
+
+std::vector<int> HamonCollectives::children_of(const int node, const int node_count) {
+    // Bits below the lowest set one; node 0 has them all.
+    const int below = node == 0 ? static_cast<int>(std::bit_ceil(static_cast<unsigned>(node_count))) : node & -node;
+    std::vector<int> children;
+    for (int bit = below >> 1; bit > 0; bit >>= 1) {
+        if (node + bit < node_count) children.push_back(node + bit);
+    }
+    return children;
+}
+
+int HamonCollectives::subtree_end(const int node, const int node_count) {
+    if (node == 0) return node_count;
+    return std::min(node + (node & -node), node_count);
+}
+
+bool HamonCollectives::fail(const char *what, const int peer) const {
+    std::cerr << "[Node " << self << "] " << what << ": failed or malformed message from node " << peer << std::endl;
+    return false;
+}
+
+void HamonCollectives::send_piece(const int peer, const int node, const std::string_view piece) const {
+    links.send(peer, header_of(node, piece.size()));
+    for (std::size_t at = 0; at < piece.size(); at += segment_bytes) {
+        links.send(peer, std::string(piece.substr(at, segment_bytes)));
+    }
+}
+
+Task<bool> HamonCollectives::receive_header(const int peer, std::string &message, int &node,
+                                            std::size_t &length) const {
+    const bool received = co_await links.receive(peer, message);
+    if (!received) co_return false;
+    if (message.empty()) {
+        node = -1; // end of the stream
+        co_return true;
+    }
+    co_return parse_header(message, node, length);
+}
+
+Task<bool> HamonCollectives::receive_pieces(const int peer, const int first, const int last, const int relay,
+                                            std::vector<std::string> &all, const int modulus) const {
+    std::string message;
+    int node = -1;
+    std::size_t length = 0;
+    while (true) {
+        const bool headed = co_await receive_header(peer, message, node, length);
+        if (!headed) co_return false;
+        if (node < 0) co_return true;
+        if (node >= node_count || node % modulus < first || node % modulus >= last) co_return false;
+        if (relay >= 0) links.send(relay, std::move(message));
+        else all[static_cast<std::size_t>(node)].clear();
+        for (std::size_t got = 0; got < length;) {
+            const bool received = co_await links.receive(peer, message);
+            if (!received || message.empty() || message.size() > length - got) co_return false;
+            got += message.size();
+            if (relay >= 0) links.send(relay, std::move(message));
+            else all[static_cast<std::size_t>(node)] += message;
+        }
+    }
+}
+
+Task<bool> HamonCollectives::broadcast(std::string &payload) {
+    const std::vector<int> children = children_of(self, node_count);
+    if (self == 0) {
+        // Segment by segment to every child, so each subtree starts forwarding after one segment.
+        const std::string header = header_of(0, payload.size());
+        for (const int child: children) links.send(child, header);
+        for (std::size_t at = 0; at < payload.size(); at += segment_bytes) {
+            const std::string_view segment = std::string_view(payload).substr(at, segment_bytes);
+            for (const int child: children) links.send(child, std::string(segment));
+        }
+        co_return true;
+    }
+    const int parent = parent_of(self);
+    std::string message;
+    int node = -1;
+    std::size_t length = 0;
+    const bool headed = co_await receive_header(parent, message, node, length);
+    if (!headed || node != 0) co_return fail("Broadcast", parent);
+    for (const int child: children) links.send(child, message);
+    payload.clear();
+    payload.reserve(length);
+    while (payload.size() < length) {
+        const bool received = co_await links.receive(parent, message);
+        if (!received || message.empty() || message.size() > length - payload.size()) {
+            co_return fail("Broadcast", parent);
+        }
+        payload += message;
+        for (std::size_t i = 0; i < children.size(); ++i) {
+            links.send(children[i], i + 1 == children.size() ? std::move(message) : message);
+        }
+    }
+    co_return true;
+}
+
+Task<bool> HamonCollectives::scatter(std::vector<std::string> pieces, std::string &mine) {
+    if (self != 0) {
+        mine.clear();
+        const SegmentSink append = [&mine](std::string &segment) { mine += segment; };
+        const bool received = co_await receive_scatter(append);
+        co_return received;
+    }
+    if (pieces.size() != static_cast<std::size_t>(node_count)) {
+        std::cerr << "[Node 0] Scatter: " << pieces.size() << " pieces for " << node_count << " nodes" << std::endl;
+        co_return false;
+    }
+    // The last bytes on every link are the child's own: nothing is left to forward at the end.
+    for (const int child: children_of(0, node_count)) {
+        for (int node = subtree_end(child, node_count) - 1; node >= child; --node) {
+            send_piece(child, node, pieces[static_cast<std::size_t>(node)]);
+        }
+        links.send(child, {});
+    }
+    mine = std::move(pieces[0]);
+    co_return true;
+}
+
+void HamonCollectives::scatter_file(const int file_fd, const std::vector<ShardRange> &ranges) const {
+    for (const int child: children_of(0, node_count)) {
+        for (int node = subtree_end(child, node_count) - 1; node >= child; --node) {
+            const ShardRange &range = ranges[static_cast<std::size_t>(node)];
+            links.send(child, header_of(node, range.length));
+            for (std::size_t at = 0; at < range.length; at += segment_bytes) {
+                links.send_file_range(child, file_fd, {range.offset + at, std::min(segment_bytes, range.length - at)});
+            }
+        }
+        links.send(child, {});
+    }
+}
+
+Task<bool> HamonCollectives::receive_scatter(const SegmentSink &own) {
+    const int parent = parent_of(self);
+    const int end = subtree_end(self, node_count);
+    std::string message;
+    int node = -1;
+    std::size_t length = 0;
+    while (true) {
+        const bool headed = co_await receive_header(parent, message, node, length);
+        if (!headed) co_return fail("Scatter", parent);
+        if (node < 0) break;
+        if (node < self || node >= end) co_return fail("Scatter", parent);
+        // The child whose subtree holds the piece: the highest bit where the IDs differ.
+        const int next = node == self ? -1 : self | static_cast<int>(std::bit_floor(static_cast<unsigned>(node ^ self)));
+        if (next >= 0) links.send(next, std::move(message));
+        for (std::size_t got = 0; got < length;) {
+            const bool received = co_await links.receive(parent, message);
+            if (!received || message.empty() || message.size() > length - got) co_return fail("Scatter", parent);
+            got += message.size();
+            if (next >= 0) links.send(next, std::move(message));
+            else own(message);
+        }
+    }
+    for (const int child: children_of(self, node_count)) links.send(child, {});
+    co_return true;
+}
+
+Task<bool> HamonCollectives::gather(std::string mine, std::vector<std::string> &all) {
+    const int parent = parent_of(self);
+    if (self == 0) {
+        all.assign(static_cast<std::size_t>(node_count), {});
+        all[0] = std::move(mine);
+    } else {
+        send_piece(parent, self, mine);
+    }
+    // Smallest subtree first: it is the first to have everything.
+    std::vector<int> children = children_of(self, node_count);
+    std::ranges::reverse(children);
+    for (const int child: children) {
+        const bool relayed = co_await receive_pieces(child, child, subtree_end(child, node_count), parent, all,
+                                                     node_count);
+        if (!relayed) co_return fail("Gather", child);
+    }
+    if (parent >= 0) links.send(parent, {});
+    co_return true;
+}
+
+Task<bool> HamonCollectives::allgather(std::string mine, std::vector<std::string> &all) {
+    all.assign(static_cast<std::size_t>(node_count), {});
+    all[static_cast<std::size_t>(self)] = std::move(mine);
+    // Past a power of two, extra node core + i hands its piece to node i and gets everything back.
+    const int core = static_cast<int>(std::bit_floor(static_cast<unsigned>(node_count)));
+    const int fold = self >= core ? self - core : (self + core < node_count ? self + core : -1);
+    if (self >= core) {
+        send_piece(fold, self, all[static_cast<std::size_t>(self)]);
+        links.send(fold, {});
+        const bool received = co_await receive_pieces(fold, 0, node_count, -1, all, node_count);
+        if (!received) co_return fail("Allgather", fold);
+        co_return true;
+    }
+    if (fold >= 0) {
+        const bool received = co_await receive_pieces(fold, fold, fold + 1, -1, all, node_count);
+        if (!received) co_return fail("Allgather", fold);
+    }
+    for (int bit = 1; bit < core; bit <<= 1) {
+        // After the rounds below bit, this node holds the block of IDs that differ from it in
+        // those bits, and the extra nodes folded onto that block.
+        const int partner = self ^ bit;
+        const int first = self & ~(bit - 1);
+        for (int node = first; node < first + bit; ++node) {
+            send_piece(partner, node, all[static_cast<std::size_t>(node)]);
+            if (node + core < node_count) send_piece(partner, node + core, all[static_cast<std::size_t>(node + core)]);
+        }
+        links.send(partner, {});
+        const int theirs = first ^ bit;
+        const bool swapped = co_await receive_pieces(partner, theirs, theirs + bit, -1, all, core);
+        if (!swapped) co_return fail("Allgather", partner);
+    }
+    if (fold >= 0) {
+        for (int node = 0; node < node_count; ++node) {
+            if (node != fold) send_piece(fold, node, all[static_cast<std::size_t>(node)]);
+        }
+        links.send(fold, {});
+    }
+    co_return true;
+}
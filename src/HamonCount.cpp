@@ -0,0 +1,224 @@
+#include "../include/HamonCount.hpp"
+#include <algorithm>
+#include <bit>
+#include <thread>
+
+using namespace dualys;
+
+Arena::Arena(const std::size_t p_block_size)
+    : block_size(p_block_size), reserved_bytes(0), cursor(nullptr), left(0) {
+}
+
+char *Arena::allocate(const std::size_t size) {
+    if (size > left) {
+        // Oversized keys get a block of their own so the current block is not wasted.
+        const std::size_t n = std::max(size, block_size);
+        blocks.push_back(std::make_unique_for_overwrite<char[]>(n));
+        reserved_bytes += n;
+        if (n > block_size) return blocks.back().get();
+        cursor = blocks.back().get();
+        left = n;
+    }
+    char *out = cursor;
+    cursor += size;
+    left -= size;
+    return out;
+}
+
+void Arena::release() {
+    blocks.clear();
+    reserved_bytes = 0;
+    cursor = nullptr;
+    left = 0;
+}
+
+void Arena::absorb(Arena &&other) {
+    for (auto &block: other.blocks) blocks.push_back(std::move(block));
+    reserved_bytes += other.reserved_bytes;
+    other.release();
+}
+
+std::size_t Arena::reserved() const {
+    return reserved_bytes;
+}
+
+std::uint64_t WordCountTable::hash(const std::string_view word) {
+    // 8 bytes per step, multiply-xorshift mixing; short words cost one or two steps.
+    constexpr std::uint64_t k = 0x9E3779B97F4A7C15ull;
+    std::uint64_t h = word.size() * k;
+    const char *p = word.data();
+    std::size_t n = word.size();
+    while (n >= 8) {
+        std::uint64_t v;
+        std::memcpy(&v, p, 8);
+        h = (h ^ v) * k;
+        h ^= h >> 29;
+        p += 8;
+        n -= 8;
+    }
+    if (n > 0) {
+        std::uint64_t v = 0;
+        std::memcpy(&v, p, n);
+        h = (h ^ v) * k;
+        h ^= h >> 29;
+    }
+    h *= 0xBF58476D1CE4E5B9ull;
+    return h ^ h >> 32;
+}
+
+WordCountTable::WordCountTable(const std::size_t expected_words) : mask(0), used(0) {
+    const std::size_t capacity = std::bit_ceil(std::max<std::size_t>(16, expected_words * 10 / 7 + 1));
+    slots.assign(capacity, Slot{});
+    mask = capacity - 1;
+}
+
+void WordCountTable::grow() {
+    std::vector<Slot> old(slots.size() * 2, Slot{});
+    old.swap(slots);
+    mask = slots.size() - 1;
+    for (const Slot &slot: old) {
+        if (slot.count != 0) place(slots, mask, slot); // arena pointers stay valid
+    }
+}
+
+void WordCountTable::add_hashed(const std::string_view word, const std::uint64_t word_hash, const std::uint64_t count) {
+    if (count == 0) return;
+    std::size_t i = word_hash & mask;
+    while (true) {
+        Slot &slot = slots[i];
+        if (slot.count == 0) break;
+        if (slot.hash == word_hash && slot.length == word.size() && key_of(slot) == word) {
+            slot.count += count;
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+    if ((used + 1) * 10 > slots.size() * 7) {
+        grow();
+        add_hashed(word, word_hash, count);
+        return;
+    }
+    Slot &slot = slots[i];
+    slot.hash = word_hash;
+    slot.count = count;
+    slot.length = static_cast<std::uint32_t>(word.size());
+    if (word.size() <= inline_capacity) {
+        std::memcpy(slot.key, word.data(), word.size());
+    } else {
+        char *copy = arena.allocate(word.size());
+        std::memcpy(copy, word.data(), word.size());
+        std::memcpy(slot.key, &copy, sizeof(copy));
+    }
+    ++used;
+}
+
+void WordCountTable::add(const std::string_view word, const std::uint64_t count) {
+    add_hashed(word, hash(word), count);
+}
+
+void WordCountTable::merge(const WordCountTable &other) {
+    for (const Slot &slot: other.slots) {
+        if (slot.count != 0) add_hashed(key_of(slot), slot.hash, slot.count);
+    }
+}
+
+// Runs work(0) .. work(n - 1) on n threads and waits for all of them.
+template<class Work>
+static void run_on_threads(const std::size_t n, Work &&work) {
+    std::vector<std::jthread> threads;
+    threads.reserve(n);
+    for (std::size_t t = 0; t < n; ++t) threads.emplace_back([&work, t] { work(t); });
+}
+
+WordCountTable WordCountTable::merge_parallel(std::vector<WordCountTable> parts) {
+    if (parts.empty()) return WordCountTable{};
+    if (parts.size() == 1) return std::move(parts.front());
+
+    std::size_t total = 0;
+    for (const WordCountTable &part: parts) total += part.size();
+    WordCountTable out(total);
+    const std::size_t k = parts.size();
+    const std::size_t range = (out.slots.size() + k - 1) / k; // home slots owned by each thread
+
+    // 1) Every thread sorts the entries of its own part by the thread owning their home slot.
+    std::vector<std::vector<std::vector<const Slot *> > > buckets(k, std::vector<std::vector<const Slot *> >(k));
+    run_on_threads(k, [&](const std::size_t t) {
+        for (const Slot &slot: parts[t].slots) {
+            if (slot.count != 0) buckets[t][(slot.hash & out.mask) / range].push_back(&slot);
+        }
+    });
+
+    // 2) Every thread inserts its entries, probing inside its own range only.
+    std::vector<std::vector<const Slot *> > deferred(k);
+    std::vector<std::size_t> inserted(k, 0);
+    run_on_threads(k, [&](const std::size_t t) {
+        const std::size_t end = std::min(out.slots.size(), (t + 1) * range);
+        for (std::size_t source = 0; source < k; ++source) {
+            for (const Slot *slot: buckets[source][t]) {
+                std::size_t i = slot->hash & out.mask;
+                for (; i < end; ++i) {
+                    Slot &dst = out.slots[i];
+                    if (dst.count == 0) {
+                        dst = *slot; // arena pointers are kept: the arenas are absorbed below
+                        ++inserted[t];
+                        break;
+                    }
+                    if (dst.hash == slot->hash && dst.length == slot->length && key_of(dst) == key_of(*slot)) {
+                        dst.count += slot->count;
+                        break;
+                    }
+                }
+                if (i == end) deferred[t].push_back(slot);
+            }
+        }
+    });
+    for (const std::size_t n: inserted) out.used += n;
+
+    // 3) Entries that ran off the end of their range probe into the next one (and wrap) as usual.
+    for (const auto &list: deferred) {
+        for (const Slot *slot: list) out.add_hashed(key_of(*slot), slot->hash, slot->count);
+    }
+    for (WordCountTable &part: parts) out.arena.absorb(std::move(part.arena));
+    return out;
+}
+
+std::uint64_t WordCountTable::find(const std::string_view word) const {
+    const std::uint64_t word_hash = hash(word);
+    for (std::size_t i = word_hash & mask; slots[i].count != 0; i = (i + 1) & mask) {
+        const Slot &slot = slots[i];
+        if (slot.hash == word_hash && slot.length == word.size() && key_of(slot) == word) return slot.count;
+    }
+    return 0;
+}
+
+std::size_t WordCountTable::size() const {
+    return used;
+}
+
+bool WordCountTable::empty() const {
+    return used == 0;
+}
+
+WordCountEntries WordCountTable::sorted() const {
+    WordCountEntries entries;
+    entries.reserve(used);
+    for_each([&](const std::string_view word, const std::uint64_t count) { entries.emplace_back(word, count); });
+    std::ranges::sort(entries, {}, &WordCountEntries::value_type::first);
+    return entries;
+}
+
+WordCountMap WordCountTable::to_map() const {
+    WordCountMap out;
+    for (const auto &[word, count]: sorted()) out.emplace_hint(out.end(), word, count);
+    return out;
+}
+
+void WordCountTable::clear() {
+    std::ranges::fill(slots, Slot{});
+    used = 0;
+    arena.release();
+}
+
+std::size_t WordCountTable::memory_usage() const {
+    return slots.size() * sizeof(Slot) + arena.reserved();
+}
@@ -0,0 +1,221 @@
+#include "../include/HamonCpuTopology.hpp"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <ranges>
+#include <set>
+#include <thread>
+#include <tuple>
+#include <sched.h>
+
+using namespace dualys;
+
+namespace {
+    // CPUs of the process's affinity mask; every CPU if it cannot be read.
+    std::vector<int> allowed_cpus() {
+        std::vector<int> cpus;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(static_cast<unsigned>(cpu), &set)) cpus.push_back(cpu);
+            }
+        }
+        if (cpus.empty()) {
+            for (int cpu = 0; cpu < static_cast<int>(std::max(1u, std::thread::hardware_concurrency())); ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    bool parse_int(const std::string_view text, int &value) {
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        return error == std::errc{} && end == text.data() + text.size();
+    }
+
+    // First line of a sysfs file, without its newline; false if it cannot be read.
+    bool read_line(const std::filesystem::path &path, std::string &text) {
+        std::ifstream in(path);
+        return static_cast<bool>(std::getline(in, text));
+    }
+
+    bool read_int(const std::filesystem::path &path, int &value) {
+        std::string text;
+        return read_line(path, text) && parse_int(text, value);
+    }
+
+    bool read_cpu_list(const std::filesystem::path &path, std::vector<int> &cpus) {
+        std::string text;
+        return read_line(path, text) && HamonCpuTopology::parse_cpu_list(text, cpus);
+    }
+
+    // Cache sizes read "32K", "12288K" or "1M".
+    std::size_t parse_size(const std::string &text) {
+        std::size_t value = 0;
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (error != std::errc{}) return 0;
+        if (end != text.data() + text.size() && *end == 'K') return value << 10;
+        if (end != text.data() + text.size() && *end == 'M') return value << 20;
+        return value;
+    }
+
+    std::vector<int> keep_usable(const std::vector<int> &cpus, const std::vector<int> &usable) {
+        std::vector<int> kept;
+        std::ranges::set_intersection(cpus, usable, std::back_inserter(kept));
+        return kept;
+    }
+
+    std::string plural(const std::size_t count, const std::string &noun) {
+        return std::to_string(count) + ' ' + noun + (count == 1 ? "" : "s");
+    }
+
+    std::string size_text(const std::size_t bytes) {
+        if (bytes >= std::size_t{1} << 20 && bytes % (std::size_t{1} << 20) == 0) {
+            return std::to_string(bytes >> 20) + " MiB";
+        }
+        return std::to_string(bytes >> 10) + " KiB";
+    }
+}
+
+bool HamonCpuTopology::parse_cpu_list(const std::string &text, std::vector<int> &cpus) {
+    cpus.clear();
+    std::string_view rest = text;
+    while (!rest.empty() && std::isspace(static_cast<unsigned char>(rest.back()))) rest.remove_suffix(1);
+    while (!rest.empty()) {
+        const auto comma = rest.find(',');
+        const std::string_view item = rest.substr(0, comma);
+        rest = comma == std::string_view::npos ? std::string_view() : rest.substr(comma + 1);
+        const auto dash = item.find('-');
+        int first = 0;
+        int last = 0;
+        if (!parse_int(item.substr(0, dash), first) || first < 0) return false;
+        last = first;
+        if (dash != std::string_view::npos && !parse_int(item.substr(dash + 1), last)) return false;
+        if (last < first) return false;
+        for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+    }
+    std::ranges::sort(cpus);
+    cpus.erase(std::ranges::unique(cpus).begin(), cpus.end());
+    return true;
+}
+
+HamonCpuTopology HamonCpuTopology::discover(const std::string &root, std::vector<int> allowed) {
+    if (allowed.empty()) allowed = allowed_cpus();
+    std::ranges::sort(allowed);
+    const std::filesystem::path cpu_root = std::filesystem::path(root) / "cpu";
+    std::vector<int> online;
+    std::vector<int> usable = allowed;
+    if (read_cpu_list(cpu_root / "online", online) && !keep_usable(online, allowed).empty()) {
+        usable = keep_usable(online, allowed);
+    }
+
+    // NUMA node of each CPU; memory-only nodes list no CPU.
+    std::map<int, int> numa_of;
+    std::error_code ec;
+    for (const auto &entry: std::filesystem::directory_iterator(std::filesystem::path(root) / "node", ec)) {
+        const std::string name = entry.path().filename().string();
+        int numa = 0;
+        std::vector<int> cpus;
+        if (name.rfind("node", 0) != 0 || !parse_int(std::string_view(name).substr(4), numa) || numa < 0) continue;
+        if (!read_cpu_list(entry.path() / "cpulist", cpus)) continue;
+        for (const int cpu: cpus) numa_of.emplace(cpu, numa);
+    }
+
+    HamonCpuTopology topology;
+    std::set<std::tuple<int, std::string, std::vector<int> > > seen_caches;
+    for (const int cpu: usable) {
+        const std::filesystem::path dir = cpu_root / ("cpu" + std::to_string(cpu));
+        CpuInfo info;
+        info.id = cpu;
+        if (!read_int(dir / "topology" / "physical_package_id", info.package) || info.package < 0) info.package = 0;
+        if (!read_int(dir / "topology" / "core_id", info.core)) info.core = cpu;
+        if (const auto numa = numa_of.find(cpu); numa != numa_of.end()) info.numa = numa->second;
+        // core_cpus_list replaced thread_siblings_list in Linux 5.16; both list the SMT siblings.
+        std::vector<int> siblings;
+        if (!read_cpu_list(dir / "topology" / "core_cpus_list", siblings)) {
+            (void) read_cpu_list(dir / "topology" / "thread_siblings_list", siblings);
+        }
+        info.siblings = keep_usable(siblings, usable);
+        if (!std::ranges::binary_search(info.siblings, cpu)) info.siblings = {cpu};
+        info.thread = static_cast<int>(std::ranges::lower_bound(info.siblings, cpu) - info.siblings.begin());
+        topology.cpu_list.push_back(std::move(info));
+
+        for (const auto &entry: std::filesystem::directory_iterator(dir / "cache", ec)) {
+            if (entry.path().filename().string().rfind("index", 0) != 0) continue;
+            CpuCache cache;
+            std::string size;
+            std::vector<int> shared;
+            if (!read_int(entry.path() / "level", cache.level)) continue;
+            if (!read_line(entry.path() / "type", cache.type)) continue;
+            if (read_line(entry.path() / "size", size)) cache.size_bytes = parse_size(size);
+            if (!read_cpu_list(entry.path() / "shared_cpu_list", shared)) shared = {cpu};
+            cache.cpus = keep_usable(shared, usable);
+            if (seen_caches.emplace(cache.level, cache.type, cache.cpus).second) {
+                topology.cache_list.push_back(std::move(cache));
+            }
+        }
+    }
+    std::ranges::sort(topology.cache_list, {}, [](const CpuCache &cache) {
+        return std::tie(cache.level, cache.type, cache.cpus);
+    });
+    return topology;
+}
+
+int HamonCpuTopology::package_count() const {
+    std::set<int> packages;
+    for (const CpuInfo &cpu: cpu_list) packages.insert(cpu.package);
+    return static_cast<int>(packages.size());
+}
+
+int HamonCpuTopology::core_count() const {
+    return static_cast<int>(std::ranges::count(cpu_list, 0, &CpuInfo::thread));
+}
+
+std::vector<NumaDomain> HamonCpuTopology::numa_domains() const {
+    std::map<int, NumaDomain> by_numa;
+    for (const CpuInfo &cpu: cpu_list) {
+        NumaDomain &domain = by_numa[cpu.numa];
+        domain.id = cpu.numa;
+        if (cpu.thread == 0) domain.cores.push_back(cpu.siblings);
+    }
+    std::vector<NumaDomain> domains;
+    for (auto &domain: by_numa | std::views::values) {
+        // First threads of every core before any SMT sibling.
+        for (std::size_t thread = 0;; ++thread) {
+            const std::size_t before = domain.cpus.size();
+            for (const auto &core: domain.cores) {
+                if (thread < core.size()) domain.cpus.push_back(core[thread]);
+            }
+            if (domain.cpus.size() == before) break;
+        }
+        domains.push_back(std::move(domain));
+    }
+    return domains;
+}
+
+std::string HamonCpuTopology::summary() const {
+    std::string text = plural(static_cast<std::size_t>(package_count()), "package") + ", " +
+                       plural(numa_domains().size(), "NUMA node") + ", " +
+                       plural(static_cast<std::size_t>(core_count()), "core") + ", " +
+                       plural(cpu_list.size(), "CPU");
+    // One entry per cache level and type: its size and how many instances there are.
+    std::map<std::pair<int, std::string>, std::pair<std::size_t, int> > levels;
+    for (const CpuCache &cache: cache_list) {
+        auto &[size, count] = levels[{cache.level, cache.type}];
+        size = std::max(size, cache.size_bytes);
+        ++count;
+    }
+    for (const auto &[key, value]: levels) {
+        const auto &[level, type] = key;
+        text += (key == levels.begin()->first ? "; L" : ", L") + std::to_string(level);
+        if (type == "Data") text += 'd';
+        else if (type == "Instruction") text += 'i';
+        text += ' ' + size_text(value.first);
+        if (value.second > 1) text += " x" + std::to_string(value.second);
+    }
+    return text;
+}
@@ -5,14 +5,83 @@
 #include <unistd.h>
 #include <thread>
 #include <cmath>
+#include <algorithm>
+#include <bit>
 using namespace dualys;
 
+bool TopologySpec::parse(const std::string &text, TopologySpec &spec) {
+    spec = {};
+    if (text == "hypercube") return true;
+    if (text == "ring") {
+        spec.kind = TopologyKind::Ring;
+        return true;
+    }
+    if (text.rfind("torus", 0) != 0) return false;
+    spec.kind = TopologyKind::Torus;
+    if (text.size() == 5) return true;
+    const auto x = text.find('x');
+    if (text[5] != ':' || x == std::string::npos) return false;
+    try {
+        spec.rows = std::stoi(text.substr(6, x - 6));
+        spec.columns = std::stoi(text.substr(x + 1));
+    } catch (...) {
+        return false;
+    }
+    return spec.rows > 0 && spec.columns > 0;
+}
+
 void HamonCube::initializeTopology() {
     for (size_t i = 0; i < static_cast<size_t>(node_count); ++i) {
         nodes[i].id = static_cast<int>(i);
-        for (int d = 0; d < dimension; ++d) {
-            nodes[i].neighbors.push_back(static_cast<int>(i ^ 1 << d));
+        if (kind == TopologyKind::Hypercube) {
+            for (int d = 0; d < dimension; ++d) {
+                if (const auto neighbor = i ^ size_t{1} << d; neighbor < nodes.size()) {
+                    nodes[i].neighbors.push_back(static_cast<int>(neighbor));
+                }
+            }
+            continue;
+        }
+        const int id = static_cast<int>(i);
+        std::vector<int> &neighbors = nodes[i].neighbors;
+        if (kind == TopologyKind::Ring) {
+            neighbors = {(id + node_count - 1) % node_count, (id + 1) % node_count};
+        } else {
+            const int r = id / columns;
+            const int c = id % columns;
+            neighbors = {
+                (r + rows - 1) % rows * columns + c, (r + 1) % rows * columns + c,
+                r * columns + (c + columns - 1) % columns, r * columns + (c + 1) % columns
+            };
+        }
+        // Small rings and grids reach the same neighbor both ways, or themselves.
+        std::ranges::sort(neighbors);
+        neighbors.erase(std::ranges::unique(neighbors).begin(), neighbors.end());
+        std::erase(neighbors, id);
+    }
+}
+
+void HamonCube::initializeRing() {
+    ring_order.clear();
+    ring_order.reserve(static_cast<size_t>(node_count));
+    if (kind == TopologyKind::Hypercube) {
+        for (int i = 0; i < 1 << dimension; ++i) {
+            if (const int code = i ^ i >> 1; code < node_count) ring_order.push_back(code);
+        }
+    } else if (kind == TopologyKind::Ring) {
+        for (int i = 0; i < node_count; ++i) ring_order.push_back(i);
+    } else if (rows % 2 == 0) {
+        // Snake along the rows: with an even row count it ends in column 0, below the start.
+        for (int r = 0; r < rows; ++r) {
+            for (int k = 0; k < columns; ++k) ring_order.push_back(r * columns + (r % 2 == 0 ? k : columns - 1 - k));
         }
+    } else {
+        // Odd row count: snake over columns 1.., which ends in the last column, wrap around
+        // to column 0 and climb it back to the start.
+        ring_order.push_back(0);
+        for (int r = 0; r < rows; ++r) {
+            for (int k = 1; k < columns; ++k) ring_order.push_back(r * columns + (r % 2 == 0 ? k : columns - k));
+        }
+        for (int r = rows - 1; r > 0; --r) ring_order.push_back(r * columns);
     }
 }
 
@@ -31,15 +100,72 @@ const Node &HamonCube::getNode(const size_t id) const {
     return nodes[id];
 }
 
-HamonCube::HamonCube(const int num_nodes) : node_count(num_nodes) {
-    if (num_nodes <= 0 || (num_nodes & (num_nodes - 1)) != 0) {
-        throw std::invalid_argument(_("Number of nodes must be a power of 2."));
+HamonCube::HamonCube(const int num_nodes) : HamonCube(num_nodes, TopologySpec{}) {
+}
+
+HamonCube::HamonCube(const int num_nodes, const TopologySpec spec) : node_count(num_nodes), kind(spec.kind) {
+    if (num_nodes <= 0) {
+        throw std::invalid_argument(_("Number of nodes must be positive."));
+    }
+    if (kind == TopologyKind::Torus) {
+        rows = spec.rows;
+        if (rows == 0) {
+            // Squarest grid: the largest divisor up to the square root.
+            rows = static_cast<int>(std::sqrt(static_cast<double>(num_nodes)));
+            while (num_nodes % rows != 0) --rows;
+        }
+        if (rows <= 0 || num_nodes % rows != 0 || (spec.columns > 0 && rows * spec.columns != num_nodes)) {
+            throw std::invalid_argument(_("The torus grid does not match the number of nodes."));
+        }
+        columns = num_nodes / rows;
+    } else {
+        columns = num_nodes;
     }
-    this->dimension = static_cast<int>(log2(num_nodes));
+    // Bits of the highest ID: the hypercube's dimension, and the depth of the binomial tree.
+    this->dimension = static_cast<int>(std::bit_width(static_cast<unsigned>(num_nodes - 1)));
     nodes.resize(static_cast<size_t>(node_count));
     initializeTopology();
+    initializeRing();
 }
 
 int HamonCube::getNodeCount() const {
     return node_count;
 }
+
+TopologyKind HamonCube::getKind() const {
+    return kind;
+}
+
+int HamonCube::getRows() const {
+    return rows;
+}
+
+int HamonCube::getColumns() const {
+    return columns;
+}
+
+const std::vector<int> &HamonCube::getRingOrder() const {
+    return ring_order;
+}
+
+int HamonCube::getCoreCount() const {
+    return static_cast<int>(std::bit_floor(static_cast<unsigned>(node_count)));
+}
+
+int HamonCube::getFoldPartner(const int id) const {
+    const int core = getCoreCount();
+    if (id >= core) return id - core;
+    return id + core < node_count ? id + core : -1;
+}
+
+const char *HamonCube::kindName(const TopologyKind kind) {
+    switch (kind) {
+        case TopologyKind::Ring:
+            return "ring";
+        case TopologyKind::Torus:
+            return "torus";
+        case TopologyKind::Hypercube:
+            break;
+    }
+    return "hypercube";
+}
@@ -0,0 +1,349 @@
+#include "../include/HamonFrame.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+
+using namespace dualys;
+
+static void put_be(unsigned char *out, std::uint64_t value, const std::size_t bytes) {
+    for (std::size_t i = bytes; i > 0; --i) {
+        out[i - 1] = static_cast<unsigned char>(value & 0xFF);
+        value >>= 8;
+    }
+}
+
+static std::uint64_t get_be(const unsigned char *in, const std::size_t bytes) {
+    std::uint64_t value = 0;
+    for (std::size_t i = 0; i < bytes; ++i) value = value << 8 | in[i];
+    return value;
+}
+
+// Body of a Hello frame: min version(2) max version(2) node ID(4).
+static constexpr std::size_t hello_size = 8;
+
+static std::array<std::uint32_t, 256> make_crc_table() {
+    std::array<std::uint32_t, 256> table{};
+    for (std::uint32_t i = 0; i < 256; ++i) {
+        std::uint32_t c = i;
+        for (int k = 0; k < 8; ++k) c = c & 1 ? 0xEDB88320u ^ c >> 1 : c >> 1;
+        table[i] = c;
+    }
+    return table;
+}
+
+bool HamonFrame::write_all(const int fd, const void *data, const std::size_t size) {
+    iovec iov{const_cast<void *>(data), size};
+    return writev_all(fd, &iov, 1);
+}
+
+bool HamonFrame::writev_all(const int fd, iovec *iov, std::size_t count) {
+    while (count > 0 && iov->iov_len == 0) {
+        ++iov;
+        --count;
+    }
+    while (count > 0) {
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        const ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        auto left = static_cast<std::size_t>(sent);
+        while (count > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char *>(iov->iov_base) + left;
+            iov->iov_len -= left;
+        }
+    }
+    return true;
+}
+
+bool HamonFrame::read_all(const int fd, void *data, const std::size_t size) {
+    auto *out = static_cast<char *>(data);
+    std::size_t done = 0;
+    while (done < size) {
+        const ssize_t got = recv(fd, out + done, size - done, 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        done += static_cast<std::size_t>(got);
+    }
+    return true;
+}
+
+std::uint32_t HamonFrame::crc32(const void *data, const std::size_t size, std::uint32_t crc) {
+    static const std::array<std::uint32_t, 256> table = make_crc_table();
+    const auto *p = static_cast<const unsigned char *>(data);
+    crc = ~crc;
+    for (std::size_t i = 0; i < size; ++i) crc = table[(crc ^ p[i]) & 0xFF] ^ crc >> 8;
+    return ~crc;
+}
+
+void HamonFrame::encode_header(const FrameHeader &header, unsigned char *out) {
+    out[0] = static_cast<unsigned char>(header.type);
+    out[1] = header.flags;
+    out[2] = 0;
+    out[3] = 0;
+    put_be(out + 4, header.checksum, 4);
+    put_be(out + 8, header.length, 8);
+}
+
+FrameHeader HamonFrame::decode_header(const unsigned char *in) {
+    FrameHeader header{};
+    header.type = static_cast<FrameType>(in[0]);
+    header.flags = in[1];
+    header.checksum = static_cast<std::uint32_t>(get_be(in + 4, 4));
+    header.length = get_be(in + 8, 8);
+    return header;
+}
+
+bool HamonFrame::handshake(const int fd, const int self_id, int &peer_id, std::uint16_t &version) {
+    return send_hello(fd, self_id) && receive_hello(fd, peer_id, version);
+}
+
+bool HamonFrame::send_hello(const int fd, const int self_id) {
+    std::array<unsigned char, header_size + hello_size> out{};
+    encode_header({FrameType::Hello, 0, 0, hello_size}, out.data());
+    put_be(out.data() + header_size, min_protocol_version, 2);
+    put_be(out.data() + header_size + 2, protocol_version, 2);
+    put_be(out.data() + header_size + 4, static_cast<std::uint32_t>(self_id), 4);
+    return write_all(fd, out.data(), out.size());
+}
+
+bool HamonFrame::receive_hello(const int fd, int &peer_id, std::uint16_t &version) {
+    std::array<unsigned char, header_size + hello_size> in{};
+    if (!read_all(fd, in.data(), header_size)) return false;
+    if (const FrameHeader header = decode_header(in.data());
+        header.type != FrameType::Hello || header.length != hello_size) {
+        std::cerr << "[Frame Error] peer did not start with a Hello frame" << std::endl;
+        return false;
+    }
+    if (!read_all(fd, in.data() + header_size, hello_size)) return false;
+    const auto peer_min = static_cast<std::uint16_t>(get_be(in.data() + header_size, 2));
+    const auto peer_max = static_cast<std::uint16_t>(get_be(in.data() + header_size + 2, 2));
+    peer_id = static_cast<int>(static_cast<std::int32_t>(get_be(in.data() + header_size + 4, 4)));
+    version = std::min(protocol_version, peer_max);
+    if (version < std::max(min_protocol_version, peer_min)) {
+        std::cerr << "[Frame Error] no common protocol version with node " << peer_id << std::endl;
+        return false;
+    }
+    return true;
+}
+
+FrameWriter::FrameWriter(const int p_fd, const bool p_checksums, const std::size_t p_max_frame, IoUring *p_ring)
+    : fd(p_fd), checksums(p_checksums), max_frame(std::max<std::size_t>(p_max_frame, 1)), ring(p_ring) {
+}
+
+bool FrameWriter::write_frame(const FrameType type, const std::string_view body) {
+    FrameHeader header{type, 0, 0, body.size()};
+    if (checksums && type == FrameType::Data) {
+        header.flags |= HamonFrame::flag_checksum;
+        header.checksum = HamonFrame::crc32(body.data(), body.size());
+    }
+    if (ring != nullptr) {
+        Queued &frame = queued.emplace_back();
+        HamonFrame::encode_header(header, frame.head.data());
+        frame.iov = {{{frame.head.data(), frame.head.size()}, {const_cast<char *>(body.data()), body.size()}}};
+        frame.message = {};
+        frame.message.msg_iov = frame.iov.data();
+        frame.message.msg_iovlen = body.empty() ? 1 : 2;
+        return queued.size() < batch_frames || send_batch();
+    }
+    std::array<unsigned char, HamonFrame::header_size> head{};
+    HamonFrame::encode_header(header, head.data());
+    std::array<iovec, 2> iov{{{head.data(), head.size()}, {const_cast<char *>(body.data()), body.size()}}};
+    return HamonFrame::writev_all(fd, iov.data(), iov.size());
+}
+
+bool FrameWriter::send_batch() {
+    // Linked, so the frames go out in order; MSG_WAITALL makes each one complete in full
+    // (or fail, which cancels the rest of the chain).
+    std::size_t count = 0;
+    for (; count < queued.size(); ++count) {
+        const bool link = count + 1 < queued.size();
+        if (!ring->prep_sendmsg(fd, &queued[count].message, MSG_NOSIGNAL | MSG_WAITALL, count + 1, link)) break;
+    }
+    bool ok = count == queued.size();
+    // Every submitted operation is reaped, even after a failure, so none completes into the next batch.
+    std::size_t completed = 0;
+    while (completed < count) {
+        if (!ring->enter(static_cast<unsigned>(count - completed))) return false;
+        std::uint64_t index = 0;
+        std::int32_t result = 0;
+        std::uint32_t flags = 0;
+        while (ring->next_completion(index, result, flags)) {
+            if (index == 0 || index > count) continue;
+            const Queued &frame = queued[index - 1];
+            std::size_t expected = frame.iov[0].iov_len;
+            if (frame.message.msg_iovlen > 1) expected += frame.iov[1].iov_len;
+            if (result < 0 || static_cast<std::size_t>(result) != expected) ok = false;
+            ++completed;
+        }
+    }
+    queued.clear();
+    return ok;
+}
+
+bool FrameWriter::write(const std::string_view data) {
+    for (std::size_t at = 0; at < data.size(); at += max_frame) {
+        if (!write_frame(FrameType::Data, data.substr(at, max_frame))) return false;
+    }
+    return true;
+}
+
+bool FrameWriter::write_file(const int file_fd, const ShardRange &range) {
+    // Bodies go out with sendfile(), after whatever frames are still queued.
+    if (ring != nullptr && !queued.empty() && !send_batch()) return false;
+    std::vector<char> scratch;
+    for (std::size_t at = 0; at < range.length; at += max_frame) {
+        const std::size_t n = std::min(max_frame, range.length - at);
+        auto offset = static_cast<off_t>(range.offset + at);
+        if (checksums) {
+            scratch.resize(n);
+            std::size_t done = 0;
+            while (done < n) {
+                const ssize_t got = pread(file_fd, scratch.data() + done, n - done, offset + static_cast<off_t>(done));
+                if (got <= 0) return false;
+                done += static_cast<std::size_t>(got);
+            }
+            // The scratch buffer is reused for the next frame: send this one now.
+            if (!write_frame(FrameType::Data, {scratch.data(), n}) || (ring != nullptr && !send_batch())) return false;
+            continue;
+        }
+        std::array<unsigned char, HamonFrame::header_size> head{};
+        HamonFrame::encode_header({FrameType::Data, 0, 0, n}, head.data());
+        if (!HamonFrame::write_all(fd, head.data(), head.size())) return false;
+        std::size_t remaining = n;
+        while (remaining > 0) {
+            const ssize_t sent = sendfile(fd, file_fd, &offset, remaining);
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent <= 0) return false;
+            remaining -= static_cast<std::size_t>(sent);
+        }
+    }
+    return true;
+}
+
+bool FrameWriter::finish() {
+    if (!write_frame(FrameType::End, {})) return false;
+    return ring == nullptr || queued.empty() || send_batch();
+}
+
+FrameReader::FrameReader(const int p_fd) : fd(p_fd), ended(false), error(false) {
+}
+
+bool FrameReader::next_into(std::string &out, const std::size_t at) {
+    if (ended || error) return false;
+    std::array<unsigned char, HamonFrame::header_size> head{};
+    if (!HamonFrame::read_all(fd, head.data(), head.size())) {
+        error = true;
+        return false;
+    }
+    const FrameHeader header = HamonFrame::decode_header(head.data());
+    if (header.type == FrameType::End) {
+        ended = true;
+        return false;
+    }
+    if (header.type != FrameType::Data || header.length > HamonFrame::max_frame_size) {
+        std::cerr << "[Frame Error] unexpected frame (type " << static_cast<int>(header.type)
+                << ", length " << header.length << ")" << std::endl;
+        error = true;
+        return false;
+    }
+    const auto length = static_cast<std::size_t>(header.length);
+    out.resize(at + length);
+    if (!HamonFrame::read_all(fd, out.data() + at, length)) {
+        error = true;
+        return false;
+    }
+    if (header.flags & HamonFrame::flag_checksum &&
+        HamonFrame::crc32(out.data() + at, length) != header.checksum) {
+        std::cerr << "[Frame Error] checksum mismatch" << std::endl;
+        error = true;
+        return false;
+    }
+    return true;
+}
+
+bool FrameReader::next(std::string &frame) {
+    return next_into(frame, 0);
+}
+
+bool FrameReader::read_payload(std::string &out) {
+    while (next_into(out, out.size())) {
+    }
+    return !error;
+}
+
+bool FrameReader::failed() const {
+    return error;
+}
+
+ReceiveStatus FrameAssembler::poll(const int fd, std::string &out) {
+    while (true) {
+        const std::span<char> next = next_buffer();
+        const ssize_t got = recv(fd, next.data(), next.size(), MSG_DONTWAIT);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return ReceiveStatus::Pending;
+        if (got <= 0) return ReceiveStatus::Failed;
+        if (const ReceiveStatus status = advance(static_cast<std::size_t>(got), out); status != ReceiveStatus::Pending) {
+            return status;
+        }
+    }
+}
+
+std::span<char> FrameAssembler::next_buffer() {
+    if (in_body) return {payload.data() + body_start + body_got, static_cast<std::size_t>(header.length) - body_got};
+    return {reinterpret_cast<char *>(head.data()) + head_got, head.size() - head_got};
+}
+
+ReceiveStatus FrameAssembler::advance(const std::size_t n, std::string &out) {
+    if (in_body) {
+        body_got += n;
+        if (body_got < header.length) return ReceiveStatus::Pending;
+        return finish_body() ? ReceiveStatus::Pending : ReceiveStatus::Failed;
+    }
+    head_got += n;
+    if (head_got < head.size()) return ReceiveStatus::Pending;
+    head_got = 0;
+    header = HamonFrame::decode_header(head.data());
+    if (header.type == FrameType::End) {
+        // Swapped, so a caller that reuses its buffer hands it back for the next payload.
+        out.swap(payload);
+        payload.clear();
+        return ReceiveStatus::Complete;
+    }
+    if (header.type != FrameType::Data || header.length > HamonFrame::max_frame_size) {
+        std::cerr << "[Frame Error] unexpected frame (type " << static_cast<int>(header.type)
+                << ", length " << header.length << ")" << std::endl;
+        return ReceiveStatus::Failed;
+    }
+    body_start = payload.size();
+    body_got = 0;
+    payload.resize(body_start + static_cast<std::size_t>(header.length));
+    in_body = true;
+    // An empty Data frame has no body to wait for.
+    if (header.length == 0 && !finish_body()) return ReceiveStatus::Failed;
+    return ReceiveStatus::Pending;
+}
+
+bool FrameAssembler::finish_body() {
+    in_body = false;
+    if (header.flags & HamonFrame::flag_checksum &&
+        HamonFrame::crc32(payload.data() + body_start, body_got) != header.checksum) {
+        std::cerr << "[Frame Error] checksum mismatch" << std::endl;
+        return false;
+    }
+    return true;
+}
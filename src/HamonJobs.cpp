@@ -0,0 +1,154 @@
+#include "../include/HamonJobs.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace dualys;
+
+namespace {
+    bool unix_address(const std::string &path, sockaddr_un &address) {
+        address = {};
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+            std::cerr << "[Jobs] Invalid socket path: " << path << std::endl;
+            return false;
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+
+    int connect_to(const sockaddr_un &address) {
+        const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        if (connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    bool write_all(const int fd, std::string_view bytes) {
+        while (!bytes.empty()) {
+            const ssize_t wrote = send(fd, bytes.data(), bytes.size(), MSG_NOSIGNAL);
+            if (wrote < 0 && errno == EINTR) continue;
+            if (wrote <= 0) return false;
+            bytes.remove_prefix(static_cast<std::size_t>(wrote));
+        }
+        return true;
+    }
+}
+
+std::string HamonJobs::default_socket_path() {
+    if (const char *runtime = std::getenv("XDG_RUNTIME_DIR"); runtime != nullptr && *runtime != '\0') {
+        return std::string(runtime) + "/hamon.sock";
+    }
+    return "/tmp/hamon-" + std::to_string(getuid()) + ".sock";
+}
+
+int HamonJobs::listen(const std::string &path) {
+    sockaddr_un address{};
+    if (!unix_address(path, address)) return -1;
+    if (const int probe = connect_to(address); probe >= 0) {
+        close(probe);
+        std::cerr << "[Jobs] A daemon is already listening on " << path << std::endl;
+        return -1;
+    }
+    unlink(path.c_str()); // left behind by a daemon that died
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("[Jobs] socket failed");
+        return -1;
+    }
+    if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || chmod(path.c_str(), 0600) != 0 ||
+        ::listen(fd, SOMAXCONN) != 0) {
+        perror("[Jobs] Cannot listen for jobs");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+std::string HamonJobs::encode(const JobRequest &request) {
+    if (request.shutdown) return "shutdown\n";
+    return request.op + ' ' + request.input + '\n';
+}
+
+bool HamonJobs::decode(const std::string_view line, JobRequest &request) {
+    request = {};
+    if (line == "shutdown") {
+        request.shutdown = true;
+        return true;
+    }
+    const auto space = line.find(' ');
+    if (space == std::string_view::npos || line.substr(0, space) != word_count || space + 1 == line.size()) {
+        return false;
+    }
+    request.op = std::string(line.substr(0, space));
+    request.input = std::string(line.substr(space + 1));
+    return true;
+}
+
+bool HamonJobs::read_request(const int client, JobRequest &request) {
+    timeval timeout{request_timeout_ms / 1000, request_timeout_ms % 1000 * 1000};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    std::string line;
+    char c;
+    while (line.size() < 4096) {
+        const ssize_t got = recv(client, &c, 1, 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        if (c == '\n') return decode(line, request);
+        line.push_back(c);
+    }
+    return false;
+}
+
+bool HamonJobs::reply(const int client, const bool ok, const std::string_view body) {
+    if (ok) return write_all(client, "ok\n") && write_all(client, body);
+    return write_all(client, "error ") && write_all(client, body) && write_all(client, "\n");
+}
+
+bool HamonJobs::submit(const std::string &path, const JobRequest &request, std::ostream &out, std::string &error) {
+    sockaddr_un address{};
+    if (!unix_address(path, address)) {
+        error = "invalid socket path " + path;
+        return false;
+    }
+    const int fd = connect_to(address);
+    if (fd < 0) {
+        error = "no daemon is listening on " + path;
+        return false;
+    }
+    if (!write_all(fd, encode(request))) {
+        close(fd);
+        error = "the daemon closed the connection";
+        return false;
+    }
+    std::string status;
+    bool in_status = true;
+    char buffer[1 << 16];
+    while (true) {
+        const ssize_t got = recv(fd, buffer, sizeof(buffer), 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        std::string_view chunk(buffer, static_cast<std::size_t>(got));
+        if (in_status) {
+            const auto newline = chunk.find('\n');
+            status.append(chunk.substr(0, newline));
+            if (newline == std::string_view::npos) continue;
+            in_status = false;
+            chunk.remove_prefix(newline + 1);
+        }
+        out << chunk;
+    }
+    close(fd);
+    if (status == "ok") return true;
+    error = status.starts_with("error ") ? status.substr(6) : "no answer from the daemon";
+    return false;
+}
@@ -0,0 +1,191 @@
+#include "../include/HamonLink.hpp"
+#include "../include/HamonFrame.hpp"
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace dualys;
+
+namespace {
+    // Ring of a link's sender thread; without one (none requested, or setup failed) frames use sendmsg.
+    std::unique_ptr<IoUring> sender_ring(const IoBackend backend) {
+        if (backend != IoBackend::Uring) return nullptr;
+        auto ring = std::make_unique<IoUring>(64);
+        return ring->is_open() ? std::move(ring) : nullptr;
+    }
+}
+
+PeerLink::PeerLink(const int p_fd, const int p_peer_id, const bool p_checksums, const IoBackend p_backend)
+    : fd(p_fd), peer_id(p_peer_id), checksums(p_checksums),
+      ring(sender_ring(p_backend)), sending(false), failed(false),
+      sender([this](const std::stop_token &stop) { sender_loop(stop); }) {
+}
+
+PeerLink::PeerLink(std::unique_ptr<LocalChannel> p_local, const int p_peer_id)
+    : fd(-1), peer_id(p_peer_id), checksums(false), local(std::move(p_local)), sending(false), failed(false) {
+}
+
+PeerLink::~PeerLink() {
+    flush();
+    if (sender.joinable()) {
+        sender.request_stop();
+        sender.join();
+    }
+    channel.reset();
+    local.reset(); // the peer still drains whatever we moved into its queue
+    if (fd >= 0) close(fd); // the peer still drains whatever is left in our ring
+}
+
+void PeerLink::enqueue(Outgoing item) {
+    if (local) {
+        // Nothing to write: the payload goes straight into the peer's queue.
+        const bool sent = item.file_fd >= 0 ? local->send_file_range(item.file_fd, item.range)
+                                             : local->send(std::move(item.payload));
+        if (!sent) {
+            std::lock_guard lock(mutex);
+            failed = true;
+        }
+        return;
+    }
+    {
+        std::lock_guard lock(mutex);
+        queue.push_back(std::move(item));
+    }
+    queue_changed.notify_all();
+}
+
+void PeerLink::send(std::string payload) {
+    enqueue({std::move(payload), -1, {}});
+}
+
+void PeerLink::send_file_range(const int file_fd, const ShardRange &range) {
+    enqueue({{}, file_fd, range});
+}
+
+bool PeerLink::negotiate_transport(const bool initiator, const std::size_t ring_bytes) {
+    // Nothing is queued yet, so the sender thread is idle and the socket is ours.
+    if (initiator) {
+        std::unique_ptr<ShmChannel> offer;
+        if (ring_bytes > 0 && ShmChannel::same_host(fd)) offer = ShmChannel::create(ring_bytes, fd);
+        FrameWriter writer(fd);
+        if (!writer.write(offer ? offer->name() : std::string()) || !writer.finish()) return false;
+        std::string reply;
+        if (FrameReader reader(fd); !reader.read_payload(reply)) return false;
+        if (offer && reply == "shm") {
+            offer->unlink(); // both sides have it mapped
+            channel = std::move(offer);
+        }
+        return true;
+    }
+    std::string name;
+    if (FrameReader reader(fd); !reader.read_payload(name)) return false;
+    std::unique_ptr<ShmChannel> accepted;
+    if (!name.empty() && ring_bytes > 0) accepted = ShmChannel::open(name, fd);
+    FrameWriter writer(fd);
+    if (!writer.write(accepted ? "shm" : "tcp") || !writer.finish()) return false;
+    channel = std::move(accepted);
+    return true;
+}
+
+bool PeerLink::uses_shared_memory() const {
+    return channel != nullptr;
+}
+
+bool PeerLink::in_process() const {
+    return local != nullptr;
+}
+
+bool PeerLink::receive(std::string &out) {
+    if (local) return local->receive(out);
+    if (channel) return channel->receive(out);
+    out.clear();
+    FrameReader reader(fd);
+    return reader.read_payload(out);
+}
+
+ReceiveStatus PeerLink::poll_receive(std::string &out) {
+    if (local) return local->poll_receive(out);
+    return channel ? channel->poll_receive(out) : assembler.poll(fd, out);
+}
+
+std::span<char> PeerLink::receive_buffer() {
+    return assembler.next_buffer();
+}
+
+ReceiveStatus PeerLink::received(const std::size_t n, std::string &out) {
+    return assembler.advance(n, out);
+}
+
+bool PeerLink::flush() {
+    std::unique_lock lock(mutex);
+    queue_changed.wait(lock, [this] { return queue.empty() && !sending; });
+    return !failed;
+}
+
+bool PeerLink::flush_until(const std::chrono::steady_clock::time_point deadline) {
+    std::unique_lock lock(mutex);
+    const bool drained = queue_changed.wait_until(lock, deadline, [this] { return queue.empty() && !sending; });
+    return drained && !failed;
+}
+
+void PeerLink::abort() {
+    {
+        std::lock_guard lock(mutex);
+        failed = true;
+    }
+    // Wakes a sender blocked in send() or in a shared-memory wait, and the peer's reads.
+    if (local) local->close();
+    else shutdown(fd, SHUT_RDWR);
+    queue_changed.notify_all();
+}
+
+int PeerLink::socket_fd() const {
+    return local ? local->doorbell_fd() : fd;
+}
+
+int PeerLink::peer() const {
+    return peer_id;
+}
+
+void PeerLink::sender_loop(const std::stop_token &stop) {
+    while (true) {
+        Outgoing item;
+        bool broken;
+        {
+            std::unique_lock lock(mutex);
+            if (!queue_changed.wait(lock, stop, [this] { return !queue.empty(); })) return;
+            item = std::move(queue.front());
+            queue.pop_front();
+            sending = true;
+            broken = failed;
+        }
+        // After a failure the stream is out of sync; drop what is left instead of sending garbage.
+        bool ok = false;
+        if (!broken && channel) {
+            ok = item.file_fd >= 0 ? channel->send_file_range(item.file_fd, item.range) : channel->send(item.payload);
+            if (!ok) std::cerr << "[Link] Failed to send to node " << peer_id << std::endl;
+        } else if (!broken) {
+            FrameWriter writer(fd, checksums, HamonFrame::default_frame_size, ring.get());
+            ok = (item.file_fd >= 0 ? writer.write_file(item.file_fd, item.range) : writer.write(item.payload)) &&
+                 writer.finish();
+            if (!ok) std::cerr << "[Link] Failed to send to node " << peer_id << std::endl;
+        }
+        {
+            std::lock_guard lock(mutex);
+            sending = false;
+            if (!ok) failed = true;
+        }
+        queue_changed.notify_all();
+    }
+}
+
+void PeerLink::tune_socket(const int fd, const int buffer_bytes) {
+    constexpr int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (buffer_bytes > 0) {
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buffer_bytes, sizeof(buffer_bytes));
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer_bytes, sizeof(buffer_bytes));
+    }
+}
@@ -0,0 +1,376 @@
+#include "../include/HamonLoop.hpp"
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace dualys;
+
+namespace {
+    // Shared by the children of one EventLoop::all(); lives in the awaiting frame.
+    struct JoinState {
+        std::size_t pending = 0;
+        bool ok = true;
+        std::coroutine_handle<> parent;
+    };
+
+    // Low bit of the user_data of accept operations; other operations carry a Waiter *.
+    constexpr std::uint64_t listener_tag = 1;
+
+    std::uint64_t user_data_of(const void *p) {
+        return reinterpret_cast<std::uint64_t>(p);
+    }
+
+    // Fire-and-forget coroutine: starts at once and frees itself when done.
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() { return {}; }
+
+            std::suspend_never initial_suspend() noexcept { return {}; }
+
+            std::suspend_never final_suspend() noexcept { return {}; }
+
+            void return_void() {
+            }
+
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+    };
+
+    // The task stays owned by JoinAll; its result is bound first (see Task).
+    Detached join_one(Task<bool> &task, JoinState &state) {
+        const bool ok = co_await task;
+        if (!ok) state.ok = false;
+        if (--state.pending == 0) state.parent.resume();
+    }
+
+    // Owns the children until the last one resumes the parent.
+    struct JoinAll {
+        std::vector<Task<bool> > tasks;
+        JoinState state;
+
+        bool await_ready() const noexcept { return tasks.empty(); }
+
+        bool await_suspend(const std::coroutine_handle<> parent) {
+            // One extra count for this function, so children that finish synchronously
+            // cannot resume the parent before it is fully suspended.
+            state = {tasks.size() + 1, true, parent};
+            for (Task<bool> &task: tasks) join_one(task, state);
+            return --state.pending != 0;
+        }
+
+        bool await_resume() const noexcept { return state.ok; }
+    };
+}
+
+// A receive handed to the ring; resumed with the operation's result.
+class EventLoop::Operation {
+public:
+    Operation(EventLoop &p_loop, const int p_fd, const std::span<char> p_buffer, const Deadline p_deadline)
+        : loop(p_loop), buffer(p_buffer), deadline(p_deadline) {
+        waiter.fd = p_fd;
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(const std::coroutine_handle<> handle) {
+        waiter.handle = handle;
+        if (!loop.ring->prep_recv(waiter.fd, buffer, MSG_WAITALL, user_data_of(&waiter))) {
+            waiter.result = -EIO;
+            return false;
+        }
+        waiter.in_kernel = true;
+        loop.track(waiter, deadline);
+        return true;
+    }
+
+    int await_resume() const noexcept { return waiter.result; }
+
+private:
+    EventLoop &loop;
+    std::span<char> buffer;
+    Deadline deadline;
+    Waiter waiter;
+};
+
+// Waits for the listener's multishot accept to queue a connection (or to fail).
+class EventLoop::AcceptWait {
+public:
+    AcceptWait(EventLoop &p_loop, Listener &p_listener, const Deadline p_deadline)
+        : loop(p_loop), listener(p_listener), deadline(p_deadline) {
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(const std::coroutine_handle<> handle) {
+        waiter.handle = handle;
+        listener.waiting = &waiter;
+        loop.track(waiter, deadline);
+        return true;
+    }
+
+    bool await_resume() const noexcept {
+        listener.waiting = nullptr;
+        return waiter.ready;
+    }
+
+private:
+    EventLoop &loop;
+    Listener &listener;
+    Deadline deadline;
+    Waiter waiter;
+};
+
+EventLoop::Wait::Wait(EventLoop &p_loop, const int p_fd, const std::uint32_t p_events, const Deadline p_deadline)
+    : loop(p_loop), events(p_events), deadline(p_deadline) {
+    waiter.fd = p_fd;
+}
+
+bool EventLoop::Wait::await_suspend(const std::coroutine_handle<> handle) {
+    waiter.handle = handle;
+    if (waiter.fd >= 0 && loop.ring) {
+        // poll() and epoll share the event bit values.
+        if (!loop.ring->prep_poll(waiter.fd, events, user_data_of(&waiter))) return false;
+        waiter.in_kernel = true;
+    } else if (waiter.fd >= 0) {
+        epoll_event event{};
+        event.events = events;
+        event.data.ptr = &waiter;
+        if (epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, waiter.fd, &event) != 0) {
+            perror("[Loop] epoll_ctl failed");
+            return false; // resume at once, reported as a timeout
+        }
+    }
+    loop.track(waiter, deadline);
+    return true;
+}
+
+EventLoop::EventLoop(const IoBackend p_backend) : epoll_fd(-1), suspended(0) {
+    if (IoUring::resolve(p_backend) == IoBackend::Uring) {
+        ring = std::make_unique<IoUring>(256);
+        if (ring->is_open()) return;
+        ring.reset();
+    }
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) perror("[Loop] epoll_create1 failed");
+}
+
+EventLoop::~EventLoop() {
+    ring.reset(); // cancels the operations still in flight
+    for (const Listener &listener: listeners) {
+        for (const int sock: listener.ready) close(sock);
+    }
+    if (epoll_fd >= 0) close(epoll_fd);
+}
+
+IoBackend EventLoop::backend() const {
+    return ring ? IoBackend::Uring : IoBackend::Epoll;
+}
+
+void EventLoop::track(Waiter &waiter, const Deadline deadline) {
+    if (deadline != Deadline::max()) {
+        waiter.timer = timers.emplace(deadline, &waiter);
+        waiter.timed = true;
+    }
+    ++suspended;
+}
+
+void EventLoop::complete(Waiter &waiter, const bool ready) {
+    if (waiter.fd >= 0 && !ring) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, waiter.fd, nullptr);
+    if (waiter.timed) timers.erase(waiter.timer);
+    waiter.timed = false;
+    waiter.ready = ready;
+    --suspended;
+    waiter.handle.resume();
+}
+
+void EventLoop::expire(Waiter &waiter) {
+    if (!waiter.in_kernel) {
+        complete(waiter, false);
+        return;
+    }
+    // The operation may still write into the waiter's buffer: cancel it and resume the
+    // coroutine once its (cancelled) completion arrives.
+    timers.erase(waiter.timer);
+    waiter.timed = false;
+    ring->prep_cancel(user_data_of(&waiter));
+}
+
+void EventLoop::dispatch(const std::uint64_t user_data, const std::int32_t result, const std::uint32_t flags) {
+    if (user_data == 0) return; // completion of a cancellation
+    if (user_data & listener_tag) {
+        accepted(*reinterpret_cast<Listener *>(user_data & ~listener_tag), result, flags);
+        return;
+    }
+    Waiter &waiter = *reinterpret_cast<Waiter *>(user_data);
+    waiter.in_kernel = false;
+    waiter.result = result;
+    complete(waiter, result >= 0);
+}
+
+void EventLoop::accepted(Listener &listener, const std::int32_t result, const std::uint32_t flags) {
+    if (!(flags & IORING_CQE_F_MORE)) listener.armed = false;
+    if (result >= 0) {
+        if (listener.stopped) close(result);
+        else listener.ready.push_back(result);
+    } else if (result == -EINVAL && listener.multishot) {
+        listener.multishot = false; // multishot accept needs Linux 5.19: accept one at a time
+    } else if (result != -ECANCELED && result != -EINTR && result != -EAGAIN && result != -ECONNABORTED) {
+        listener.error = -result;
+    }
+    if (listener.stopped && !listener.armed) {
+        listeners.remove_if([&](const Listener &l) { return &l == &listener; });
+        return;
+    }
+    if (listener.waiting != nullptr) complete(*listener.waiting, true);
+}
+
+EventLoop::Listener &EventLoop::listener_for(const int fd) {
+    for (Listener &listener: listeners) {
+        if (listener.fd == fd && !listener.stopped) return listener;
+    }
+    Listener &listener = listeners.emplace_back();
+    listener.fd = fd;
+    return listener;
+}
+
+bool EventLoop::poll_events(const int timeout_ms) {
+    if (ring) {
+        // Submits what the coroutines queued and waits, in one system call.
+        if (!ring->enter(1, timeout_ms)) return false;
+        std::uint64_t user_data = 0;
+        std::int32_t result = 0;
+        std::uint32_t flags = 0;
+        while (ring->next_completion(user_data, result, flags)) dispatch(user_data, result, flags);
+        return true;
+    }
+    std::array<epoll_event, 64> events{};
+    const int n = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), timeout_ms);
+    if (n < 0) {
+        if (errno == EINTR) return true;
+        perror("[Loop] epoll_wait failed");
+        return false;
+    }
+    for (int i = 0; i < n; ++i) complete(*static_cast<Waiter *>(events[static_cast<std::size_t>(i)].data.ptr), true);
+    return true;
+}
+
+bool EventLoop::run(Task<bool> task) {
+    if (!ring && epoll_fd < 0) return false;
+    task.handle.resume();
+    while (!task.handle.done()) {
+        if (suspended == 0) {
+            std::cerr << "[Loop] Task is suspended without anything to wait for" << std::endl;
+            return false;
+        }
+        int timeout = -1;
+        if (!timers.empty()) {
+            const auto left = timers.begin()->first - std::chrono::steady_clock::now();
+            // Round up: waking before the deadline would just spin.
+            timeout = static_cast<int>(std::max<std::int64_t>(
+                0, std::chrono::ceil<std::chrono::milliseconds>(left).count()));
+        }
+        if (!poll_events(timeout)) return false;
+        const Deadline now = std::chrono::steady_clock::now();
+        while (!timers.empty() && timers.begin()->first <= now) expire(*timers.begin()->second);
+    }
+    return task.handle.promise().value;
+}
+
+EventLoop::Wait EventLoop::readable(const int fd, const Deadline deadline) {
+    return {*this, fd, EPOLLIN | EPOLLRDHUP, deadline};
+}
+
+EventLoop::Wait EventLoop::writable(const int fd, const Deadline deadline) {
+    return {*this, fd, EPOLLOUT, deadline};
+}
+
+EventLoop::Wait EventLoop::sleep_until(const Deadline deadline) {
+    return {*this, -1, 0, deadline};
+}
+
+Task<std::size_t> EventLoop::receive(const int fd, const std::span<char> buffer, const Deadline deadline) {
+    std::size_t got = 0;
+    while (got < buffer.size()) {
+        if (ring) {
+            // MSG_WAITALL: the kernel keeps receiving until the buffer is full.
+            Operation operation(*this, fd, buffer.subspan(got), deadline);
+            const int n = co_await operation;
+            if (n <= 0) break;
+            got += static_cast<std::size_t>(n);
+            continue;
+        }
+        const ssize_t n = recv(fd, buffer.data() + got, buffer.size() - got, MSG_DONTWAIT);
+        if (n > 0) {
+            got += static_cast<std::size_t>(n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) break;
+        const bool ready = co_await readable(fd, deadline);
+        if (!ready) break;
+    }
+    co_return got;
+}
+
+Task<int> EventLoop::accept(const int fd, const Deadline deadline) {
+    if (!ring) {
+        while (true) {
+            const int sock = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (sock >= 0) co_return sock;
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED) co_return -errno;
+            const bool incoming = co_await readable(fd, deadline);
+            if (!incoming) co_return -ETIMEDOUT;
+        }
+    }
+    Listener &listener = listener_for(fd);
+    while (true) {
+        if (!listener.ready.empty()) {
+            const int sock = listener.ready.front();
+            listener.ready.pop_front();
+            co_return sock;
+        }
+        if (listener.error != 0) co_return -std::exchange(listener.error, 0);
+        if (!listener.armed) {
+            if (!ring->prep_accept(fd, SOCK_CLOEXEC, listener.multishot, user_data_of(&listener) | listener_tag)) {
+                co_return -EIO;
+            }
+            listener.armed = true;
+        }
+        AcceptWait wait(*this, listener, deadline);
+        const bool woke = co_await wait;
+        if (!woke) co_return -ETIMEDOUT;
+    }
+}
+
+void EventLoop::stop_accepting(const int fd) {
+    if (!ring) return;
+    for (auto it = listeners.begin(); it != listeners.end(); ++it) {
+        if (it->fd != fd || it->stopped) continue;
+        for (const int sock: it->ready) close(sock);
+        it->ready.clear();
+        if (!it->armed) {
+            listeners.erase(it);
+            return;
+        }
+        // Kept until the cancelled accept completes; submitted now so the socket is released.
+        it->stopped = true;
+        ring->prep_cancel(user_data_of(&*it) | listener_tag);
+        (void) ring->enter();
+        return;
+    }
+}
+
+Task<bool> EventLoop::all(std::vector<Task<bool> > tasks) {
+    // A named awaiter: GCC 12 destroys temporary awaiters twice.
+    JoinAll join{std::move(tasks), {}};
+    co_return co_await join;
+}
+
+Deadline EventLoop::deadline_in(const int milliseconds) {
+    if (milliseconds <= 0) return Deadline::max();
+    return std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+}
@@ -0,0 +1,263 @@
+#include "../include/HamonMap.hpp"
+#include "../include/HamonShard.hpp"
+#include "../include/HamonTokenizer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <sched.h>
+
+using namespace dualys;
+
+namespace {
+    // Next sub-chunk of one thread's run; other threads advance it too when they steal.
+    struct alignas(64) Run {
+        std::atomic<std::size_t> next{0};
+        std::size_t end = 0;
+
+        bool take(std::size_t &index) {
+            if (next.load(std::memory_order_relaxed) >= end) return false;
+            index = next.fetch_add(1, std::memory_order_relaxed);
+            return index < end;
+        }
+    };
+}
+
+MapWorkers::MapWorkers(const unsigned p_threads) : job(nullptr), width(0), running(0), round(0), stopping(false) {
+    for (std::size_t t = 1; t < std::max(1u, p_threads); ++t) helpers.emplace_back([this, t] { helper_loop(t); });
+}
+
+MapWorkers::~MapWorkers() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    for (std::thread &helper: helpers) helper.join();
+}
+
+void MapWorkers::run(const std::size_t k, const std::function<void(std::size_t)> &p_job) {
+    const std::size_t n = std::min(k, size());
+    if (n <= 1) {
+        if (n == 1) p_job(0);
+        return;
+    }
+    {
+        std::lock_guard lock(mutex);
+        job = &p_job;
+        width = n;
+        running = n - 1;
+        ++round;
+    }
+    changed.notify_all();
+    p_job(0);
+    std::unique_lock lock(mutex);
+    changed.wait(lock, [this] { return running == 0; });
+    job = nullptr;
+}
+
+void MapWorkers::helper_loop(const std::size_t index) {
+    std::uint64_t seen = 0;
+    std::unique_lock lock(mutex);
+    while (true) {
+        changed.wait(lock, [this, &seen] { return stopping || round != seen; });
+        if (stopping) return;
+        seen = round;
+        // run() waits for every helper of a round, so none misses one it takes part in.
+        if (index >= width) continue;
+        const std::function<void(std::size_t)> &work = *job;
+        lock.unlock();
+        work(index);
+        lock.lock();
+        if (--running == 0) changed.notify_all();
+    }
+}
+
+unsigned HamonMap::pinned_cpu_count() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        if (const int n = CPU_COUNT(&set); n > 0) return static_cast<unsigned>(n);
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+unsigned HamonMap::resolve_threads(const int configured) {
+    return configured > 0 ? static_cast<unsigned>(configured) : pinned_cpu_count();
+}
+
+WordCountTable HamonMap::count(const std::string_view text, const unsigned threads) {
+    const std::size_t k = std::min<std::size_t>(threads, text.size() / min_subchunk);
+    std::vector<WordCountTable> tables(std::max<std::size_t>(k, 1));
+    count_into(text, tables);
+    if (tables.size() == 1) return std::move(tables.front());
+    return WordCountTable::merge_parallel(std::move(tables));
+}
+
+WordCountTable HamonMap::count(const std::string_view text, const unsigned threads, RunStore &spills,
+                               const std::size_t budget) {
+    std::vector<WordCountTable> tables(std::max(1u, threads));
+    MapWorkers workers(threads);
+    for (std::size_t at = 0; at < text.size();) {
+        const std::size_t end = HamonShard::align_to_boundary(
+            text, std::min(text.size(), at + StreamingCount::piece_bytes));
+        count_into(text.substr(at, end - at), tables, &workers);
+        if (!spills.spill_if_over(tables, budget)) break;
+        at = end;
+    }
+    return combine(std::move(tables));
+}
+
+WordCountTable HamonMap::combine(std::vector<WordCountTable> tables) {
+    std::erase_if(tables, [](const WordCountTable &table) { return table.empty(); });
+    if (tables.empty()) return WordCountTable();
+    if (tables.size() == 1) return std::move(tables.front());
+    return WordCountTable::merge_parallel(std::move(tables));
+}
+
+WordCountTable HamonMap::combine(std::vector<WordCountTable> tables, const unsigned threads) {
+    std::erase_if(tables, [](const WordCountTable &table) { return table.empty(); });
+    const std::size_t groups = std::max(1u, threads);
+    if (tables.size() > groups) {
+        // Group g folds tables g + groups, g + 2 * groups, ... into tables[g].
+        const auto fold = [&tables, groups](const std::size_t g) {
+            for (std::size_t i = g + groups; i < tables.size(); i += groups) tables[g].merge(tables[i]);
+        };
+        {
+            std::vector<std::jthread> folders;
+            for (std::size_t g = 1; g < groups; ++g) folders.emplace_back(fold, g);
+            fold(0);
+        }
+        tables.resize(groups);
+    }
+    return combine(std::move(tables));
+}
+
+void HamonMap::count_into(const std::string_view text, std::vector<WordCountTable> &tables, MapWorkers *workers) {
+    const std::size_t width = workers != nullptr ? std::min(tables.size(), workers->size()) : tables.size();
+    const std::size_t k = std::min<std::size_t>(width, text.size() / min_subchunk);
+    if (k <= 1) {
+        HamonTokenizer::count(text, tables.front());
+        return;
+    }
+
+    const std::size_t subchunk_count = std::min(k * subchunks_per_thread, text.size() / min_subchunk);
+    const std::vector<ShardRange> subchunks = HamonShard::split(text, subchunk_count);
+    const auto runs = std::make_unique<Run[]>(k);
+    for (std::size_t t = 0; t < k; ++t) {
+        runs[t].next.store(t * subchunk_count / k, std::memory_order_relaxed);
+        runs[t].end = (t + 1) * subchunk_count / k;
+    }
+
+    const auto count_runs = [&](const std::size_t t) {
+        // Own run first, then the other runs in order.
+        for (std::size_t v = 0; v < k; ++v) {
+            Run &run = runs[(t + v) % k];
+            std::size_t index = 0;
+            while (run.take(index)) {
+                const ShardRange &range = subchunks[index];
+                HamonTokenizer::count(text.substr(range.offset, range.length), tables[t]);
+            }
+        }
+    };
+    if (workers != nullptr) {
+        workers->run(k, count_runs);
+        return;
+    }
+    std::vector<std::jthread> threads;
+    threads.reserve(k);
+    for (std::size_t t = 0; t < k; ++t) threads.emplace_back(count_runs, t);
+}
+
+StreamingCount::StreamingCount(const unsigned p_threads, RunStore *p_spills, const std::size_t p_budget)
+    : tables(std::max(1u, p_threads)), spills(p_spills), budget(p_budget), has_pending(false), stopping(false), bytes_counted(0), seconds_counting(0),
+      workers(p_threads), counter([this] { counter_loop(); }) {
+}
+
+StreamingCount::~StreamingCount() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    if (counter.joinable()) counter.join();
+}
+
+void StreamingCount::feed(std::string &piece) {
+    std::unique_lock lock(mutex);
+    changed.wait(lock, [this] { return !has_pending; });
+    // pending now holds the last counted piece: hand its buffer back for reuse.
+    pending.swap(piece);
+    piece.clear();
+    has_pending = true;
+    lock.unlock();
+    changed.notify_all();
+}
+
+WordCountTable StreamingCount::finish() {
+    {
+        std::unique_lock lock(mutex);
+        changed.wait(lock, [this] { return !has_pending; });
+        stopping = true;
+    }
+    changed.notify_all();
+    counter.join();
+    HamonTokenizer::count(carry, tables.front());
+    carry.clear();
+    return HamonMap::combine(std::move(tables));
+}
+
+WordCountTable StreamingCount::cut() {
+    std::unique_lock lock(mutex);
+    changed.wait(lock, [this] { return !has_pending; });
+    // The counting thread is idle until the next feed(): its tables and carry are ours.
+    HamonTokenizer::count(carry, tables.front());
+    carry.clear();
+    std::vector<WordCountTable> counted(tables.size());
+    counted.swap(tables);
+    lock.unlock();
+    return HamonMap::combine(std::move(counted));
+}
+
+double StreamingCount::throughput() const {
+    std::lock_guard lock(mutex);
+    return seconds_counting > 0 ? static_cast<double>(bytes_counted) / seconds_counting : 0;
+}
+
+void StreamingCount::count_piece(std::string_view text) {
+    // Complete the word cut at the end of the previous piece.
+    if (!carry.empty()) {
+        const auto first = std::ranges::find_if(text, HamonShard::is_delimiter);
+        const auto head = static_cast<std::size_t>(first - text.begin());
+        carry.append(text.substr(0, head));
+        if (first == text.end()) return;
+        HamonTokenizer::count(carry, tables.front());
+        carry.clear();
+        text.remove_prefix(head);
+    }
+    const auto last = std::ranges::find_if(text.rbegin(), text.rend(), HamonShard::is_delimiter);
+    const auto whole = static_cast<std::size_t>(text.rend() - last);
+    carry.assign(text.substr(whole));
+    HamonMap::count_into(text.substr(0, whole), tables, &workers);
+}
+
+void StreamingCount::counter_loop() {
+    std::unique_lock lock(mutex);
+    while (true) {
+        changed.wait(lock, [this] { return has_pending || stopping; });
+        if (!has_pending) return;
+        lock.unlock();
+        const auto start = std::chrono::steady_clock::now();
+        count_piece(pending);
+        // A failed spill is recorded in the store, which the node checks after the map.
+        if (spills != nullptr) (void) spills->spill_if_over(tables, budget);
+        const std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+        lock.lock();
+        bytes_counted += pending.size();
+        seconds_counting += took.count();
+        has_pending = false;
+        changed.notify_all();
+    }
+}
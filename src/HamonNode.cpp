@@ -1,5 +1,15 @@
 #include "../include/HamonNode.hpp"
+#include "../include/HamonJobs.hpp"
+#include "../include/HamonMap.hpp"
+#include <algorithm>
+#include <charconv>
+#include <deque>
+#include <filesystem>
 #include <fstream>
+#include <memory>
+#include <map>
+#include <ranges>
+#include <set>
 #include <sstream>
 #include <utility>
 #include <vector>
@@ -9,7 +19,10 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <cerrno>
 #include <chrono>
+#include <cstring>
+#include <fcntl.h>
 
 using namespace dualys;
 using namespace std::chrono_literals;
@@ -21,74 +34,274 @@ void HamonNode::initializeTopology() {
 }
 
 // --- Constructeur Corrigé ---
-HamonNode::HamonNode(Node p_topology_node, HamonCube p_cube, const std::vector<NodeConfig> &p_configs)
+HamonNode::HamonNode(Node p_topology_node, HamonCube p_cube, const std::vector<NodeConfig> &p_configs,
+                     NodeOptions p_options, LocalMesh *p_mesh)
     : topology_node(std::move(p_topology_node))
       , cube(std::move(p_cube))
       , server_fd(-1)
-      , port(0), is_master(false), all_configs(p_configs) {
+      , port(0), is_master(false), options(std::move(p_options)), all_configs(p_configs), loop(options.io_backend)
+      , local_mesh(p_mesh) {
+    if (options.io_backend == IoBackend::Uring && loop.backend() != IoBackend::Uring) {
+        std::cerr << "[Node " << topology_node.id << "] io_uring is not available, using epoll" << std::endl;
+    }
 }
 
 // --- Fonctions d'implémentation (certaines manquaient) ---
 
 bool HamonNode::run() {
-    if (!setup_server()) return false;
+    if (options.launch_time == std::chrono::steady_clock::time_point{}) {
+        options.launch_time = std::chrono::steady_clock::now();
+    }
+    // Nodes of one process are linked through the mesh: nobody connects to them. A server
+    // bound by the orchestrator was adopted already.
+    if (!local_mesh && server_fd < 0 && !setup_server()) return false;
+    // Mesh setup, map and reduce run as coroutines on the node's event loop, each phase
+    // with a deadline, so a slow or dead peer fails the run instead of hanging it.
+    if (!run_job(std::cout)) return fail_run();
+    links.clear();
 
-    // Petite pause pour s'assurer que tous les serveurs sont prêts
-    std::this_thread::sleep_for(100ms);
+    return close_server_socket();
+}
 
-    if (!distribute_and_map()) return false;
-    if (!reduce()) return false;
+bool HamonNode::serve(const int job_fd) {
+    if (options.launch_time == std::chrono::steady_clock::time_point{}) {
+        options.launch_time = std::chrono::steady_clock::now();
+    }
+    if (!local_mesh && server_fd < 0 && !setup_server()) return false;
+    if (!loop.run(link_cluster())) return fail_run();
+    const bool served = topology_node.id == 0 ? dispatch_jobs(job_fd) : follow_jobs();
+    if (!served) return fail_run();
+    links.clear();
+    return close_server_socket();
+}
+
+bool HamonNode::dispatch_jobs(const int job_fd) {
+    std::cout << "[Node 0] Waiting for jobs" << std::endl;
+    while (true) {
+        const int client = accept4(job_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("[Node 0] accept failed on the job socket");
+            return false;
+        }
+        JobRequest request;
+        if (!HamonJobs::read_request(client, request)) {
+            (void) HamonJobs::reply(client, false, "malformed request");
+            close(client);
+            continue;
+        }
+        if (request.shutdown) {
+            for (const auto &link: links | std::views::values) link->send("Q");
+            (void) HamonJobs::reply(client, true, {});
+            close(client);
+            std::cout << "[Node 0] Shutting down" << std::endl;
+            begin_phase("flush");
+            return flush_links();
+        }
+        // A job that fails desynchronizes the links and stops the daemon: refuse what can be seen to fail.
+        if (!std::filesystem::is_regular_file(request.input) || access(request.input.c_str(), R_OK) != 0) {
+            (void) HamonJobs::reply(client, false, "cannot read " + request.input);
+            close(client);
+            continue;
+        }
+        for (const auto &link: links | std::views::values) link->send("J " + request.input);
+        start_job(request.input);
+        std::ostringstream results;
+        const bool done = run_job(results);
+        (void) HamonJobs::reply(client, done, done ? results.str() : "the job failed; the daemon stops");
+        close(client);
+        if (!done) return false;
+    }
+}
 
+bool HamonNode::follow_jobs() {
+    std::string job;
+    while (true) {
+        if (!loop.run(next_job(job))) return false;
+        if (job == "Q") {
+            begin_phase("flush");
+            return flush_links();
+        }
+        if (!job.starts_with("J ")) {
+            std::cerr << "[Node " << topology_node.id << "] Unexpected message from node 0 between jobs" << std::endl;
+            return false;
+        }
+        start_job(job.substr(2));
+        if (!run_job(std::cout)) return false;
+    }
+}
+
+Task<bool> HamonNode::next_job(std::string &job) {
+    // Idle: the next job may come any time.
+    phase_name = "idle";
+    phase_deadline = EventLoop::deadline_in(0);
+    co_return co_await receive_from(0, job);
+}
+
+void HamonNode::start_job(std::string input) {
+    options.input_file = std::move(input);
+    options.launch_time = std::chrono::steady_clock::now();
+    local_counts = WordCountTable();
+}
+
+bool HamonNode::run_job(std::ostream &results) {
+    if (!loop.run(run_phases())) return false;
+
+    uint64_t distinct = local_counts.size();
+    uint64_t occurrences = 0;
+    local_counts.for_each([&](std::string_view, const uint64_t count) { occurrences += count; });
+    if (spills && spills->run_count() > 0) {
+        // Only a merge tells how many of the spilled words are distinct.
+        distinct = 0;
+        occurrences = 0;
+        (void) for_each_result([&](std::string_view, const uint64_t count) {
+            ++distinct;
+            occurrences += count;
+            return true;
+        });
+    }
+    // One write per line: nodes running as threads share std::cout with node 0's results.
+    std::ostringstream summary;
+    summary << "[Node " << topology_node.id << "] Holds " << distinct << " distinct words, " << occurrences
+            << " occurrences; startup " << phase_timings.startup_seconds * 1000.0 << " ms, map "
+            << phase_timings.map_seconds * 1000.0 << " ms, reduce " << phase_timings.reduce_seconds * 1000.0 << " ms";
+    if (spills) summary << "; " << spills->run_count() << " spilled run(s), " << spills->bytes() << " bytes";
+    summary << '\n';
+    std::cout << summary.str() << std::flush;
+
+    if (topology_node.id == 0 && options.reduce_mode != ReduceMode::Shuffle && !options.output_dir.empty() &&
+        !write_partition()) {
+        return false;
+    }
+    if (topology_node.id == 0 && (options.reduce_mode != ReduceMode::Shuffle || options.gather)) {
+        print_final_results(results);
+    }
+    begin_phase("flush");
+    return flush_links();
+}
+
+Task<bool> HamonNode::link_cluster() {
+    begin_phase("mesh");
+    const bool linked = co_await connect_mesh();
+    if (!linked) co_return false;
+    // The map starts on every node at once, as soon as the last one is linked.
+    const bool synchronized = co_await barrier();
+    if (!synchronized) co_return false;
+    mesh_ready = true;
     if (topology_node.id == 0) {
-        print_final_results();
+        const std::chrono::duration<double, std::milli> ready = std::chrono::steady_clock::now() - options.launch_time;
+        std::cout << "[Node 0] All " << all_configs.size() << " nodes ready " << ready.count() << " ms after launch"
+                << std::endl;
     }
+    co_return true;
+}
 
-    return close_server_socket();
+Task<bool> HamonNode::run_phases() {
+    // Results of co_await are bound to locals before being tested (see Task).
+    if (!mesh_ready) {
+        // Once per node: every later phase (and job) reuses these connections.
+        const bool linked = co_await link_cluster();
+        if (!linked) co_return false;
+    }
+    const auto map_start = std::chrono::steady_clock::now();
+    phase_timings.startup_seconds = std::chrono::duration<double>(map_start - options.launch_time).count();
+
+    begin_phase("map");
+    spills.reset();
+    if (options.memory_budget > 0) spills = std::make_unique<RunStore>(options.spill_dir);
+    const bool mapped = co_await distribute_and_map();
+    if (!mapped) co_return false;
+    if (spills && !spills->ok()) {
+        std::cerr << "[Node " << topology_node.id << "] Could not spill counts to " << options.spill_dir << std::endl;
+        co_return false;
+    }
+    const auto reduce_start = std::chrono::steady_clock::now();
+
+    begin_phase("reduce");
+    bool reduced = false;
+    switch (options.reduce_mode) {
+        case ReduceMode::Shuffle:
+            reduced = co_await shuffle();
+            // Every node writes its own partition, all at the same time.
+            if (reduced && !options.output_dir.empty()) reduced = write_partition();
+            if (reduced && options.gather) reduced = co_await gather_partitions();
+            break;
+        case ReduceMode::AllReduce:
+            // Recursive doubling needs every hypercube edge; other graphs go around their ring.
+            if (cube.getKind() == TopologyKind::Hypercube) reduced = co_await allreduce();
+            else reduced = co_await ring_allreduce();
+            break;
+        case ReduceMode::RingAllReduce:
+            reduced = co_await ring_allreduce();
+            break;
+        case ReduceMode::Tree:
+            reduced = co_await reduce();
+            if (reduced && options.broadcast) reduced = co_await broadcast();
+            break;
+    }
+    if (!reduced) co_return false;
+    const auto reduce_end = std::chrono::steady_clock::now();
+    phase_timings.map_seconds = std::chrono::duration<double>(reduce_start - map_start).count();
+    phase_timings.reduce_seconds = std::chrono::duration<double>(reduce_end - reduce_start).count();
+    co_return true;
+}
+
+void HamonNode::begin_phase(const char *name) {
+    phase_name = name;
+    phase_deadline = EventLoop::deadline_in(options.phase_timeout_ms);
+}
+
+bool HamonNode::fail_run() {
+    // Shut every link down so the peers fail right away instead of at their own deadlines.
+    for (const auto &link: links | std::views::values) link->abort();
+    links.clear();
+    (void) close_server_socket();
+    return false;
 }
 
 void HamonNode::print_final_results() const {
+    print_final_results(std::cout);
+}
+
+void HamonNode::print_final_results(std::ostream &out) const {
     if (topology_node.id == 0) {
-        std::cout << "------------------------------------------" << std::endl;
-        std::cout << "[Node 0] FINAL RESULT: Word Counts" << std::endl;
-        for (const auto &[fst, snd]: local_counts) {
-            std::cout << " - '" << fst << "': " << snd << std::endl;
-        }
-        std::cout << "------------------------------------------" << std::endl;
+        out << "------------------------------------------" << std::endl;
+        out << "[Node 0] FINAL RESULT: Word Counts" << std::endl;
+        (void) for_each_result([&out](const std::string_view word, const std::uint64_t count) {
+            std::string line = " - '";
+            line.append(word).append("': ").append(std::to_string(count)).push_back('\n');
+            out << line << std::flush;
+            return true;
+        });
+        out << "------------------------------------------" << std::endl;
     }
 }
 
 bool HamonNode::close_server_socket() const {
-    return close(server_fd) == 0;
+    return server_fd < 0 || close(server_fd) == 0;
 }
 
-void HamonNode::send_string(const int sock, const std::string &str) {
-    const auto payload_len = static_cast<uint32_t>(str.size());
-    const uint32_t net_len = htonl(payload_len);
-    send(sock, &net_len, sizeof(net_len), 0);
-    send(sock, str.c_str(), str.size(), 0);
+bool HamonNode::send_string(const int sock, const std::string_view str, const bool checksums) {
+    FrameWriter writer(sock, checksums);
+    return writer.write(str) && writer.finish();
 }
 
-std::string HamonNode::receive_string(const int client_socket) {
-    uint32_t len = 0;
-    if (read(client_socket, &len, sizeof(len)) != sizeof(len)) return "";
-    len = ntohl(len);
-    if (len > 0 && len < 65536) { // Petite sécurité
-        std::vector<char> buffer(len);
-        if (read(client_socket, buffer.data(), len) == static_cast<ssize_t>(len)) {
-            return std::string(buffer.begin(), buffer.end());
-        }
-    }
-    return "";
+bool HamonNode::send_file_range(const int sock, const int file_fd, const ShardRange &range, const bool checksums) {
+    FrameWriter writer(sock, checksums);
+    return writer.write_file(file_fd, range) && writer.finish();
 }
 
-WordCountMap HamonNode::perform_word_count_task(const std::string &text_chunk) const {
-    std::cout << "[Node " << topology_node.id << "] Starting Word Count task..." << std::endl;
-    WordCountMap counts;
-    std::stringstream ss(text_chunk);
-    std::string word;
-    while (ss >> word) {
-        counts[word]++;
-    }
+bool HamonNode::receive_string(const int client_socket, std::string &out) {
+    out.clear();
+    FrameReader reader(client_socket);
+    return reader.read_payload(out);
+}
+
+WordCountTable HamonNode::perform_word_count_task(const std::string_view text_chunk) const {
+    const unsigned threads = HamonMap::resolve_threads(all_configs[static_cast<size_t>(topology_node.id)].map_threads);
+    std::cout << "[Node " << topology_node.id << "] Starting Word Count task on " << threads << " thread(s)..." << std::endl;
+    WordCountTable counts = spills ? HamonMap::count(text_chunk, threads, *spills, options.memory_budget)
+                                   : HamonMap::count(text_chunk, threads);
     std::cout << "[Node " << topology_node.id << "] Word Count task finished." << std::endl;
     return counts;
 }
@@ -108,127 +321,1016 @@ void HamonNode::deserialize_and_merge_map(const std::string &x, WordCountMap &ma
         if (segment.empty()) continue;
         if (const size_t colon_pos = segment.find(':'); colon_pos != std::string::npos) {
             std::string word = segment.substr(0, colon_pos);
-            const int count = std::stoi(segment.substr(colon_pos + 1));
+            const std::uint64_t count = std::stoull(segment.substr(colon_pos + 1));
             map[word] += count;
         }
     }
 }
 
-bool HamonNode::setup_server() {
-    const auto &self_config = all_configs[static_cast<std::size_t>(topology_node.id)];
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
+std::string HamonNode::encode_map(const WordCountTable &counts, const WireFormat format) {
+    return format == WireFormat::Binary ? HamonCodec::encode(counts) : serialize_map(counts.to_map());
+}
+
+bool HamonNode::decode_and_merge_map(const std::string &payload, WordCountTable &counts, const WireFormat format) {
+    if (format == WireFormat::Binary) return HamonCodec::decode_and_merge(payload, counts);
+    WordCountMap parsed;
+    try {
+        deserialize_and_merge_map(payload, parsed);
+    } catch (const std::exception &) {
+        return false;
+    }
+    for (const auto &[word, count]: parsed) counts.add(word, count);
+    return true;
+}
+
+int HamonNode::listen_on(const int port, const int buffer_bytes) {
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0); // accepted from the event loop
+    if (fd < 0) {
+        perror("[Node Error] socket failed");
+        return -1;
+    }
 
     sockaddr_in address{};
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(static_cast<uint16_t>(self_config.port));
+    address.sin_port = htons(static_cast<uint16_t>(port));
 
     constexpr int opt = 1;
-    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
 
-    if (bind(server_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+    PeerLink::tune_socket(fd, buffer_bytes); // inherited by accepted sockets
+
+    if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
         perror("[Node Error] bind failed");
-        return false;
+        close(fd);
+        return -1;
     }
-    if (listen(server_fd, 16) < 0) {
+    if (listen(fd, SOMAXCONN) < 0) {
         perror("[Node Error] listen failed");
-        return false;
+        close(fd);
+        return -1;
     }
+    return fd;
+}
+
+void HamonNode::adopt_server_socket(const int fd) {
+    server_fd = fd;
+}
+
+bool HamonNode::setup_server() {
+    const auto &self_config = all_configs[static_cast<std::size_t>(topology_node.id)];
+    server_fd = listen_on(self_config.port, options.socket_buffer_bytes);
+    if (server_fd < 0) return false;
     std::cout << "[Node " << topology_node.id << "] Server is listening on port " << self_config.port << std::endl;
     return true;
 }
 
-bool HamonNode::distribute_and_map() {
-    if (topology_node.id == 0) {
-        std::cout << "[Node 0] Reading input file and distributing tasks..." << std::endl;
-        std::ifstream file("input.txt");
-        if (!file.is_open()) {
-            std::cerr << "[Node 0] CRITICAL ERROR: Could not open input.txt" << std::endl;
-            return false;
+int HamonNode::start_connect(const size_t id) const {
+    const NodeConfig &peer_config = all_configs[id];
+    const int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        perror("[Node Error] socket failed");
+        return -1;
+    }
+    sockaddr_in serv_addr{};
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(static_cast<uint16_t>(peer_config.port));
+    inet_pton(AF_INET, peer_config.ip_address.c_str(), &serv_addr.sin_addr);
+    PeerLink::tune_socket(sock, options.socket_buffer_bytes);
+    if (connect(sock, reinterpret_cast<sockaddr *>(&serv_addr), sizeof(serv_addr)) != 0 && errno != EINPROGRESS) {
+        // Refused right away (nobody listening yet): let the caller retry like a failed async connect.
+        const int error = errno;
+        close(sock);
+        return error == ECONNREFUSED ? -2 : -1;
+    }
+    return sock;
+}
+
+Task<int> HamonNode::greet(const int sock) {
+    int peer_id = -1;
+    std::uint16_t version = 0;
+    if (!HamonFrame::send_hello(sock, topology_node.id)) co_return -1;
+    const bool answered = co_await loop.readable(sock, phase_deadline);
+    if (!answered || !HamonFrame::receive_hello(sock, peer_id, version)) co_return -1;
+    co_return peer_id;
+}
+
+Task<bool> HamonNode::accept_peers(std::vector<int> expected) {
+    std::size_t remaining = expected.size();
+    while (remaining > 0) {
+        const int sock = co_await loop.accept(server_fd, phase_deadline);
+        if (sock == -ETIMEDOUT) {
+            std::cerr << "[Node " << topology_node.id << "] mesh: " << remaining
+                    << " peer(s) did not connect before the deadline" << std::endl;
+            co_return false;
+        }
+        if (sock < 0) {
+            std::cerr << "[Node Error] accept failed while connecting the mesh: " << std::strerror(-sock) << std::endl;
+            co_return false;
         }
-        std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        PeerLink::tune_socket(sock, 0); // buffer sizes are inherited from the listening socket
+        const int peer = co_await greet(sock);
+        if (peer < 0 || std::ranges::find(expected, peer) == expected.end() || links.contains(peer)) {
+            // Not a Hamon peer, an incompatible one, or not one of ours: drop it and keep listening.
+            if (peer >= 0) std::cerr << "[Node " << topology_node.id << "] Unexpected connection from node " << peer << std::endl;
+            close(sock);
+            continue;
+        }
+        if (!add_link(peer, sock, false)) co_return false;
+        --remaining;
+    }
+    co_return true;
+}
 
+std::vector<size_t> HamonNode::shard_weights() const {
+    std::vector<size_t> weights(static_cast<size_t>(cube.getNodeCount()), 1);
+    for (size_t i = 0; i < weights.size() && i < all_configs.size(); ++i) {
+        if (all_configs[i].map_threads > 0) weights[i] = static_cast<size_t>(all_configs[i].map_threads);
+    }
+    return weights;
+}
+
+Task<bool> HamonNode::distribute_and_map() {
+    if (options.dynamic_chunks) {
+        if (topology_node.id == 0) co_return co_await dispense_chunks();
+        std::cout << "[Node " << topology_node.id << "] Pulling ranges from the coordinator..." << std::endl;
+        const bool counted = co_await pull_and_count();
+        if (!counted) {
+            std::cerr << "[Node " << topology_node.id << "] Failed to receive task from coordinator." << std::endl;
+            co_return false;
+        }
+        co_return true;
+    }
+    if (topology_node.id == 0) {
         const auto node_count = static_cast<size_t>(cube.getNodeCount());
-        if (node_count == 0) return false;
-        const size_t chunk_size = content.length() / node_count;
-
-        for (size_t i = 1; i < node_count; ++i) {
-            const NodeConfig &worker_config = all_configs[i];
-            int worker_sock = socket(AF_INET, SOCK_STREAM, 0);
-            sockaddr_in serv_addr{};
-            serv_addr.sin_family = AF_INET;
-            serv_addr.sin_port = htons(static_cast<uint16_t>(worker_config.port));
-            inet_pton(AF_INET, worker_config.ip_address.c_str(), &serv_addr.sin_addr);
-
-            if (connect(worker_sock, reinterpret_cast<sockaddr *>(&serv_addr), sizeof(serv_addr)) == 0) {
-                const size_t start = i * chunk_size;
-                const size_t size = (i == node_count - 1) ? std::string::npos : chunk_size;
-                send_string(worker_sock, content.substr(start, size));
-                close(worker_sock);
-            } else {
-                std::cerr << "[Node 0] Failed to connect to worker " << i << " to distribute task." << std::endl;
+        if (node_count == 0) co_return false;
+
+        if (options.input_mode == InputMode::Shared) {
+            // Workers read their own range: only send (path, offset, length) descriptors.
+            std::cout << "[Node 0] Sending shared-storage descriptors..." << std::endl;
+            std::error_code ec;
+            const std::string path = std::filesystem::absolute(options.input_file, ec).string();
+            const auto file_size = std::filesystem::file_size(path, ec);
+            if (ec) {
+                std::cerr << "[Node 0] CRITICAL ERROR: Could not stat " << options.input_file << std::endl;
+                co_return false;
             }
+            const std::vector<ShardRange> shards = HamonShard::nominal_split(file_size, shard_weights());
+            std::vector<std::string> descriptors(node_count);
+            for (size_t i = 1; i < node_count; ++i) descriptors[i] = HamonShard::encode_descriptor(path, shards[i]);
+            std::string own_chunk;
+            const bool scattered = co_await collectives().scatter(std::move(descriptors), own_chunk);
+            if (!scattered) co_return false;
+            if (!HamonShard::read_range(path, shards[0], own_chunk, loop.backend())) co_return false;
+            local_counts = perform_word_count_task(own_chunk);
+            co_return true;
+        }
+
+        std::cout << "[Node 0] Mapping input file and distributing tasks..." << std::endl;
+        const MappedFile input(options.input_file);
+        if (!input.is_open()) {
+            std::cerr << "[Node 0] CRITICAL ERROR: Could not open " << options.input_file << std::endl;
+            co_return false;
+        }
+        const std::vector<ShardRange> shards = HamonShard::split(input.view(), shard_weights());
+
+        // Chunks go down the binomial tree in pieces, each link sending from its own thread
+        // while node 0 counts its share; workers count their pieces while they forward the rest.
+        collectives(StreamingCount::piece_bytes).scatter_file(input.fd(), shards);
+        local_counts = perform_word_count_task(input.slice(shards[0]));
+        // The mapping must outlive the queued sendfile() calls.
+        if (!finish_chunk_sends()) co_return false;
+    } else if (options.input_mode == InputMode::Stream) {
+        std::cout << "[Node " << topology_node.id << "] Counting the chunk as it arrives..." << std::endl;
+        const bool counted = co_await receive_and_count();
+        if (!counted) {
+            std::cerr << "[Node " << topology_node.id << "] Failed to receive task from coordinator." << std::endl;
+            co_return false;
         }
-        local_counts = perform_word_count_task(content.substr(0, chunk_size));
     } else {
         std::cout << "[Node " << topology_node.id << "] Waiting for task from coordinator..." << std::endl;
-        sockaddr_in client_addr{};
-        socklen_t addrlen = sizeof(client_addr);
-        int client_socket = accept(server_fd, reinterpret_cast<sockaddr *>(&client_addr), &addrlen);
-        if (client_socket < 0) {
-            perror("[Node Error] accept failed");
-            return false;
+        std::string received_chunk;
+        const bool received = co_await collectives().scatter({}, received_chunk);
+        if (!received) {
+            std::cerr << "[Node " << topology_node.id << "] Failed to receive task from coordinator." << std::endl;
+            co_return false;
+        }
+        std::string path;
+        ShardRange nominal{};
+        if (!HamonShard::decode_descriptor(received_chunk, path, nominal)) {
+            std::cerr << "[Node " << topology_node.id << "] Invalid shard descriptor." << std::endl;
+            co_return false;
         }
-        std::string received_chunk = receive_string(client_socket);
+        if (!HamonShard::read_range(path, nominal, received_chunk, loop.backend())) co_return false;
         local_counts = perform_word_count_task(received_chunk);
-        close(client_socket);
     }
+    co_return true;
+}
+
+Task<bool> HamonNode::receive_and_count() {
+    const unsigned threads = HamonMap::resolve_threads(all_configs[static_cast<size_t>(topology_node.id)].map_threads);
+    StreamingCount counter(threads, spills.get(), options.memory_budget);
+    // Counted on the counter's thread while the loop receives the next piece.
+    const HamonCollectives::SegmentSink count = [&counter](std::string &piece) { counter.feed(piece); };
+    const bool received = co_await collectives().receive_scatter(count);
+    if (!received) co_return false;
+    local_counts = counter.finish();
+    std::cout << "[Node " << topology_node.id << "] Word Count task finished." << std::endl;
+    co_return true;
+}
+
+bool HamonNode::finish_chunk_sends() {
+    bool sent = true;
+    for (const auto &[peer, link]: links) {
+        if (!link->flush_until(phase_deadline)) {
+            std::cerr << "[Node 0] Failed to send chunk to worker " << peer << "." << std::endl;
+            // Shut the socket so the sender gives up, and wait for it to let go of the file.
+            link->abort();
+            link->flush();
+            sent = false;
+        }
+    }
+    return sent;
+}
+
+// Messages of a pull-scheduled map are short texts tagged by their first letter. Worker to
+// node 0: "R <bytes/s>" asks for a range, "D <id>" reports one counted, "E" ends. Node 0 to
+// worker: "C <id>" followed by the range (its bytes, or a descriptor), "" when the input is
+// exhausted, "X <id>" to abandon a range another node completed first, and "K <id>..." listing
+// the ranges whose counts the worker keeps. D, E and K are only used with speculation.
+
+// The number after a one-letter tag ("C 12" gives 12).
+static std::uint64_t tagged_number(const std::string_view message) {
+    std::uint64_t value = 0;
+    if (message.size() > 2) std::from_chars(message.data() + 2, message.data() + message.size(), value);
+    return value;
+}
+
+// What a worker has received from node 0 but not counted yet.
+struct PullState {
+    std::deque<std::pair<std::uint64_t, std::string> > ranges;
+    std::optional<std::uint64_t> header;
+    std::set<std::uint64_t> abandoned;
+    int in_flight = 0;
+};
+
+// Apply one message from node 0. As soon as a range arrives the next one is requested, so it
+// travels while this one is counted.
+static bool take_pull_reply(PullState &state, std::string &reply, PeerLink &coordinator,
+                            const StreamingCount &counter) {
+    if (state.header) {
+        state.ranges.emplace_back(*state.header, std::move(reply));
+        state.header.reset();
+        coordinator.send("R " + std::to_string(static_cast<std::uint64_t>(counter.throughput())));
+        return true;
+    }
+    if (reply.empty()) {
+        --state.in_flight; // the input is used up
+    } else if (reply[0] == 'C') {
+        state.header = tagged_number(reply);
+    } else if (reply[0] == 'X') {
+        state.abandoned.insert(tagged_number(reply));
+    } else {
+        return false;
+    }
+    return true;
+}
+
+Task<bool> HamonNode::dispense_chunks() {
+    const auto node_count = static_cast<size_t>(cube.getNodeCount());
+    std::string path;
+    std::size_t size = 0;
+    std::unique_ptr<MappedFile> input;
+    if (options.input_mode == InputMode::Shared) {
+        std::error_code ec;
+        path = std::filesystem::absolute(options.input_file, ec).string();
+        size = std::filesystem::file_size(path, ec);
+        if (ec) {
+            std::cerr << "[Node 0] CRITICAL ERROR: Could not stat " << options.input_file << std::endl;
+            co_return false;
+        }
+    } else {
+        input = std::make_unique<MappedFile>(options.input_file);
+        if (!input->is_open()) {
+            std::cerr << "[Node 0] CRITICAL ERROR: Could not open " << options.input_file << std::endl;
+            co_return false;
+        }
+        size = input->size();
+    }
+    std::cout << "[Node 0] Handing out input ranges on request..." << std::endl;
+    ChunkTracker tracker(size, node_count, options.speculative ? ChunkTracker::default_slack : 0.0);
+
+    // Node 0 takes ranges from the same tracker on its own thread while the loop serves the workers.
+    const unsigned threads = HamonMap::resolve_threads(all_configs[0].map_threads);
+    std::vector<WordCountTable> tables(threads);
+    bool read_ok = true;
+    std::thread own([&] {
+        const IoBackend backend = loop.backend();
+        MapWorkers workers(threads);
+        std::string text;
+        double counted = 0;
+        double seconds = 0;
+        while (true) {
+            const auto start = std::chrono::steady_clock::now();
+            const auto assignment = tracker.next(0, seconds > 0 ? counted / seconds : 0, start);
+            if (!assignment) {
+                if (tracker.finished()) return;
+                std::this_thread::sleep_for(std::chrono::milliseconds(straggler_poll_ms));
+                continue;
+            }
+            std::string_view view;
+            if (input) {
+                view = input->slice(HamonShard::align_range(input->view(), assignment->range));
+            } else if (HamonShard::read_range(path, assignment->range, text, backend)) {
+                view = text;
+            } else {
+                read_ok = false;
+                return;
+            }
+            if (!options.speculative) {
+                HamonMap::count_into(view, tables, &workers);
+                if (spills) (void) spills->spill_if_over(tables, options.memory_budget);
+            } else {
+                // Count in pieces, to give the range up early if a worker completes it first.
+                std::vector<WordCountTable> range_tables(threads);
+                for (std::size_t at = 0; at < view.size() && !tracker.completed(assignment->id);) {
+                    const std::size_t end = HamonShard::align_to_boundary(
+                        view, std::min(view.size(), at + StreamingCount::piece_bytes));
+                    HamonMap::count_into(view.substr(at, end - at), range_tables, &workers);
+                    at = end;
+                }
+                if (tracker.complete(assignment->id, 0)) {
+                    // Fold the range into the node's tables at once: they stay one per map thread.
+                    for (std::size_t t = 0; t < threads; ++t) tables[t].merge(range_tables[t]);
+                    if (spills) (void) spills->spill_if_over(tables, options.memory_budget);
+                    // The other holders hear of it from serve_chunks (take_abandoned): only the loop
+                    // sends to the workers, so no notice lands between a "C <id>" and its range.
+                }
+            }
+            counted += static_cast<double>(view.size());
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    });
+    std::vector<Task<bool> > serving;
+    for (size_t i = 1; i < node_count; ++i) {
+        serving.push_back(serve_chunks(static_cast<int>(i), tracker, input.get(), path));
+    }
+    const bool served = co_await EventLoop::all(std::move(serving));
+    own.join();
+    local_counts = HamonMap::combine(std::move(tables));
+    std::cout << "[Node 0] Word Count task finished." << std::endl;
+    if (options.speculative) {
+        std::cout << "[Node 0] " << tracker.duplicates() << " range(s) re-executed speculatively" << std::endl;
+    }
+    // The mapping must outlive the queued sendfile() calls.
+    const bool sent = !input || finish_chunk_sends();
+    co_return served && sent && read_ok;
+}
+
+Task<bool> HamonNode::serve_chunks(const int worker, ChunkTracker &tracker, const MappedFile *input,
+                                   const std::string &path) {
+    PeerLink &link = link_to(worker);
+    std::string message;
+    int waiting = 0; // requests not answered yet
+    int closed = 0; // requests answered with "exhausted"
+    double rate = 0;
+    bool ended = false;
+    while (true) {
+        ReceiveStatus status;
+        while ((status = link.poll_receive(message)) == ReceiveStatus::Complete) {
+            if (message.starts_with('R')) {
+                ++waiting;
+                rate = static_cast<double>(tagged_number(message));
+            } else if (message.starts_with('D')) {
+                tracker.complete(tagged_number(message), worker);
+            } else if (message == "E") {
+                ended = true;
+            } else {
+                std::cerr << "[Node 0] Unexpected message from worker " << worker << "." << std::endl;
+                co_return false;
+            }
+        }
+        if (status == ReceiveStatus::Failed) co_return false;
+        // Ranges of this worker that node 0 or another worker completed first.
+        for (const std::uint64_t id: tracker.take_abandoned(worker)) link.send("X " + std::to_string(id));
+
+        while (waiting > 0) {
+            std::optional<ChunkTracker::Assignment> assignment =
+                    tracker.next(worker, rate, std::chrono::steady_clock::now());
+            if (assignment && input) assignment->range = HamonShard::align_range(input->view(), assignment->range);
+            if (assignment) {
+                link.send("C " + std::to_string(assignment->id));
+                if (!input) {
+                    link.send(HamonShard::encode_descriptor(path, assignment->range));
+                } else if (assignment->range.length == 0) {
+                    // A word longer than the range leaves nothing once aligned. The worker still counts
+                    // the empty range, so it has a table to keep if node 0 lists it as the winner.
+                    link.send(std::string());
+                } else {
+                    link.send_file_range(input->fd(), assignment->range);
+                }
+            } else if (tracker.finished()) {
+                link.send({});
+                ++closed;
+            } else {
+                break; // the input is handed out but not all counted: wait for a straggler
+            }
+            --waiting;
+        }
+        if (options.speculative ? ended : closed == pull_depth) break;
+
+        // Sleep until the worker writes; with a request waiting, look for stragglers again soon, and
+        // once ranges are duplicated, for the ones this worker lost.
+        const Deadline wake = waiting > 0 || tracker.duplicates() > 0
+                                  ? std::min(phase_deadline, EventLoop::deadline_in(straggler_poll_ms))
+                                  : phase_deadline;
+        const bool readable = co_await loop.readable(link.socket_fd(), wake);
+        if (!readable && std::chrono::steady_clock::now() >= phase_deadline) {
+            std::cerr << "[Node 0] No range request from worker " << worker << " before the deadline." << std::endl;
+            co_return false;
+        }
+    }
+    if (options.speculative) {
+        std::string kept = "K";
+        for (const std::uint64_t id: tracker.won_by(worker)) kept += ' ' + std::to_string(id);
+        link.send(std::move(kept));
+    }
+    co_return true;
+}
+
+Task<bool> HamonNode::pull_and_count() {
+    const unsigned threads = HamonMap::resolve_threads(all_configs[static_cast<size_t>(topology_node.id)].map_threads);
+    StreamingCount counter(threads, spills.get(), options.memory_budget);
+    PeerLink &coordinator = link_to(0);
+    PullState state;
+    for (int i = 0; i < pull_depth; ++i) coordinator.send("R 0");
+    state.in_flight = pull_depth;
+    std::map<std::uint64_t, WordCountTable> counted; // with speculation, until node 0 says which to keep
+    std::string message;
+    std::string piece;
+    std::string path;
+    ShardRange nominal{};
+    while (true) {
+        if (state.ranges.empty()) {
+            if (state.in_flight == 0) break;
+            const bool received = co_await receive_from(0, message);
+            if (!received || !take_pull_reply(state, message, coordinator, counter)) co_return false;
+            continue;
+        }
+        auto [id, text] = std::move(state.ranges.front());
+        state.ranges.pop_front();
+        if (state.abandoned.contains(id)) continue;
+        if (options.input_mode == InputMode::Shared) {
+            if (!HamonShard::decode_descriptor(text, path, nominal)) {
+                std::cerr << "[Node " << topology_node.id << "] Invalid shard descriptor." << std::endl;
+                co_return false;
+            }
+            if (!HamonShard::read_range(path, nominal, text, loop.backend())) co_return false;
+        }
+        if (!options.speculative) {
+            // Ranges are not contiguous, but each one starts on a delimiter (or is the input's
+            // first, which the dispenser hands out first): the counter's carry never joins words
+            // from two ranges.
+            counter.feed(text);
+            continue;
+        }
+        // Feed the range in pieces and read node 0's messages in between: it may tell us
+        // another node already completed this range.
+        for (std::size_t at = 0; at < text.size() && !state.abandoned.contains(id);) {
+            const std::size_t end = std::min(text.size(), at + StreamingCount::piece_bytes);
+            piece.assign(text, at, end - at);
+            counter.feed(piece);
+            at = end;
+            ReceiveStatus status;
+            while ((status = coordinator.poll_receive(message)) == ReceiveStatus::Complete) {
+                if (!take_pull_reply(state, message, coordinator, counter)) co_return false;
+            }
+            if (status == ReceiveStatus::Failed) co_return false;
+        }
+        WordCountTable table = counter.cut();
+        if (state.abandoned.contains(id)) continue;
+        counted.emplace(id, std::move(table));
+        coordinator.send("D " + std::to_string(id));
+    }
+    if (!options.speculative) {
+        local_counts = counter.finish();
+        std::cout << "[Node " << topology_node.id << "] Word Count task finished." << std::endl;
+        co_return true;
+    }
+
+    coordinator.send("E");
+    do {
+        const bool received = co_await receive_from(0, message);
+        if (!received) co_return false;
+    } while (message.starts_with('X')); // late notices for ranges already dropped or lost
+    if (!message.starts_with('K')) {
+        std::cerr << "[Node " << topology_node.id << "] Expected the list of kept ranges." << std::endl;
+        co_return false;
+    }
+    std::vector<WordCountTable> kept;
+    for (const char *at = message.data() + 1, *end = message.data() + message.size(); at < end;) {
+        std::uint64_t id = 0;
+        const auto parsed = std::from_chars(at + 1, end, id);
+        const auto found = counted.find(id);
+        if (parsed.ec != std::errc() || found == counted.end()) {
+            std::cerr << "[Node " << topology_node.id << "] Kept a range it did not count." << std::endl;
+            co_return false;
+        }
+        kept.push_back(std::move(found->second));
+        at = parsed.ptr;
+    }
+    std::cout << "[Node " << topology_node.id << "] Word Count task finished (" << kept.size() << "/"
+            << counted.size() << " ranges kept)." << std::endl;
+    local_counts = HamonMap::combine(std::move(kept), threads);
+    co_return true;
+}
+
+Task<bool> HamonNode::connect_peer(const int peer) {
+    // Peers start at about the same time: back off from 1 ms up to 50 ms until the deadline.
+    auto delay = 1ms;
+    while (true) {
+        const int sock = start_connect(static_cast<size_t>(peer));
+        if (sock == -1) co_return false;
+        if (sock >= 0) {
+            const bool connected = co_await loop.writable(sock, phase_deadline);
+            if (!connected) {
+                close(sock);
+                break;
+            }
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &length);
+            if (error == 0) {
+                // Links use blocking sockets: their writes run on sender threads.
+                fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) & ~O_NONBLOCK);
+                const int announced = co_await greet(sock);
+                if (announced != peer) {
+                    std::cerr << "[Node " << topology_node.id << "] Handshake with node " << peer << " failed." << std::endl;
+                    close(sock);
+                    co_return false;
+                }
+                co_return add_link(peer, sock, true);
+            }
+            close(sock);
+            if (error != ECONNREFUSED) break;
+        }
+        if (phase_deadline - std::chrono::steady_clock::now() <= delay) break;
+        co_await loop.sleep_until(std::chrono::steady_clock::now() + delay);
+        delay = std::min(delay * 2, std::chrono::milliseconds(50));
+    }
+    std::cerr << "[Node " << topology_node.id << "] Could not connect to node " << peer << std::endl;
+    co_return false;
+}
+
+bool HamonNode::add_link(const int peer, const int sock, const bool initiator) {
+    // The side that connected offers a shared-memory segment when the peer is on this host.
+    auto link = std::make_unique<PeerLink>(sock, peer, options.frame_checksums, loop.backend());
+    if (!link->negotiate_transport(initiator, options.shm_ring_bytes)) {
+        std::cerr << "[Node " << topology_node.id << "] Transport negotiation with node " << peer << " failed"
+                << std::endl;
+        return false;
+    }
+    links.emplace(peer, std::move(link));
     return true;
 }
 
-bool HamonNode::reduce() {
+Task<bool> HamonNode::connect_mesh() {
+    std::vector<int> peers;
+    const auto node_count = static_cast<int>(all_configs.size());
+    if (topology_node.id == 0) {
+        for (int i = 1; i < node_count; ++i) peers.push_back(i); // the coordinator talks to every worker
+    } else {
+        peers.push_back(0);
+        if (cube.getKind() == TopologyKind::Hypercube) {
+            // Every dimension: the tree, the Gray-code ring, the butterflies and the folds use these.
+            for (int d = 0; d < cube.getDimension(); ++d) {
+                if (const int partner = topology_node.id ^ (1 << d); partner < node_count) peers.push_back(partner);
+            }
+            // Past a power of two, the Gray code skips IDs and a few ring neighbors are not in the cube.
+            const auto [predecessor, successor] = ring_neighbors();
+            peers.insert(peers.end(), {predecessor, successor});
+        } else {
+            // The graph's own edges, the ring order's and the binomial tree's.
+            const auto &neighbors = cube.getNode(static_cast<size_t>(topology_node.id)).neighbors;
+            peers.insert(peers.end(), neighbors.begin(), neighbors.end());
+            const auto [predecessor, successor] = ring_neighbors();
+            peers.insert(peers.end(), {predecessor, successor, HamonCollectives::parent_of(topology_node.id)});
+            const auto children = HamonCollectives::children_of(topology_node.id, node_count);
+            peers.insert(peers.end(), children.begin(), children.end());
+        }
+        std::erase_if(peers, [&](const int peer) { return peer < 0 || peer == topology_node.id; });
+        std::ranges::sort(peers);
+        peers.erase(std::ranges::unique(peers).begin(), peers.end());
+    }
+    if (local_mesh) {
+        for (const int peer: peers) {
+            auto channel = local_mesh->take(topology_node.id, peer);
+            if (!channel) {
+                std::cerr << "[Node " << topology_node.id << "] No in-process channel to node " << peer << std::endl;
+                co_return false;
+            }
+            links.emplace(peer, std::make_unique<PeerLink>(std::move(channel), peer));
+        }
+        std::cout << "[Node " << topology_node.id << "] Linked to " << links.size() << " peers in process" << std::endl;
+        co_return true;
+    }
+    // Connections always point downwards: a node connects to its lower IDs and accepts its
+    // higher ones. Both sides run at once on the event loop.
+    std::vector<Task<bool> > tasks;
+    std::vector<int> higher;
+    for (const int peer: peers) {
+        if (peer < topology_node.id) tasks.push_back(connect_peer(peer));
+        else higher.push_back(peer);
+    }
+    tasks.push_back(accept_peers(std::move(higher)));
+    const bool linked = co_await EventLoop::all(std::move(tasks));
+    loop.stop_accepting(server_fd);
+    if (!linked) co_return false;
+    const auto local = std::ranges::count_if(links, [](const auto &entry) { return entry.second->uses_shared_memory(); });
+    std::cout << "[Node " << topology_node.id << "] Linked to " << links.size() << " peers (" << local
+            << " over shared memory)" << std::endl;
+    co_return true;
+}
+
+Task<bool> HamonNode::barrier() {
+    std::string signal;
+    if (cube.getKind() != TopologyKind::Hypercube) {
+        // Up the binomial tree and back down: node 0 releases everyone once all have arrived.
+        HamonCollectives tree = collectives();
+        std::vector<std::string> arrived;
+        const bool gathered = co_await tree.gather({}, arrived);
+        if (!gathered) co_return false;
+        const bool released = co_await tree.broadcast(signal);
+        co_return released;
+    }
+    const int core = cube.getCoreCount();
+    const int fold = cube.getFoldPartner(topology_node.id);
+    // An extra node arrives through its core node, and leaves when that one does.
+    if (topology_node.id >= core) link_to(fold).send("B");
+    if (fold >= 0) {
+        const bool heard = co_await receive_from(fold, signal);
+        if (!heard || signal != "B") co_return barrier_failed(fold);
+        if (topology_node.id >= core) co_return true;
+    }
+    for (int bit = 1; bit < core; bit <<= 1) {
+        const int partner = topology_node.id ^ bit;
+        link_to(partner).send("B");
+        const bool heard = co_await receive_from(partner, signal);
+        if (!heard || signal != "B") co_return barrier_failed(partner);
+    }
+    if (fold >= 0) link_to(fold).send("B");
+    co_return true;
+}
+
+bool HamonNode::barrier_failed(const int peer) const {
+    std::cerr << "[Node " << topology_node.id << "] Startup barrier: no signal from node " << peer << std::endl;
+    return false;
+}
+
+PeerLink &HamonNode::link_to(const int peer_id) const {
+    return *links.at(peer_id);
+}
+
+bool HamonNode::flush_links() const {
+    bool ok = true;
+    for (const auto &[peer, link]: links) {
+        if (!link->flush_until(phase_deadline)) {
+            std::cerr << "[Node " << topology_node.id << "] " << phase_name << ": sending to node " << peer
+                    << " failed or timed out" << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+Task<bool> HamonNode::receive_from(const int peer_id, std::string &out) {
+    PeerLink &link = link_to(peer_id);
+    if (!link.uses_shared_memory() && !link.in_process()) {
+        // TCP: the loop reads each header and body straight into the assembler's buffer.
+        while (true) {
+            const std::span<char> buffer = link.receive_buffer();
+            const std::size_t got = co_await loop.receive(link.socket_fd(), buffer, phase_deadline);
+            const ReceiveStatus status = link.received(got, out);
+            if (status == ReceiveStatus::Complete) co_return true;
+            if (status == ReceiveStatus::Failed) co_return false;
+            if (got < buffer.size()) {
+                std::cerr << "[Node " << topology_node.id << "] " << phase_name << ": no message from node "
+                        << peer_id << " before the deadline (" << options.phase_timeout_ms
+                        << " ms) or the link closed" << std::endl;
+                co_return false;
+            }
+        }
+    }
+    while (true) {
+        switch (link.poll_receive(out)) {
+            case ReceiveStatus::Complete:
+                co_return true;
+            case ReceiveStatus::Failed:
+                co_return false;
+            case ReceiveStatus::Pending:
+                break;
+        }
+        const bool readable = co_await loop.readable(link.socket_fd(), phase_deadline);
+        if (!readable) {
+            std::cerr << "[Node " << topology_node.id << "] " << phase_name << ": no message from node " << peer_id
+                    << " before the deadline (" << options.phase_timeout_ms << " ms)" << std::endl;
+            co_return false;
+        }
+    }
+}
+
+Task<bool> HamonNode::receive_and_merge(const int peer_id, const char *what) {
+    std::string payload;
+    const bool received = co_await receive_from(peer_id, payload);
+    if (!received) {
+        std::cerr << "[Node " << topology_node.id << "] " << what << ": failed to receive from node " << peer_id << std::endl;
+        co_return false;
+    }
+    if (!decode_and_merge_map(payload, local_counts, options.wire_format)) {
+        std::cerr << "[Node " << topology_node.id << "] " << what << ": malformed map from node " << peer_id << std::endl;
+        co_return false;
+    }
+    co_return true;
+}
+
+Task<bool> HamonNode::exchange(const int partner_id, std::string outgoing, std::string &incoming) {
+    // The link's sender thread writes while the loop reads: no deadlock on full buffers.
+    link_to(partner_id).send(std::move(outgoing));
+    co_return co_await receive_from(partner_id, incoming);
+}
+
+Task<bool> HamonNode::shuffle() {
+    if (cube.getKind() != TopologyKind::Hypercube) co_return co_await ring_reduce_scatter();
+    std::cout << "[Node " << topology_node.id << "] Starting shuffle (reduce-scatter)..." << std::endl;
+    const auto node_count = static_cast<size_t>(cube.getNodeCount());
+    const auto self = static_cast<size_t>(topology_node.id);
+    const auto core = static_cast<size_t>(cube.getCoreCount());
+    const int fold = cube.getFoldPartner(topology_node.id);
+    if (self >= core) {
+        // Extra node: its core node shuffles its counts and hands back the keys it owns.
+        link_to(fold).send(encode_map(local_counts, options.wire_format));
+        local_counts.clear();
+        co_return co_await receive_and_merge(fold, "Shuffle");
+    }
+    if (fold >= 0) {
+        const bool folded = co_await receive_and_merge(fold, "Shuffle");
+        if (!folded) co_return false;
+    }
+
+    for (size_t bit = 1; bit < core; bit <<= 1) {
+        const auto partner_id = static_cast<int>(self ^ bit);
+        // Keys whose owner (or the core node it is folded onto) is on the partner's side of bit leave this node.
+        const WordCountTable outgoing = local_counts.extract_if([&](const uint64_t hash) {
+            return ((WordCountTable::owner_of(hash, node_count) % core ^ self) & bit) != 0;
+        });
+        std::string incoming;
+        const bool exchanged = co_await exchange(partner_id, encode_map(outgoing, options.wire_format), incoming);
+        if (!exchanged) {
+            std::cerr << "[Node " << topology_node.id << "] Shuffle: exchange with node " << partner_id << " failed" << std::endl;
+            co_return false;
+        }
+        if (!decode_and_merge_map(incoming, local_counts, options.wire_format)) {
+            std::cerr << "[Node " << topology_node.id << "] Shuffle: malformed map from node " << partner_id << std::endl;
+            co_return false;
+        }
+    }
+    if (fold >= 0) {
+        link_to(fold).send(encode_map(local_counts.extract_if([&](const uint64_t hash) {
+            return WordCountTable::owner_of(hash, node_count) == static_cast<size_t>(fold);
+        }), options.wire_format));
+    }
+    co_return true;
+}
+
+Task<bool> HamonNode::allreduce() {
+    std::cout << "[Node " << topology_node.id << "] Starting allreduce (recursive doubling)..." << std::endl;
+    const int core = cube.getCoreCount();
+    const int fold = cube.getFoldPartner(topology_node.id);
+    if (topology_node.id >= core) {
+        // Extra node: its core node takes part for it and sends back the global counts.
+        link_to(fold).send(encode_map(local_counts, options.wire_format));
+        local_counts.clear();
+        co_return co_await receive_and_merge(fold, "Allreduce");
+    }
+    if (fold >= 0) {
+        const bool folded = co_await receive_and_merge(fold, "Allreduce");
+        if (!folded) co_return false;
+    }
+    for (int bit = 1; bit < core; bit <<= 1) {
+        const auto partner_id = topology_node.id ^ bit;
+        // Both partners hold the same key set afterwards, so the next step sends twice as much.
+        std::string incoming;
+        const bool exchanged = co_await exchange(partner_id, encode_map(local_counts, options.wire_format), incoming);
+        if (!exchanged) {
+            std::cerr << "[Node " << topology_node.id << "] Allreduce: exchange with node " << partner_id << " failed" << std::endl;
+            co_return false;
+        }
+        if (!decode_and_merge_map(incoming, local_counts, options.wire_format)) {
+            std::cerr << "[Node " << topology_node.id << "] Allreduce: malformed map from node " << partner_id << std::endl;
+            co_return false;
+        }
+    }
+    if (fold >= 0) link_to(fold).send(encode_map(local_counts, options.wire_format));
+    co_return true;
+}
+
+std::pair<int, int> HamonNode::ring_neighbors() const {
+    const std::vector<int> &order = cube.getRingOrder();
+    const auto n = static_cast<int>(order.size());
+    const auto position = static_cast<int>(std::ranges::find(order, topology_node.id) - order.begin());
+    return {order[static_cast<size_t>((position + n - 1) % n)], order[static_cast<size_t>((position + 1) % n)]};
+}
+
+Task<bool> HamonNode::ring_reduce_scatter() {
+    std::cout << "[Node " << topology_node.id << "] Starting shuffle (ring reduce-scatter)..." << std::endl;
+    const std::vector<int> &order = cube.getRingOrder();
+    const auto n = static_cast<int>(order.size());
+    const auto node_count = static_cast<size_t>(n);
+    const auto position = static_cast<int>(std::ranges::find(order, topology_node.id) - order.begin());
+    const auto [predecessor, successor] = ring_neighbors();
+    // Step s sends the part owned by the node s + 1 places back along the ring, merged with
+    // what came in at step s - 1; the last step brings in this node's own part.
+    for (int s = 0; s + 1 < n; ++s) {
+        const int owner = order[static_cast<size_t>(((position - s - 1) % n + n) % n)];
+        const WordCountTable outgoing = local_counts.extract_if([&](const uint64_t hash) {
+            return WordCountTable::owner_of(hash, node_count) == static_cast<size_t>(owner);
+        });
+        link_to(successor).send(encode_map(outgoing, options.wire_format));
+        const bool merged = co_await receive_and_merge(predecessor, "Ring reduce-scatter");
+        if (!merged) co_return false;
+    }
+    co_return true;
+}
+
+Task<bool> HamonNode::ring_allreduce() {
+    const bool scattered = co_await ring_reduce_scatter();
+    if (!scattered) co_return false;
+    std::cout << "[Node " << topology_node.id << "] Starting ring allgather..." << std::endl;
+    const auto n = static_cast<int>(cube.getNodeCount());
+    const auto [predecessor, successor] = ring_neighbors();
+    // Each partition goes once around the ring, forwarded as received: the keys are disjoint,
+    // so merging is a plain insert and nothing is re-encoded.
+    std::string payload = encode_map(local_counts, options.wire_format);
+    for (int s = 0; s + 1 < n; ++s) {
+        link_to(successor).send(std::move(payload));
+        std::string incoming;
+        const bool received = co_await receive_from(predecessor, incoming);
+        if (!received) {
+            std::cerr << "[Node " << topology_node.id << "] Ring allgather: failed to receive from node "
+                    << predecessor << std::endl;
+            co_return false;
+        }
+        if (!decode_and_merge_map(incoming, local_counts, options.wire_format)) {
+            std::cerr << "[Node " << topology_node.id << "] Ring allgather: malformed map from node " << predecessor
+                    << std::endl;
+            co_return false;
+        }
+        payload = std::move(incoming);
+    }
+    co_return true;
+}
+
+Task<bool> HamonNode::broadcast() {
+    std::string payload;
+    if (topology_node.id == 0) payload = encode_map(local_counts, options.wire_format);
+    const bool received = co_await collectives().broadcast(payload);
+    if (!received) co_return false;
+    if (topology_node.id == 0) co_return true;
+    local_counts.clear();
+    if (!decode_and_merge_map(payload, local_counts, options.wire_format)) {
+        std::cerr << "[Node " << topology_node.id << "] Broadcast: malformed map" << std::endl;
+        co_return false;
+    }
+    co_return true;
+}
+
+Task<bool> HamonNode::gather_partitions() {
+    std::cout << "[Node " << topology_node.id << "] Gathering the partitions on node 0..." << std::endl;
+    std::vector<std::string> partitions;
+    const bool gathered = co_await collectives().gather(encode_map(local_counts, options.wire_format), partitions);
+    if (!gathered) co_return false;
+    if (topology_node.id != 0) co_return true;
+    // The partitions hold disjoint keys: node 0 decodes each one once, nothing is merged twice.
+    for (size_t i = 1; i < partitions.size(); ++i) {
+        if (!decode_and_merge_map(partitions[i], local_counts, options.wire_format)) {
+            std::cerr << "[Node 0] Gather: malformed partition from node " << i << std::endl;
+            co_return false;
+        }
+        std::string().swap(partitions[i]);
+    }
+    co_return true;
+}
+
+HamonCollectives HamonNode::collectives(const std::size_t segment_bytes) {
+    CollectiveLinks ports{
+        [this](const int peer, std::string payload) { link_to(peer).send(std::move(payload)); },
+        [this](const int peer, const int file_fd, const ShardRange &range) {
+            link_to(peer).send_file_range(file_fd, range);
+        },
+        [this](const int peer, std::string &out) { return receive_from(peer, out); }
+    };
+    return {std::move(ports), topology_node.id, static_cast<int>(all_configs.size()), segment_bytes};
+}
+
+const PhaseTimings &HamonNode::timings() const {
+    return phase_timings;
+}
+
+bool HamonNode::write_partition() const {
+    std::error_code ec;
+    std::filesystem::create_directories(options.output_dir, ec); // may race with other nodes; checked on open
+    const std::filesystem::path path = std::filesystem::path(options.output_dir) /
+                                       ("part-" + std::to_string(topology_node.id) + ".txt");
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "[Node " << topology_node.id << "] Could not write " << path << std::endl;
+        return false;
+    }
+    const bool complete = for_each_result([&](const std::string_view word, const std::uint64_t count) {
+        out << word << '\t' << count << '\n';
+        return static_cast<bool>(out);
+    });
+    return complete && static_cast<bool>(out.flush());
+}
+
+Task<bool> HamonNode::reduce() {
     std::cout << "[Node " << topology_node.id << "] Starting reduce phase..." << std::endl;
+    if (spills) co_return co_await reduce_spilled();
 
+    // Children are the partners across the dimensions below this node's lowest set bit (all
+    // of them for node 0). They are received concurrently and merged as they arrive; the
+    // merged table then goes to the parent, across the lowest set bit.
+    std::vector<Task<bool> > children;
+    int parent_id = -1;
     for (int d = 0; d < cube.getDimension(); ++d) {
         const auto partner_id = topology_node.id ^ (1 << d);
         if (static_cast<size_t>(partner_id) >= all_configs.size()) continue;
-        const NodeConfig &partner_config = all_configs[static_cast<size_t>(partner_id)];
-
         if (topology_node.id > partner_id) {
-            const int client_sock = socket(AF_INET, SOCK_STREAM, 0);
-            sockaddr_in serv_addr{};
-            serv_addr.sin_family = AF_INET;
-            serv_addr.sin_port = htons(static_cast<uint16_t>(partner_config.port));
-            inet_pton(AF_INET, partner_config.ip_address.c_str(), &serv_addr.sin_addr);
-
-            bool connected = false;
-            for (int attempt = 0; attempt < 5; ++attempt) {
-                if (connect(client_sock, reinterpret_cast<sockaddr *>(&serv_addr), sizeof(serv_addr)) == 0) {
-                    connected = true;
-                    break;
-                }
-                std::this_thread::sleep_for(50ms);
-            }
+            parent_id = partner_id;
+            break;
+        }
+        children.push_back(receive_and_merge(partner_id, "Reduce phase"));
+    }
+    const bool merged = co_await EventLoop::all(std::move(children));
+    if (!merged) co_return false;
+    if (parent_id >= 0) link_to(parent_id).send(encode_map(local_counts, options.wire_format));
+    co_return true;
+}
 
-            if (connected) {
-                send_string(client_sock, serialize_map(local_counts));
-            } else {
-                std::cerr << "[Node " << topology_node.id << "] Reduce phase: could not connect to partner " << partner_id << std::endl;
-            }
-            close(client_sock);
+Task<bool> HamonNode::reduce_spilled() {
+    // Same tree as reduce(), but counts travel as sorted block streams and land in runs.
+    std::vector<Task<bool> > children;
+    int parent_id = -1;
+    for (int d = 0; d < cube.getDimension(); ++d) {
+        const auto partner_id = topology_node.id ^ (1 << d);
+        if (static_cast<size_t>(partner_id) >= all_configs.size()) continue;
+        if (topology_node.id > partner_id) {
+            parent_id = partner_id;
             break;
         }
+        children.push_back(receive_run(partner_id));
+    }
+    const bool received = co_await EventLoop::all(std::move(children));
+    if (!received) co_return false;
+    if (parent_id < 0) co_return true;
 
-        sockaddr_in client_addr{};
-        socklen_t addrlen = sizeof(client_addr);
-        if (const int client_socket = accept(server_fd, reinterpret_cast<sockaddr *>(&client_addr), &addrlen); client_socket >= 0) {
-            std::string received_str_map = receive_string(client_socket);
-            deserialize_and_merge_map(received_str_map, local_counts);
-            close(client_socket);
-        } else {
-            perror("[Node Error] accept failed during reduce");
-            return false;
+    PeerLink &link = link_to(parent_id);
+    int queued = 0;
+    const bool merged = spills->merge_blocks(local_counts, [&](std::string block) {
+        link.send(std::move(block));
+        return ++queued % spill_flush_blocks != 0 || link.flush_until(phase_deadline);
+    });
+    if (!merged) {
+        std::cerr << "[Node " << topology_node.id << "] Reduce phase: could not stream the merged runs" << std::endl;
+        co_return false;
+    }
+    link.send({});
+    // Everything now lives with the parent.
+    local_counts = WordCountTable();
+    spills->clear();
+    co_return true;
+}
+
+Task<bool> HamonNode::receive_run(const int peer_id) {
+    const int run = spills->begin_run();
+    if (run < 0) co_return false;
+    std::string block;
+    while (true) {
+        const bool received = co_await receive_from(peer_id, block);
+        if (!received) {
+            std::cerr << "[Node " << topology_node.id << "] Reduce phase: failed to receive from node " << peer_id
+                    << std::endl;
+            co_return false;
         }
+        if (block.empty()) co_return true;
+        if (!spills->append_block(run, block)) co_return false;
+    }
+}
+
+bool HamonNode::for_each_result(const RunStore::EntrySink &emit) const {
+    if (spills) return spills->merge(local_counts, emit);
+    for (const auto &[word, count]: local_counts.sorted()) {
+        if (!emit(word, count)) return false;
     }
     return true;
-}
\ No newline at end of file
+}
@@ -0,0 +1,134 @@
+#include "../include/HamonPlacement.hpp"
+#include <algorithm>
+#include <climits>
+#include <iostream>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace dualys;
+
+std::vector<NodePlacement> HamonPlacement::plan(const std::vector<NodeConfig> &configs,
+                                                const std::vector<NumaDomain> &domains) {
+    std::vector<NodePlacement> placements(configs.size());
+    std::size_t total_cpus = 0;
+    for (const auto &domain: domains) total_cpus += domain.cpus.size();
+    if (configs.empty() || total_cpus == 0) return placements;
+    const bool bind_memory = domains.size() > 1;
+
+    // Nodes per NUMA node in proportion to its CPUs; the remainder goes to the first ones.
+    std::vector<std::size_t> counts(domains.size());
+    std::size_t assigned = 0;
+    for (std::size_t d = 0; d < domains.size(); ++d) {
+        counts[d] = configs.size() * domains[d].cpus.size() / total_cpus;
+        assigned += counts[d];
+    }
+    for (std::size_t d = 0; assigned < configs.size(); d = (d + 1) % domains.size()) {
+        if (domains[d].cpus.empty()) continue;
+        ++counts[d];
+        ++assigned;
+    }
+    std::size_t next = 0;
+    for (std::size_t d = 0; d < domains.size(); ++d) {
+        const std::vector<int> &cpus = domains[d].cpus;
+        std::vector<std::vector<int> > cores = domains[d].cores;
+        if (cores.empty()) {
+            for (const int cpu: cpus) cores.push_back({cpu});
+        }
+        for (std::size_t j = 0; j < counts[d]; ++j, ++next) {
+            NodePlacement &placement = placements[next];
+            placement.numa = bind_memory ? domains[d].id : -1;
+            if (counts[d] <= cores.size()) {
+                // A contiguous share of the NUMA node's physical cores, with their SMT siblings.
+                for (std::size_t c = j * cores.size() / counts[d]; c < (j + 1) * cores.size() / counts[d]; ++c) {
+                    placement.cpus.insert(placement.cpus.end(), cores[c].begin(), cores[c].end());
+                }
+                std::ranges::sort(placement.cpus);
+            } else {
+                // One CPU each, physical cores first: a sibling only once every core has a node.
+                placement.cpus = {cpus[j % cpus.size()]};
+            }
+        }
+    }
+
+    // @cpu numa= core= overrides.
+    for (std::size_t i = 0; i < configs.size(); ++i) {
+        const NodeConfig &cfg = configs[i];
+        if (cfg.numa < 0 && cfg.core < 0) continue;
+        const auto domain = std::ranges::find(domains, cfg.numa, &NumaDomain::id);
+        if (cfg.numa >= 0 && domain == domains.end()) {
+            std::cerr << "[hamon] Node " << cfg.id << ": NUMA node " << cfg.numa
+                    << " has no usable CPU; placed automatically" << std::endl;
+            continue;
+        }
+        if (cfg.core < 0) {
+            placements[i] = {bind_memory ? domain->id : -1, domain->cpus};
+            continue;
+        }
+        // core=J counts within the NUMA node, physical cores first, or is a CPU number without numa=.
+        std::vector<std::pair<int, int> > candidates; // (cpu, its NUMA node)
+        for (const NumaDomain &candidate: domains) {
+            if (cfg.numa >= 0 && candidate.id != cfg.numa) continue;
+            for (const int cpu: candidate.cpus) candidates.emplace_back(cpu, candidate.id);
+        }
+        if (cfg.numa < 0) std::ranges::sort(candidates);
+        auto chosen = candidates.end();
+        if (static_cast<std::size_t>(cfg.core) < candidates.size()) {
+            chosen = candidates.begin() + cfg.core;
+        } else {
+            // Past the NUMA node's CPU count: read core=J as logical CPU J, if it is one of them.
+            chosen = std::ranges::find(candidates, cfg.core, &std::pair<int, int>::first);
+        }
+        if (chosen == candidates.end()) {
+            std::cerr << "[hamon] Node " << cfg.id << ": core " << cfg.core << " is not available; placed automatically"
+                    << std::endl;
+            continue;
+        }
+        placements[i] = {bind_memory ? chosen->second : -1, {chosen->first}};
+    }
+    return placements;
+}
+
+bool HamonPlacement::apply(const NodePlacement &placement, const int node_id) {
+    bool ok = true;
+    if (!placement.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (const int cpu: placement.cpus) {
+            if (cpu < CPU_SETSIZE) CPU_SET(static_cast<unsigned>(cpu), &set);
+        }
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            std::cerr << "[Node " << node_id << "] Could not pin to " << describe(placement) << std::endl;
+            ok = false;
+        }
+    }
+    if (placement.numa >= 0) {
+        constexpr std::size_t bits = sizeof(unsigned long) * CHAR_BIT;
+        const auto numa = static_cast<std::size_t>(placement.numa);
+        std::vector<unsigned long> mask(numa / bits + 1, 0);
+        mask[numa / bits] |= 1UL << (numa % bits);
+        // The kernel reads maxnode - 1 bits.
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask.data(), mask.size() * bits + 1) != 0) {
+            std::cerr << "[Node " << node_id << "] Could not prefer memory on NUMA node " << placement.numa
+                    << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+std::string HamonPlacement::describe(const NodePlacement &placement) {
+    if (placement.cpus.empty()) return "unpinned";
+    std::string text = placement.cpus.size() == 1 ? "cpu " : "cpus ";
+    for (std::size_t i = 0; i < placement.cpus.size();) {
+        std::size_t j = i;
+        while (j + 1 < placement.cpus.size() && placement.cpus[j + 1] == placement.cpus[j] + 1) ++j;
+        if (i > 0) text += ',';
+        text += std::to_string(placement.cpus[i]);
+        if (j > i) text += '-' + std::to_string(placement.cpus[j]);
+        i = j + 1;
+    }
+    if (placement.numa >= 0) text += ", numa " + std::to_string(placement.numa);
+    return text;
+}
@@ -0,0 +1,142 @@
+#include "../include/HamonQueue.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using namespace dualys;
+
+namespace dualys {
+    // One direction of a LocalChannel, shared by its two ends.
+    struct LocalPipe {
+        explicit LocalPipe(const int p_doorbell) : doorbell(p_doorbell) {
+        }
+
+        ~LocalPipe() {
+            ::close(doorbell);
+        }
+
+        void ring() const {
+            constexpr std::uint64_t one = 1;
+            while (write(doorbell, &one, sizeof(one)) < 0 && errno == EINTR) {
+            }
+        }
+
+        void drain() const {
+            std::uint64_t count;
+            while (read(doorbell, &count, sizeof(count)) < 0 && errno == EINTR) {
+            }
+        }
+
+        MpscQueue<std::string> queue;
+        int doorbell;
+        // Set by the reader before its last look at the queue; the writer rings only then.
+        std::atomic<bool> armed{false};
+        std::atomic<bool> writer_closed{false};
+        std::atomic<bool> reader_closed{false};
+    };
+}
+
+namespace {
+    std::shared_ptr<LocalPipe> make_pipe() {
+        const int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0) {
+            perror("[Local] eventfd failed");
+            return nullptr;
+        }
+        return std::make_shared<LocalPipe>(fd);
+    }
+}
+
+LocalChannel::LocalChannel(std::shared_ptr<LocalPipe> p_outbound, std::shared_ptr<LocalPipe> p_inbound)
+    : outbound(std::move(p_outbound)), inbound(std::move(p_inbound)) {
+}
+
+std::pair<std::unique_ptr<LocalChannel>, std::unique_ptr<LocalChannel> > LocalChannel::pair() {
+    auto forward = make_pipe();
+    auto backward = make_pipe();
+    if (!forward || !backward) return {};
+    return {
+        std::unique_ptr<LocalChannel>(new LocalChannel(forward, backward)),
+        std::unique_ptr<LocalChannel>(new LocalChannel(backward, forward))
+    };
+}
+
+LocalChannel::~LocalChannel() {
+    close();
+}
+
+void LocalChannel::close() {
+    if (!outbound->writer_closed.exchange(true)) outbound->ring(); // wake a reader waiting for more
+    inbound->reader_closed.store(true);
+}
+
+bool LocalChannel::send(std::string payload) {
+    if (outbound->writer_closed.load() || outbound->reader_closed.load()) return false;
+    outbound->queue.push(std::move(payload));
+    // seq_cst, like the reader's arming: either it sees the payload or we see it armed.
+    if (outbound->armed.exchange(false)) outbound->ring();
+    return true;
+}
+
+bool LocalChannel::send_file_range(const int file_fd, const ShardRange &range) {
+    std::string payload(range.length, '\0');
+    for (std::size_t done = 0; done < payload.size();) {
+        const ssize_t got = pread(file_fd, payload.data() + done, payload.size() - done,
+                                  static_cast<off_t>(range.offset + done));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            perror("[Local] pread failed");
+            return false;
+        }
+        done += static_cast<std::size_t>(got);
+    }
+    return send(std::move(payload));
+}
+
+ReceiveStatus LocalChannel::poll_receive(std::string &out) {
+    if (inbound->queue.try_pop(out)) return ReceiveStatus::Complete;
+    inbound->drain();
+    inbound->armed.store(true);
+    if (inbound->queue.try_pop(out)) return ReceiveStatus::Complete;
+    if (inbound->writer_closed.load()) {
+        // Everything sent before the close is already linked into the queue.
+        return inbound->queue.try_pop(out) ? ReceiveStatus::Complete : ReceiveStatus::Failed;
+    }
+    return ReceiveStatus::Pending;
+}
+
+bool LocalChannel::receive(std::string &out) {
+    while (true) {
+        switch (poll_receive(out)) {
+            case ReceiveStatus::Complete:
+                return true;
+            case ReceiveStatus::Failed:
+                return false;
+            case ReceiveStatus::Pending:
+                break;
+        }
+        pollfd pfd{inbound->doorbell, POLLIN, 0};
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR) return false;
+    }
+}
+
+int LocalChannel::doorbell_fd() const {
+    return inbound->doorbell;
+}
+
+std::unique_ptr<LocalChannel> LocalMesh::take(const int self, const int peer) {
+    std::lock_guard lock(mutex);
+    if (std::exchange(taken[{self, peer}], true)) return nullptr;
+    if (const auto it = waiting.find({self, peer}); it != waiting.end()) {
+        auto end = std::move(it->second);
+        waiting.erase(it);
+        return end;
+    }
+    auto [mine, theirs] = LocalChannel::pair();
+    if (!mine) return nullptr;
+    waiting[{peer, self}] = std::move(theirs);
+    return std::move(mine);
+}
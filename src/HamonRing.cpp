@@ -0,0 +1,372 @@
+#include "../include/HamonRing.hpp"
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/futex.h>
+#include <netinet/in.h>
+#include <new>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+using namespace dualys;
+
+namespace {
+    constexpr std::uint64_t segment_magic = 0x48414d4f4e524e47; // "HAMONRNG"
+    constexpr std::size_t page_size = 4096;
+    constexpr std::size_t min_ring_bytes = page_size;
+    constexpr int spin_iterations = 64;
+    constexpr long liveness_poll_ns = 50'000'000;
+
+    struct SegmentHeader {
+        std::uint64_t magic;
+        std::uint64_t ring_bytes;
+        RingControl rings[2];
+    };
+
+    constexpr std::size_t header_bytes = (sizeof(SegmentHeader) + page_size - 1) / page_size * page_size;
+
+    std::atomic<unsigned> segment_counter{0};
+
+    void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#endif
+    }
+
+    // Shared (not FUTEX_PRIVATE) futexes: the two sides are different processes.
+    void futex_wait(std::atomic<std::uint32_t> &word, const std::uint32_t expected, const timespec &timeout) {
+        syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+    }
+
+    void futex_wake(std::atomic<std::uint32_t> &word) {
+        syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+    }
+
+    // Names come from the peer: only accept the ones create() produces.
+    bool valid_segment_name(const std::string &name) {
+        return name.starts_with("/hamon-") && name.find('/', 1) == std::string::npos && name.size() < 64;
+    }
+}
+
+ShmRing::ShmRing(RingControl *p_control, char *p_data, const std::size_t p_capacity, const int p_liveness_fd)
+    : control(p_control), data(p_data), capacity(p_capacity), liveness_fd(p_liveness_fd), broken(false) {
+}
+
+bool ShmRing::peer_alive() const {
+    pollfd pfd{liveness_fd, POLLRDHUP, 0};
+    if (poll(&pfd, 1, 0) < 0) return errno == EINTR;
+    return (pfd.revents & (POLLRDHUP | POLLHUP | POLLERR | POLLNVAL)) == 0;
+}
+
+bool ShmRing::wait(std::atomic<std::uint32_t> &seq, std::atomic<std::uint32_t> &sleeping, const bool for_data) {
+    const auto ready = [&] {
+        const std::uint64_t head = control->head.load();
+        const std::uint64_t tail = control->tail.load();
+        return for_data ? head != tail : head - tail < capacity;
+    };
+    for (int i = 0; i < spin_iterations; ++i) {
+        if (ready()) return true;
+        cpu_relax();
+    }
+    while (true) {
+        // Announce the sleep before the last check: the other side either sees the flag
+        // and wakes us, or published its update before our check and we do not sleep.
+        const std::uint32_t seen = seq.load();
+        sleeping.store(futex_sleeper);
+        if (ready()) {
+            sleeping.store(0);
+            return true;
+        }
+        constexpr timespec timeout{0, liveness_poll_ns};
+        futex_wait(seq, seen, timeout);
+        sleeping.store(0);
+        if (ready()) return true;
+        // Bytes published before the peer hung up are still valid.
+        if (!peer_alive()) return ready();
+    }
+}
+
+std::span<char> ShmRing::reserve() {
+    while (!broken) {
+        const std::uint64_t head = control->head.load(std::memory_order_relaxed);
+        const std::uint64_t tail = control->tail.load(std::memory_order_acquire);
+        if (const std::size_t free = capacity - static_cast<std::size_t>(head - tail); free > 0) {
+            const std::size_t index = static_cast<std::size_t>(head) & (capacity - 1);
+            return {data + index, std::min(free, capacity - index)};
+        }
+        if (!wait(control->space_seq, control->writer_sleeping, false)) broken = true;
+    }
+    return {};
+}
+
+void ShmRing::commit(const std::size_t n) {
+    // seq_cst, like the sleeper's announcement: one of the two sides sees the other's store.
+    control->head.store(control->head.load(std::memory_order_relaxed) + n);
+    control->data_seq.fetch_add(1);
+    if (std::uint32_t sleeper = control->reader_sleeping.load(); sleeper == futex_sleeper) {
+        futex_wake(control->data_seq);
+    } else if (sleeper == doorbell_sleeper && control->reader_sleeping.compare_exchange_strong(sleeper, 0)) {
+        // One byte is enough; if the socket buffer is full the reader has plenty to wake up to.
+        constexpr char bell = 0;
+        send(liveness_fd, &bell, 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+}
+
+std::span<const char> ShmRing::peek() {
+    while (!broken) {
+        const std::uint64_t tail = control->tail.load(std::memory_order_relaxed);
+        const std::uint64_t head = control->head.load(std::memory_order_acquire);
+        if (const auto used = static_cast<std::size_t>(head - tail); used > 0) {
+            const std::size_t index = static_cast<std::size_t>(tail) & (capacity - 1);
+            return {data + index, std::min(used, capacity - index)};
+        }
+        if (!wait(control->data_seq, control->reader_sleeping, true)) broken = true;
+    }
+    return {};
+}
+
+void ShmRing::consume(const std::size_t n) {
+    control->tail.store(control->tail.load(std::memory_order_relaxed) + n);
+    control->space_seq.fetch_add(1);
+    if (control->writer_sleeping.load()) futex_wake(control->space_seq);
+}
+
+bool ShmRing::write(const void *bytes, const std::size_t size) {
+    const auto *in = static_cast<const char *>(bytes);
+    std::size_t done = 0;
+    while (done < size) {
+        const std::span<char> space = reserve();
+        if (space.empty()) return false;
+        const std::size_t n = std::min(space.size(), size - done);
+        std::memcpy(space.data(), in + done, n);
+        commit(n);
+        done += n;
+    }
+    return true;
+}
+
+bool ShmRing::write_file(const int file_fd, const ShardRange &range) {
+    std::size_t done = 0;
+    while (done < range.length) {
+        const std::span<char> space = reserve();
+        if (space.empty()) return false;
+        const std::size_t n = std::min(space.size(), range.length - done);
+        const ssize_t got = pread(file_fd, space.data(), n, static_cast<off_t>(range.offset + done));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        commit(static_cast<std::size_t>(got));
+        done += static_cast<std::size_t>(got);
+    }
+    return true;
+}
+
+bool ShmRing::read(void *bytes, const std::size_t size) {
+    auto *out = static_cast<char *>(bytes);
+    std::size_t done = 0;
+    while (done < size) {
+        const std::span<const char> available = peek();
+        if (available.empty()) return false;
+        const std::size_t n = std::min(available.size(), size - done);
+        std::memcpy(out + done, available.data(), n);
+        consume(n);
+        done += n;
+    }
+    return true;
+}
+
+std::size_t ShmRing::try_read(void *bytes, const std::size_t size) {
+    auto *out = static_cast<char *>(bytes);
+    std::size_t done = 0;
+    while (done < size) {
+        const std::uint64_t tail = control->tail.load(std::memory_order_relaxed);
+        const std::uint64_t head = control->head.load(std::memory_order_acquire);
+        const auto used = static_cast<std::size_t>(head - tail);
+        if (used == 0) break;
+        const std::size_t index = static_cast<std::size_t>(tail) & (capacity - 1);
+        const std::size_t n = std::min({used, capacity - index, size - done});
+        std::memcpy(out + done, data + index, n);
+        consume(n);
+        done += n;
+    }
+    return done;
+}
+
+bool ShmRing::arm_doorbell() {
+    // Same handshake as wait(): announce, then check once more.
+    control->reader_sleeping.store(doorbell_sleeper);
+    if (control->head.load() == control->tail.load()) return false;
+    control->reader_sleeping.store(0);
+    return true;
+}
+
+ShmChannel::ShmChannel(void *p_base, const std::size_t p_mapped, const std::size_t ring_bytes, const bool creator,
+                       const int socket_fd, std::string p_name)
+    : base(p_base), mapped(p_mapped), segment_name(std::move(p_name)),
+      // The creator writes ring 0 and reads ring 1; the peer does the opposite.
+      outbound(&static_cast<SegmentHeader *>(p_base)->rings[creator ? 0 : 1],
+               static_cast<char *>(p_base) + header_bytes + (creator ? 0 : ring_bytes), ring_bytes, socket_fd),
+      inbound(&static_cast<SegmentHeader *>(p_base)->rings[creator ? 1 : 0],
+              static_cast<char *>(p_base) + header_bytes + (creator ? ring_bytes : 0), ring_bytes, socket_fd),
+      socket(socket_fd), incoming_length(0), length_got(0), body_got(0) {
+}
+
+ShmChannel::~ShmChannel() {
+    munmap(base, mapped);
+    unlink();
+}
+
+std::unique_ptr<ShmChannel> ShmChannel::create(const std::size_t ring_bytes, const int socket_fd) {
+    const std::size_t ring = std::bit_ceil(std::max(ring_bytes, min_ring_bytes));
+    const std::size_t total = header_bytes + 2 * ring;
+    std::string name;
+    int fd = -1;
+    for (int attempt = 0; attempt < 16 && fd < 0; ++attempt) {
+        name = "/hamon-" + std::to_string(getpid()) + "-" + std::to_string(segment_counter.fetch_add(1));
+        fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0 && errno != EEXIST) break;
+    }
+    if (fd < 0) {
+        perror("[Ring] shm_open failed");
+        return nullptr;
+    }
+    // Reserve every page now: running out of tmpfs later would be a SIGBUS.
+    if (const int err = posix_fallocate(fd, 0, static_cast<off_t>(total)); err != 0) {
+        std::cerr << "[Ring] Cannot reserve " << total << " bytes of shared memory: " << std::strerror(err)
+                << std::endl;
+        close(fd);
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+    void *base = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror("[Ring] mmap failed");
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+    auto *header = new(base) SegmentHeader{};
+    header->magic = segment_magic;
+    header->ring_bytes = ring;
+    return std::unique_ptr<ShmChannel>(new ShmChannel(base, total, ring, true, socket_fd, name));
+}
+
+std::unique_ptr<ShmChannel> ShmChannel::open(const std::string &name, const int socket_fd) {
+    if (!valid_segment_name(name)) return nullptr;
+    const int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) return nullptr;
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < header_bytes) {
+        close(fd);
+        return nullptr;
+    }
+    const auto total = static_cast<std::size_t>(st.st_size);
+    void *base = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return nullptr;
+    const auto *header = static_cast<const SegmentHeader *>(base);
+    const std::size_t ring = header->ring_bytes;
+    if (header->magic != segment_magic || !std::has_single_bit(ring) || total != header_bytes + 2 * ring) {
+        munmap(base, total);
+        return nullptr;
+    }
+    return std::unique_ptr<ShmChannel>(new ShmChannel(base, total, ring, false, socket_fd, {}));
+}
+
+bool ShmChannel::same_host(const int socket_fd) {
+    sockaddr_storage local{};
+    sockaddr_storage remote{};
+    socklen_t local_len = sizeof(local);
+    socklen_t remote_len = sizeof(remote);
+    if (getsockname(socket_fd, reinterpret_cast<sockaddr *>(&local), &local_len) != 0 ||
+        getpeername(socket_fd, reinterpret_cast<sockaddr *>(&remote), &remote_len) != 0) {
+        return false;
+    }
+    if (remote.ss_family == AF_UNIX) return true;
+    if (remote.ss_family == AF_INET && local.ss_family == AF_INET) {
+        const in_addr peer = reinterpret_cast<const sockaddr_in *>(&remote)->sin_addr;
+        const in_addr self = reinterpret_cast<const sockaddr_in *>(&local)->sin_addr;
+        return (ntohl(peer.s_addr) >> 24) == 127 || peer.s_addr == self.s_addr;
+    }
+    if (remote.ss_family == AF_INET6 && local.ss_family == AF_INET6) {
+        const in6_addr &peer = reinterpret_cast<const sockaddr_in6 *>(&remote)->sin6_addr;
+        const in6_addr &self = reinterpret_cast<const sockaddr_in6 *>(&local)->sin6_addr;
+        return IN6_IS_ADDR_LOOPBACK(&peer) || std::memcmp(&peer, &self, sizeof(peer)) == 0;
+    }
+    return false;
+}
+
+const std::string &ShmChannel::name() const {
+    return segment_name;
+}
+
+void ShmChannel::unlink() {
+    if (segment_name.empty()) return;
+    shm_unlink(segment_name.c_str());
+    segment_name.clear();
+}
+
+bool ShmChannel::send(const std::string_view payload) {
+    const std::uint64_t length = payload.size();
+    return outbound.write(&length, sizeof(length)) && outbound.write(payload.data(), payload.size());
+}
+
+bool ShmChannel::send_file_range(const int file_fd, const ShardRange &range) {
+    const std::uint64_t length = range.length;
+    return outbound.write(&length, sizeof(length)) && outbound.write_file(file_fd, range);
+}
+
+bool ShmChannel::receive(std::string &out) {
+    std::uint64_t length = 0;
+    out.clear();
+    if (!inbound.read(&length, sizeof(length))) return false;
+    out.resize(static_cast<std::size_t>(length));
+    return inbound.read(out.data(), out.size());
+}
+
+bool ShmChannel::drain_doorbell() const {
+    char bells[64];
+    while (true) {
+        const ssize_t got = recv(socket, bells, sizeof(bells), MSG_DONTWAIT);
+        if (got > 0) continue;
+        if (got < 0 && errno == EINTR) continue;
+        return got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+    }
+}
+
+ReceiveStatus ShmChannel::poll_receive(std::string &out) {
+    // A hang-up only counts once the ring is empty: bytes published before it are valid.
+    const bool hung_up = drain_doorbell();
+    while (true) {
+        if (length_got < sizeof(incoming_length)) {
+            length_got += inbound.try_read(reinterpret_cast<char *>(&incoming_length) + length_got,
+                                           sizeof(incoming_length) - length_got);
+            if (length_got == sizeof(incoming_length)) {
+                incoming.resize(static_cast<std::size_t>(incoming_length));
+                body_got = 0;
+            }
+        }
+        if (length_got == sizeof(incoming_length)) {
+            body_got += inbound.try_read(incoming.data() + body_got, incoming.size() - body_got);
+            if (body_got == incoming.size()) {
+                out.swap(incoming); // the caller's buffer is reused for the next payload
+                incoming.clear();
+                length_got = 0;
+                return ReceiveStatus::Complete;
+            }
+        }
+        if (hung_up) return ReceiveStatus::Failed;
+        if (!inbound.arm_doorbell()) return ReceiveStatus::Pending;
+    }
+}
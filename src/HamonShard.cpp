@@ -0,0 +1,394 @@
+#include "../include/HamonShard.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace dualys;
+
+MappedFile::MappedFile(const std::string &path) : file_fd(-1), data(nullptr), length(0) {
+    file_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file_fd < 0) {
+        perror("[Shard Error] open failed");
+        return;
+    }
+    struct stat st{};
+    if (fstat(file_fd, &st) != 0) {
+        perror("[Shard Error] fstat failed");
+        close(file_fd);
+        file_fd = -1;
+        return;
+    }
+    length = static_cast<std::size_t>(st.st_size);
+    if (length == 0) return; // mmap refuses empty mappings; an empty view is fine
+    data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file_fd, 0);
+    if (data == MAP_FAILED) {
+        perror("[Shard Error] mmap failed");
+        data = nullptr;
+        length = 0;
+        close(file_fd);
+        file_fd = -1;
+        return;
+    }
+    madvise(data, length, MADV_SEQUENTIAL);
+}
+
+MappedFile::~MappedFile() {
+    if (data != nullptr) munmap(data, length);
+    if (file_fd >= 0) close(file_fd);
+}
+
+bool MappedFile::is_open() const {
+    return file_fd >= 0;
+}
+
+std::string_view MappedFile::view() const {
+    if (data == nullptr) return {};
+    return {static_cast<const char *>(data), length};
+}
+
+std::string_view MappedFile::slice(const ShardRange &range) const {
+    return view().substr(range.offset, range.length);
+}
+
+int MappedFile::fd() const {
+    return file_fd;
+}
+
+std::size_t MappedFile::size() const {
+    return length;
+}
+
+bool HamonShard::is_delimiter(const char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+std::size_t HamonShard::align_to_boundary(const std::string_view data, std::size_t pos) {
+    if (pos == 0) return 0;
+    while (pos < data.size() && !is_delimiter(data[pos])) ++pos;
+    return std::min(pos, data.size());
+}
+
+ShardRange HamonShard::align_range(const std::string_view data, const ShardRange &nominal) {
+    const std::size_t start = align_to_boundary(data, nominal.offset);
+    const std::size_t end = std::max(start, align_to_boundary(data, nominal.offset + nominal.length));
+    return {start, end - start};
+}
+
+// End of the nominal range i, at sum(weights[0..i]) / sum(weights) of the input.
+static std::vector<std::size_t> nominal_ends(const std::size_t size, const std::vector<std::size_t> &weights) {
+    std::size_t total = 0;
+    for (const std::size_t w: weights) total += w;
+    std::vector<std::size_t> ends;
+    ends.reserve(weights.size());
+    std::size_t prefix = 0;
+    for (std::size_t i = 0; i < weights.size(); ++i) {
+        prefix += weights[i];
+        // size * prefix / total without overflowing for large inputs.
+        ends.push_back(i + 1 < weights.size()
+                           ? size / total * prefix + size % total * prefix / total
+                           : size);
+    }
+    return ends;
+}
+
+std::vector<ShardRange> HamonShard::split(const std::string_view data, const std::size_t parts) {
+    return split(data, std::vector<std::size_t>(parts, 1));
+}
+
+std::vector<ShardRange> HamonShard::split(const std::string_view data, const std::vector<std::size_t> &weights) {
+    std::vector<ShardRange> ranges;
+    if (weights.empty()) return ranges;
+    ranges.reserve(weights.size());
+    std::size_t start = 0;
+    for (const std::size_t nominal_end: nominal_ends(data.size(), weights)) {
+        // A long word may push the boundary past the next nominal split;
+        // never go backwards, the following ranges just become empty.
+        const std::size_t end = std::max(start, align_to_boundary(data, nominal_end));
+        ranges.push_back({start, end - start});
+        start = end;
+    }
+    return ranges;
+}
+
+std::vector<ShardRange> HamonShard::nominal_split(const std::size_t file_size, const std::size_t parts) {
+    return nominal_split(file_size, std::vector<std::size_t>(parts, 1));
+}
+
+std::vector<ShardRange> HamonShard::nominal_split(const std::size_t file_size, const std::vector<std::size_t> &weights) {
+    std::vector<ShardRange> ranges;
+    if (weights.empty()) return ranges;
+    ranges.reserve(weights.size());
+    std::size_t start = 0;
+    for (const std::size_t end: nominal_ends(file_size, weights)) {
+        ranges.push_back({start, end - start});
+        start = end;
+    }
+    return ranges;
+}
+
+// Same rule as align_to_boundary, but scanning the file with pread() instead of a mapping.
+static bool align_in_file(const int fd, std::size_t pos, const std::size_t file_size, std::size_t &out) {
+    if (pos == 0 || pos >= file_size) {
+        out = std::min(pos, file_size);
+        return true;
+    }
+    std::array<char, 4096> block{};
+    while (pos < file_size) {
+        const ssize_t got = pread(fd, block.data(), block.size(), static_cast<off_t>(pos));
+        if (got <= 0) return false;
+        const auto n = static_cast<std::size_t>(got);
+        for (std::size_t i = 0; i < n; ++i) {
+            if (HamonShard::is_delimiter(block[i])) {
+                out = pos + i;
+                return true;
+            }
+        }
+        pos += n;
+    }
+    out = file_size;
+    return true;
+}
+
+// Reads kept in flight by read_with_ring().
+static constexpr unsigned ring_depth = 16;
+
+static bool read_with_pread(const int fd, const std::size_t start, std::string &out) {
+    std::size_t done = 0;
+    while (done < out.size()) {
+        const ssize_t got = pread(fd, out.data() + done, out.size() - done, static_cast<off_t>(start + done));
+        if (got <= 0) return false;
+        done += static_cast<std::size_t>(got);
+    }
+    return true;
+}
+
+// The range as fixed-size chunks, ring_depth of them in flight at once; a short read
+// resubmits the rest of its chunk.
+static bool read_with_ring(IoUring &ring, const int fd, const std::size_t start, std::string &out) {
+    constexpr std::size_t chunk = std::size_t{1} << 20;
+    const std::size_t chunks = (out.size() + chunk - 1) / chunk;
+    std::vector<std::size_t> done(chunks, 0);
+    const auto submit = [&](const std::size_t k) {
+        const std::size_t begin = k * chunk + done[k];
+        const std::size_t end = std::min(out.size(), (k + 1) * chunk);
+        return ring.prep_read(fd, {out.data() + begin, end - begin}, start + begin, k);
+    };
+    std::size_t next = 0;
+    std::size_t in_flight = 0;
+    std::size_t finished = 0;
+    while (finished < chunks) {
+        for (; next < chunks && in_flight < ring_depth; ++next, ++in_flight) {
+            if (!submit(next)) return false;
+        }
+        if (!ring.enter(1)) return false;
+        std::uint64_t k = 0;
+        std::int32_t result = 0;
+        std::uint32_t flags = 0;
+        while (ring.next_completion(k, result, flags)) {
+            if (result <= 0) {
+                errno = result < 0 ? -result : EIO;
+                return false;
+            }
+            done[k] += static_cast<std::size_t>(result);
+            if (k * chunk + done[k] < std::min(out.size(), (k + 1) * chunk)) {
+                if (!submit(k)) return false;
+                continue;
+            }
+            --in_flight;
+            ++finished;
+        }
+    }
+    return true;
+}
+
+bool HamonShard::read_range(const std::string &path, const ShardRange &nominal, std::string &out,
+                            const IoBackend backend) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror("[Shard Error] open failed");
+        return false;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) != 0) {
+        perror("[Shard Error] fstat failed");
+        close(fd);
+        return false;
+    }
+    const auto file_size = static_cast<std::size_t>(st.st_size);
+    posix_fadvise(fd, static_cast<off_t>(nominal.offset), static_cast<off_t>(nominal.length), POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, static_cast<off_t>(nominal.offset), static_cast<off_t>(nominal.length), POSIX_FADV_WILLNEED);
+
+    std::size_t start = 0;
+    std::size_t end = 0;
+    if (!align_in_file(fd, nominal.offset, file_size, start) ||
+        !align_in_file(fd, nominal.offset + nominal.length, file_size, end)) {
+        perror("[Shard Error] pread failed");
+        close(fd);
+        return false;
+    }
+    end = std::max(start, end);
+
+    out.resize(end - start);
+    bool ok = false;
+    bool read = false;
+    if (backend == IoBackend::Uring && !out.empty()) {
+        if (IoUring ring(ring_depth); ring.is_open()) {
+            ok = read_with_ring(ring, fd, start, out);
+            read = true;
+            if (!ok) perror("[Shard Error] io_uring read failed");
+        }
+    }
+    if (!read) {
+        ok = read_with_pread(fd, start, out);
+        if (!ok) perror("[Shard Error] pread failed");
+    }
+    close(fd);
+    return ok;
+}
+
+std::string HamonShard::encode_descriptor(const std::string &path, const ShardRange &range) {
+    std::ostringstream ss;
+    ss << range.offset << ' ' << range.length << ' ' << path;
+    return ss.str();
+}
+
+bool HamonShard::decode_descriptor(const std::string &message, std::string &path, ShardRange &range) {
+    std::istringstream ss(message);
+    if (!(ss >> range.offset >> range.length)) return false;
+    ss.get(); // single separator; the path itself may contain spaces
+    std::getline(ss, path, '\0');
+    return !path.empty();
+}
+
+ChunkDispenser::ChunkDispenser(const std::size_t p_total, const std::size_t p_takers, const std::size_t p_min_chunk,
+                               const std::size_t p_max_chunk)
+    : total(p_total), takers(std::max<std::size_t>(p_takers, 1)), min_chunk(std::max<std::size_t>(p_min_chunk, 1)),
+      max_chunk(std::max(p_max_chunk, p_min_chunk)), position(0) {
+}
+
+std::optional<ShardRange> ChunkDispenser::next(const double bytes_per_second) {
+    std::lock_guard lock(mutex);
+    const std::size_t left = total - position;
+    if (left == 0) return std::nullopt;
+    // Without a measurement yet, start small enough for every taker to get several ranges.
+    std::size_t size = bytes_per_second > 0
+                           ? static_cast<std::size_t>(bytes_per_second * target_seconds)
+                           : total / (takers * 16);
+    size = std::min(size, left / (2 * takers));
+    size = std::min(std::clamp(size, min_chunk, max_chunk), left);
+    const ShardRange range{position, size};
+    position += size;
+    return range;
+}
+
+std::size_t ChunkDispenser::remaining() const {
+    std::lock_guard lock(mutex);
+    return total - position;
+}
+
+ChunkTracker::ChunkTracker(const std::size_t p_total, const std::size_t p_takers, const double p_slack,
+                           const std::size_t p_min_chunk, const std::size_t p_max_chunk)
+    : dispenser(p_total, p_takers, p_min_chunk, p_max_chunk), slack(p_slack),
+      rates(std::max<std::size_t>(p_takers, 1), 0.0), abandoned(rates.size()), open(0), duplicated(0) {
+}
+
+std::optional<ChunkTracker::Assignment> ChunkTracker::next(const int taker, const double bytes_per_second,
+                                                           const std::chrono::steady_clock::time_point now) {
+    std::lock_guard lock(mutex);
+    const auto who = static_cast<std::size_t>(taker);
+    if (bytes_per_second > 0 && who < rates.size()) rates[who] = bytes_per_second;
+    if (const std::optional<ShardRange> range = dispenser.next(bytes_per_second)) {
+        entries.push_back({*range, {taker}, now, -1});
+        ++open;
+        return Assignment{entries.size() - 1, *range, false};
+    }
+    if (slack <= 0 || open == 0) return std::nullopt;
+
+    std::vector<double> measured;
+    for (const double rate: rates) {
+        if (rate > 0) measured.push_back(rate);
+    }
+    if (measured.empty()) return std::nullopt;
+    std::ranges::nth_element(measured, measured.begin() + static_cast<std::ptrdiff_t>(measured.size() / 2));
+    const double median = measured[measured.size() / 2];
+
+    // The open range furthest behind, among those held once and not by the taker.
+    std::size_t best = entries.size();
+    double best_lag = slack;
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        const Entry &entry = entries[i];
+        if (entry.winner >= 0 || entry.holders.size() != 1 || entry.holders.front() == taker) continue;
+        const double expected = std::max(static_cast<double>(entry.range.length) / median,
+                                         ChunkDispenser::target_seconds);
+        const double lag = std::chrono::duration<double>(now - entry.issued).count() / expected;
+        if (lag > best_lag) {
+            best_lag = lag;
+            best = i;
+        }
+    }
+    if (best == entries.size()) return std::nullopt;
+    entries[best].holders.push_back(taker);
+    ++duplicated;
+    return Assignment{best, entries[best].range, true};
+}
+
+bool ChunkTracker::complete(const std::uint64_t id, const int taker) {
+    std::lock_guard lock(mutex);
+    if (id >= entries.size()) return false;
+    Entry &entry = entries[id];
+    if (entry.winner >= 0 || std::ranges::find(entry.holders, taker) == entry.holders.end()) return false;
+    entry.winner = taker;
+    --open;
+    for (const int holder: entry.holders) {
+        if (holder != taker) abandoned[static_cast<std::size_t>(holder)].push_back(id);
+    }
+    return true;
+}
+
+bool ChunkTracker::completed(const std::uint64_t id) const {
+    std::lock_guard lock(mutex);
+    return id < entries.size() && entries[id].winner >= 0;
+}
+
+std::vector<int> ChunkTracker::other_holders(const std::uint64_t id, const int taker) const {
+    std::lock_guard lock(mutex);
+    std::vector<int> others;
+    if (id >= entries.size()) return others;
+    for (const int holder: entries[id].holders) {
+        if (holder != taker) others.push_back(holder);
+    }
+    return others;
+}
+
+std::vector<std::uint64_t> ChunkTracker::take_abandoned(const int taker) {
+    std::lock_guard lock(mutex);
+    std::vector<std::uint64_t> ids;
+    if (static_cast<std::size_t>(taker) < abandoned.size()) ids.swap(abandoned[static_cast<std::size_t>(taker)]);
+    return ids;
+}
+
+bool ChunkTracker::finished() const {
+    std::lock_guard lock(mutex);
+    // Without speculation nobody waits for completions: handing everything out is enough.
+    return dispenser.remaining() == 0 && (open == 0 || slack <= 0);
+}
+
+std::vector<std::uint64_t> ChunkTracker::won_by(const int taker) const {
+    std::lock_guard lock(mutex);
+    std::vector<std::uint64_t> ids;
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].winner == taker) ids.push_back(i);
+    }
+    return ids;
+}
+
+std::size_t ChunkTracker::duplicates() const {
+    std::lock_guard lock(mutex);
+    return duplicated;
+}
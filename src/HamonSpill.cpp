@@ -0,0 +1,319 @@
+#include "../include/HamonSpill.hpp"
+#include "../include/HamonCodec.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace dualys;
+
+namespace {
+    // Entries of the block being built, with their keys copied (the merge reuses its buffers).
+    class BlockBuilder {
+    public:
+        void add(const std::string_view word, const std::uint64_t count) {
+            entries.push_back({keys.size(), word.size(), count});
+            keys.append(word);
+        }
+
+        [[nodiscard]] std::size_t size() const {
+            return entries.size();
+        }
+
+        std::string take() {
+            WordCountEntries views;
+            views.reserve(entries.size());
+            for (const Entry &entry: entries) {
+                views.emplace_back(std::string_view(keys).substr(entry.offset, entry.length), entry.count);
+            }
+            std::string block(HamonCodec::encoded_size(views), '\0');
+            HamonCodec::encode_into(views, block.data());
+            entries.clear();
+            keys.clear();
+            return block;
+        }
+
+    private:
+        struct Entry {
+            std::size_t offset;
+            std::size_t length;
+            std::uint64_t count;
+        };
+
+        std::string keys;
+        std::vector<Entry> entries;
+    };
+
+    // One input of the k-way merge.
+    class MergeSource {
+    public:
+        virtual ~MergeSource() = default;
+
+        virtual bool next() = 0;
+
+        [[nodiscard]] virtual std::string_view word() const = 0;
+
+        [[nodiscard]] virtual std::uint64_t count() const = 0;
+
+        [[nodiscard]] virtual bool failed() const { return false; }
+    };
+
+    // Reads a run file block by block.
+    class RunSource final : public MergeSource {
+    public:
+        RunSource(const int p_fd, const std::uint64_t p_size) : fd(p_fd), size(p_size), offset(0), broken(false) {
+        }
+
+        bool next() override {
+            while (true) {
+                if (cursor && cursor->next()) return true;
+                if (cursor && cursor->failed()) broken = true;
+                if (broken || offset >= size) return false;
+                if (!read_block()) {
+                    broken = true;
+                    return false;
+                }
+            }
+        }
+
+        [[nodiscard]] std::string_view word() const override { return cursor->word(); }
+
+        [[nodiscard]] std::uint64_t count() const override { return cursor->count(); }
+
+        [[nodiscard]] bool failed() const override { return broken; }
+
+    private:
+        bool read_exactly(char *out, const std::size_t n) {
+            for (std::size_t done = 0; done < n;) {
+                const ssize_t got = pread(fd, out + done, n - done, static_cast<off_t>(offset + done));
+                if (got < 0 && errno == EINTR) continue;
+                if (got <= 0) return false;
+                done += static_cast<std::size_t>(got);
+            }
+            offset += n;
+            return true;
+        }
+
+        bool read_block() {
+            char head[10];
+            const auto head_size = static_cast<std::size_t>(std::min<std::uint64_t>(sizeof(head), size - offset));
+            const ssize_t got = pread(fd, head, head_size, static_cast<off_t>(offset));
+            if (got <= 0) return false;
+            const char *p = head;
+            std::uint64_t length = 0;
+            if (!HamonCodec::get_varint(p, head + got, length) || length > size) return false;
+            offset += static_cast<std::uint64_t>(p - head);
+            cursor.reset();
+            block.resize(static_cast<std::size_t>(length));
+            if (!read_exactly(block.data(), block.size())) return false;
+            cursor.emplace(block);
+            return true;
+        }
+
+        int fd;
+        std::uint64_t size;
+        std::uint64_t offset;
+        std::string block;
+        std::optional<CodecCursor> cursor;
+        bool broken;
+    };
+
+    // The counts still in memory, in key order.
+    class TableSource final : public MergeSource {
+    public:
+        explicit TableSource(const WordCountTable &table) : entries(table.sorted()), index(0) {
+        }
+
+        bool next() override { return ++index <= entries.size(); }
+
+        [[nodiscard]] std::string_view word() const override { return entries[index - 1].first; }
+
+        [[nodiscard]] std::uint64_t count() const override { return entries[index - 1].second; }
+
+    private:
+        WordCountEntries entries;
+        std::size_t index;
+    };
+}
+
+RunStore::RunStore(std::string p_directory) : directory(std::move(p_directory)), failed(false) {
+    if (directory.empty()) {
+        std::error_code ec;
+        directory = std::filesystem::temp_directory_path(ec).string();
+        if (ec) directory = "/tmp";
+    }
+}
+
+RunStore::~RunStore() {
+    clear();
+}
+
+int RunStore::create_file() const {
+    // An anonymous file in the directory; older kernels and filesystems without
+    // O_TMPFILE get a named one, unlinked right away.
+    int fd = open(directory.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0 || (errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL)) {
+        if (fd < 0) perror("[Spill] Could not create a run file");
+        return fd;
+    }
+    std::string name = (std::filesystem::path(directory) / "hamon-run-XXXXXX").string();
+    fd = mkostemp(name.data(), O_CLOEXEC);
+    if (fd < 0) {
+        perror("[Spill] Could not create a run file");
+        return -1;
+    }
+    unlink(name.c_str());
+    return fd;
+}
+
+bool RunStore::write_block(Run &run, const std::string_view block) {
+    char head[10];
+    const std::size_t head_size = static_cast<std::size_t>(HamonCodec::put_varint(block.size(), head) - head);
+    for (const std::string_view part: {std::string_view(head, head_size), block}) {
+        for (std::size_t done = 0; done < part.size();) {
+            const ssize_t wrote = pwrite(run.fd, part.data() + done, part.size() - done,
+                                         static_cast<off_t>(run.size + done));
+            if (wrote < 0 && errno == EINTR) continue;
+            if (wrote <= 0) {
+                perror("[Spill] Could not write a run");
+                return false;
+            }
+            done += static_cast<std::size_t>(wrote);
+        }
+        run.size += part.size();
+    }
+    return true;
+}
+
+bool RunStore::spill(const WordCountTable &table) {
+    const WordCountEntries entries = table.sorted();
+    const int fd = create_file();
+    std::lock_guard lock(mutex);
+    if (fd < 0) {
+        failed = true;
+        return false;
+    }
+    Run run{fd, 0};
+    WordCountEntries part;
+    for (std::size_t at = 0; at < entries.size(); at += block_entries) {
+        const auto first = entries.begin() + static_cast<std::ptrdiff_t>(at);
+        part.assign(first, first + static_cast<std::ptrdiff_t>(std::min(block_entries, entries.size() - at)));
+        std::string block(HamonCodec::encoded_size(part), '\0');
+        HamonCodec::encode_into(part, block.data());
+        if (!write_block(run, block)) {
+            close(fd);
+            failed = true;
+            return false;
+        }
+    }
+    runs.push_back(run);
+    return true;
+}
+
+bool RunStore::spill_if_over(std::vector<WordCountTable> &tables, const std::size_t budget) {
+    std::size_t used = 0;
+    for (const WordCountTable &table: tables) used += table.memory_usage();
+    if (used <= budget / 2) return ok();
+    bool spilled = true;
+    for (WordCountTable &table: tables) {
+        if (!table.empty()) spilled = spill(table) && spilled;
+        table = WordCountTable(); // also gives the slot array back
+    }
+    return spilled;
+}
+
+int RunStore::begin_run() {
+    const int fd = create_file();
+    std::lock_guard lock(mutex);
+    if (fd < 0) {
+        failed = true;
+        return -1;
+    }
+    runs.push_back({fd, 0});
+    return static_cast<int>(runs.size() - 1);
+}
+
+bool RunStore::append_block(const int run, const std::string_view block) {
+    std::lock_guard lock(mutex);
+    if (run < 0 || static_cast<std::size_t>(run) >= runs.size()) return false;
+    if (!write_block(runs[static_cast<std::size_t>(run)], block)) failed = true;
+    return !failed;
+}
+
+bool RunStore::merge(const WordCountTable &rest, const EntrySink &sink) const {
+    std::vector<std::unique_ptr<MergeSource> > sources;
+    {
+        std::lock_guard lock(mutex);
+        for (const Run &run: runs) sources.push_back(std::make_unique<RunSource>(run.fd, run.size));
+    }
+    if (!rest.empty()) sources.push_back(std::make_unique<TableSource>(rest));
+
+    // Min-heap of the sources by current key.
+    const auto after = [&](const std::size_t a, const std::size_t b) {
+        return sources[a]->word() > sources[b]->word();
+    };
+    std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(after)> heads(after);
+    for (std::size_t i = 0; i < sources.size(); ++i) {
+        if (sources[i]->next()) heads.push(i);
+    }
+    std::string word;
+    while (!heads.empty()) {
+        std::size_t i = heads.top();
+        heads.pop();
+        word.assign(sources[i]->word());
+        std::uint64_t count = sources[i]->count();
+        if (sources[i]->next()) heads.push(i);
+        while (!heads.empty() && sources[heads.top()]->word() == word) {
+            i = heads.top();
+            heads.pop();
+            count += sources[i]->count();
+            if (sources[i]->next()) heads.push(i);
+        }
+        if (!sink(word, count)) return false;
+    }
+    for (const auto &source: sources) {
+        if (source->failed()) {
+            std::cerr << "[Spill] Corrupt run" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RunStore::merge_blocks(const WordCountTable &rest, const BlockSink &sink) const {
+    BlockBuilder builder;
+    const bool merged = merge(rest, [&](const std::string_view word, const std::uint64_t count) {
+        builder.add(word, count);
+        return builder.size() < block_entries || sink(builder.take());
+    });
+    return merged && (builder.size() == 0 || sink(builder.take()));
+}
+
+std::size_t RunStore::run_count() const {
+    std::lock_guard lock(mutex);
+    return runs.size();
+}
+
+std::uint64_t RunStore::bytes() const {
+    std::lock_guard lock(mutex);
+    std::uint64_t total = 0;
+    for (const Run &run: runs) total += run.size;
+    return total;
+}
+
+bool RunStore::ok() const {
+    std::lock_guard lock(mutex);
+    return !failed;
+}
+
+void RunStore::clear() {
+    std::lock_guard lock(mutex);
+    for (const Run &run: runs) close(run.fd);
+    runs.clear();
+}
@@ -0,0 +1,145 @@
+#include "../include/HamonTokenizer.hpp"
+#include "../include/HamonShard.hpp"
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAMON_X86_KERNELS 1
+#endif
+
+using namespace dualys;
+
+// Each kernel turns 64 bytes into a bitmask: bit i is set when p[i] is whitespace.
+using BlockMask = std::uint64_t (*)(const char *p);
+
+static std::uint64_t scalar_mask(const char *p) {
+    std::uint64_t mask = 0;
+    for (unsigned i = 0; i < 64; ++i) {
+        if (HamonShard::is_delimiter(p[i])) mask |= std::uint64_t{1} << i;
+    }
+    return mask;
+}
+
+#ifdef HAMON_X86_KERNELS
+__attribute__((target("sse2"))) static std::uint64_t sse2_mask(const char *p) {
+    // Whitespace is ' ' or a byte in [\t, \r]: (c - 9) <= 4 as an unsigned compare.
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i four = _mm_set1_epi8(4);
+    std::uint64_t mask = 0;
+    for (unsigned i = 0; i < 4; ++i) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * i));
+        const __m128i shifted = _mm_sub_epi8(v, tab);
+        const __m128i in_range = _mm_cmpeq_epi8(_mm_min_epu8(shifted, four), shifted);
+        const __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(v, space), in_range);
+        const auto bits = static_cast<std::uint32_t>(_mm_movemask_epi8(ws)) & 0xFFFFu;
+        mask |= static_cast<std::uint64_t>(bits) << (16 * i);
+    }
+    return mask;
+}
+
+__attribute__((target("avx2"))) static std::uint64_t avx2_mask(const char *p) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i four = _mm256_set1_epi8(4);
+    std::uint64_t mask = 0;
+    for (unsigned i = 0; i < 2; ++i) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32 * i));
+        const __m256i shifted = _mm256_sub_epi8(v, tab);
+        const __m256i in_range = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, four), shifted);
+        const __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(v, space), in_range);
+        const auto bits = static_cast<std::uint32_t>(_mm256_movemask_epi8(ws));
+        mask |= static_cast<std::uint64_t>(bits) << (32 * i);
+    }
+    return mask;
+}
+#endif
+
+static BlockMask mask_function(const TokenizerKernel kernel) {
+#ifdef HAMON_X86_KERNELS
+    if (kernel == TokenizerKernel::Avx2) return avx2_mask;
+    if (kernel == TokenizerKernel::Sse2) return sse2_mask;
+#else
+    (void) kernel;
+#endif
+    return scalar_mask;
+}
+
+// Walks the whitespace bitmasks and calls sink(token) for every maximal non-whitespace run.
+template<class Sink>
+static void scan(const std::string_view text, const BlockMask mask_of, Sink &&sink) {
+    const char *base = text.data();
+    const std::size_t n = text.size();
+    bool in_word = false;
+    std::size_t start = 0;
+    for (std::size_t block = 0; block < n; block += 64) {
+        std::uint64_t ws;
+        if (block + 64 <= n) {
+            ws = mask_of(base + block);
+        } else {
+            // Pad the tail with spaces: they end the last token exactly at n.
+            char tail[64];
+            std::memset(tail, ' ', sizeof(tail));
+            std::memcpy(tail, base + block, n - block);
+            ws = mask_of(tail);
+        }
+        unsigned pos = 0;
+        while (pos < 64) {
+            const std::uint64_t rest = (in_word ? ws : ~ws) >> pos;
+            if (rest == 0) break; // the current state lasts until the next block
+            pos += static_cast<unsigned>(std::countr_zero(rest));
+            if (in_word) sink(std::string_view(base + start, block + pos - start));
+            else start = block + pos;
+            in_word = !in_word;
+        }
+    }
+    if (in_word) sink(std::string_view(base + start, n - start));
+}
+
+bool HamonTokenizer::is_supported(const TokenizerKernel kernel) {
+    switch (kernel) {
+        case TokenizerKernel::Scalar:
+            return true;
+#ifdef HAMON_X86_KERNELS
+        case TokenizerKernel::Sse2:
+            return __builtin_cpu_supports("sse2");
+        case TokenizerKernel::Avx2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+TokenizerKernel HamonTokenizer::best_kernel() {
+    static const TokenizerKernel best = [] {
+        if (is_supported(TokenizerKernel::Avx2)) return TokenizerKernel::Avx2;
+        if (is_supported(TokenizerKernel::Sse2)) return TokenizerKernel::Sse2;
+        return TokenizerKernel::Scalar;
+    }();
+    return best;
+}
+
+const char *HamonTokenizer::kernel_name(const TokenizerKernel kernel) {
+    switch (kernel) {
+        case TokenizerKernel::Avx2: return "avx2";
+        case TokenizerKernel::Sse2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+void HamonTokenizer::count(const std::string_view text, WordCountTable &counts) {
+    count(text, counts, best_kernel());
+}
+
+void HamonTokenizer::count(const std::string_view text, WordCountTable &counts, const TokenizerKernel kernel) {
+    scan(text, mask_function(kernel), [&](const std::string_view word) { counts.add(word); });
+}
+
+std::vector<std::string_view> HamonTokenizer::split(const std::string_view text, const TokenizerKernel kernel) {
+    std::vector<std::string_view> tokens;
+    scan(text, mask_function(kernel), [&](const std::string_view word) { tokens.push_back(word); });
+    return tokens;
+}
@@ -0,0 +1,270 @@
+#include "../include/HamonUring.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace dualys;
+
+namespace {
+    int uring_setup(const unsigned entries, io_uring_params &params) {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    }
+
+    int uring_enter(const int fd, const unsigned to_submit, const unsigned min_complete, const unsigned flags,
+                    const void *arg, const std::size_t arg_size) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size));
+    }
+
+    int uring_register(const int fd, const unsigned opcode, const void *arg, const unsigned count) {
+        return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+    }
+
+    // The ring indices are shared with the kernel: the side that publishes uses release
+    // stores, the side that consumes acquire loads.
+    unsigned load_acquire(unsigned *p) {
+        return std::atomic_ref(*p).load(std::memory_order_acquire);
+    }
+
+    void store_release(unsigned *p, const unsigned v) {
+        std::atomic_ref(*p).store(v, std::memory_order_release);
+    }
+
+    bool probe_ring() {
+        // Operations used by the event loop, the link senders and the input reads.
+        constexpr std::uint8_t needed[] = {
+            IORING_OP_POLL_ADD, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_ACCEPT,
+            IORING_OP_READ, IORING_OP_ASYNC_CANCEL
+        };
+        io_uring_params params{};
+        const int fd = uring_setup(2, params);
+        if (fd < 0) return false;
+        // Waits with a timeout pass it to io_uring_enter (IORING_ENTER_EXT_ARG, Linux 5.11).
+        bool ok = (params.features & IORING_FEAT_EXT_ARG) != 0;
+        std::vector<unsigned char> buffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+        auto *probe = reinterpret_cast<io_uring_probe *>(buffer.data());
+        if (ok && uring_register(fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+            for (const std::uint8_t op: needed) {
+                if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) ok = false;
+            }
+        } else {
+            ok = false;
+        }
+        close(fd);
+        return ok;
+    }
+}
+
+IoUring::IoUring(const unsigned entries)
+    : ring_fd(-1), sq_map(MAP_FAILED), sq_map_size(0), cq_map(MAP_FAILED), cq_map_size(0), sqes(nullptr),
+      sqes_size(0), sq_head(nullptr), sq_tail(nullptr), sq_mask(0), sq_entries(0), sq_array(nullptr),
+      cq_head(nullptr), cq_tail(nullptr), cq_mask(0), cqes(nullptr), queued_tail(0), submitted_tail(0),
+      enters(0) {
+    io_uring_params params{};
+    // Completions are only reaped from io_uring_enter: no need to interrupt the thread to run them.
+    params.flags = IORING_SETUP_COOP_TASKRUN;
+    ring_fd = uring_setup(entries, params);
+    if (ring_fd < 0 && errno == EINVAL) {
+        params = {};
+        ring_fd = uring_setup(entries, params); // kernels older than 5.19
+    }
+    if (ring_fd < 0) return;
+
+    sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_map = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_map) sq_map_size = cq_map_size = std::max(sq_map_size, cq_map_size);
+    sq_map = mmap(nullptr, sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                  IORING_OFF_SQ_RING);
+    if (sq_map != MAP_FAILED) {
+        cq_map = single_map
+                     ? sq_map
+                     : mmap(nullptr, cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                            IORING_OFF_CQ_RING);
+    }
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqe_map = MAP_FAILED;
+    if (cq_map != MAP_FAILED) {
+        sqe_map = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                       IORING_OFF_SQES);
+    }
+    if (sqe_map == MAP_FAILED) {
+        perror("[Uring] mmap failed");
+        if (cq_map != MAP_FAILED && cq_map != sq_map) munmap(cq_map, cq_map_size);
+        if (sq_map != MAP_FAILED) munmap(sq_map, sq_map_size);
+        sq_map = cq_map = MAP_FAILED;
+        close(ring_fd);
+        ring_fd = -1;
+        return;
+    }
+    sqes = static_cast<io_uring_sqe *>(sqe_map);
+
+    auto *sq = static_cast<char *>(sq_map);
+    sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_entries = params.sq_entries;
+    sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    auto *cq = static_cast<char *>(cq_map);
+    cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    queued_tail = submitted_tail = *sq_tail;
+}
+
+IoUring::~IoUring() {
+    if (ring_fd < 0) return;
+    munmap(sqes, sqes_size);
+    if (cq_map != sq_map) munmap(cq_map, cq_map_size);
+    munmap(sq_map, sq_map_size);
+    close(ring_fd); // cancels whatever is still in flight
+}
+
+bool IoUring::available() {
+    static const bool supported = probe_ring();
+    return supported;
+}
+
+IoBackend IoUring::resolve(const IoBackend requested) {
+    if (requested == IoBackend::Epoll) return IoBackend::Epoll;
+    return available() ? IoBackend::Uring : IoBackend::Epoll;
+}
+
+bool IoUring::is_open() const {
+    return ring_fd >= 0;
+}
+
+io_uring_sqe *IoUring::next_sqe() {
+    // Full submission queue: hand the queued operations to the kernel to make room.
+    while (queued_tail - load_acquire(sq_head) >= sq_entries) {
+        if (!enter()) return nullptr;
+    }
+    io_uring_sqe *sqe = &sqes[queued_tail & sq_mask];
+    sq_array[queued_tail & sq_mask] = queued_tail & sq_mask;
+    ++queued_tail;
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+bool IoUring::prep_poll(const int fd, const std::uint32_t events, const std::uint64_t user_data) {
+    io_uring_sqe *sqe = next_sqe();
+    if (sqe == nullptr) return false;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool IoUring::prep_recv(const int fd, const std::span<char> buffer, const int flags, const std::uint64_t user_data) {
+    io_uring_sqe *sqe = next_sqe();
+    if (sqe == nullptr) return false;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(buffer.data());
+    sqe->len = static_cast<std::uint32_t>(std::min<std::size_t>(buffer.size(), 1u << 30));
+    sqe->msg_flags = static_cast<std::uint32_t>(flags);
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool IoUring::prep_sendmsg(const int fd, const msghdr *message, const int flags, const std::uint64_t user_data,
+                           const bool link) {
+    io_uring_sqe *sqe = next_sqe();
+    if (sqe == nullptr) return false;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(message);
+    sqe->len = 1;
+    sqe->msg_flags = static_cast<std::uint32_t>(flags);
+    if (link) sqe->flags |= IOSQE_IO_LINK;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool IoUring::prep_accept(const int fd, const int flags, const bool multishot, const std::uint64_t user_data) {
+    io_uring_sqe *sqe = next_sqe();
+    if (sqe == nullptr) return false;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->accept_flags = static_cast<std::uint32_t>(flags);
+    if (multishot) sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool IoUring::prep_read(const int fd, const std::span<char> buffer, const std::uint64_t offset,
+                        const std::uint64_t user_data) {
+    io_uring_sqe *sqe = next_sqe();
+    if (sqe == nullptr) return false;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(buffer.data());
+    sqe->len = static_cast<std::uint32_t>(buffer.size());
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool IoUring::prep_cancel(const std::uint64_t target) {
+    io_uring_sqe *sqe = next_sqe();
+    if (sqe == nullptr) return false;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = 0;
+    return true;
+}
+
+bool IoUring::enter(const unsigned wait_for, const int timeout_ms) {
+    store_release(sq_tail, queued_tail);
+    const unsigned to_submit = queued_tail - submitted_tail;
+    if (to_submit == 0 && wait_for == 0) return true;
+    unsigned flags = wait_for > 0 ? IORING_ENTER_GETEVENTS : 0;
+    __kernel_timespec timeout{};
+    io_uring_getevents_arg arg{};
+    const void *arg_ptr = nullptr;
+    std::size_t arg_size = 0;
+    if (wait_for > 0 && timeout_ms >= 0) {
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000;
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = reinterpret_cast<std::uint64_t>(&timeout);
+        flags |= IORING_ENTER_EXT_ARG;
+        arg_ptr = &arg;
+        arg_size = sizeof(arg);
+    }
+    ++enters;
+    const int submitted = uring_enter(ring_fd, to_submit, wait_for, flags, arg_ptr, arg_size);
+    if (submitted < 0) {
+        if (errno == ETIME || errno == EINTR || errno == EAGAIN || errno == EBUSY) return true;
+        perror("[Uring] io_uring_enter failed");
+        return false;
+    }
+    submitted_tail += static_cast<unsigned>(submitted);
+    return true;
+}
+
+bool IoUring::next_completion(std::uint64_t &user_data, std::int32_t &result, std::uint32_t &flags) {
+    const unsigned head = *cq_head;
+    if (head == load_acquire(cq_tail)) return false;
+    const io_uring_cqe &cqe = cqes[head & cq_mask];
+    user_data = cqe.user_data;
+    result = cqe.res;
+    flags = cqe.flags;
+    store_release(cq_head, head + 1);
+    return true;
+}
+
+std::size_t IoUring::enter_calls() const {
+    return enters;
+}
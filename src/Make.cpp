@@ -1,17 +1,16 @@
 #include "../include/Hamon.hpp"
 #include "../include/Make.hpp"
+#include "../include/HamonPlacement.hpp"
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <regex>
 #include <string>
 #include <vector>
-#include <ranges>
 #include <future>
 #include <thread>
 #include <unistd.h>
 #include <sys/wait.h>
-#include <sched.h>
 #include <fcntl.h>
 #include <cstdlib>
 #include <cstring>
@@ -54,44 +53,18 @@ struct RunItem {
     int node_id = -1; // -1 if not mapped
 };
 
-static int infer_logical_cpu(const std::unordered_map<int, NodeCfg> &nodes_by_id, const int node_id) {
-    const auto it = nodes_by_id.find(node_id);
-    if (it == nodes_by_id.end()) return -1;
-    const auto &n = it->second;
-    if (n.numa < 0 && n.core < 0) return -1;
-    // Infer cores per NUMA from hardware_concurrency and max numa index present
-    unsigned hw = std::thread::hardware_concurrency();
-    if (hw == 0) hw = 1;
-    int max_numa = -1;
-    for (const auto &snd: nodes_by_id | std::views::values) if (snd.numa >= 0) max_numa = std::max(max_numa, snd.numa);
-    const int numa_count = max_numa >= 0 ? max_numa + 1 : 1;
-    unsigned cores_per_numa = hw / (numa_count == 0 ? 1 : static_cast<unsigned>(numa_count));
-    if (cores_per_numa == 0) cores_per_numa = 1;
-    const int numa = std::max(n.numa, 0);
-    const int core = std::max(n.core, 0);
-    const long logical = static_cast<long>(numa) * static_cast<long>(cores_per_numa) + static_cast<long>(core);
-    if (logical < 0 || logical >= static_cast<long>(hw)) return -1;
-    return static_cast<int>(logical);
-}
-
-static int run_with_affinity(const std::string &cmd, const std::unordered_map<int, NodeCfg> &nodes_by_id,
-                             const int node_id, std::ostream &log, const std::string &out_path,
-                             const std::string &err_path) {
+static int run_with_affinity(const std::string &cmd, const NodePlacement *placement, const int node_id,
+                             std::ostream &log, const std::string &out_path, const std::string &err_path) {
     const int pid = fork();
     if (pid < 0) {
         print_status(log, "failed to fork cmd", "!!", true);
         return -1;
     }
     if (pid == 0) {
-        // Child: set CPU affinity if available
-        if (const int cpu = infer_logical_cpu(nodes_by_id, node_id); cpu >= 0) {
-            cpu_set_t set;
-            CPU_ZERO(&set);
-            CPU_SET(static_cast<unsigned>(cpu), &set);
-            if (sched_setaffinity(0, sizeof(set), &set) != 0) {
-                // best-effort: continue even if it fails
-                // Do not exit; proceed to execute the command without pinning
-            }
+        // Child: pin to the node's CPUs and NUMA node if it has a placement
+        if (placement != nullptr) {
+            // best-effort: on failure, proceed to execute the command without pinning
+            (void) HamonPlacement::apply(*placement, node_id);
         }
         // Redirect stdout/stderr to files
         if (!out_path.empty()) {
@@ -129,8 +102,16 @@ bool Make::build_from_hc(const string &hc_path, ostream &log) {
         return false;
     }
 
-    std::unordered_map<int, NodeCfg> nodes_by_id;
-    for (const auto &n: parser.materialize_nodes()) nodes_by_id[n.id] = n;
+    // Nodes are placed on the machine's CPUs as the word-count orchestrator places them (HamonPlacement).
+    const HamonCpuTopology cpus = HamonCpuTopology::discover();
+    const std::vector<NodeConfig> configs = parser.node_configs();
+    const std::vector<NodePlacement> plan = HamonPlacement::plan(configs, cpus.numa_domains());
+    std::unordered_map<int, NodePlacement> placements;
+    for (std::size_t i = 0; i < configs.size(); ++i) placements[configs[i].id] = plan[i];
+    const auto placement_of = [&placements](const int node_id) -> const NodePlacement * {
+        const auto it = placements.find(node_id);
+        return it == placements.end() ? nullptr : &it->second;
+    };
     vector<RunItem> compiles;
     vector<RunItem> others;
     for (const auto &jobs = parser.get_jobs(); const auto &job: jobs) {
@@ -182,15 +163,16 @@ bool Make::build_from_hc(const string &hc_path, ostream &log) {
 
     // Prepare overall progress
     if (const size_t total_tasks = compiles.size() + others.size(); total_tasks > 0) {
+        parser.print_plan(log, cpus);
         print_status(log, "Starting build system...", "ok");
     }
     if (!compiles.empty()) {
         vector<future<int> > futures;
         futures.reserve(compiles.size());
         for (const auto &item: compiles) {
-            auto &nodes_copy = nodes_by_id;
-            futures.emplace_back(std::async(std::launch::async, [item, nodes_copy] {
-                return run_with_affinity(item.cmd, nodes_copy, item.node_id, cout, item.stdout_path,
+            const NodePlacement *placement = placement_of(item.node_id);
+            futures.emplace_back(std::async(std::launch::async, [item, placement] {
+                return run_with_affinity(item.cmd, placement, item.node_id, cout, item.stdout_path,
                                          item.stderr_path);
             }));
         }
@@ -206,7 +188,7 @@ bool Make::build_from_hc(const string &hc_path, ostream &log) {
 
     // Run the remaining tasks sequentially
     for (const auto &[cmd, desc, stdout_path, stderr_path, id, node_id]: others) {
-        if (int rc = run_with_affinity(cmd, nodes_by_id, node_id, log, stdout_path, stderr_path); rc != 0) {
+        if (int rc = run_with_affinity(cmd, placement_of(node_id), node_id, log, stdout_path, stderr_path); rc != 0) {
             print_status(log, desc, "!!", true);
             return false;
         }
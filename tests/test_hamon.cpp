@@ -147,7 +147,7 @@ TEST(Hamon, ExplicitDimMismatchThrows)
     HamonParser p;
     std::string dsl =
         "@use 6\n"
-        "@dim 3\n"; // 2^3=8 != 6 -> incohérent pour hypercube
+        "@dim 2\n"; // 2^2=4 < 6 -> incohérent pour hypercube
     TmpFile tf("scenario3.hc");
     {
         std::ofstream o(tf.path);
@@ -157,6 +157,24 @@ TEST(Hamon, ExplicitDimMismatchThrows)
     EXPECT_THROW(p.finalize(), std::runtime_error);
 }
 
+TEST(Hamon, HypercubeOfAnySize)
+{
+    HamonParser p;
+    TmpFile tf("scenario_fold.hc");
+    {
+        std::ofstream o(tf.path);
+        o << "@use 6\n@dim 3\n";
+    }
+    p.parse_file(tf.path);
+    p.finalize();
+    EXPECT_EQ(p.dim(), 3);
+    const auto nodes = p.materialize_nodes();
+    ASSERT_EQ(static_cast<int>(nodes.size()), 6);
+    // Node 5 has no neighbor 7 across bit 1; node 4 is node 0's neighbor across bit 2.
+    EXPECT_EQ(nodes[5].neighbors, (std::vector<int>{1, 4}));
+    EXPECT_EQ(nodes[0].neighbors, (std::vector<int>{1, 2, 4}));
+}
+
 TEST(Hamon, NeighborsOverride)
 {
     HamonParser p;
@@ -232,6 +250,40 @@ TEST(Hamon, CpuParsing)
     EXPECT_EQ(nodes[1].core, 3);
 }
 
+TEST(Hamon, ThreadsParsing)
+{
+    HamonParser p;
+    std::string dsl =
+        "@use 2\n"
+        "@node 0 @role coordinator @threads 6\n"
+        "@node 1\n";
+    TmpFile tf("scenario_threads.hc");
+    {
+        std::ofstream o(tf.path);
+        o << dsl;
+    }
+    p.parse_file(tf.path);
+    p.finalize();
+    auto nodes = p.materialize_nodes();
+    EXPECT_EQ(nodes[0].threads, 6);
+    EXPECT_EQ(nodes[1].threads, -1); // auto
+}
+
+TEST(Hamon, ThreadsMustBePositive)
+{
+    HamonParser p;
+    std::string dsl =
+        "@use 2\n"
+        "@node 1\n"
+        "@threads 0\n";
+    TmpFile tf("scenario_threads_zero.hc");
+    {
+        std::ofstream o(tf.path);
+        o << dsl;
+    }
+    EXPECT_THROW(p.parse_file(tf.path), std::runtime_error);
+}
+
 TEST(Hamon, IpParsingExplicit)
 {
     HamonParser p;
@@ -431,3 +483,47 @@ TEST(Hamon, IncludeCircularDetected)
     }
     EXPECT_THROW(p.parse_file(a.path), std::runtime_error);
 }
+
+TEST(Hamon, RingAndTorusTopologies)
+{
+    TmpFile tf("scenario_ring.hc");
+    {
+        std::ofstream o(tf.path);
+        o << "@use 6\n@topology ring\n@autoprefix 127.0.0.1:9000\n";
+    }
+    HamonParser ring;
+    ring.parse_file(tf.path);
+    ring.finalize();
+    EXPECT_EQ(ring.get_topology(), "ring");
+    EXPECT_EQ(ring.get_topology_spec().kind, TopologyKind::Ring);
+    auto nodes = ring.materialize_nodes();
+    ASSERT_EQ(static_cast<int>(nodes.size()), 6);
+    EXPECT_EQ(nodes[0].neighbors, (std::vector<int>{1, 5}));
+
+    {
+        std::ofstream o(tf.path);
+        o << "@use 12\n@topology mesh wrap=true cols=4\n";
+    }
+    HamonParser torus;
+    torus.parse_file(tf.path);
+    torus.finalize();
+    EXPECT_EQ(torus.get_topology(), "torus");
+    EXPECT_EQ(torus.get_topology_spec().rows, 3);
+    nodes = torus.materialize_nodes();
+    EXPECT_EQ(nodes[5].neighbors, (std::vector<int>{1, 4, 6, 9}));
+}
+
+TEST(Hamon, UnsupportedTopologiesThrow)
+{
+    TmpFile tf("scenario_topology.hc");
+    for (const std::string dsl: {"@use 4\n@topology full\n", "@use 4\n@topology mesh\n",
+                                 "@use 6\n@topology torus rows=4\n", "@use 6\n@topology torus cols=4\n",
+                                 "@use 6\n@topology ring\n@dim 3\n"}) {
+        {
+            std::ofstream o(tf.path);
+            o << dsl;
+        }
+        HamonParser p;
+        EXPECT_THROW({ p.parse_file(tf.path); p.finalize(); }, std::runtime_error) << dsl;
+    }
+}
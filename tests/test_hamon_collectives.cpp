@@ -0,0 +1,188 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "../include/HamonCollectives.hpp"
+#include "../include/HamonQueue.hpp"
+
+using namespace dualys;
+
+namespace {
+    using NodeBody = std::function<Task<bool>(HamonCollectives &, int)>;
+
+    Task<bool> receive_local(EventLoop &loop, LocalChannel &channel, std::string &out) {
+        const Deadline deadline = EventLoop::deadline_in(10000);
+        while (true) {
+            switch (channel.poll_receive(out)) {
+                case ReceiveStatus::Complete:
+                    co_return true;
+                case ReceiveStatus::Failed:
+                    co_return false;
+                case ReceiveStatus::Pending:
+                    break;
+            }
+            const bool readable = co_await loop.readable(channel.doorbell_fd(), deadline);
+            if (!readable) co_return false;
+        }
+    }
+
+    // Runs body on node_count threads linked in process; true if it returned true on every node.
+    bool run_nodes(const int node_count, const std::size_t segment_bytes, const NodeBody &body) {
+        LocalMesh mesh;
+        std::atomic<int> succeeded{0};
+        {
+            std::vector<std::jthread> threads;
+            for (int id = 0; id < node_count; ++id) {
+                threads.emplace_back([&, id] {
+                    std::map<int, std::unique_ptr<LocalChannel> > channels;
+                    for (int peer = 0; peer < node_count; ++peer) {
+                        if (peer != id) channels[peer] = mesh.take(id, peer);
+                    }
+                    EventLoop loop;
+                    CollectiveLinks links{
+                        [&](const int peer, std::string payload) { channels.at(peer)->send(std::move(payload)); },
+                        [&](const int peer, const int file_fd, const ShardRange &range) {
+                            channels.at(peer)->send_file_range(file_fd, range);
+                        },
+                        [&](const int peer, std::string &out) { return receive_local(loop, *channels.at(peer), out); }
+                    };
+                    HamonCollectives collectives(std::move(links), id, node_count, segment_bytes);
+                    if (loop.run(body(collectives, id))) ++succeeded;
+                });
+            }
+        }
+        return succeeded == node_count;
+    }
+
+    // Node i's piece: i repeated 3 * i times, so node 0's is empty and the others span segments.
+    std::string piece_of(const int node) {
+        return std::string(static_cast<std::size_t>(3 * node), static_cast<char>('a' + node));
+    }
+
+    Task<bool> broadcast_and_check(HamonCollectives &collectives, const int id, const std::string expected) {
+        std::string payload = id == 0 ? expected : "stale";
+        const bool received = co_await collectives.broadcast(payload);
+        co_return received && payload == expected;
+    }
+
+    Task<bool> scatter_and_gather(HamonCollectives &collectives, const int id, const int node_count) {
+        std::vector<std::string> pieces;
+        if (id == 0) {
+            for (int node = 0; node < node_count; ++node) pieces.push_back(piece_of(node));
+        }
+        std::string mine;
+        const bool scattered = co_await collectives.scatter(std::move(pieces), mine);
+        if (!scattered || mine != piece_of(id)) co_return false;
+        std::vector<std::string> all;
+        const bool gathered = co_await collectives.gather(mine + "!", all);
+        if (!gathered) co_return false;
+        if (id != 0) co_return all.empty();
+        for (int node = 0; node < node_count; ++node) {
+            if (all[static_cast<std::size_t>(node)] != piece_of(node) + "!") co_return false;
+        }
+        co_return true;
+    }
+
+    Task<bool> allgather_and_check(HamonCollectives &collectives, const int id, const int node_count) {
+        std::vector<std::string> all;
+        const bool gathered = co_await collectives.allgather(piece_of(id), all);
+        if (!gathered || all.size() != static_cast<std::size_t>(node_count)) co_return false;
+        for (int node = 0; node < node_count; ++node) {
+            if (all[static_cast<std::size_t>(node)] != piece_of(node)) co_return false;
+        }
+        co_return true;
+    }
+
+    Task<bool> receive_file_piece(HamonCollectives &collectives, const int id, const std::string &text,
+                                  const std::vector<ShardRange> &ranges) {
+        if (id == 0) co_return true;
+        std::string mine;
+        const HamonCollectives::SegmentSink append = [&mine](std::string &segment) { mine += segment; };
+        const bool received = co_await collectives.receive_scatter(append);
+        const ShardRange &range = ranges[static_cast<std::size_t>(id)];
+        co_return received && mine == text.substr(range.offset, range.length);
+    }
+}
+
+TEST(HamonCollectives, TreeReachesEveryNodeOnce)
+{
+    for (int node_count = 1; node_count <= 12; ++node_count) {
+        std::vector<int> reached(static_cast<std::size_t>(node_count), 0);
+        reached[0] = 1;
+        for (int node = 0; node < node_count; ++node) {
+            int next = node + 1;
+            // The children's subtrees tile the node's own, smallest last.
+            const std::vector<int> children = HamonCollectives::children_of(node, node_count);
+            for (auto child = children.rbegin(); child != children.rend(); ++child) {
+                EXPECT_EQ(HamonCollectives::parent_of(*child), node);
+                EXPECT_EQ(*child, next);
+                next = HamonCollectives::subtree_end(*child, node_count);
+                ++reached[static_cast<std::size_t>(*child)];
+            }
+            EXPECT_EQ(next, HamonCollectives::subtree_end(node, node_count));
+        }
+        for (const int count: reached) EXPECT_EQ(count, 1) << node_count << " nodes";
+    }
+    EXPECT_EQ(HamonCollectives::children_of(0, 8), (std::vector<int>{4, 2, 1}));
+    EXPECT_EQ(HamonCollectives::children_of(4, 6), (std::vector<int>{5}));
+    EXPECT_EQ(HamonCollectives::parent_of(0), -1);
+}
+
+TEST(HamonCollectives, BroadcastArrivesWholeThroughSmallSegments)
+{
+    const std::string payload = "a payload cut in segments of five bytes";
+    for (const int node_count: {1, 6, 8}) {
+        EXPECT_TRUE(run_nodes(node_count, 5, [&](HamonCollectives &collectives, const int id) {
+            return broadcast_and_check(collectives, id, payload);
+        })) << node_count << " nodes";
+    }
+    EXPECT_TRUE(run_nodes(4, 5, [](HamonCollectives &collectives, const int id) {
+        return broadcast_and_check(collectives, id, "");
+    }));
+}
+
+TEST(HamonCollectives, ScatterThenGatherReturnsEveryPiece)
+{
+    for (const int node_count: {2, 5, 8}) {
+        EXPECT_TRUE(run_nodes(node_count, 4, [node_count](HamonCollectives &collectives, const int id) {
+            return scatter_and_gather(collectives, id, node_count);
+        })) << node_count << " nodes";
+    }
+}
+
+TEST(HamonCollectives, ScatterFileAndAllgather)
+{
+    std::string text;
+    for (int i = 0; i < 500; ++i) text += "word" + std::to_string(i) + ' ';
+    char path[] = "/tmp/hamon_collectives_XXXXXX";
+    const int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(write(fd, text.data(), text.size()), static_cast<ssize_t>(text.size()));
+    constexpr int node_count = 6;
+    const std::vector<ShardRange> ranges = HamonShard::nominal_split(text.size(), node_count);
+    EXPECT_TRUE(run_nodes(node_count, 64, [&](HamonCollectives &collectives, const int id) {
+        if (id == 0) collectives.scatter_file(fd, ranges);
+        return receive_file_piece(collectives, id, text, ranges);
+    }));
+    close(fd);
+    std::remove(path);
+
+    EXPECT_TRUE(run_nodes(8, 3, [](HamonCollectives &collectives, const int id) {
+        return allgather_and_check(collectives, id, 8);
+    }));
+}
+
+TEST(HamonCollectives, AllgatherFoldsNodesPastAPowerOfTwo)
+{
+    for (const int node_count: {1, 3, 6, 7, 12}) {
+        EXPECT_TRUE(run_nodes(node_count, 4, [node_count](HamonCollectives &collectives, const int id) {
+            return allgather_and_check(collectives, id, node_count);
+        })) << node_count << " nodes";
+    }
+}
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+#include <map>
+#include <random>
+#include <string>
+#include "../include/HamonCount.hpp"
+
+using namespace dualys;
+
+TEST(WordCountTable, CountsInlineAndArenaKeys)
+{
+    WordCountTable table;
+    const std::string long_word(100, 'h');
+    table.add("cube");
+    table.add("cube");
+    table.add(long_word);
+    table.add(long_word, 4);
+    table.add("");
+    EXPECT_EQ(table.size(), 3u);
+    EXPECT_EQ(table.find("cube"), 2u);
+    EXPECT_EQ(table.find(long_word), 5u);
+    EXPECT_EQ(table.find(""), 1u);
+    EXPECT_EQ(table.find("absent"), 0u);
+}
+
+TEST(WordCountTable, MatchesOrderedMapUnderGrowth)
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> len(1, 40);
+    std::uniform_int_distribution<int> letter('a', 'e');
+    WordCountTable table;
+    WordCountMap reference;
+    for (int i = 0; i < 20000; ++i)
+    {
+        std::string w(static_cast<std::size_t>(len(rng)) % 6 + (i % 7 == 0 ? 30 : 1), 'x');
+        for (auto &c : w) c = static_cast<char>(letter(rng));
+        table.add(w);
+        reference[w]++;
+    }
+    EXPECT_EQ(table.size(), reference.size());
+    EXPECT_EQ(table.to_map(), reference);
+
+    const auto sorted = table.sorted();
+    ASSERT_EQ(sorted.size(), reference.size());
+    auto it = reference.begin();
+    for (const auto &[word, count] : sorted)
+    {
+        EXPECT_EQ(word, it->first);
+        EXPECT_EQ(count, it->second);
+        ++it;
+    }
+}
+
+TEST(WordCountTable, MergeAndClear)
+{
+    WordCountTable a;
+    WordCountTable b;
+    a.add("hamon", 2);
+    b.add("hamon", 3);
+    b.add("a_rather_long_word_stored_in_the_arena");
+    a.merge(b);
+    EXPECT_EQ(a.find("hamon"), 5u);
+    EXPECT_EQ(a.find("a_rather_long_word_stored_in_the_arena"), 1u);
+    a.clear();
+    EXPECT_TRUE(a.empty());
+    EXPECT_EQ(a.find("hamon"), 0u);
+}
+
+TEST(WordCountTable, ExtractIfSplitsByOwner)
+{
+    WordCountTable table;
+    WordCountMap expected;
+    for (int i = 0; i < 5000; ++i)
+    {
+        const std::string word = "w" + std::to_string(i % 700) + std::string(static_cast<std::size_t>(i % 30), 'z');
+        table.add(word);
+        ++expected[word];
+    }
+    constexpr std::size_t nodes = 4;
+    const WordCountTable moved = table.extract_if([](const std::uint64_t hash) {
+        return WordCountTable::owner_of(hash, nodes) >= 2;
+    });
+    EXPECT_EQ(table.size() + moved.size(), expected.size());
+    table.for_each([](const std::string_view word, std::uint64_t) {
+        EXPECT_LT(WordCountTable::owner_of(WordCountTable::hash(word), nodes), 2u);
+    });
+    moved.for_each([](const std::string_view word, std::uint64_t) {
+        EXPECT_GE(WordCountTable::owner_of(WordCountTable::hash(word), nodes), 2u);
+    });
+    // Both halves stay usable tables.
+    table.add("w1");
+    ++expected["w1"];
+    table.merge(moved);
+    EXPECT_EQ(table.to_map(), expected);
+}
@@ -0,0 +1,157 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "../include/Hamon.hpp"
+#include "../include/HamonCpuTopology.hpp"
+#include "../include/HamonPlacement.hpp"
+
+using namespace dualys;
+
+namespace {
+    void write_file(const std::filesystem::path &path, const std::string &text) {
+        std::filesystem::create_directories(path.parent_path());
+        std::ofstream(path) << text << "\n";
+    }
+
+    // A small two-socket machine numbered as Linux numbers an R710: CPUs alternate between the
+    // sockets, and the SMT siblings come after every first thread. Socket 0 holds CPUs 0, 2, 4
+    // and 6; CPU 4 is the sibling of CPU 0. CPU 8 is offline, NUMA node 2 has memory only.
+    struct FakeSysfs {
+        std::filesystem::path root = std::filesystem::temp_directory_path() /
+                                     ("hamon_sysfs_" + std::to_string(getpid()));
+
+        FakeSysfs() {
+            write_file(root / "cpu" / "online", "0-7");
+            for (int cpu = 0; cpu <= 8; ++cpu) {
+                const std::filesystem::path dir = root / "cpu" / ("cpu" + std::to_string(cpu));
+                const int package = cpu % 2;
+                const int first = cpu % 4;
+                const std::string siblings = std::to_string(first) + "," + std::to_string(first + 4);
+                write_file(dir / "topology" / "physical_package_id", std::to_string(package));
+                write_file(dir / "topology" / "core_id", std::to_string(first / 2));
+                write_file(dir / "topology" / "thread_siblings_list", siblings);
+                write_file(dir / "cache" / "index0" / "level", "1");
+                write_file(dir / "cache" / "index0" / "type", "Data");
+                write_file(dir / "cache" / "index0" / "size", "32K");
+                write_file(dir / "cache" / "index0" / "shared_cpu_list", siblings);
+                write_file(dir / "cache" / "index3" / "level", "3");
+                write_file(dir / "cache" / "index3" / "type", "Unified");
+                write_file(dir / "cache" / "index3" / "size", "12288K");
+                write_file(dir / "cache" / "index3" / "shared_cpu_list", package == 0 ? "0,2,4,6" : "1,3,5,7");
+            }
+            write_file(root / "node" / "node0" / "cpulist", "0,2,4,6");
+            write_file(root / "node" / "node1" / "cpulist", "1,3,5,7");
+            write_file(root / "node" / "node2" / "cpulist", "");
+            write_file(root / "node" / "possible", "0-2");
+        }
+
+        ~FakeSysfs() { std::filesystem::remove_all(root); }
+
+        [[nodiscard]] HamonCpuTopology discover(std::vector<int> allowed = {0, 1, 2, 3, 4, 5, 6, 7, 8}) const {
+            return HamonCpuTopology::discover(root.string(), std::move(allowed));
+        }
+    };
+
+    std::vector<NodeConfig> nodes(const int count) {
+        std::vector<NodeConfig> configs;
+        for (int id = 0; id < count; ++id) configs.push_back({id, "worker", "127.0.0.1", 8000 + id});
+        return configs;
+    }
+}
+
+TEST(HamonCpuTopology, ParsesKernelCpuLists)
+{
+    std::vector<int> cpus;
+    EXPECT_TRUE(HamonCpuTopology::parse_cpu_list("0-3,8,10-11\n", cpus));
+    EXPECT_EQ(cpus, (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+    EXPECT_TRUE(HamonCpuTopology::parse_cpu_list("\n", cpus));
+    EXPECT_TRUE(cpus.empty());
+    EXPECT_FALSE(HamonCpuTopology::parse_cpu_list("3-1", cpus));
+    EXPECT_FALSE(HamonCpuTopology::parse_cpu_list("0,,2", cpus));
+    EXPECT_FALSE(HamonCpuTopology::parse_cpu_list("a-b", cpus));
+}
+
+TEST(HamonCpuTopology, ReadsPackagesCoresSiblingsAndCaches)
+{
+    const FakeSysfs sysfs;
+    const HamonCpuTopology topology = sysfs.discover();
+    ASSERT_EQ(topology.cpus().size(), 8u); // CPU 8 is offline
+    EXPECT_EQ(topology.package_count(), 2);
+    EXPECT_EQ(topology.core_count(), 4);
+    const CpuInfo &cpu4 = topology.cpus()[4];
+    EXPECT_EQ(cpu4.package, 0);
+    EXPECT_EQ(cpu4.numa, 0);
+    EXPECT_EQ(cpu4.siblings, (std::vector<int>{0, 4}));
+    EXPECT_EQ(cpu4.thread, 1);
+    EXPECT_EQ(topology.cpus()[1].numa, 1);
+    EXPECT_EQ(topology.caches().size(), 6u);
+    EXPECT_EQ(topology.summary(), "2 packages, 2 NUMA nodes, 4 cores, 8 CPUs; L1d 32 KiB x4, L3 12 MiB x2");
+
+    const std::vector<NumaDomain> domains = topology.numa_domains();
+    ASSERT_EQ(domains.size(), 2u);
+    EXPECT_EQ(domains[0].id, 0);
+    EXPECT_EQ(domains[0].cores, (std::vector<std::vector<int> >{{0, 4}, {2, 6}}));
+    EXPECT_EQ(domains[0].cpus, (std::vector<int>{0, 2, 4, 6}));
+    EXPECT_EQ(domains[1].cpus, (std::vector<int>{1, 3, 5, 7}));
+}
+
+TEST(HamonCpuTopology, KeepsOnlyAllowedCpus)
+{
+    const FakeSysfs sysfs;
+    const HamonCpuTopology topology = sysfs.discover({0, 2, 4});
+    EXPECT_EQ(topology.core_count(), 2);
+    EXPECT_EQ(topology.cpus()[1].siblings, (std::vector<int>{2}));
+    const std::vector<NumaDomain> domains = topology.numa_domains();
+    ASSERT_EQ(domains.size(), 1u);
+    EXPECT_EQ(domains[0].cpus, (std::vector<int>{0, 2, 4}));
+
+    // Without sysfs: one NUMA node, every CPU its own core.
+    const HamonCpuTopology bare = HamonCpuTopology::discover(sysfs.root.string() + "/missing", {0, 1, 2});
+    EXPECT_EQ(bare.core_count(), 3);
+    ASSERT_EQ(bare.numa_domains().size(), 1u);
+    EXPECT_EQ(bare.numa_domains()[0].cpus, (std::vector<int>{0, 1, 2}));
+}
+
+TEST(HamonCpuTopology, PlacementPrefersPhysicalCores)
+{
+    const FakeSysfs sysfs;
+    const std::vector<NumaDomain> domains = sysfs.discover().numa_domains();
+    // One node per core: each gets a whole core, siblings included.
+    const std::vector<NodePlacement> per_core = HamonPlacement::plan(nodes(4), domains);
+    EXPECT_EQ(per_core[0].cpus, (std::vector<int>{0, 4}));
+    EXPECT_EQ(per_core[1].cpus, (std::vector<int>{2, 6}));
+    EXPECT_EQ(per_core[2].cpus, (std::vector<int>{1, 5}));
+    // More nodes than cores: siblings only once every core of the socket is taken.
+    const std::vector<NodePlacement> per_cpu = HamonPlacement::plan(nodes(6), domains);
+    EXPECT_EQ(per_cpu[0].cpus, (std::vector<int>{0}));
+    EXPECT_EQ(per_cpu[1].cpus, (std::vector<int>{2}));
+    EXPECT_EQ(per_cpu[2].cpus, (std::vector<int>{4}));
+
+    // @cpu numa=0 core=1 is the second core of socket 0 (CPU 2), not CPU 1 on the other socket.
+    std::vector<NodeConfig> configs = nodes(2);
+    configs[1].numa = 0;
+    configs[1].core = 1;
+    EXPECT_EQ(HamonPlacement::plan(configs, domains)[1].cpus, (std::vector<int>{2}));
+}
+
+TEST(HamonCpuTopology, PrintPlanShowsTheResolvedPlacement)
+{
+    const FakeSysfs sysfs;
+    const std::filesystem::path hc = sysfs.root / "plan.hc";
+    write_file(hc, "@use 2\n@autoprefix 127.0.0.1:9000\n@node 0 @role coordinator\n@node 1 @cpu numa=1 core=1");
+    HamonParser parser;
+    parser.parse_file(hc.string());
+    parser.finalize();
+    std::ostringstream out;
+    parser.print_plan(out, sysfs.discover());
+    const std::string plan = out.str();
+    EXPECT_NE(plan.find("CPUs: 2 packages, 2 NUMA nodes, 4 cores, 8 CPUs"), std::string::npos) << plan;
+    EXPECT_NE(plan.find("Node 0 | role=coordinator | core=auto | numa=auto | placement=cpus 0,2,4,6, numa 0"),
+              std::string::npos) << plan;
+    EXPECT_NE(plan.find("Node 1 | role=worker | core=1 | numa=1 | placement=cpu 3, numa 1"), std::string::npos)
+            << plan;
+}
@@ -1,4 +1,6 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <vector>
 #include "../include/HamonCube.hpp"
 using namespace dualys;
 
@@ -21,7 +23,84 @@ TEST(HamonCubeTest, CorrectNeighborsForNode5)
 
 TEST(HamonCubeTest, ThrowsOnInvalidNodeCount)
 {
-    EXPECT_THROW(dualys::HamonCube(7), std::invalid_argument);
     EXPECT_THROW(dualys::HamonCube(0), std::invalid_argument);
     EXPECT_THROW(dualys::HamonCube(-8), std::invalid_argument);
 }
+
+TEST(HamonCubeTest, FoldsExtraNodesOntoTheCore)
+{
+    // 24 nodes: a 16-node core; node 16 + i is folded onto node i, across the top dimension.
+    const HamonCube cube(24);
+    EXPECT_EQ(cube.getDimension(), 5);
+    EXPECT_EQ(cube.getCoreCount(), 16);
+    EXPECT_EQ(cube.getFoldPartner(19), 3);
+    EXPECT_EQ(cube.getFoldPartner(3), 19);
+    EXPECT_EQ(cube.getFoldPartner(12), -1);
+    EXPECT_EQ(cube.getNode(17).neighbors, (std::vector<int>{16, 19, 21, 1}));
+    EXPECT_EQ(HamonCube(8).getFoldPartner(5), -1);
+    EXPECT_EQ(HamonCube(1).getDimension(), 0);
+
+    const auto &order = cube.getRingOrder();
+    std::vector<int> sorted = order;
+    std::ranges::sort(sorted);
+    for (int id = 0; id < 24; ++id) EXPECT_EQ(sorted[static_cast<std::size_t>(id)], id);
+}
+
+TEST(HamonCubeTest, RingAndTorusNeighbors)
+{
+    const HamonCube ring(6, {TopologyKind::Ring});
+    EXPECT_EQ(ring.getNode(0).neighbors, (std::vector<int>{1, 5}));
+    EXPECT_EQ(ring.getNode(3).neighbors, (std::vector<int>{2, 4}));
+    EXPECT_EQ(HamonCube(2, {TopologyKind::Ring}).getNode(0).neighbors, (std::vector<int>{1}));
+    EXPECT_TRUE(HamonCube(1, {TopologyKind::Ring}).getNode(0).neighbors.empty());
+
+    // 3 x 4 grid, wrapping both ways; node 5 is row 1, column 1.
+    const HamonCube torus(12, {TopologyKind::Torus, 3});
+    EXPECT_EQ(torus.getRows(), 3);
+    EXPECT_EQ(torus.getColumns(), 4);
+    EXPECT_EQ(torus.getNode(5).neighbors, (std::vector<int>{1, 4, 6, 9}));
+    EXPECT_EQ(torus.getNode(0).neighbors, (std::vector<int>{1, 3, 4, 8}));
+    // Default grid: the squarest one.
+    EXPECT_EQ(HamonCube(6, {TopologyKind::Torus}).getRows(), 2);
+}
+
+TEST(HamonCubeTest, RingOrderFollowsEdges)
+{
+    const std::vector<HamonCube> cubes = {
+        HamonCube(8), HamonCube(5, {TopologyKind::Ring}), HamonCube(12, {TopologyKind::Torus, 3}),
+        HamonCube(15, {TopologyKind::Torus, 3}), HamonCube(6, {TopologyKind::Torus, 3})
+    };
+    for (const HamonCube &cube: cubes) {
+        const auto &order = cube.getRingOrder();
+        ASSERT_EQ(static_cast<int>(order.size()), cube.getNodeCount());
+        std::vector<int> sorted = order;
+        std::ranges::sort(sorted);
+        for (int id = 0; id < cube.getNodeCount(); ++id) EXPECT_EQ(sorted[static_cast<std::size_t>(id)], id);
+        // Consecutive nodes, and the last and the first, are linked by the graph itself.
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            const auto &neighbors = cube.getNode(static_cast<std::size_t>(order[i])).neighbors;
+            const int next = order[(i + 1) % order.size()];
+            EXPECT_NE(std::ranges::find(neighbors, next), neighbors.end())
+                << HamonCube::kindName(cube.getKind()) << " " << order[i] << " -> " << next;
+        }
+    }
+}
+
+TEST(HamonCubeTest, TopologySpecParsing)
+{
+    TopologySpec spec;
+    EXPECT_TRUE(TopologySpec::parse("ring", spec));
+    EXPECT_EQ(spec.kind, TopologyKind::Ring);
+    EXPECT_TRUE(TopologySpec::parse("torus:4x6", spec));
+    EXPECT_EQ(spec.kind, TopologyKind::Torus);
+    EXPECT_EQ(spec.rows, 4);
+    EXPECT_EQ(spec.columns, 6);
+    EXPECT_TRUE(TopologySpec::parse("hypercube", spec));
+    EXPECT_EQ(spec.kind, TopologyKind::Hypercube);
+    EXPECT_FALSE(TopologySpec::parse("mesh", spec));
+    EXPECT_FALSE(TopologySpec::parse("torus:4", spec));
+
+    EXPECT_NO_THROW(HamonCube(6, {TopologyKind::Ring}));
+    EXPECT_THROW(HamonCube(12, (TopologySpec{TopologyKind::Torus, 5})), std::invalid_argument);
+    EXPECT_THROW(HamonCube(8, (TopologySpec{TopologyKind::Torus, 3, 3})), std::invalid_argument);
+}
@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+#include <array>
+#include <string>
+#include <thread>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../include/HamonFrame.hpp"
+
+using namespace dualys;
+
+namespace
+{
+    struct SocketPair
+    {
+        int fds[2]{-1, -1};
+
+        SocketPair() { socketpair(AF_UNIX, SOCK_STREAM, 0, fds); }
+
+        ~SocketPair()
+        {
+            close(fds[0]);
+            close(fds[1]);
+        }
+    };
+
+    std::string make_payload(const std::size_t size)
+    {
+        std::string s(size, '\0');
+        for (std::size_t i = 0; i < size; ++i) s[i] = static_cast<char>('a' + i % 26);
+        return s;
+    }
+} // namespace
+
+TEST(HamonFrame, LargePayloadRoundTrip)
+{
+    // Well above the old 64 KiB limit, split into many frames.
+    const std::string payload = make_payload(3 * 1024 * 1024 + 17);
+    SocketPair sp;
+    std::thread sender([&] {
+        FrameWriter writer(sp.fds[0], true, 64 * 1024);
+        EXPECT_TRUE(writer.write(payload));
+        EXPECT_TRUE(writer.finish());
+    });
+    std::string got;
+    FrameReader reader(sp.fds[1]);
+    EXPECT_TRUE(reader.read_payload(got));
+    sender.join();
+    EXPECT_EQ(got, payload);
+}
+
+TEST(HamonFrame, EmptyPayload)
+{
+    SocketPair sp;
+    FrameWriter writer(sp.fds[0]);
+    ASSERT_TRUE(writer.write(""));
+    ASSERT_TRUE(writer.finish());
+    FrameReader reader(sp.fds[1]);
+    std::string frame;
+    EXPECT_FALSE(reader.next(frame));
+    EXPECT_FALSE(reader.failed());
+}
+
+TEST(HamonFrame, ChecksumMismatchDetected)
+{
+    SocketPair sp;
+    const std::string body = "hamon";
+    FrameHeader header{FrameType::Data, HamonFrame::flag_checksum, HamonFrame::crc32(body.data(), body.size()) ^ 1u,
+                       body.size()};
+    std::array<unsigned char, HamonFrame::header_size> head{};
+    HamonFrame::encode_header(header, head.data());
+    ASSERT_TRUE(HamonFrame::write_all(sp.fds[0], head.data(), head.size()));
+    ASSERT_TRUE(HamonFrame::write_all(sp.fds[0], body.data(), body.size()));
+    std::string got;
+    FrameReader reader(sp.fds[1]);
+    EXPECT_FALSE(reader.read_payload(got));
+    EXPECT_TRUE(reader.failed());
+}
+
+TEST(HamonFrame, HandshakeExchangesIdsAndVersion)
+{
+    SocketPair sp;
+    int peer_of_a = -1;
+    std::uint16_t version_a = 0;
+    std::thread other([&] { EXPECT_TRUE(HamonFrame::handshake(sp.fds[0], 3, peer_of_a, version_a)); });
+    int peer_of_b = -1;
+    std::uint16_t version_b = 0;
+    EXPECT_TRUE(HamonFrame::handshake(sp.fds[1], 5, peer_of_b, version_b));
+    other.join();
+    EXPECT_EQ(peer_of_a, 5);
+    EXPECT_EQ(peer_of_b, 3);
+    EXPECT_EQ(version_a, HamonFrame::protocol_version);
+    EXPECT_EQ(version_a, version_b);
+}
+
+TEST(HamonFrame, AssemblerCollectsPartialWrites)
+{
+    SocketPair sp;
+    const std::string payload = make_payload(100000);
+    std::thread writer([&] {
+        // Small frames: the payload spans several of them, each arriving in pieces.
+        FrameWriter frames(sp.fds[0], true, 4096);
+        EXPECT_TRUE(frames.write(payload));
+        EXPECT_TRUE(frames.finish());
+    });
+    FrameAssembler assembler;
+    std::string out;
+    ReceiveStatus status = ReceiveStatus::Pending;
+    while ((status = assembler.poll(sp.fds[1], out)) == ReceiveStatus::Pending) std::this_thread::yield();
+    writer.join();
+    EXPECT_EQ(status, ReceiveStatus::Complete);
+    EXPECT_EQ(out, payload);
+    EXPECT_EQ(assembler.poll(sp.fds[1], out), ReceiveStatus::Pending);
+    close(sp.fds[0]);
+    sp.fds[0] = -1;
+    EXPECT_EQ(assembler.poll(sp.fds[1], out), ReceiveStatus::Failed);
+}
+
+TEST(HamonFrame, Crc32KnownValue)
+{
+    const std::string check = "123456789";
+    EXPECT_EQ(HamonFrame::crc32(check.data(), check.size()), 0xCBF43926u);
+}
@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../include/HamonJobs.hpp"
+
+using namespace dualys;
+
+TEST(HamonJobs, RequestLinesRoundTrip)
+{
+    JobRequest job;
+    job.input = "/data/with space.txt";
+    const std::string line = HamonJobs::encode(job);
+    ASSERT_EQ(line, "wordcount /data/with space.txt\n");
+    JobRequest decoded;
+    ASSERT_TRUE(HamonJobs::decode(std::string_view(line).substr(0, line.size() - 1), decoded));
+    EXPECT_FALSE(decoded.shutdown);
+    EXPECT_EQ(decoded.op, "wordcount");
+    EXPECT_EQ(decoded.input, job.input);
+
+    ASSERT_TRUE(HamonJobs::decode("shutdown", decoded));
+    EXPECT_TRUE(decoded.shutdown);
+    EXPECT_FALSE(HamonJobs::decode("grep /data/a.txt", decoded));
+    EXPECT_FALSE(HamonJobs::decode("wordcount ", decoded));
+    EXPECT_FALSE(HamonJobs::decode("", decoded));
+}
+
+TEST(HamonJobs, SubmitGetsTheDaemonsAnswer)
+{
+    const std::string path = (std::filesystem::temp_directory_path() /
+                              ("hamon-test-" + std::to_string(getpid()) + ".sock")).string();
+    const int server = HamonJobs::listen(path);
+    ASSERT_GE(server, 0);
+    EXPECT_LT(HamonJobs::listen(path), 0); // someone answers there already
+    close(accept(server, nullptr, nullptr)); // that probe's connection
+
+    std::jthread daemon([server] {
+        for (int served = 0; served < 2; ++served) {
+            const int client = accept(server, nullptr, nullptr);
+            JobRequest request;
+            EXPECT_TRUE(HamonJobs::read_request(client, request));
+            if (request.input == "/missing") HamonJobs::reply(client, false, "cannot read /missing");
+            else HamonJobs::reply(client, true, " - 'a': 1\n");
+            close(client);
+        }
+    });
+
+    JobRequest job;
+    job.input = "/present";
+    std::ostringstream out;
+    std::string error;
+    EXPECT_TRUE(HamonJobs::submit(path, job, out, error));
+    EXPECT_EQ(out.str(), " - 'a': 1\n");
+
+    job.input = "/missing";
+    EXPECT_FALSE(HamonJobs::submit(path, job, out, error));
+    EXPECT_EQ(error, "cannot read /missing");
+    daemon.join();
+    close(server);
+    unlink(path.c_str());
+    EXPECT_FALSE(HamonJobs::submit(path, job, out, error));
+}
@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <sys/socket.h>
+#include "../include/HamonLink.hpp"
+
+using namespace dualys;
+
+TEST(PeerLink, QueuedPayloadsArriveInOrder)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    PeerLink a(fds[0], 1, true);
+    PeerLink b(fds[1], 0, true);
+    a.send("first");
+    a.send(std::string(3 << 20, 'x')); // several frames
+    a.send("");
+    std::string out;
+    ASSERT_TRUE(b.receive(out));
+    EXPECT_EQ(out, "first");
+    ASSERT_TRUE(b.receive(out));
+    EXPECT_EQ(out.size(), std::size_t{3} << 20);
+    ASSERT_TRUE(b.receive(out));
+    EXPECT_TRUE(out.empty());
+    EXPECT_TRUE(a.flush());
+}
+
+TEST(PeerLink, LargeSwapInBothDirectionsDoesNotDeadlock)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    PeerLink a(fds[0], 1, false);
+    PeerLink b(fds[1], 0, false);
+    // Far more than the socket buffers: both sides must be able to send before they read.
+    const std::string from_a(16 << 20, 'a');
+    const std::string from_b(16 << 20, 'b');
+    std::string got_a;
+    std::string got_b;
+    std::thread other([&] {
+        b.send(from_b);
+        EXPECT_TRUE(b.receive(got_b));
+    });
+    a.send(from_a);
+    EXPECT_TRUE(a.receive(got_a));
+    other.join();
+    EXPECT_EQ(got_a, from_b);
+    EXPECT_EQ(got_b, from_a);
+}
+
+TEST(PeerLink, FlushReportsFailedSend)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    PeerLink a(fds[0], 1, false);
+    shutdown(fds[1], SHUT_RD);
+    a.send(std::string(1 << 20, 'z'));
+    EXPECT_FALSE(a.flush());
+    close(fds[1]);
+}
+
+TEST(PeerLink, NegotiatesSharedMemoryWithALocalPeer)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    PeerLink a(fds[0], 1, false);
+    PeerLink b(fds[1], 0, false);
+    std::thread other([&] { EXPECT_TRUE(b.negotiate_transport(false, 1 << 16)); });
+    ASSERT_TRUE(a.negotiate_transport(true, 1 << 16));
+    other.join();
+    EXPECT_TRUE(a.uses_shared_memory());
+    EXPECT_TRUE(b.uses_shared_memory());
+
+    const std::string from_a(4 << 20, 'a');
+    const std::string from_b(4 << 20, 'b');
+    std::string got_a;
+    std::string got_b;
+    std::thread swap([&] {
+        b.send(from_b);
+        EXPECT_TRUE(b.receive(got_b));
+    });
+    a.send(from_a);
+    EXPECT_TRUE(a.receive(got_a));
+    swap.join();
+    EXPECT_EQ(got_a, from_b);
+    EXPECT_EQ(got_b, from_a);
+}
+
+TEST(PeerLink, ZeroRingSizeKeepsTcp)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    PeerLink a(fds[0], 1, false);
+    PeerLink b(fds[1], 0, false);
+    std::thread other([&] { EXPECT_TRUE(b.negotiate_transport(false, 1 << 16)); });
+    ASSERT_TRUE(a.negotiate_transport(true, 0));
+    other.join();
+    EXPECT_FALSE(a.uses_shared_memory());
+    EXPECT_FALSE(b.uses_shared_memory());
+    a.send("over the socket");
+    std::string out;
+    ASSERT_TRUE(b.receive(out));
+    EXPECT_EQ(out, "over the socket");
+}
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../include/HamonLoop.hpp"
+#include "../include/HamonRing.hpp"
+
+using namespace dualys;
+using namespace std::chrono_literals;
+
+namespace
+{
+    Task<bool> wait_readable(EventLoop &loop, const int fd, const Deadline deadline)
+    {
+        co_return co_await loop.readable(fd, deadline);
+    }
+
+    Task<bool> sleep_then(EventLoop &loop, const std::chrono::milliseconds delay, int &order, int &slot)
+    {
+        co_await loop.sleep_until(std::chrono::steady_clock::now() + delay);
+        slot = ++order;
+        co_return true;
+    }
+
+    Task<bool> receive_all(EventLoop &loop, ShmChannel &channel, const int fd, std::string &out, int count)
+    {
+        std::string payload;
+        while (count > 0) {
+            switch (channel.poll_receive(payload)) {
+                case ReceiveStatus::Complete:
+                    out += payload;
+                    --count;
+                    continue;
+                case ReceiveStatus::Failed:
+                    co_return false;
+                case ReceiveStatus::Pending:
+                    break;
+            }
+            const bool readable = co_await loop.readable(fd, EventLoop::deadline_in(5000));
+            if (!readable) co_return false;
+        }
+        co_return true;
+    }
+} // namespace
+
+TEST(EventLoop, ReadableWakesOnData)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    EventLoop loop;
+    std::thread writer([&] {
+        std::this_thread::sleep_for(20ms);
+        ASSERT_EQ(write(fds[1], "x", 1), 1);
+    });
+    EXPECT_TRUE(loop.run(wait_readable(loop, fds[0], EventLoop::deadline_in(5000))));
+    writer.join();
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(EventLoop, DeadlineEndsAWait)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    EventLoop loop;
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(loop.run(wait_readable(loop, fds[0], EventLoop::deadline_in(30))));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, 30ms);
+    // The descriptor was unregistered: it can be waited on again.
+    ASSERT_EQ(write(fds[1], "x", 1), 1);
+    EXPECT_TRUE(loop.run(wait_readable(loop, fds[0], EventLoop::deadline_in(5000))));
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(EventLoop, AllRunsTasksConcurrently)
+{
+    EventLoop loop;
+    int order = 0;
+    int slow = 0;
+    int fast = 0;
+    std::vector<Task<bool> > tasks;
+    tasks.push_back(sleep_then(loop, 40ms, order, slow));
+    tasks.push_back(sleep_then(loop, 10ms, order, fast));
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(loop.run(EventLoop::all(std::move(tasks))));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 2s);
+    EXPECT_EQ(fast, 1);
+    EXPECT_EQ(slow, 2);
+    EXPECT_TRUE(loop.run(EventLoop::all({})));
+}
+
+TEST(EventLoop, ShmChannelRingsTheSocket)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    const auto creator = ShmChannel::create(4096, fds[0]);
+    ASSERT_NE(creator, nullptr);
+    const auto peer = ShmChannel::open(creator->name(), fds[1]);
+    ASSERT_NE(peer, nullptr);
+    creator->unlink();
+
+    const std::string big(20000, 'b');
+    std::thread writer([&] {
+        std::this_thread::sleep_for(20ms);
+        EXPECT_TRUE(creator->send("first "));
+        EXPECT_TRUE(creator->send(big));
+    });
+    EventLoop loop;
+    std::string out;
+    EXPECT_TRUE(loop.run(receive_all(loop, *peer, fds[1], out, 2)));
+    writer.join();
+    EXPECT_EQ(out, "first " + big);
+    close(fds[0]);
+    close(fds[1]);
+}
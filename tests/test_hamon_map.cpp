@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <utility>
+#include <string>
+#include <vector>
+#include "../include/HamonMap.hpp"
+#include "../include/HamonShard.hpp"
+#include "../include/HamonTokenizer.hpp"
+
+using namespace dualys;
+
+namespace
+{
+    // Enough text for several sub-chunks per thread, with short and arena-stored long words.
+    std::string make_text(const std::size_t bytes)
+    {
+        std::mt19937 rng(11);
+        std::uniform_int_distribution<int> len(1, 30);
+        std::uniform_int_distribution<int> letter('a', 'f');
+        std::uniform_int_distribution<int> gap(0, 9);
+        std::string text;
+        while (text.size() < bytes)
+        {
+            for (int i = len(rng); i > 0; --i) text += static_cast<char>(letter(rng));
+            text += gap(rng) == 0 ? '\n' : ' ';
+        }
+        return text;
+    }
+
+    WordCountMap single_threaded(const std::string &text)
+    {
+        WordCountTable counts;
+        HamonTokenizer::count(text, counts);
+        return counts.to_map();
+    }
+} // namespace
+
+TEST(HamonMap, ThreadCountDoesNotChangeCounts)
+{
+    const std::string text = make_text(3 * 1024 * 1024);
+    const WordCountMap expected = single_threaded(text);
+    for (const unsigned threads : {1u, 2u, 3u, 8u})
+    {
+        EXPECT_EQ(HamonMap::count(text, threads).to_map(), expected) << "threads=" << threads;
+    }
+}
+
+TEST(HamonMap, SmallChunkStaysOnCallingThread)
+{
+    EXPECT_EQ(HamonMap::count("a b a", 8).to_map(), (WordCountMap{{"a", 2}, {"b", 1}}));
+    EXPECT_TRUE(HamonMap::count("", 8).empty());
+}
+
+TEST(StreamingCount, PiecesCutAnywhereMatchOneCount)
+{
+    const std::string whole = make_text(3 * 1024 * 1024);
+    std::mt19937 rng(5);
+    // Pieces from a few bytes (words spanning several pieces) to more than a sub-chunk per thread.
+    for (const auto [largest, bytes] : {std::pair<std::size_t, std::size_t>{7, 64 * 1024}, {4096, 1024 * 1024},
+                                        {2 * 1024 * 1024, whole.size()}})
+    {
+        const std::string text = whole.substr(0, bytes);
+        const WordCountMap expected = single_threaded(text);
+        std::uniform_int_distribution<std::size_t> size(1, largest);
+        StreamingCount counter(4);
+        std::string piece;
+        for (std::size_t at = 0; at < text.size();)
+        {
+            const std::size_t n = std::min(size(rng), text.size() - at);
+            piece.assign(text, at, n);
+            counter.feed(piece);
+            EXPECT_TRUE(piece.empty());
+            at += n;
+        }
+        EXPECT_EQ(counter.finish().to_map(), expected) << "largest=" << largest;
+    }
+}
+
+TEST(StreamingCount, EmptyAndUnterminatedChunks)
+{
+    StreamingCount nothing(2);
+    EXPECT_TRUE(nothing.finish().empty());
+    StreamingCount counter(2);
+    std::string piece = "a b";
+    counter.feed(piece);
+    piece = "b a";
+    counter.feed(piece);
+    EXPECT_EQ(counter.finish().to_map(), (WordCountMap{{"a", 2}, {"bb", 1}}));
+}
+
+TEST(StreamingCount, CutSeparatesChunks)
+{
+    StreamingCount counter(2);
+    std::string piece = "a b";
+    counter.feed(piece);
+    // The unterminated "b" ends the first chunk instead of joining the next one.
+    EXPECT_EQ(counter.cut().to_map(), (WordCountMap{{"a", 1}, {"b", 1}}));
+    piece = "b a";
+    counter.feed(piece);
+    piece = "c d";
+    counter.feed(piece);
+    EXPECT_EQ(counter.cut().to_map(), (WordCountMap{{"b", 1}, {"ac", 1}, {"d", 1}}));
+    EXPECT_TRUE(counter.cut().empty());
+    piece = "d";
+    counter.feed(piece);
+    EXPECT_EQ(counter.finish().to_map(), (WordCountMap{{"d", 1}}));
+}
+
+TEST(HamonMap, ResolveThreads)
+{
+    EXPECT_EQ(HamonMap::resolve_threads(5), 5u);
+    EXPECT_EQ(HamonMap::resolve_threads(0), HamonMap::pinned_cpu_count());
+    EXPECT_GE(HamonMap::pinned_cpu_count(), 1u);
+}
+
+TEST(WordCountTable, MergeParallelMatchesSequentialMerge)
+{
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<int> len(1, 40);
+    std::uniform_int_distribution<int> letter('a', 'c');
+    std::vector<WordCountTable> parts(5);
+    WordCountTable sequential;
+    for (WordCountTable &part : parts)
+    {
+        for (int i = 0; i < 20000; ++i)
+        {
+            std::string word;
+            for (int n = len(rng); n > 0; --n) word += static_cast<char>(letter(rng));
+            part.add(word);
+        }
+        sequential.merge(part);
+    }
+    const WordCountTable merged = WordCountTable::merge_parallel(std::move(parts));
+    EXPECT_EQ(merged.size(), sequential.size());
+    EXPECT_EQ(merged.to_map(), sequential.to_map());
+}
+
+TEST(HamonMap, CombineManyTablesOnFewThreads)
+{
+    // One table per range, as a worker keeps them under speculation: far more tables than threads.
+    const auto ranges = []
+    {
+        std::vector<WordCountTable> tables(37);
+        for (std::size_t i = 0; i < tables.size(); ++i)
+        {
+            if (i % 5 != 0) HamonTokenizer::count(make_text(4096 + i * 97), tables[i]); // some emptied by a long word
+        }
+        return tables;
+    };
+    const WordCountMap expected = HamonMap::combine(ranges()).to_map();
+    for (const unsigned threads : {0u, 1u, 3u, 64u})
+    {
+        EXPECT_EQ(HamonMap::combine(ranges(), threads).to_map(), expected) << "threads=" << threads;
+    }
+    EXPECT_TRUE(HamonMap::combine(std::vector<WordCountTable>(4), 2).empty());
+}
+
+TEST(MapWorkers, RunsEveryJobOncePerRound)
+{
+    MapWorkers workers(4);
+    EXPECT_EQ(workers.size(), 4u);
+    std::vector<int> calls(4, 0);
+    for (int round = 0; round < 200; ++round)
+    {
+        const std::size_t k = static_cast<std::size_t>(round % 5);
+        workers.run(k, [&](const std::size_t t) { ++calls[t]; });
+    }
+    // Job t runs in the rounds with k > t; more jobs than workers run one per worker.
+    workers.run(9, [&](const std::size_t t) { ++calls[t]; });
+    EXPECT_EQ(calls, (std::vector<int>{161, 121, 81, 41}));
+
+    // The same workers count piece after piece into the same tables.
+    const std::string text = make_text(3 * 1024 * 1024);
+    std::vector<WordCountTable> tables(4);
+    for (std::size_t at = 0; at < text.size();)
+    {
+        const std::size_t end = HamonShard::align_to_boundary(text, std::min(text.size(), at + 1024 * 1024));
+        HamonMap::count_into(std::string_view(text).substr(at, end - at), tables, &workers);
+        at = end;
+    }
+    EXPECT_EQ(HamonMap::combine(std::move(tables)).to_map(), single_threaded(text));
+}
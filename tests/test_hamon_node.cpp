@@ -1,8 +1,48 @@
 #include <gtest/gtest.h>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
 #include "../include/HamonNode.hpp"
 
 using namespace dualys;
 
+namespace {
+    // Runs a word count on node_count nodes linked in process; true if every node succeeded.
+    // Node 0's console output (its results) goes to out.
+    bool run_in_process(const int node_count, const NodeOptions &options, std::string &out) {
+        const HamonCube cube(node_count);
+        std::vector<NodeConfig> configs;
+        for (int id = 0; id < node_count; ++id) {
+            configs.push_back({id, id == 0 ? "coordinator" : "worker", "127.0.0.1", 8000 + id});
+        }
+        LocalMesh mesh;
+        std::atomic<int> succeeded{0};
+        std::ostringstream console;
+        std::streambuf *const saved = std::cout.rdbuf(console.rdbuf());
+        {
+            std::vector<std::jthread> threads;
+            for (int id = 0; id < node_count; ++id) {
+                threads.emplace_back([&, id] {
+                    HamonNode node(cube.getNode(static_cast<std::size_t>(id)), cube, configs, options, &mesh);
+                    if (node.run()) ++succeeded;
+                });
+            }
+        }
+        std::cout.rdbuf(saved);
+        out = console.str();
+        return succeeded == node_count;
+    }
+}
+
 TEST(HamonNodeLogicTest, Serialization)
 {
     // ARRANGE
@@ -36,3 +76,83 @@ TEST(HamonNodeLogicTest, DeserializationAndMerge)
     EXPECT_EQ(counts["new"], 10);     // A été ajouté
     EXPECT_EQ(counts.size(), 3);
 }
+
+TEST(HamonNodeLogicTest, BinaryCodecRoundTrip)
+{
+    WordCountMap counts;
+    counts["hamon"] = 3;
+    counts["hamonCube"] = 1;
+    counts["key:with,separators"] = 7;
+    counts[""] = 2;
+    counts["zeta"] = 1000000;
+
+    const std::string payload = HamonCodec::encode(counts);
+    EXPECT_EQ(payload.size(), HamonCodec::encoded_size(counts));
+
+    WordCountMap merged;
+    merged["hamon"] = 1;
+    ASSERT_TRUE(HamonCodec::decode_and_merge(payload, merged));
+    EXPECT_EQ(merged["hamon"], 4);
+    EXPECT_EQ(merged["hamonCube"], 1);
+    EXPECT_EQ(merged["key:with,separators"], 7);
+    EXPECT_EQ(merged[""], 2);
+    EXPECT_EQ(merged["zeta"], 1000000);
+    EXPECT_EQ(merged.size(), 5);
+}
+
+TEST(HamonNodeLogicTest, BinaryCodecIsSmallerThanText)
+{
+    WordCountMap counts;
+    for (int i = 0; i < 1000; ++i) counts["topologie_" + std::to_string(i)] = i;
+    EXPECT_LT(HamonCodec::encode(counts).size() * 2, HamonNode::serialize_map(counts).size());
+}
+
+TEST(HamonNodeLogicTest, BinaryCodecRejectsTruncatedPayload)
+{
+    WordCountMap counts;
+    counts["hello"] = 2;
+    counts["world"] = 1;
+    const std::string payload = HamonCodec::encode(counts);
+    WordCountMap merged;
+    EXPECT_FALSE(HamonCodec::decode_and_merge(std::string_view(payload).substr(0, payload.size() - 2), merged));
+    EXPECT_FALSE(HamonCodec::decode_and_merge("hello:2,", merged));
+}
+
+TEST(HamonNodeLogicTest, ListeningSocketAcceptsConnectionsBeforeAnyAccept)
+{
+    const int server = HamonNode::listen_on(0, 0);
+    ASSERT_GE(server, 0);
+    sockaddr_in address{};
+    socklen_t length = sizeof(address);
+    ASSERT_EQ(getsockname(server, reinterpret_cast<sockaddr *>(&address), &length), 0);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // The orchestrator binds every server before forking: a peer's connect succeeds even
+    // though the node has not started accepting yet.
+    const int client = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(client, 0);
+    EXPECT_EQ(connect(client, reinterpret_cast<sockaddr *>(&address), sizeof(address)), 0);
+    close(client);
+    close(server);
+}
+
+TEST(HamonNodeLogicTest, SpeculationKeepsRangesEmptiedByALongWord)
+{
+    // Ranges are at least 1 MiB: those inside the 4 MiB word are empty once aligned on words.
+    const std::string path = "/tmp/hamon_long_word_" + std::to_string(getpid()) + ".txt";
+    {
+        std::ofstream input(path);
+        input << std::string(std::size_t{4} << 20, 'w') << " y";
+    }
+    NodeOptions options;
+    options.input_file = path;
+    options.dynamic_chunks = true;
+    options.speculative = true;
+    options.phase_timeout_ms = 30000;
+    for (const int node_count: {2, 3}) {
+        std::string out;
+        EXPECT_TRUE(run_in_process(node_count, options, out)) << node_count << " nodes";
+        EXPECT_NE(out.find(" - 'y': 1\n"), std::string::npos) << node_count << " nodes";
+    }
+    std::remove(path.c_str());
+}
@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "../include/HamonPlacement.hpp"
+
+using namespace dualys;
+
+namespace {
+    std::vector<NodeConfig> nodes(const int count) {
+        std::vector<NodeConfig> configs;
+        for (int id = 0; id < count; ++id) configs.push_back({id, "worker", "127.0.0.1", 8000 + id});
+        return configs;
+    }
+
+    // Two sockets of four CPUs, numbered like a machine that interleaves them.
+    const std::vector<NumaDomain> two_sockets = {{0, {0, 2, 4, 6}}, {1, {1, 3, 5, 7}}};
+}
+
+TEST(HamonPlacement, PacksNodesCompactlyPerSocket)
+{
+    const std::vector<NodePlacement> placements = HamonPlacement::plan(nodes(4), two_sockets);
+    ASSERT_EQ(placements.size(), 4u);
+    // Nodes 0 and 1 (hypercube neighbors across dimension 0) share socket 0.
+    EXPECT_EQ(placements[0].numa, 0);
+    EXPECT_EQ(placements[0].cpus, (std::vector<int>{0, 2}));
+    EXPECT_EQ(placements[1].cpus, (std::vector<int>{4, 6}));
+    EXPECT_EQ(placements[2].numa, 1);
+    EXPECT_EQ(placements[3].cpus, (std::vector<int>{5, 7}));
+    EXPECT_EQ(HamonPlacement::describe(placements[3]), "cpus 5,7, numa 1");
+
+    // More nodes than CPUs: they share them, and stay on their socket.
+    const std::vector<NodePlacement> crowded = HamonPlacement::plan(nodes(10), two_sockets);
+    EXPECT_EQ(crowded[4].cpus, (std::vector<int>{0}));
+    EXPECT_EQ(crowded[4].numa, 0);
+    EXPECT_EQ(crowded[5].numa, 1);
+    EXPECT_EQ(crowded[8].cpus, (std::vector<int>{7}));
+
+    // One NUMA node: the memory policy is left alone.
+    const std::vector<NodePlacement> single = HamonPlacement::plan(nodes(3), {{0, {0, 1, 2, 3}}});
+    EXPECT_EQ(single[0].numa, -1);
+    EXPECT_EQ(HamonPlacement::describe(single[0]), "cpu 0");
+    EXPECT_EQ(HamonPlacement::describe(single[2]), "cpus 2-3");
+}
+
+TEST(HamonPlacement, CpuDirectivesOverrideTheDefault)
+{
+    std::vector<NodeConfig> configs = nodes(4);
+    configs[0].numa = 1;
+    configs[0].core = 2;
+    configs[1].numa = 1;
+    configs[2].core = 3;
+    configs[3].numa = 4; // no such NUMA node
+    const std::vector<NodePlacement> placements = HamonPlacement::plan(configs, two_sockets);
+    EXPECT_EQ(placements[0].cpus, (std::vector<int>{5}));
+    EXPECT_EQ(placements[0].numa, 1);
+    EXPECT_EQ(placements[1].cpus, (std::vector<int>{1, 3, 5, 7}));
+    EXPECT_EQ(placements[2].cpus, (std::vector<int>{3}));
+    EXPECT_EQ(placements[2].numa, 1);
+    EXPECT_EQ(placements[3].cpus, (std::vector<int>{5, 7}));
+
+    // core=7 on a NUMA node of four CPUs: logical CPU 7, one of them. CPU 6 is not, so node 1 keeps its default.
+    configs[0].core = 7;
+    configs[1].core = 6;
+    const std::vector<NodePlacement> by_number = HamonPlacement::plan(configs, two_sockets);
+    EXPECT_EQ(by_number[0].cpus, (std::vector<int>{7}));
+    EXPECT_EQ(by_number[1].cpus, (std::vector<int>{4, 6}));
+}
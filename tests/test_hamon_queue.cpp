@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include "../include/HamonQueue.hpp"
+
+using namespace dualys;
+
+TEST(MpscQueue, KeepsEachProducersOrder)
+{
+    MpscQueue<std::string> queue;
+    constexpr int producers = 4;
+    constexpr int per_producer = 10000;
+    std::vector<std::jthread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&queue, p] {
+            for (int i = 0; i < per_producer; ++i) queue.push(std::to_string(p) + ":" + std::to_string(i));
+        });
+    }
+    std::vector<int> next(producers, 0);
+    int popped = 0;
+    std::string item;
+    while (popped < producers * per_producer) {
+        if (!queue.try_pop(item)) continue;
+        const auto colon = item.find(':');
+        const int p = std::stoi(item.substr(0, colon));
+        EXPECT_EQ(std::stoi(item.substr(colon + 1)), next[static_cast<std::size_t>(p)]++);
+        ++popped;
+    }
+    EXPECT_FALSE(queue.try_pop(item));
+}
+
+TEST(LocalChannel, DoorbellRingsOnlyForAWaitingReader)
+{
+    auto [a, b] = LocalChannel::pair();
+    ASSERT_NE(a, nullptr);
+    std::string out;
+    EXPECT_EQ(b->poll_receive(out), ReceiveStatus::Pending);
+    pollfd pfd{b->doorbell_fd(), POLLIN, 0};
+    EXPECT_EQ(poll(&pfd, 1, 0), 0);
+
+    ASSERT_TRUE(a->send("first"));
+    EXPECT_EQ(poll(&pfd, 1, 0), 1);
+    ASSERT_TRUE(a->send(""));
+    EXPECT_EQ(b->poll_receive(out), ReceiveStatus::Complete);
+    EXPECT_EQ(out, "first");
+    EXPECT_EQ(b->poll_receive(out), ReceiveStatus::Complete);
+    EXPECT_EQ(out, "");
+    EXPECT_EQ(b->poll_receive(out), ReceiveStatus::Pending);
+}
+
+TEST(LocalChannel, PeerDrainsWhatWasSentBeforeTheClose)
+{
+    auto [a, b] = LocalChannel::pair();
+    ASSERT_NE(a, nullptr);
+    std::string big(1 << 20, 'x');
+    const char *bytes = big.data();
+    ASSERT_TRUE(a->send(std::move(big)));
+    a.reset();
+    std::string out;
+    ASSERT_TRUE(b->receive(out));
+    EXPECT_EQ(out.size(), std::size_t{1} << 20);
+    EXPECT_EQ(out.data(), bytes); // moved, not copied
+    EXPECT_FALSE(b->receive(out));
+    EXPECT_FALSE(b->send("late"));
+}
+
+TEST(LocalMesh, EachEndIsTakenOnce)
+{
+    LocalMesh mesh;
+    auto one = mesh.take(0, 1);
+    auto other = mesh.take(1, 0);
+    ASSERT_NE(one, nullptr);
+    ASSERT_NE(other, nullptr);
+    EXPECT_EQ(mesh.take(0, 1), nullptr);
+    std::jthread reader([&] {
+        std::string out;
+        EXPECT_TRUE(other->receive(out));
+        EXPECT_EQ(out, "hello");
+    });
+    EXPECT_TRUE(one->send("hello"));
+}
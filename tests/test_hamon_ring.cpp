@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../include/HamonRing.hpp"
+
+using namespace dualys;
+
+TEST(ShmChannel, PayloadsLargerThanTheRingArriveIntact)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    const auto creator = ShmChannel::create(4096, fds[0]);
+    ASSERT_NE(creator, nullptr);
+    const auto peer = ShmChannel::open(creator->name(), fds[1]);
+    ASSERT_NE(peer, nullptr);
+    creator->unlink();
+    EXPECT_TRUE(creator->name().empty());
+
+    std::string big(1 << 20, '\0');
+    for (std::size_t i = 0; i < big.size(); ++i) big[i] = static_cast<char>(i * 7);
+    std::thread writer([&] {
+        EXPECT_TRUE(creator->send("hello"));
+        EXPECT_TRUE(creator->send(big));
+        EXPECT_TRUE(creator->send(""));
+    });
+    std::string out;
+    ASSERT_TRUE(peer->receive(out));
+    EXPECT_EQ(out, "hello");
+    ASSERT_TRUE(peer->receive(out));
+    EXPECT_EQ(out, big);
+    ASSERT_TRUE(peer->receive(out));
+    EXPECT_TRUE(out.empty());
+    writer.join();
+
+    // The other direction uses the second ring.
+    ASSERT_TRUE(peer->send("back"));
+    ASSERT_TRUE(creator->receive(out));
+    EXPECT_EQ(out, "back");
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(ShmChannel, SendsFileRanges)
+{
+    const std::string path = "/tmp/hamon_ring_test_" + std::to_string(getpid()) + ".txt";
+    {
+        std::ofstream out(path);
+        for (int i = 0; i < 10000; ++i) out << "word" << i << ' ';
+    }
+    const MappedFile input(path);
+    ASSERT_TRUE(input.is_open());
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    const auto creator = ShmChannel::create(4096, fds[0]);
+    ASSERT_NE(creator, nullptr);
+    const auto peer = ShmChannel::open(creator->name(), fds[1]);
+    ASSERT_NE(peer, nullptr);
+    const ShardRange range{100, input.size() - 200};
+    std::thread writer([&] { EXPECT_TRUE(creator->send_file_range(input.fd(), range)); });
+    std::string out;
+    ASSERT_TRUE(peer->receive(out));
+    writer.join();
+    EXPECT_EQ(out, input.slice(range));
+    close(fds[0]);
+    close(fds[1]);
+    std::remove(path.c_str());
+}
+
+TEST(ShmChannel, ReceiveFailsOnceThePeerHangsUp)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    const auto creator = ShmChannel::create(4096, fds[0]);
+    ASSERT_NE(creator, nullptr);
+    const auto peer = ShmChannel::open(creator->name(), fds[1]);
+    ASSERT_NE(peer, nullptr);
+    // Bytes sent before the hang-up are still delivered.
+    ASSERT_TRUE(creator->send("last words"));
+    close(fds[0]);
+    std::string out;
+    ASSERT_TRUE(peer->receive(out));
+    EXPECT_EQ(out, "last words");
+    EXPECT_FALSE(peer->receive(out));
+    close(fds[1]);
+}
+
+TEST(ShmChannel, OpenRejectsForeignNames)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    EXPECT_EQ(ShmChannel::open("/etc/passwd", fds[1]), nullptr);
+    EXPECT_EQ(ShmChannel::open("/hamon-does-not-exist", fds[1]), nullptr);
+    EXPECT_TRUE(ShmChannel::same_host(fds[0]));
+    close(fds[0]);
+    close(fds[1]);
+}
@@ -0,0 +1,294 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../include/HamonShard.hpp"
+
+using namespace dualys;
+
+namespace
+{
+    std::vector<std::string> words_of(const std::string_view text)
+    {
+        std::istringstream ss{std::string(text)};
+        std::vector<std::string> out;
+        std::string w;
+        while (ss >> w) out.push_back(w);
+        return out;
+    }
+} // namespace
+
+TEST(HamonShard, SplitNeverCutsWords)
+{
+    const std::string text = "le cube hamon est une topologie de communication\nla topologie hamon est efficace";
+    const auto ranges = HamonShard::split(text, 5);
+    ASSERT_EQ(ranges.size(), 5u);
+    for (const auto &[offset, length] : ranges)
+    {
+        if (offset > 0 && offset < text.size())
+        {
+            EXPECT_TRUE(HamonShard::is_delimiter(text[offset])) << "split at " << offset;
+        }
+    }
+    EXPECT_EQ(ranges.front().offset, 0u);
+    EXPECT_EQ(ranges.back().offset + ranges.back().length, text.size());
+}
+
+TEST(HamonShard, WordsDoNotDependOnPartCount)
+{
+    const std::string text = "alpha beta\tgamma  delta\nepsilon zeta eta theta iota kappa lambda";
+    const auto expected = words_of(text);
+    for (std::size_t parts = 1; parts <= 16; ++parts)
+    {
+        std::vector<std::string> got;
+        for (const auto &r : HamonShard::split(text, parts))
+        {
+            for (auto &w : words_of(std::string_view(text).substr(r.offset, r.length))) got.push_back(w);
+        }
+        EXPECT_EQ(got, expected) << "parts=" << parts;
+    }
+}
+
+TEST(HamonShard, LongWordLeavesEmptyRanges)
+{
+    const std::string text = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa b";
+    const auto ranges = HamonShard::split(text, 4);
+    ASSERT_EQ(ranges.size(), 4u);
+    EXPECT_EQ(ranges[0].length, 32u);
+    EXPECT_EQ(ranges[1].length, 0u);
+    std::size_t total = 0;
+    for (const auto &r : ranges) total += r.length;
+    EXPECT_EQ(total, text.size());
+}
+
+TEST(HamonShard, SharedReadMatchesSplit)
+{
+    const std::string text = "dualys os est un systeme robuste\nhamon est le nom du projet\tle projet hamon";
+    const std::string path = "scenario_shard_shared.txt";
+    {
+        std::ofstream o(path, std::ios::binary);
+        o << text;
+    }
+    for (std::size_t parts = 1; parts <= 8; ++parts)
+    {
+        const auto aligned = HamonShard::split(text, parts);
+        const auto nominal = HamonShard::nominal_split(text.size(), parts);
+        ASSERT_EQ(aligned.size(), nominal.size());
+        for (std::size_t i = 0; i < parts; ++i)
+        {
+            std::string got_path;
+            ShardRange got_range{};
+            ASSERT_TRUE(HamonShard::decode_descriptor(HamonShard::encode_descriptor(path, nominal[i]), got_path, got_range));
+            EXPECT_EQ(got_path, path);
+            std::string chunk;
+            ASSERT_TRUE(HamonShard::read_range(got_path, got_range, chunk));
+            EXPECT_EQ(chunk, text.substr(aligned[i].offset, aligned[i].length)) << "parts=" << parts << " i=" << i;
+        }
+    }
+    std::remove(path.c_str());
+}
+
+TEST(HamonShard, WeightedSplitFollowsWeights)
+{
+    std::string text;
+    for (int i = 0; i < 4000; ++i) text += "mot" + std::to_string(i % 97) + (i % 11 == 0 ? "\n" : " ");
+    const std::vector<std::size_t> weights = {1, 3, 2, 2};
+    const auto aligned = HamonShard::split(text, weights);
+    const auto nominal = HamonShard::nominal_split(text.size(), weights);
+    ASSERT_EQ(aligned.size(), weights.size());
+    ASSERT_EQ(nominal.size(), weights.size());
+    std::string joined;
+    for (std::size_t i = 0; i < weights.size(); ++i)
+    {
+        // Within one word of the exact share.
+        EXPECT_NEAR(static_cast<double>(nominal[i].length), static_cast<double>(text.size() * weights[i]) / 8.0, 1.0);
+        EXPECT_LE(aligned[i].length, nominal[i].length + 16);
+        joined += text.substr(aligned[i].offset, aligned[i].length);
+    }
+    EXPECT_EQ(joined, text);
+    EXPECT_EQ(words_of(joined), words_of(text));
+}
+
+TEST(ChunkDispenser, CoversTheInputOnceInOrder)
+{
+    ChunkDispenser dispenser(10000000, 4, 1000, 1 << 20);
+    std::size_t end = 0;
+    std::size_t ranges = 0;
+    double rate = 0;
+    while (const auto range = dispenser.next(rate))
+    {
+        EXPECT_EQ(range->offset, end);
+        EXPECT_GT(range->length, 0u);
+        EXPECT_LE(range->length, std::size_t{1} << 20);
+        end += range->length;
+        rate = (rate == 0 ? 2e6 : rate * 1.5);
+        ++ranges;
+    }
+    EXPECT_EQ(end, 10000000u);
+    EXPECT_EQ(dispenser.remaining(), 0u);
+    EXPECT_FALSE(dispenser.next(1e9).has_value());
+    EXPECT_GT(ranges, 16u);
+}
+
+TEST(ChunkDispenser, FasterTakersGetLargerRanges)
+{
+    ChunkDispenser dispenser(1000000000, 4, 1000, std::size_t{1} << 30);
+    const auto slow = dispenser.next(1e6);
+    const auto fast = dispenser.next(1e8);
+    ASSERT_TRUE(slow && fast);
+    EXPECT_EQ(slow->length, 50000u); // target_seconds of work at 1 MB/s
+    EXPECT_EQ(fast->length, 5000000u);
+}
+
+TEST(ChunkDispenser, RangesShrinkTowardsTheEnd)
+{
+    ChunkDispenser dispenser(1000000, 2, 1000, 1000000);
+    // Never more than half of a taker's share of what is left, whatever the rate.
+    const auto first = dispenser.next(1e12);
+    ASSERT_TRUE(first.has_value());
+    EXPECT_EQ(first->length, 250000u);
+    std::size_t previous = first->length;
+    while (const auto range = dispenser.next(1e12))
+    {
+        EXPECT_LE(range->length, previous);
+        EXPECT_TRUE(range->length >= 1000u || dispenser.remaining() == 0);
+        previous = range->length;
+    }
+    EXPECT_LE(previous, 1000u);
+}
+
+TEST(ChunkTracker, WithoutSpeculationEveryRangeGoesOnce)
+{
+    ChunkTracker tracker(100000, 2, 0.0, 1000, 10000);
+    const auto start = std::chrono::steady_clock::now();
+    std::size_t end = 0;
+    std::uint64_t expected_id = 0;
+    while (const auto assignment = tracker.next(static_cast<int>(expected_id % 2), 1e5, start))
+    {
+        EXPECT_EQ(assignment->id, expected_id++);
+        EXPECT_EQ(assignment->range.offset, end);
+        EXPECT_FALSE(assignment->duplicate);
+        end += assignment->range.length;
+    }
+    EXPECT_EQ(end, 100000u);
+    // Nobody reported completions, and nobody needs to.
+    EXPECT_TRUE(tracker.finished());
+    EXPECT_FALSE(tracker.next(0, 1e5, start + std::chrono::hours(1)).has_value());
+    EXPECT_EQ(tracker.duplicates(), 0u);
+}
+
+TEST(ChunkTracker, StragglerIsDuplicatedAndFirstCompletionWins)
+{
+    using namespace std::chrono_literals;
+    // Ranges of min 1000 bytes at 10 kB/s: 0.1 s each at the median throughput.
+    ChunkTracker tracker(3000, 3, ChunkTracker::default_slack, 1000, 1000);
+    const auto t0 = std::chrono::steady_clock::now();
+    const auto a = tracker.next(0, 1e4, t0);
+    const auto b = tracker.next(1, 1e4, t0);
+    const auto c = tracker.next(2, 1e4, t0);
+    ASSERT_TRUE(a && b && c);
+    EXPECT_TRUE(tracker.complete(a->id, 0));
+    EXPECT_TRUE(tracker.complete(c->id, 2));
+    EXPECT_FALSE(tracker.finished());
+
+    // Node 1 is slow, but not yet slack times slower than expected.
+    EXPECT_FALSE(tracker.next(0, 1e4, t0 + 200ms).has_value());
+    const auto copy = tracker.next(0, 1e4, t0 + 400ms);
+    ASSERT_TRUE(copy.has_value());
+    EXPECT_TRUE(copy->duplicate);
+    EXPECT_EQ(copy->id, b->id);
+    EXPECT_EQ(copy->range.offset, b->range.offset);
+    // Held twice already: not handed out a third time.
+    EXPECT_FALSE(tracker.next(2, 1e4, t0 + 800ms).has_value());
+
+    EXPECT_TRUE(tracker.complete(b->id, 0));
+    EXPECT_TRUE(tracker.completed(b->id));
+    EXPECT_EQ(tracker.other_holders(b->id, 0), std::vector<int>{1});
+    EXPECT_EQ(tracker.take_abandoned(1), std::vector<std::uint64_t>{b->id});
+    EXPECT_TRUE(tracker.take_abandoned(1).empty()); // reported once
+    EXPECT_TRUE(tracker.take_abandoned(0).empty());
+    EXPECT_FALSE(tracker.complete(b->id, 1)); // the straggler's late result is dropped
+    EXPECT_FALSE(tracker.complete(a->id, 2)); // not a holder
+    EXPECT_TRUE(tracker.finished());
+    EXPECT_EQ(tracker.won_by(0), (std::vector<std::uint64_t>{a->id, b->id}));
+    EXPECT_TRUE(tracker.won_by(1).empty());
+    EXPECT_EQ(tracker.won_by(2), std::vector<std::uint64_t>{c->id});
+    EXPECT_EQ(tracker.duplicates(), 1u);
+}
+
+TEST(ChunkTracker, LostRangesAreNoticedBetweenWholeReplies)
+{
+    using namespace std::chrono_literals;
+    constexpr std::size_t range_count = 200;
+    ChunkTracker tracker(range_count * 1000, 2, ChunkTracker::default_slack, 1000, 1000);
+    const auto t0 = std::chrono::steady_clock::now();
+
+    // The loop: the only writer of worker 1's link, whose messages are recorded in order.
+    std::vector<std::string> sent;
+    std::vector<std::uint64_t> held;
+    const auto serve = [&]
+    {
+        for (const std::uint64_t id : tracker.take_abandoned(1)) sent.push_back("X " + std::to_string(id));
+        const auto range = tracker.next(1, 1e4, t0);
+        if (!range) return false;
+        sent.push_back("C " + std::to_string(range->id));
+        sent.push_back("range " + std::to_string(range->range.offset));
+        held.push_back(range->id);
+        return true;
+    };
+    for (std::size_t i = 0; i < range_count / 2; ++i) ASSERT_TRUE(serve());
+
+    // Node 0's counting thread takes the other ranges with worker 1, then sees every range worker 1
+    // still holds as a straggler: it takes copies and completes them while the loop keeps serving.
+    std::thread own([&]
+    {
+        while (!tracker.finished())
+        {
+            if (const auto copy = tracker.next(0, 1e4, t0 + 10s)) tracker.complete(copy->id, 0);
+            else std::this_thread::yield();
+        }
+    });
+
+    while (!tracker.finished())
+    {
+        if (serve()) continue;
+        if (tracker.duplicates() > 0)
+        {
+            for (const std::uint64_t id : held) tracker.complete(id, 1);
+            held.clear();
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+    own.join();
+    for (const std::uint64_t id : tracker.take_abandoned(1)) sent.push_back("X " + std::to_string(id));
+
+    // Every header is followed by its range, and worker 1 hears once of each range it lost.
+    std::set<std::uint64_t> served;
+    std::multiset<std::uint64_t> notices;
+    for (std::size_t i = 0; i < sent.size(); ++i)
+    {
+        if (sent[i].starts_with("X ")) notices.insert(std::stoull(sent[i].substr(2)));
+        else if (sent[i].starts_with("C "))
+        {
+            served.insert(std::stoull(sent[i].substr(2)));
+            ASSERT_LT(++i, sent.size());
+            EXPECT_TRUE(sent[i].starts_with("range ")) << sent[i];
+        }
+        else ADD_FAILURE() << "range without a header: " << sent[i];
+    }
+    std::multiset<std::uint64_t> lost;
+    for (const std::uint64_t id : tracker.won_by(0))
+    {
+        if (served.contains(id)) lost.insert(id);
+    }
+    EXPECT_GT(tracker.duplicates(), 0u);
+    EXPECT_EQ(notices, lost);
+}
@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../include/HamonCodec.hpp"
+#include "../include/HamonSpill.hpp"
+
+using namespace dualys;
+
+namespace {
+    std::vector<std::pair<std::string, std::uint64_t> > merged(const RunStore &store, const WordCountTable &rest) {
+        std::vector<std::pair<std::string, std::uint64_t> > out;
+        EXPECT_TRUE(store.merge(rest, [&](const std::string_view word, const std::uint64_t count) {
+            out.emplace_back(std::string(word), count);
+            return true;
+        }));
+        return out;
+    }
+}
+
+TEST(RunStore, MergeCombinesRunsAndTheTableInKeyOrder)
+{
+    RunStore store;
+    WordCountTable whole;
+    for (int run = 0; run < 3; ++run) {
+        WordCountTable table;
+        // Enough words for several blocks, with keys shared across runs.
+        for (int i = run; i < 40000; i += 2) {
+            const std::string word = "w" + std::to_string(i);
+            table.add(word, static_cast<std::uint64_t>(run + 1));
+            whole.add(word, static_cast<std::uint64_t>(run + 1));
+        }
+        ASSERT_TRUE(store.spill(table));
+    }
+    WordCountTable rest;
+    rest.add("w1", 5);
+    rest.add("zz", 1);
+    whole.add("w1", 5);
+    whole.add("zz", 1);
+    EXPECT_EQ(store.run_count(), 3u);
+    EXPECT_GT(store.bytes(), 0u);
+
+    const auto out = merged(store, rest);
+    const WordCountEntries expected = whole.sorted();
+    ASSERT_EQ(out.size(), expected.size());
+    for (std::size_t i = 0; i < out.size(); ++i) {
+        EXPECT_EQ(out[i].first, expected[i].first);
+        EXPECT_EQ(out[i].second, expected[i].second);
+    }
+}
+
+TEST(RunStore, BlocksCopiedIntoAnotherStoreMergeTheSame)
+{
+    RunStore source;
+    WordCountTable table;
+    for (int i = 0; i < 50000; ++i) table.add("k" + std::to_string(i % 30000));
+    ASSERT_TRUE(source.spill(table));
+
+    RunStore copy;
+    const int run = copy.begin_run();
+    ASSERT_GE(run, 0);
+    std::size_t blocks = 0;
+    ASSERT_TRUE(source.merge_blocks(WordCountTable(), [&](std::string block) {
+        ++blocks;
+        return copy.append_block(run, block);
+    }));
+    EXPECT_EQ(blocks, (30000 + RunStore::block_entries - 1) / RunStore::block_entries);
+    EXPECT_EQ(merged(copy, WordCountTable()), merged(source, WordCountTable()));
+}
+
+TEST(RunStore, SpillIfOverOnlySpillsPastHalfTheBudget)
+{
+    RunStore store;
+    std::vector<WordCountTable> tables(2);
+    tables[0].add("a");
+    tables[1].add("b", 2);
+    const std::size_t used = tables[0].memory_usage() + tables[1].memory_usage();
+    ASSERT_TRUE(store.spill_if_over(tables, 2 * used));
+    EXPECT_EQ(store.run_count(), 0u);
+    EXPECT_FALSE(tables[0].empty());
+
+    ASSERT_TRUE(store.spill_if_over(tables, used));
+    EXPECT_EQ(store.run_count(), 2u);
+    EXPECT_TRUE(tables[0].empty());
+    EXPECT_TRUE(tables[1].empty());
+    const auto out = merged(store, WordCountTable());
+    ASSERT_EQ(out.size(), 2u);
+    EXPECT_EQ(out[0], std::make_pair(std::string("a"), std::uint64_t{1}));
+    EXPECT_EQ(out[1], std::make_pair(std::string("b"), std::uint64_t{2}));
+}
+
+TEST(CodecCursor, StopsOnATruncatedPayload)
+{
+    const WordCountEntries entries = {{"alpha", 1}, {"beta", 2}};
+    std::string payload(HamonCodec::encoded_size(entries), '\0');
+    HamonCodec::encode_into(entries, payload.data());
+
+    CodecCursor whole(payload);
+    ASSERT_TRUE(whole.next());
+    EXPECT_EQ(whole.word(), "alpha");
+    ASSERT_TRUE(whole.next());
+    EXPECT_EQ(whole.word(), "beta");
+    EXPECT_EQ(whole.count(), 2u);
+    EXPECT_FALSE(whole.next());
+    EXPECT_FALSE(whole.failed());
+
+    CodecCursor cut(std::string_view(payload).substr(0, payload.size() - 2));
+    while (cut.next()) {
+    }
+    EXPECT_TRUE(cut.failed());
+}
@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include <locale>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../include/HamonTokenizer.hpp"
+
+using namespace dualys;
+
+namespace {
+    std::vector<std::string> stream_tokens(const std::string &text) {
+        std::istringstream ss(text);
+        ss.imbue(std::locale::classic());
+        std::vector<std::string> out;
+        std::string word;
+        while (ss >> word) out.push_back(word);
+        return out;
+    }
+
+    std::vector<std::string> kernel_tokens(const std::string &text, const TokenizerKernel kernel) {
+        std::vector<std::string> out;
+        for (const std::string_view token: HamonTokenizer::split(text, kernel)) out.emplace_back(token);
+        return out;
+    }
+
+    const TokenizerKernel all_kernels[] = {TokenizerKernel::Scalar, TokenizerKernel::Sse2, TokenizerKernel::Avx2};
+}
+
+TEST(HamonTokenizer, ScalarIsAlwaysSupported)
+{
+    EXPECT_TRUE(HamonTokenizer::is_supported(TokenizerKernel::Scalar));
+    EXPECT_TRUE(HamonTokenizer::is_supported(HamonTokenizer::best_kernel()));
+}
+
+TEST(HamonTokenizer, EdgeCasesMatchStreamExtraction)
+{
+    const std::vector<std::string> cases = {
+        "", " ", "word", "  lead", "trail  ", "\t\n\v\f\r", "a\vb\fc\rd",
+        std::string(63, 'x') + " y", std::string(64, 'x'), std::string(65, 'x') + "\n",
+        std::string(64, ' ') + "z" + std::string(64, ' '), std::string(200, 'w'),
+        std::string("nul\0byte", 8), "caf\xc3\xa9 \xa0nbsp \x85next",
+    };
+    for (const TokenizerKernel kernel: all_kernels) {
+        if (!HamonTokenizer::is_supported(kernel)) continue;
+        for (const std::string &text: cases) {
+            EXPECT_EQ(kernel_tokens(text, kernel), stream_tokens(text))
+                << HamonTokenizer::kernel_name(kernel) << " on \"" << text << "\"";
+        }
+    }
+}
+
+TEST(HamonTokenizer, RandomBytesMatchStreamExtraction)
+{
+    std::mt19937 rng(2024);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::uniform_int_distribution<int> pick(0, 3);
+    std::uniform_int_distribution<std::size_t> length(0, 700);
+    for (int round = 0; round < 200; ++round) {
+        std::string text(length(rng), '\0');
+        // Half of the bytes are whitespace so tokens start and end at every block offset.
+        for (char &c: text) c = pick(rng) < 2 ? "\t\n\v\f\r "[byte(rng) % 6] : static_cast<char>(byte(rng));
+        const std::vector<std::string> expected = stream_tokens(text);
+        for (const TokenizerKernel kernel: all_kernels) {
+            if (!HamonTokenizer::is_supported(kernel)) continue;
+            ASSERT_EQ(kernel_tokens(text, kernel), expected) << HamonTokenizer::kernel_name(kernel);
+        }
+    }
+}
+
+TEST(HamonTokenizer, CountsIntoTable)
+{
+    WordCountTable counts;
+    HamonTokenizer::count("the cube\tthe\nnode  the", counts);
+    EXPECT_EQ(counts.size(), 3u);
+    EXPECT_EQ(counts.find("the"), 3u);
+    EXPECT_EQ(counts.find("cube"), 1u);
+    EXPECT_EQ(counts.find("node"), 1u);
+}
@@ -0,0 +1,168 @@
+#include <gtest/gtest.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../include/HamonFrame.hpp"
+#include "../include/HamonLoop.hpp"
+#include "../include/HamonShard.hpp"
+#include "../include/HamonUring.hpp"
+
+using namespace dualys;
+using namespace std::chrono_literals;
+
+namespace
+{
+    Task<bool> wait_readable(EventLoop &loop, const int fd, const Deadline deadline)
+    {
+        co_return co_await loop.readable(fd, deadline);
+    }
+
+    Task<bool> receive_exactly(EventLoop &loop, const int fd, std::string &out, const Deadline deadline)
+    {
+        const std::size_t got = co_await loop.receive(fd, out, deadline);
+        co_return got == out.size();
+    }
+
+    Task<bool> accept_one(EventLoop &loop, const int fd, const int timeout_ms, int &sock)
+    {
+        sock = co_await loop.accept(fd, EventLoop::deadline_in(timeout_ms));
+        co_return sock >= 0;
+    }
+
+    // A listening socket on an ephemeral loopback port.
+    int listen_loopback(sockaddr_in &address)
+    {
+        const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(fd, 4) != 0 ||
+            getsockname(fd, reinterpret_cast<sockaddr *>(&address), &length) != 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+} // namespace
+
+TEST(IoUring, BatchedWriterRoundTrip)
+{
+    if (!IoUring::available()) GTEST_SKIP() << "io_uring is not available";
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    std::string payload;
+    for (int i = 0; i < 5000; ++i) payload += "mot" + std::to_string(i) + ' ';
+    std::string received;
+    std::thread reader([&] {
+        FrameReader frames(fds[1]);
+        EXPECT_TRUE(frames.read_payload(received));
+    });
+    IoUring ring(64);
+    ASSERT_TRUE(ring.is_open());
+    // 64-byte frames: several full batches plus a partial one.
+    FrameWriter writer(fds[0], true, 64, &ring);
+    EXPECT_TRUE(writer.write(payload));
+    EXPECT_TRUE(writer.finish());
+    reader.join();
+    EXPECT_EQ(received, payload);
+    EXPECT_LT(ring.enter_calls(), payload.size() / 64);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(IoUring, LoopWaitsAndTimesOut)
+{
+    if (!IoUring::available()) GTEST_SKIP() << "io_uring is not available";
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    EventLoop loop(IoBackend::Uring);
+    ASSERT_EQ(loop.backend(), IoBackend::Uring);
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(loop.run(wait_readable(loop, fds[0], EventLoop::deadline_in(30))));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, 30ms);
+    std::thread writer([&] {
+        std::this_thread::sleep_for(20ms);
+        ASSERT_EQ(write(fds[1], "x", 1), 1);
+    });
+    EXPECT_TRUE(loop.run(wait_readable(loop, fds[0], EventLoop::deadline_in(5000))));
+    writer.join();
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(IoUring, ReceiveFillsTheBuffer)
+{
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    const std::string sent(300000, 'r');
+    for (const IoBackend backend: {IoBackend::Epoll, IoBackend::Uring}) {
+        if (backend == IoBackend::Uring && !IoUring::available()) continue;
+        EventLoop loop(backend);
+        std::thread writer([&] { EXPECT_TRUE(HamonFrame::write_all(fds[1], sent.data(), sent.size())); });
+        std::string out(sent.size(), '\0');
+        EXPECT_TRUE(loop.run(receive_exactly(loop, fds[0], out, EventLoop::deadline_in(5000))));
+        writer.join();
+        EXPECT_EQ(out, sent);
+        // Nothing more arrives: the receive gives up at its deadline.
+        std::string more(1, '\0');
+        EXPECT_FALSE(loop.run(receive_exactly(loop, fds[0], more, EventLoop::deadline_in(30))));
+    }
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(IoUring, AcceptReturnsConnections)
+{
+    for (const IoBackend backend: {IoBackend::Epoll, IoBackend::Uring}) {
+        if (backend == IoBackend::Uring && !IoUring::available()) continue;
+        sockaddr_in address{};
+        const int server = listen_loopback(address);
+        ASSERT_GE(server, 0);
+        EventLoop loop(backend);
+        int clients[2];
+        for (int &client: clients) {
+            client = socket(AF_INET, SOCK_STREAM, 0);
+            ASSERT_EQ(connect(client, reinterpret_cast<sockaddr *>(&address), sizeof(address)), 0);
+        }
+        for (int i = 0; i < 2; ++i) {
+            int sock = -1;
+            EXPECT_TRUE(loop.run(accept_one(loop, server, 5000, sock)));
+            close(sock);
+        }
+        int late = 0;
+        EXPECT_FALSE(loop.run(accept_one(loop, server, 30, late)));
+        EXPECT_EQ(late, -ETIMEDOUT);
+        loop.stop_accepting(server);
+        for (const int client: clients) close(client);
+        close(server);
+    }
+}
+
+TEST(IoUring, ReadRangeMatchesPread)
+{
+    if (!IoUring::available()) GTEST_SKIP() << "io_uring is not available";
+    std::string text;
+    for (int i = 0; i < 400000; ++i) text += "mot" + std::to_string(i % 997) + (i % 13 == 0 ? "\n" : " ");
+    const std::string path = "scenario_uring_range.txt";
+    {
+        std::ofstream o(path, std::ios::binary);
+        o << text;
+    }
+    const auto nominal = HamonShard::nominal_split(text.size(), 3);
+    for (const ShardRange &range: nominal) {
+        std::string plain;
+        std::string batched;
+        ASSERT_TRUE(HamonShard::read_range(path, range, plain));
+        ASSERT_TRUE(HamonShard::read_range(path, range, batched, IoBackend::Uring));
+        EXPECT_EQ(batched, plain);
+    }
+    std::remove(path.c_str());
+}